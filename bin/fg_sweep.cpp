@@ -0,0 +1,587 @@
+/**
+ * \file fg_sweep.cpp
+ * \brief Run the work units of a configuration on a local pool of
+ *        fg_simulation processes, resuming interrupted sweeps
+ *
+ * Copyright 2007-2018 IMP Inventors. All rights reserved.
+ */
+
+#include <IMP/npctransport/avro.h>
+#include <IMP/npctransport/protobuf.h>
+#include <IMP/npctransport/internal/AvroBlockWriter.h>
+#include <IMP/npctransport/internal/OutputFileView.h>
+#include <IMP/npctransport/internal/avro_index.h>
+#include <IMP/npctransport/internal/npctransport.pb.h>
+#include <IMP/flags.h>
+#include <IMP/exception.h>
+#include <IMP/check_macros.h>
+#include <boost/algorithm/string.hpp>
+#include <boost/lexical_cast.hpp>
+#include <algorithm>
+#include <cerrno>
+#include <csignal>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <map>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+#if !defined(_MSC_VER)
+#include <fcntl.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+boost::int64_t first_work_unit = 0;
+IMP::AddIntFlag first_work_unit_adder("first_work_unit",
+                                      "first work unit of a new sweep",
+                                      &first_work_unit);
+boost::int64_t number_of_work_units = -1;
+IMP::AddIntFlag number_of_work_units_adder
+( "number_of_work_units",
+  "number of work units of a new sweep, or -1 for all work units"
+  " from first_work_unit on",
+  &number_of_work_units);
+boost::int64_t jobs = std::thread::hardware_concurrency();
+IMP::AddIntFlag jobs_adder("jobs",
+                           "number of work units run concurrently",
+                           &jobs);
+std::string simulation = "";
+IMP::AddStringFlag simulation_adder
+( "simulation",
+  "the simulation executable [default: fg_simulation next to this one]",
+  &simulation);
+std::string simulation_flags = "";
+IMP::AddStringFlag simulation_flags_adder
+( "simulation_flags",
+  "additional flags of each simulation, separated by spaces,"
+  " e.g. \"--short_sim_factor 0.1\"",
+  &simulation_flags);
+boost::int64_t max_attempts = 3;
+IMP::AddIntFlag max_attempts_adder
+( "max_attempts",
+  "number of times a work unit is run, restarting it from its last"
+  " checkpoint, before it is marked as failed",
+  &max_attempts);
+bool retry_failed = false;
+IMP::AddBoolFlag retry_failed_adder("retry_failed",
+                                    "run failed work units of a resumed"
+                                    " sweep again",
+                                    &retry_failed);
+std::string archive = "";
+IMP::AddStringFlag archive_adder
+( "archive",
+  "avro archive of the outputs of a new sweep"
+  " [default: outputs.avro in the sweep directory]",
+  &archive);
+#ifdef IMP_NPCTRANSPORT_HAS_ZLIB
+std::string codec = "deflate";
+#else
+std::string codec = "null";
+#endif
+IMP::AddStringFlag codec_adder("codec",
+                               "compression of archive blocks,"
+                               " null or deflate",
+                               &codec);
+bool remove_archived_outputs = false;
+IMP::AddBoolFlag remove_archived_outputs_adder
+( "remove_archived_outputs",
+  "remove the output file of each work unit once it is archived",
+  &remove_archived_outputs);
+bool use_snapshots = false;
+IMP::AddBoolFlag use_snapshots_adder
+( "use_snapshots",
+  "share snapshots of initialized models between work units of the same"
+  " geometry, kept in the snapshots directory of the sweep"
+  " (see --snapshot_dir of the simulation)",
+  &use_snapshots);
+
+using IMP::npctransport::internal::AvroBlockWriter;
+using IMP::npctransport::internal::OutputFileView;
+typedef ::npctransport_proto::SweepQueue SweepQueue;
+typedef ::npctransport_proto::SweepQueue_WorkUnit QueuedWorkUnit;
+
+// status of work units in the queue
+enum Status { PENDING = 0, RUNNING = 1, FINISHED = 2, ARCHIVED = 3,
+              FAILED = 4 };
+
+#if !defined(_MSC_VER)
+
+volatile sig_atomic_t is_stopped = 0;
+
+void stop(int) { is_stopped = 1; }
+
+void make_directory(std::string dir) {
+  IMP_ALWAYS_CHECK(mkdir(dir.c_str(), 0777) == 0 || errno == EEXIST,
+                   "Unable to create directory " << dir << ": "
+                   << std::strerror(errno), IMP::IOException);
+}
+
+bool get_file_exists(std::string fname) {
+  struct stat st;
+  return stat(fname.c_str(), &st) == 0;
+}
+
+void copy_file(std::string from, std::string to) {
+  std::ifstream in(from.c_str(), std::ios::binary);
+  std::ofstream out(to.c_str(), std::ios::binary);
+  IMP_ALWAYS_CHECK(in && out << in.rdbuf() && out.flush(),
+                   "Unable to copy " << from << " to " << to,
+                   IMP::IOException);
+}
+
+// fname relative to the root directory, so that it is found when the
+// sweep is resumed from another working directory
+std::string get_absolute_path(std::string fname) {
+  if (!fname.empty() && fname[0] == '/') {
+    return fname;
+  }
+  std::vector<char> cwd(4096);
+  IMP_ALWAYS_CHECK(getcwd(&cwd[0], cwd.size()) != nullptr,
+                   "Unable to get the working directory: "
+                   << std::strerror(errno), IMP::IOException);
+  return std::string(&cwd[0]) + "/" + fname;
+}
+
+bool load_queue(std::string fname, SweepQueue& queue) {
+  std::ifstream in(fname.c_str(), std::ios::binary);
+  return in && queue.ParseFromIstream(&in);
+}
+
+// replace the queue file at once, so it is never left half written
+void save_queue(std::string fname, SweepQueue const& queue) {
+  std::string tmp = fname + ".tmp";
+  {
+    std::ofstream out(tmp.c_str(), std::ios::binary);
+    IMP_ALWAYS_CHECK(queue.SerializeToOstream(&out) && out.flush(),
+                     "Unable to write queue " << tmp, IMP::IOException);
+  }
+  IMP_ALWAYS_CHECK(std::rename(tmp.c_str(), fname.c_str()) == 0,
+                   "Unable to write queue " << fname, IMP::IOException);
+}
+
+// a queue of the work units of configuration in the requested range, the
+// most expensive ones first so that the pool is not left waiting on one
+// long work unit at the end of the sweep
+void make_queue(std::string configuration, std::string sweep_dir,
+                SweepQueue& queue) {
+  std::string manifest_file = sweep_dir + "/manifest.pb";
+  int n = IMP::npctransport::write_work_units_manifest(configuration,
+                                                       manifest_file);
+  ::npctransport_proto::WorkUnitsManifest manifest;
+  {
+    std::ifstream in(manifest_file.c_str(), std::ios::binary);
+    IMP_ALWAYS_CHECK(in && manifest.ParseFromIstream(&in),
+                     "Unable to read " << manifest_file, IMP::IOException);
+  }
+  IMP_ALWAYS_CHECK(first_work_unit >= 0 && first_work_unit < n,
+                   "first_work_unit must be in [0, " << n << ")",
+                   IMP::ValueException);
+  int end = n;
+  if (number_of_work_units >= 0) {
+    end = std::min<boost::int64_t>(n, first_work_unit + number_of_work_units);
+  }
+  std::vector<std::pair<double, int> > costs;
+  for (int i = 0; i < manifest.work_units_size(); i++) {
+    int wu = manifest.work_units(i).work_unit();
+    if (wu >= first_work_unit && wu < end) {
+      costs.push_back(std::make_pair
+                      (-manifest.work_units(i).estimated_run_time_s(), wu));
+    }
+  }
+  std::sort(costs.begin(), costs.end());
+  queue.Clear();
+  queue.set_configuration_file(configuration);
+  queue.set_archive_file(get_absolute_path
+                         (archive.empty() ? sweep_dir + "/outputs.avro"
+                                          : archive));
+  for (unsigned int i = 0; i < costs.size(); i++) {
+    QueuedWorkUnit* u = queue.add_work_units();
+    u->set_work_unit(costs[i].second);
+    u->set_estimated_run_time_s(-costs[i].first);
+  }
+}
+
+// whether fname is an output that a simulation can be restarted from
+bool get_is_restartable(std::string fname) {
+  if (!get_file_exists(fname)) {
+    return false;
+  }
+  try {
+    OutputFileView view(fname);
+    return view.get_has_field(view.ASSIGNMENT) &&
+      view.get_has_field(view.CHECKPOINT);
+  } catch (IMP::Exception&) {
+    return false;
+  }
+}
+
+// whether fname is the output of a simulation that ran to its end
+bool get_is_complete(std::string fname) {
+  try {
+    OutputFileView view(fname);
+    return view.get_has_field(view.ASSIGNMENT) &&
+      view.get_has_field(view.STATISTICS) && !view.get_is_interrupted();
+  } catch (IMP::Exception&) {
+    return false;
+  }
+}
+
+//! streams outputs of finished work units into an avro archive
+class Archive {
+  std::string file_name_;
+  std::set<std::string> keys_;
+  AvroBlockWriter writer_;
+
+ public:
+  Archive(std::string file_name, std::string codec)
+    : file_name_(file_name),
+      keys_(IMP::npctransport::internal::get_avro_archive_keys(file_name)),
+      writer_(file_name, codec, true) {}
+
+  //! add output_file to the archive, unless it was added before
+  void add(std::string output_file) {
+    std::string data;
+    {
+      std::ifstream in(output_file.c_str(), std::ios::binary);
+      IMP_ALWAYS_CHECK(in, "Unable to read " << output_file,
+                       IMP::IOException);
+      data.assign(std::istreambuf_iterator<char>(in),
+                  std::istreambuf_iterator<char>());
+    }
+    ::npctransport_proto::Assignment assignment;
+    OutputFileView view(data.data(), data.size());
+    IMP_ALWAYS_CHECK(view.get_assignment(&assignment),
+                     "No valid assignment in " << output_file,
+                     IMP::IOException);
+    std::string key = IMP::npctransport::internal::get_avro_key(assignment);
+    if (!keys_.insert(key).second) {
+      return;  // archived before the sweep was interrupted
+    }
+    AvroBlockWriter::Block block;
+    block.add_entry(key, data.data(), data.size());
+    block.compress(writer_.get_codec());
+    writer_.write_block(block);
+    writer_.flush();
+  }
+
+  //! close the archive and index it
+  void close() {
+    writer_.close();
+    IMP::npctransport::create_avro_index(file_name_);
+  }
+};
+
+// the simulation executable next to this one
+std::string get_default_simulation(std::string argv0) {
+  std::string::size_type slash = argv0.rfind('/');
+  if (slash == std::string::npos) {
+    return "fg_simulation";
+  }
+  return argv0.substr(0, slash + 1) + "fg_simulation";
+}
+
+//! run args in a child process with output redirected to log_file
+pid_t launch(IMP::Strings const& args, std::string log_file) {
+  pid_t pid = fork();
+  IMP_ALWAYS_CHECK(pid >= 0, "Unable to fork: " << std::strerror(errno),
+                   IMP::IOException);
+  if (pid == 0) {
+    int fd = open(log_file.c_str(), O_WRONLY | O_CREAT | O_APPEND, 0644);
+    if (fd >= 0) {
+      dup2(fd, 1);
+      dup2(fd, 2);
+      close(fd);
+    }
+    std::vector<char*> argv;
+    for (unsigned int i = 0; i < args.size(); i++) {
+      argv.push_back(const_cast<char*>(args[i].c_str()));
+    }
+    argv.push_back(nullptr);
+    execvp(argv[0], &argv[0]);
+    std::perror(argv[0]);
+    _exit(127);
+  }
+  return pid;
+}
+
+//! runs the work units of a queue, saving the queue on every change
+class Sweep {
+  std::string sweep_dir_;
+  std::string queue_file_;
+  SweepQueue queue_;
+  Archive archive_;
+  std::map<pid_t, int> running_;  // index in the queue of each process
+
+  std::string get_output_file(int wu) const {
+    return sweep_dir_ + "/outputs/"
+      + boost::lexical_cast<std::string>(wu) + ".pb";
+  }
+
+  std::string get_log_file(int wu) const {
+    return sweep_dir_ + "/logs/"
+      + boost::lexical_cast<std::string>(wu) + ".log";
+  }
+
+  void set_status(int i, Status status) {
+    queue_.mutable_work_units(i)->set_status(status);
+    save_queue(queue_file_, queue_);
+  }
+
+  // the flags that run or resume work unit wu, restarting it from the
+  // last checkpoint of a previous attempt. The checkpoint is copied
+  // first, so that an attempt that is killed while writing its output
+  // can still be restarted from the checkpoint of the one before.
+  IMP::Strings get_simulation_args(int wu) const {
+    std::string output = get_output_file(wu);
+    std::string restart = output + ".restart";
+    IMP::Strings ret;
+    ret.push_back(simulation);
+    ret.push_back("--output");
+    ret.push_back(output);
+    if (get_is_restartable(output)) {
+      copy_file(output, restart);
+    }
+    if (get_is_restartable(restart)) {
+      // only the frames that were not simulated yet
+      ret.push_back("--restart");
+      ret.push_back(restart);
+      ret.push_back("--resume");
+    } else {
+      ret.push_back("--configuration");
+      ret.push_back(queue_.configuration_file());
+      ret.push_back("--work_unit");
+      ret.push_back(boost::lexical_cast<std::string>(wu));
+    }
+    if (use_snapshots) {
+      ret.push_back("--snapshot_dir");
+      ret.push_back(sweep_dir_ + "/snapshots");
+    }
+    IMP::Strings extra;
+    std::string flags = boost::trim_copy(simulation_flags);
+    if (!flags.empty()) {
+      boost::split(extra, flags, boost::is_any_of(" \t"),
+                   boost::token_compress_on);
+    }
+    ret.insert(ret.end(), extra.begin(), extra.end());
+    return ret;
+  }
+
+  void archive_output(int i) {
+    int wu = queue_.work_units(i).work_unit();
+    archive_.add(get_output_file(wu));
+    set_status(i, ARCHIVED);
+    if (remove_archived_outputs) {
+      std::remove(get_output_file(wu).c_str());
+    }
+    std::remove((get_output_file(wu) + ".restart").c_str());
+  }
+
+  // handle the exit of the process of the i'th work unit
+  void finish(int i, int status) {
+    QueuedWorkUnit* u = queue_.mutable_work_units(i);
+    int wu = u->work_unit();
+    bool is_complete = WIFEXITED(status) && WEXITSTATUS(status) == 0 &&
+      get_is_complete(get_output_file(wu));
+    if (!is_complete && is_stopped) {
+      // stopped by us, resume it next time
+      std::cout << "Stopped work unit " << wu << std::endl;
+      set_status(i, PENDING);
+      return;
+    }
+    u->set_number_of_attempts(u->number_of_attempts() + 1);
+    if (is_complete) {
+      set_status(i, FINISHED);
+      archive_output(i);
+      std::cout << "Finished work unit " << wu << std::endl;
+    } else if (u->number_of_attempts() < max_attempts) {
+      std::cout << "Work unit " << wu << " did not finish, see "
+                << get_log_file(wu) << "; resuming it later" << std::endl;
+      set_status(i, PENDING);
+    } else {
+      std::cout << "Work unit " << wu << " failed " << max_attempts
+                << " times, see " << get_log_file(wu) << std::endl;
+      set_status(i, FAILED);
+    }
+  }
+
+ public:
+  Sweep(std::string sweep_dir, SweepQueue const& queue)
+    : sweep_dir_(sweep_dir),
+      queue_file_(sweep_dir + "/queue.pb"),
+      queue_(queue),
+      archive_(queue.archive_file(), codec) {
+    make_directory(sweep_dir_ + "/outputs");
+    make_directory(sweep_dir_ + "/logs");
+    if (use_snapshots) {
+      make_directory(sweep_dir_ + "/snapshots");
+    }
+    // work units that were running when a previous sweep was stopped are
+    // resumed, and those that finished are archived if they were not yet
+    for (int i = 0; i < queue_.work_units_size(); i++) {
+      QueuedWorkUnit* u = queue_.mutable_work_units(i);
+      if (u->status() == RUNNING ||
+          (u->status() == FAILED && retry_failed)) {
+        u->set_status(PENDING);
+        if (retry_failed) {
+          u->set_number_of_attempts(0);
+        }
+      }
+    }
+    save_queue(queue_file_, queue_);
+    for (int i = 0; i < queue_.work_units_size(); i++) {
+      if (queue_.work_units(i).status() == FINISHED) {
+        archive_output(i);
+      }
+    }
+  }
+
+  //! run all pending work units, n_jobs at a time
+  /** @return false if stopped by a signal before all work units ran */
+  bool run(unsigned int n_jobs) {
+    int next = 0;
+    bool is_killed = false;
+    while (true) {
+      while (!is_stopped && running_.size() < n_jobs) {
+        while (next < queue_.work_units_size() &&
+               queue_.work_units(next).status() != PENDING) {
+          next++;
+        }
+        if (next >= queue_.work_units_size()) {
+          break;
+        }
+        int wu = queue_.work_units(next).work_unit();
+        running_[launch(get_simulation_args(wu), get_log_file(wu))] = next;
+        set_status(next, RUNNING);
+        std::cout << "Running work unit " << wu << std::endl;
+        next++;
+      }
+      if (running_.empty()) {
+        if (is_stopped || get_number_of_work_units(PENDING) == 0) {
+          break;
+        }
+        next = 0;  // resume work units whose attempts did not finish
+        continue;
+      }
+      if (is_stopped && !is_killed) {
+        for (std::map<pid_t, int>::const_iterator it = running_.begin();
+             it != running_.end(); it++) {
+          kill(it->first, SIGTERM);
+        }
+        is_killed = true;
+      }
+      int status;
+      pid_t pid = waitpid(-1, &status, 0);
+      if (pid < 0) {
+        IMP_ALWAYS_CHECK(errno == EINTR, "waitpid failed: "
+                         << std::strerror(errno), IMP::IOException);
+        continue;
+      }
+      std::map<pid_t, int>::iterator it = running_.find(pid);
+      if (it != running_.end()) {
+        int i = it->second;
+        running_.erase(it);
+        finish(i, status);
+      }
+      if (next >= queue_.work_units_size()) {
+        next = 0;
+      }
+    }
+    archive_.close();
+    return !is_stopped;
+  }
+
+  unsigned int get_number_of_work_units(Status status) const {
+    unsigned int ret = 0;
+    for (int i = 0; i < queue_.work_units_size(); i++) {
+      ret += queue_.work_units(i).status() == status;
+    }
+    return ret;
+  }
+};
+
+#endif
+}
+
+int main(int argc, char* argv[]) {
+  IMP::Strings args = IMP::setup_from_argv
+    ( argc, argv,
+      "Run the work units of a configuration on a pool of local simulation"
+      " processes, streaming their outputs into an avro archive. The state"
+      " of the sweep is kept in the sweep directory, so an interrupted"
+      " sweep is resumed by running it again with the same directory,"
+      " restarting unfinished work units from their last checkpoint.",
+      "sweep_directory [configuration]", -1);
+#if defined(_MSC_VER)
+  std::cerr << "fg_sweep is not supported on this platform" << std::endl;
+  return -1;
+#else
+  try {
+    IMP_ALWAYS_CHECK(args.size() <= 2, "Too many arguments",
+                     IMP::UsageException);
+    IMP_ALWAYS_CHECK(jobs > 0 && max_attempts > 0,
+                     "jobs and max_attempts must be positive",
+                     IMP::UsageException);
+    std::string sweep_dir = args[0];
+    make_directory(sweep_dir);
+    SweepQueue queue;
+    if (load_queue(sweep_dir + "/queue.pb", queue)) {
+      IMP_ALWAYS_CHECK(args.size() == 1 ||
+                       get_absolute_path(args[1]) ==
+                       queue.configuration_file(),
+                       sweep_dir << " is a sweep of "
+                       << queue.configuration_file() << ", not of "
+                       << args[1], IMP::UsageException);
+      std::cout << "Resuming sweep of " << queue.configuration_file()
+                << std::endl;
+    } else {
+      IMP_ALWAYS_CHECK(args.size() == 2,
+                       "A configuration is needed for a new sweep",
+                       IMP::UsageException);
+      make_queue(get_absolute_path(args[1]), sweep_dir, queue);
+      std::cout << "Sweeping " << queue.work_units_size()
+                << " work units of " << queue.configuration_file()
+                << std::endl;
+    }
+    if (simulation.empty()) {
+      simulation = get_default_simulation(argv[0]);
+    }
+    // stop launching work units on SIGINT or SIGTERM, and let waitpid
+    // return so that running ones are stopped too
+    struct sigaction sa;
+    std::memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = stop;
+    sigaction(SIGINT, &sa, nullptr);
+    sigaction(SIGTERM, &sa, nullptr);
+
+    Sweep sweep(sweep_dir, queue);
+    bool is_done = sweep.run(jobs);
+    std::cout << sweep.get_number_of_work_units(ARCHIVED)
+              << " work units archived in " << queue.archive_file() << ", "
+              << sweep.get_number_of_work_units(FAILED) << " failed, "
+              << sweep.get_number_of_work_units(PENDING) << " pending"
+              << std::endl;
+    if (!is_done) {
+      std::cout << "Sweep stopped; run again with " << sweep_dir
+                << " to resume it" << std::endl;
+      return 1;
+    }
+    if (sweep.get_number_of_work_units(FAILED) > 0) {
+      return 1;
+    }
+  }
+  catch (const IMP::Exception& e) {
+    std::cerr << "Error: " << e.what() << std::endl;
+    return -1;
+  }
+  return 0;
+#endif
+}
@@ -1,4 +1,4 @@
 required_modules = 'container:display:core:atom:statistics:rmf:benchmark:score_functor:kernel:algebra:rmf'
 lib_only_optional_modules = 'cgal'
 required_dependencies = 'RMF:Protobuf:AvroCpp'
-optional_dependencies = ""
+optional_dependencies = "ZLIB"
@@ -29,6 +29,7 @@ AnchorToCylidnricalPorePairScore : public PairScore
   Float pore_radial_d_; // equilibrium distance of anchor point from pore surface in x,y plane
   score_functor::Harmonic ds_; // distance score
   mutable algebra::Vector3D reference_point_; // current value of equilibrium reference point
+  mutable Float reference_pore_radius_; // pore radius for which reference_point_ was last updated
 
  public:
   /** Initialize a harmonic distance score between an anchor bead
@@ -89,7 +90,8 @@ AnchorToCylidnricalPorePairScore : public PairScore
  private:
 
   // update internal variable holding current reference point for fast access
-  // based on decorated particle slab
+  // based on decorated particle slab, if pore radius has changed since the
+  // last update (so effectively once per simulation step)
   // @param pr current pore radius
   void update_reference_point_for_pore_radius
     (Float pr) const;
@@ -100,6 +102,10 @@ AnchorToCylidnricalPorePairScore
 ::update_reference_point_for_pore_radius
 ( Float pr) const
 {
+  if(pr == reference_pore_radius_){
+    return;
+  }
+  reference_pore_radius_= pr;
   Float r= pr - pore_radial_d_;
   reference_point_[0]= normalized_xy_[0]*r;
   reference_point_[1]= normalized_xy_[1]*r;
@@ -11,26 +11,28 @@
 
 #include <IMP/npctransport/avro.h>
 #include <IMP/npctransport/AvroDataFileData.h>
+#include <IMP/npctransport/npctransport_proto.fwd.h>
 #include <IMP/value_macros.h>
 #include <IMP/types.h>
 #include <IMP/showable_macros.h>
 
-#ifndef SWIG
-IMP_GCC_PUSH_POP(diagnostic push)
-IMP_GCC_PRAGMA(diagnostic ignored "-Wextra")
-#include <DataFile.hh>
-IMP_GCC_PUSH_POP(diagnostic pop)
-#endif
-
+#include <boost/shared_ptr.hpp>
+#include <cstddef>
 #include <fstream>
 #include <iomanip>
+#include <string>
+#include <vector>
 
 IMPNPCTRANSPORT_BEGIN_NAMESPACE
 
-class IMPNPCTRANSPORTEXPORT Avro2PBReader {
- private:
-  typedef IMP_NPCTRANSPORT_AVRO_NAMESPACE::DataFileReader<IMP_npctransport::wrapper> t_avro_reader;
+#ifndef SWIG
+namespace internal {
+  class AvroPrefetcher;
+  class AvroBlockReader;
+}
+#endif
 
+class IMPNPCTRANSPORTEXPORT Avro2PBReader {
  public:
   /** Initiates a reader that goes over all output
       entries in all files specified in avro_filenames
@@ -42,12 +44,26 @@ class IMPNPCTRANSPORTEXPORT Avro2PBReader {
   */
   Avro2PBReader(std::string avro_filename);
 
+  /** Initiates a reader that goes over all output entries in all files
+      specified in avro_filenames, in the same order, while decoding
+      up to n_threads files concurrently on background threads.
+
+      @param avro_filenames the avro files to read
+      @param n_threads number of files decoded concurrently
+      @param max_buffered_mb maximal size in MB of decoded entries waiting
+                             to be read, beyond the file being read
+  */
+  Avro2PBReader(const Strings& avro_filenames, unsigned int n_threads,
+                unsigned int max_buffered_mb = 256);
+
   /** closes any open files */
   ~Avro2PBReader();
 
 #if defined(SWIG) || defined(IMP_SWIG_WRAPPER)
   typedef std::string ByteBuffer;
+  typedef std::vector<std::string> ByteBuffers;
   ByteBuffer read_next();
+  ByteBuffers read_next_batch(unsigned int n);
 #else
   /**
      Read the next output entry into output and returns it
@@ -55,8 +71,42 @@ class IMPNPCTRANSPORTEXPORT Avro2PBReader {
      this object.
   */
   std::string read_next();
+
+  /**
+     Read up to n next output entries and return them as strings.
+     Fewer than n entries are returned only if no input is left.
+  */
+  std::vector<std::string> read_next_batch(unsigned int n);
+
+  //! a view of an output entry, valid until the next read from its reader
+  struct EntryView {
+    char const* data;
+    std::size_t size;
+  };
+
+  /**
+     Read the next output entry into entry without copying it.
+
+     @return false if no input is left, in which case this
+             object is invalidated
+  */
+  bool read_next_view(EntryView& entry);
 #endif
 
+  /**
+     Move to the output entry of work unit work_unit, searching the
+     files from the first one, so that it is the next entry read, followed
+     by the entries after it. Files are searched using their index files
+     (see create_avro_index()). Missing or out of date index files are
+     rebuilt and written on the first seek, if possible. Indexes are
+     loaded once per reader, so files are assumed not to change while
+     being read. Not supported when decoding files on background threads.
+
+     @return false if no entry of work_unit was found, in which case
+             the position of the reader is unchanged
+  */
+  bool seek_to_work_unit(int work_unit);
+
   //! returns true if there are still files to go over
   //! (though possibly no entries left in neither of them)
   bool get_is_valid();
@@ -65,7 +115,7 @@ class IMPNPCTRANSPORTEXPORT Avro2PBReader {
   //! or "" if reader is at invalid state
   std::string get_cur_file_name() {
     if (!get_is_valid()) return "";
-    return avro_filenames_[cur_file_];
+    return avro_filenames_[get_cur_file_index()];
   }
 
  private:
@@ -76,10 +126,20 @@ class IMPNPCTRANSPORTEXPORT Avro2PBReader {
   // is only supported from g++ 4.7, so we use init() for backward compatibility
   void init(const Strings& avro_filenames);
 
+  unsigned int get_cur_file_index() const;
+
  private:
   Strings avro_filenames_;  // list of files to go over
-  t_avro_reader* avro_reader_;
   unsigned int cur_file_;  // file index we're reading now
+#ifndef SWIG
+  // decodes files on background threads, if set
+  boost::shared_ptr<internal::AvroPrefetcher> prefetcher_;
+  // reads the current file block by block, if open
+  boost::shared_ptr<internal::AvroBlockReader> block_reader_;
+  // the index of each file, loaded on the first seek
+  std::vector<boost::shared_ptr< ::npctransport_proto::AvroArchiveIndex > >
+    indexes_;
+#endif
 
  public:
   IMP_SHOWABLE_INLINE(Avro2PBReader,
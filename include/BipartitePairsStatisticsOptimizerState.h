@@ -15,6 +15,7 @@
 #include <IMP/core/PeriodicOptimizerState.h>
 #include <IMP/container/CloseBipartitePairContainer.h>
 #include <IMP/npctransport/typedefs.h>
+#include "internal/ContactKinetics.h"
 #include <boost/unordered_set.hpp>
 #include <deque>
 
@@ -72,6 +73,9 @@ class IMPNPCTRANSPORTEXPORT BipartitePairsStatisticsOptimizerState
   t_particle_index_ordered_set bounds_II_;
   t_particle_index_pair_ordered_set contacts_;
 
+  // residence times and rebinding intervals of contacts
+  internal::ContactKinetics contact_kinetics_;
+
   // Average since last reset:
   double avg_pct_bound_particles_I_; // particles in group I (it is fraction, not pct)
   double avg_pct_bound_particles_II_;  // particles in group II (it is fraction, not pct)
@@ -199,6 +203,46 @@ class IMPNPCTRANSPORTEXPORT BipartitePairsStatisticsOptimizerState
     return avg_fraction_bound_sites_II_;
   }
 
+  //! returns the histogram counts of contact residence times since
+  //! last reset(), in log-spaced bins
+  //! (see get_contact_kinetics_min_ns() and
+  //!  get_contact_kinetics_bins_per_decade())
+  Ints get_residence_time_counts() const
+  { return contact_kinetics_.get_residence_times().get_counts(); }
+
+  //! returns the histogram counts of intervals between loss and
+  //! reformation of the same contact since last reset(), in log-spaced bins
+  Ints get_rebinding_interval_counts() const
+  { return contact_kinetics_.get_rebinding_intervals().get_counts(); }
+
+  //! lower edge of the first bin of kinetics histograms in ns
+  double get_contact_kinetics_min_ns() const
+  { return contact_kinetics_.get_residence_times().get_min_ns(); }
+
+  //! number of bins per decade in kinetics histograms
+  double get_contact_kinetics_bins_per_decade() const
+  { return contact_kinetics_.get_residence_times().get_bins_per_decade(); }
+
+#ifndef SWIG
+  internal::ContactKinetics const& get_contact_kinetics() const
+  { return contact_kinetics_; }
+
+  //! the state kept by this optimizer state across reset(), from which
+  //! updates can be resumed without counting all present contacts as new
+  struct History {
+    double time_ns; // simulation time of the last update
+    ParticleIndexes bounds_I;
+    ParticleIndexes bounds_II;
+    internal::ContactKinetics::State contact_kinetics;
+  };
+
+  History get_history() const;
+
+  //! resume updates from history, e.g. saved in a checkpoint of a
+  //! previous simulation, as if it was just reset()
+  void set_history(History const& history);
+#endif
+
   /**
      return the total number of particles in the first group
   */
@@ -0,0 +1,107 @@
+/**
+ *  \file npctransport/BodiesStatisticsOptimizerState.h
+ *  \brief batched body statistics over a group of particles
+ *
+ *  Copyright 2007-2018 IMP Inventors. All rights reserved.
+ */
+
+#ifndef IMPNPCTRANSPORT_BODIES_STATISTICS_OPTIMIZER_STATE_H
+#define IMPNPCTRANSPORT_BODIES_STATISTICS_OPTIMIZER_STATE_H
+
+#include "npctransport_config.h"
+#include <IMP/Particle.h>
+#include <IMP/algebra/Vector3D.h>
+#include <IMP/OptimizerState.h>
+#include <IMP/core/PeriodicOptimizerState.h>
+#include <IMP/npctransport/typedefs.h>
+#include "internal/body_statistics_estimators.h"
+#include <vector>
+
+IMPNPCTRANSPORT_BEGIN_NAMESPACE
+
+class Statistics;
+
+//! Track the diffusion of a group of particles
+/** Same as a BodyStatisticsOptimizerState for each of the particles,
+    but all particles are tracked by a single optimizer state that
+    reads all of their positions in one pass on each update, and
+    accumulates their displacements and, for rigid bodies, their
+    rotations online.
+*/
+class IMPNPCTRANSPORTEXPORT BodiesStatisticsOptimizerState
+    : public core::PeriodicOptimizerState {
+ private:
+  typedef core::PeriodicOptimizerState P;
+  ParticleIndexes pis_;
+  WeakPointer<IMP::npctransport::Statistics> statistics_manager_;
+
+  // positions of all particles and time in the last update, if any
+  bool has_last_;
+  algebra::Vector3Ds last_positions_;
+  double last_time_fs_;
+
+  // diffusion_estimators_[i] is the estimator of the i'th particle
+  std::vector<internal::DiffusionCoefficientEstimator> diffusion_estimators_;
+
+  // correlation_estimators_[i] is the estimator of the i'th particle,
+  // updated only if is_correlation_time_on_
+  bool is_correlation_time_on_;
+  std::vector<internal::RotationalCorrelationTimeEstimator>
+    correlation_estimators_;
+
+ public:
+  /**
+     @param ps the particles being tracked
+     @param statistics_manager an optional statistical manager to which statistical updates are sent
+     @param periodicity frame interval for statistics, equiv. to set_period(1)
+   */
+  BodiesStatisticsOptimizerState
+    (const ParticlesTemp& ps,
+     IMP::npctransport::Statistics* statistics_manager = nullptr,
+     unsigned int periodicity=1);
+
+  //! add p to the tracked particles (resets all statistics)
+  void add_particle(Particle* p);
+
+  unsigned int get_number_of_particles() const {
+    return pis_.size();
+  }
+
+  ParticlesTemp get_particles() const;
+
+  //! returns the diffusion coefficients of all particles, in the order
+  //! they were added
+  Floats get_diffusion_coefficients() const;
+
+  //! returns the diffusion coefficient of the i'th particle
+  double get_diffusion_coefficient(unsigned int i) const;
+
+  //! set whether rotational correlation times of rigid bodies are
+  //! estimated (off by default, resets all statistics)
+  void set_is_correlation_time_on(bool is_on);
+
+  bool get_is_correlation_time_on() const {
+    return is_correlation_time_on_;
+  }
+
+  //! returns the rotational correlation time of the i'th particle
+  /** Estimated the same way as in BodyStatisticsOptimizerState.
+
+      @return the correlation time in fs, or infinity if correlation
+              times are off, the particle is not a rigid body, or its
+              orientation did not decorrelate within the tracked lags
+              since the last reset
+  */
+  double get_correlation_time(unsigned int i) const;
+
+  void reset();
+
+  virtual void do_update(unsigned int call_num) IMP_OVERRIDE;
+
+  IMP_OBJECT_METHODS(BodiesStatisticsOptimizerState);
+};
+IMP_OBJECTS(BodiesStatisticsOptimizerState, BodiesStatisticsOptimizerStates);
+
+IMPNPCTRANSPORT_END_NAMESPACE
+
+#endif /* IMPNPCTRANSPORT_BODIES_STATISTICS_OPTIMIZER_STATE_H */
@@ -15,14 +15,19 @@
 //#include <IMP/optimizer_state_macros.h>
 #include <IMP/core/PeriodicOptimizerState.h>
 #include <IMP/npctransport/typedefs.h>
-#include <deque>
+#include "internal/body_statistics_estimators.h"
 
 IMPNPCTRANSPORT_BEGIN_NAMESPACE
 
 class Statistics;
 
 /** Track the rotational correlation time of a rigid body particle*/
-/** The correlation with at most the last 100 updates is tracked*/
+/** The rotational correlation time is estimated only if turned on by
+    set_is_correlation_time_on(), by a multi-tau correlator of the
+    orientation over lags of up to ~14000 updates. Both the diffusion
+    coefficient and the correlation time are accumulated online in each
+    update, so no history of positions is kept.
+*/
 class IMPNPCTRANSPORTEXPORT BodyStatisticsOptimizerState
     : public core::PeriodicOptimizerState {
  private:
@@ -30,13 +35,16 @@ class IMPNPCTRANSPORTEXPORT BodyStatisticsOptimizerState
   Particle *p_;
   WeakPointer<IMP::npctransport::Statistics> statistics_manager_;
 
-  // time series of the positions of particles in the chain:
-  std::deque<algebra::Transformation3D> positions_;
-  std::deque<double> times_fs_;
+  // the position and time of the last update, if any
+  bool has_last_;
+  algebra::Vector3D last_translation_;
+  double last_time_fs_;
 
-  Particle *get_particle() const { return p_; }
+  internal::DiffusionCoefficientEstimator diffusion_estimator_;
+  bool is_correlation_time_on_;
+  internal::RotationalCorrelationTimeEstimator correlation_estimator_;
 
-  void add_orientation(algebra::Rotation3D rot) { positions_.push_back(rot); }
+  Particle *get_particle() const { return p_; }
 
   double get_dt() const;
 
@@ -52,17 +60,22 @@ class IMPNPCTRANSPORTEXPORT BodyStatisticsOptimizerState
      IMP::npctransport::Statistics* statistics_manager = nullptr,
      unsigned int periodicity=1);
 
+  //! set whether the rotational correlation time is estimated
+  //! (off by default, resets all statistics)
+  void set_is_correlation_time_on(bool is_on);
+
+  bool get_is_correlation_time_on() const {
+    return is_correlation_time_on_;
+  }
+
+  //! the rotational correlation time in fs, or infinity if it is off
+  //! or the orientation did not decorrelate within the tracked lags
   double get_correlation_time() const;
 
   double get_diffusion_coefficient() const;
 
   void reset();
 
-  /** updates the z-r distriubution table in owner's statistics
-      for this particle type (distribution of z coordinates and r coordinates)
-  */
-  void update_particle_type_zr_distribution_map();
-
   virtual void do_update(unsigned int call_num) IMP_OVERRIDE;
 
   IMP_OBJECT_METHODS(BodyStatisticsOptimizerState);
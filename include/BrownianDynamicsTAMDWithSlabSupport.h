@@ -10,7 +10,11 @@
 #define IMPNPCTRANPORT_BROWNIAN_DYNAMICS_TAMD_WITH_SLAB_SUPPORT_H
 
 #include "npctransport_config.h"
+#include "FGChain.h"
 #include <IMP/atom/BrownianDynamicsTAMD.h>
+#include <IMP/algebra/BoundingBoxD.h>
+#include <IMP/algebra/vector_search.h>
+#include <boost/unordered_map.hpp>
 
 IMPNPCTRANSPORT_BEGIN_NAMESPACE
 
@@ -55,6 +59,69 @@ class SimulationParameters;
     If the skt (stochastic runge kutta) flag is true, the simulation is
     altered slightly to apply the SKT scheme.
 
+    _Free diffusion propagation_
+
+    Optionally, see set_free_diffusion_propagation(), candidate particles
+    (typically floaters) that are isolated from all other beads, the slab
+    and the bounding box walls by more than a safety shell are taken out
+    of the step-by-step integration. Each of them is then propagated
+    analytically, in a single move, using the free-diffusion Green's
+    function for the time it spent in flight (translational and, for
+    rigid bodies, rotational), and it rejoins regular BD afterwards. The
+    flight time is chosen such that it is unlikely to breach the clearance
+    around the particle, where the clearance of particles in flight is
+    reduced by the distance they may have travelled. A flight is aborted
+    and the particle is landed at the current time as soon as another
+    particle or a wall may have breached its clearance.
+
+    The obstacles are indexed in space only once every few steps, when
+    new flights are started. The clearance of each flight is cached at
+    that time. In between, a flight is aborted once its cached clearance
+    minus a conservative bound on the displacement of the obstacles
+    since the indexing is within interaction range. The bound covers the
+    maximal move of a BD step (see set_maximum_move()) plus diffusion at
+    the maximal diffusion coefficient of the obstacles, so flights last
+    beyond the next step only if a maximal move was set.
+
+    Particles in flight are left at their coordinates from the beginning
+    of the flight until they land. The flights of particles whose
+    coordinates are read by statistics and RMF optimizer states are
+    landed before each of their updates (see
+    synchronize_free_diffusion_flights()), and all flights are landed
+    before checkpoints are saved.
+
+    _Constrained chain backbones_
+
+    Optionally, see add_constrained_chain(), the backbone bonds of FG
+    chains are treated as holonomic distance constraints instead of
+    springs. After each step, bond lengths are restored to their rest
+    length by an iterative SHAKE-like projection, one chain at a time
+    (chains are processed in parallel if OpenMP is enabled). Beads are
+    displaced in proportion to their diffusion coefficients, and beads
+    with non-optimized coordinates are not displaced.
+
+    _Slab support_
+
+    If a slab particle is set using set_slab() and its pore radius is
+    optimized, the pore radius is advanced as an additional degree of
+    freedom in each step, by random diffusion + the gradient of the scoring
+    function with respect to the pore radius, just as particle coordinates,
+    using the pore radius diffusion coefficient of the slab.
+
+    \see SlabWithPore::set_pore_radius_diffusion_coefficient()
+
+    _Spatial sorting_
+
+    Optionally, see set_spatial_sort_interval(), the simulated particles
+    are periodically re-sorted along a Morton (Z-order) curve of their
+    current positions, and advanced in that order. Only the order of
+    traversal changes - attribute storage is owned by the Model and is
+    not permuted, and the scoring function, which dominates the cost of
+    a step, still reads it in its own order. No speedup is claimed; the
+    order only groups the per-particle work of a step (e.g. each
+    parallel chunk covers a compact region of space). The sort is
+    refreshed in setup() and then every few steps.
+
     \see Diffusion
     \see RigidBodyDiffusion
   */
@@ -77,9 +144,144 @@ class IMPNPCTRANSPORTEXPORT BrownianDynamicsTAMDWithSlabSupport
   BrownianDynamicsTAMDWithSlabSupport(Model *m,
                        std::string name = "BrownianDynamicsTAMDWithSlabSupport%1%",
                                       double wave_factor = 1.0):
-  BrownianDynamicsTAMD(m, name, wave_factor)
+  BrownianDynamicsTAMD(m, name, wave_factor),
+    free_diffusion_interaction_range_(0.0),
+    free_diffusion_safety_shell_(-1.0),
+    free_diffusion_check_interval_(10),
+    n_steps_since_free_diffusion_check_(0),
+    max_free_diffusion_time_(0.0),
+    free_diffusion_obstacles_max_radius_(0.0),
+    free_diffusion_obstacles_max_D_(0.0),
+    is_free_diffusion_box_(false),
+    is_slab_(false),
+    bond_constraints_tolerance_(1e-4),
+    bond_constraints_max_iterations_(100),
+    spatial_sort_interval_(0),
+    n_steps_since_spatial_sort_(0)
     {}
 
+  //! Enable analytic free-diffusion propagation of isolated particles
+  /** A candidate particle whose surface is farther than
+      interaction_range + safety_shell from the surface of any of the
+      obstacle beads (and from the slab and box walls, if set) is
+      propagated analytically instead of step by step.
+
+      @param candidates particles that may be propagated analytically,
+                        must be decorated with atom::Diffusion
+      @param obstacles all beads that candidates may interact with
+                       (candidates may also appear in this list)
+      @param interaction_range maximal range of interactions between beads
+      @param safety_shell minimal additional clearance beyond interaction_range
+                          required for a particle to start a free flight.
+                          If non-positive, free diffusion propagation is
+                          disabled.
+      @param max_flight_time_fs maximal duration of a single free flight in fs
+  */
+  void set_free_diffusion_propagation(const ParticleIndexes& candidates,
+                                      const ParticleIndexes& obstacles,
+                                      double interaction_range,
+                                      double safety_shell,
+                                      double max_flight_time_fs);
+
+  //! Bounding box walls that limit free flights of isolated particles
+  void set_free_diffusion_bounding_box(const algebra::BoundingBox3D& bb) {
+    free_diffusion_box_ = bb;
+    is_free_diffusion_box_ = true;
+  }
+
+  //! Set the slab particle that is simulated with this simulator
+  /** If the pore radius of the slab is optimized, it is advanced in each
+      simulation step. The slab walls also limit free flights of isolated
+      particles (the pore is treated as a cylinder for that purpose, which
+      is conservative also for toroidal pores).
+
+      @param slab a particle decorated as SlabWithPore
+  */
+  void set_slab(Particle* slab);
+
+  //! Returns true if a slab particle was set using set_slab()
+  bool get_has_slab() const {
+    return is_slab_;
+  }
+
+  //! Returns true if analytic free-diffusion propagation is on
+  bool get_is_free_diffusion_propagation() const {
+    return free_diffusion_safety_shell_ > 0.0;
+  }
+
+  //! Returns the number of particles that are currently in free flight
+  unsigned int get_number_of_free_diffusion_flights() const {
+    return free_flights_.size();
+  }
+
+  //! Land all particles in free flight at the current time
+  /** Particles in free flight are left at their coordinates from the
+      beginning of the flight until it ends, so this method should be
+      called before using their coordinates outside of optimize().
+      Landed particles rejoin regular BD, and may start new flights
+      later on.
+  */
+  void synchronize_free_diffusion_flights();
+
+  //! Land the particles in pis that are in free flight at the current time
+  /** Same as synchronize_free_diffusion_flights(), but other particles
+      remain in flight. Particles in pis that are not in flight are
+      ignored.
+  */
+  void synchronize_free_diffusion_flights(const ParticleIndexes& pis);
+
+  //! Constrain the backbone bonds of chain to their rest length
+  /** The rest length of a bond is the sum of the radii of the bonded
+      beads, factored by chain->get_rest_length_factor() at the time
+      of each step. The chain beads should not be modified after this
+      call.
+
+      @note the chain backbone restraint should not be part of the
+            scoring function, see Scoring::get_is_backbone_constrained()
+  */
+  void add_constrained_chain(FGChain* chain);
+
+  //! Remove all chains added by add_constrained_chain()
+  void clear_constrained_chains() {
+    constrained_chains_.clear();
+    constrained_chains_beads_.clear();
+  }
+
+  //! Returns the number of chains added by add_constrained_chain()
+  unsigned int get_number_of_constrained_chains() const {
+    return constrained_chains_.size();
+  }
+
+  //! Set the maximal bond length error relative to the rest length
+  //! after the constraints of each step are applied
+  void set_bond_constraints_tolerance(double relative_tolerance) {
+    IMP_USAGE_CHECK(relative_tolerance > 0.0,
+                    "tolerance must be positive");
+    bond_constraints_tolerance_= relative_tolerance;
+  }
+
+  //! Set the maximal number of iterations over each chain bonds
+  //! in each step
+  void set_bond_constraints_max_iterations(unsigned int n) {
+    bond_constraints_max_iterations_= n;
+  }
+
+  //! Restore the bonds of all chains added by add_constrained_chain() to
+  //! their rest length (invoked automatically after each step)
+  /** @return the maximal relative bond length error after projection */
+  double apply_bond_constraints();
+
+  //! Re-sort simulated particles along a space-filling curve of their
+  //! positions every n_steps steps (0 to disable)
+  void set_spatial_sort_interval(unsigned int n_steps) {
+    spatial_sort_interval_= n_steps;
+    spatially_sorted_ps_.clear();
+  }
+
+  unsigned int get_spatial_sort_interval() const {
+    return spatial_sort_interval_;
+  }
+
  protected:
   /** advances a chunk of ps from index begin to end
 
@@ -92,6 +294,104 @@ class IMPNPCTRANSPORTEXPORT BrownianDynamicsTAMDWithSlabSupport
   void do_advance_chunk(double dtfs, double ikt,
                         const ParticleIndexes &ps,
                         unsigned int begin, unsigned int end);
+
+  /** advances all particles in ps that are not in free flight by a
+      single BD step of dt fs, and handles free flights of isolated
+      particles if set_free_diffusion_propagation() was used
+  */
+  virtual double do_step(const ParticleIndexes &ps, double dt) IMP_OVERRIDE;
+
+  //! called by the simulator before each simulation with the simulated
+  //! particles, which may have changed since the last sort (and whose
+  //! coordinates may have changed since the last free diffusion check)
+  virtual void setup(const ParticleIndexes &ps) IMP_OVERRIDE;
+
+ private:
+  //! propagate pi analytically by free diffusion over dtfs fs
+  void propagate_free_diffusion(ParticleIndex pi, double dtfs);
+
+  //! start free flights for all candidates that are currently isolated
+  void update_free_diffusion_flights();
+
+  //! land all flights whose clearance may have been breached by another
+  //! particle or a wall since they started. If is_index_updated, the
+  //! clearance of each flight is recomputed from the obstacles index and
+  //! cached, otherwise it is bounded from the cached one.
+  void abort_breached_free_diffusion_flights(bool is_index_updated);
+
+  //! index the current positions of all obstacles in space
+  void update_free_diffusion_obstacles_index();
+
+  //! update the radii of indexed obstacles (inflated by their reach if
+  //! in flight) without moving them
+  void update_free_diffusion_obstacles_radii();
+
+  //! a bound on the displacement of any obstacle over n_steps BD steps
+  double get_free_diffusion_obstacles_reach(unsigned int n_steps) const;
+
+  //! the distance by which particle pi may have moved away from its
+  //! coordinates during its current free flight, or 0 if not in flight
+  double get_free_diffusion_reach(ParticleIndex pi) const;
+
+  //! the clearance between the sphere (center, radius) of particle pi
+  //! and all obstacles other than pi, and the slab and box walls, or
+  //! max_clearance if it is larger. Obstacles in free flight are
+  //! inflated by their reach. Requires an up-to-date obstacles index.
+  double get_free_diffusion_clearance
+    (ParticleIndex pi, const algebra::Vector3D& center, double radius,
+     double max_clearance) const;
+
+  //! advance the pore radius of the slab (if set and optimized) by a
+  //! BD step of dtfs fs at inverse kT ikt
+  void advance_pore_radius(double dtfs, double ikt);
+
+  //! restore the bonds of the i'th constrained chain, returns the
+  //! maximal relative bond length error after projection
+  double apply_chain_bond_constraints(unsigned int i);
+
+  //! returns ps in spatially sorted order if set_spatial_sort_interval()
+  //! was used, or ps itself otherwise. ps is assumed to be the same list
+  //! that was passed to setup() (only its size is checked)
+  const ParticleIndexes& get_spatially_sorted(const ParticleIndexes& ps);
+
+  //! the clearance between the sphere (center, radius) and the slab and
+  //! box walls, if those were set
+  double get_free_diffusion_walls_clearance
+    (const algebra::Vector3D& center, double radius) const;
+
+#ifndef SWIG
+  struct FreeFlight {
+    double duration_fs; // planned duration of flight
+    double elapsed_fs; // time elapsed since beginning of flight
+    double reach; // a bound on the displacement during the entire flight
+    double clearance; // of the sphere inflated by reach at the last check
+  };
+  typedef boost::unordered_map<ParticleIndex, FreeFlight> FreeFlightsMap;
+  FreeFlightsMap free_flights_;
+  PointerMember<algebra::NearestNeighbor3D> free_diffusion_obstacles_nn_;
+#endif
+  ParticleIndexes free_diffusion_candidates_;
+  ParticleIndexes free_diffusion_obstacles_;
+  double free_diffusion_interaction_range_;
+  double free_diffusion_safety_shell_;
+  unsigned int free_diffusion_check_interval_; // in steps
+  unsigned int n_steps_since_free_diffusion_check_;
+  double max_free_diffusion_time_;
+  algebra::Vector3Ds free_diffusion_obstacles_centers_;
+  Floats free_diffusion_obstacles_radii_; // inflated by reach if in flight
+  double free_diffusion_obstacles_max_radius_;
+  double free_diffusion_obstacles_max_D_;
+  algebra::BoundingBox3D free_diffusion_box_;
+  bool is_free_diffusion_box_;
+  ParticleIndex slab_;
+  bool is_slab_;
+  FGChains constrained_chains_;
+  std::vector<ParticleIndexes> constrained_chains_beads_;
+  double bond_constraints_tolerance_;
+  unsigned int bond_constraints_max_iterations_;
+  unsigned int spatial_sort_interval_; // in steps
+  unsigned int n_steps_since_spatial_sort_;
+  ParticleIndexes spatially_sorted_ps_;
 };
 
 IMPNPCTRANSPORT_END_NAMESPACE
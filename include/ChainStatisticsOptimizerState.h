@@ -14,7 +14,8 @@
 //#include <IMP/optimizer_state_macros.h>
 #include <IMP/core/PeriodicOptimizerState.h>
 #include <IMP/npctransport/typedefs.h>
-#include <deque>
+#include "internal/body_statistics_estimators.h"
+#include <vector>
 
 IMPNPCTRANSPORT_BEGIN_NAMESPACE
 
@@ -25,11 +26,25 @@ class IMPNPCTRANSPORTEXPORT ChainStatisticsOptimizerState
   typedef core::PeriodicOptimizerState P;
 
   // particles in the chain:
-  ParticlesTemp ps_;
+  ParticleIndexes pis_;
 
-  // time series of the positions of particles in the chain:
-  std::deque<algebra::Vector3Ds> positions_;
-  std::deque<double> times_fs_;
+  // positions of particles in the chain in the current and previous
+  // updates, swapped on each update to avoid reallocation
+  algebra::Vector3Ds positions_;
+  algebra::Vector3Ds last_positions_;
+  bool has_last_;
+
+  // chain center of mass and time in the last update
+  algebra::Vector3D last_center_;
+  double last_time_fs_;
+
+  // diffusion of the chain center of mass since last reset
+  internal::DiffusionCoefficientEstimator diffusion_estimator_;
+
+  // diffusion of each particle in the local reference frame of the
+  // chain since last reset
+  std::vector<internal::DiffusionCoefficientEstimator>
+    local_diffusion_estimators_;
 
   // mean radius-of-gyration and its square since last reset
   double mean_rgyr_;
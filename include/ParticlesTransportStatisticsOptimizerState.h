@@ -0,0 +1,145 @@
+/**
+ *  \file npctransport/ParticlesTransportStatisticsOptimizerState.h
+ *  \brief batched transport statistics over a group of particles
+ *
+ *  Copyright 2007-2018 IMP Inventors. All rights reserved.
+ */
+
+#ifndef IMPNPCTRANSPORT_PARTICLES_TRANSPORT_STATISTICS_OPTIMIZER_STATE_H
+#define IMPNPCTRANSPORT_PARTICLES_TRANSPORT_STATISTICS_OPTIMIZER_STATE_H
+
+#include "npctransport_config.h"
+#include <IMP/Particle.h>
+#include <IMP/OptimizerState.h>
+#include <IMP/core/PeriodicOptimizerState.h>
+#include <IMP/npctransport/typedefs.h>
+#include <IMP/atom/Simulator.h>
+#include <vector>
+
+IMPNPCTRANSPORT_BEGIN_NAMESPACE
+
+class Statistics;
+
+//! Maintains transport statistics about a group of particles in a z-axis
+//! aligned channel
+/**
+   Same as a ParticleTransportStatisticsOptimizerState for each of the
+   particles, but all particles are tracked by a single optimizer state
+   that scans their z-coordinates in one pass. The crossing state of
+   each particle is kept in compact arrays, and is written back to its
+   Transporting decorator only when it changes (the last tracked z is
+   written on every update, so it is up to date for RMF output).
+
+   The arrays are reloaded from the Transporting decorators in the first
+   update after construction or reset(), so changes made to the
+   decorators before that (e.g. loading from an RMF file) are respected.
+ */
+class IMPNPCTRANSPORTEXPORT ParticlesTransportStatisticsOptimizerState
+    : public core::PeriodicOptimizerState {
+ private:
+  typedef core::PeriodicOptimizerState P;
+  ParticleIndexes pis_;     // the particles
+  Float bottom_z_, top_z_;  // channel boundaries on z-axis
+  WeakPointer<IMP::npctransport::Statistics> statistics_manager_;
+  WeakPointer<IMP::atom::Simulator> owner_;
+
+  // crossing state of each particle, mirroring its Transporting decorator
+  Floats last_z_;
+  Ints n_entries_bottom_;
+  Ints n_entries_top_;
+  std::vector<char> is_last_entry_from_top_;
+
+  // transport statistics of each particle since last reset
+  std::vector<unsigned int> n_transports_up_;
+  std::vector<unsigned int> n_transports_down_;
+  Floats transport_time_points_in_ns_;  // of all particles, in order
+  bool is_reset_;
+
+  // reload crossing state from the Transporting decorators
+  void load_from_decorators();
+
+ public:
+  /**
+     Initiates transport statistics about particles ps in a z-axis
+     aligned channel, whose bottom and top are at z-coordinates bottom_z
+     and top_z, respectively. Each particle is decorated as Transporting,
+     and must not be decorated as such before.
+
+     @param ps the particles
+     @param bottom_z the z coordinate of the channel bottom
+     @param top_z the z coordinate of the channel top
+     @param statistics_manager Statistics object that can be
+            used to communicate back pertinent information from
+            this object, or nullptr if not managed
+     @param owner a simulator that is moving these particles and can
+            provide time information, or nullptr
+   */
+  ParticlesTransportStatisticsOptimizerState(
+      const ParticlesTemp& ps, Float bottom_z, Float top_z,
+      WeakPointer<IMP::npctransport::Statistics> statistics_manager = nullptr,
+      WeakPointer<IMP::atom::Simulator> owner = nullptr);
+
+  //! add p to the tracked particles and decorate it as Transporting
+  //! (resets all statistics)
+  void add_particle(Particle* p);
+
+  unsigned int get_number_of_particles() const { return pis_.size(); }
+
+  ParticlesTemp get_particles() const;
+
+  //! sets a simulator that moves these particles and can provide
+  //! simulation time information about them, or nullptr if none
+  void set_owner(WeakPointer<IMP::atom::Simulator> owner) {
+    owner_ = owner;
+  }
+
+  //! returns the simulator that was declared in the constructor or by
+  //! set_owner()
+  WeakPointer<IMP::atom::Simulator> get_owner() const { return owner_; }
+
+  /**
+      Returns the number of times the i'th particle crossed the channel
+      from its bottom to its top
+  */
+  unsigned int get_n_transports_up(unsigned int i) const {
+    return n_transports_up_[i];
+  }
+
+  /** Returns the number of times the i'th particle crossed the channel
+      from its top to its bottom
+  */
+  unsigned int get_n_transports_down(unsigned int i) const {
+    return n_transports_down_[i];
+  }
+
+  /** Returns the number of times any of the particles crossed the
+      channel from any one side to the other
+  */
+  unsigned int get_total_n_transports() const {
+    return transport_time_points_in_ns_.size();
+  }
+
+  /**
+     returns a list of the simulation time points in nanoseconds
+     of all transport events of all particles, in the order they
+     occurred (according to the owner of this OptimizerState).
+     Time points are 0.0 for events that occurred while there
+     was no owner.
+   */
+  Floats const &get_transport_time_points_in_ns() const {
+    return transport_time_points_in_ns_;
+  }
+
+  /** resets the number of transports statistics to 0 */
+  void reset();
+
+  virtual void do_update(unsigned int call_num) IMP_OVERRIDE;
+  IMP_OBJECT_METHODS(ParticlesTransportStatisticsOptimizerState);
+};
+
+IMP_OBJECTS(ParticlesTransportStatisticsOptimizerState,
+            ParticlesTransportStatisticsOptimizerStates);
+
+IMPNPCTRANSPORT_END_NAMESPACE
+
+#endif /* IMPNPCTRANSPORT_PARTICLES_TRANSPORT_STATISTICS_OPTIMIZER_STATE_H */
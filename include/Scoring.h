@@ -13,6 +13,7 @@
 #include "FGChain.h"
 #include "npctransport_proto.fwd.h"
 #include "Parameter.h"
+#include "internal/TAMDForest.h"
 // #include "SimulationData.h"
 
 #include <IMP/Model.h>
@@ -52,6 +53,7 @@ class IMPNPCTRANSPORTEXPORT Scoring: public Object
   Parameter<double> interaction_range_;
   Parameter<double> backbone_k_;
   Parameter<bool> is_backbone_harmonic_;
+  Parameter<bool> is_backbone_constrained_;
   Parameter<double> slack_;
   Parameter<double> nonspecific_k_;
   Parameter<double> nonspecific_range_;
@@ -119,6 +121,10 @@ class IMPNPCTRANSPORTEXPORT Scoring: public Object
     t_particle_index_to_fg_chain_map;
   t_particle_index_to_fg_chain_map bead_to_chain_map_;
 
+  // maintains the centroids of all TAMD chains of the model (null if
+  // none were added by add_chain_restraints())
+  PointerMember<internal::TAMDForest> tamd_forest_;
+
   // particles to be z-biased on call to get_z_bias_restraints()
   // with key being the k value of each particle subset
   typedef boost::unordered_map<double, ParticlesTemp> t_z_bias_particles_map;
@@ -452,6 +458,11 @@ class IMPNPCTRANSPORTEXPORT Scoring: public Object
 
   bool get_is_backbone_harmonic() const { return is_backbone_harmonic_; }
 
+  //! returns true if chain backbone bonds are enforced as distance
+  //! constraints by the simulator rather than by restraints
+  //! \see BrownianDynamicsTAMDWithSlabSupport::add_constrained_chain()
+  bool get_is_backbone_constrained() const { return is_backbone_constrained_; }
+
 #ifndef SWIG
   //! Create a backbone bond restraint over beads according to class flags
   /** create a backbone bond restraint with specified rest_length_factor
@@ -564,6 +575,10 @@ class IMPNPCTRANSPORTEXPORT Scoring: public Object
       @note if the chain->get_backbone_k() is non-positive, it is reset to
             this->get_default_backbone_k()
 
+      @note if chain is a TAMD chain, its centroids are maintained by
+            the TAMD forest of the model (see get_tamd_forest()), to which
+            it was added when it was created
+
       @note this method assumes that all such chains will be disjoint
       and so it is later possible to use
       container::ExclusiveConsecutivePairFilter to filter out all
@@ -672,6 +687,13 @@ class IMPNPCTRANSPORTEXPORT Scoring: public Object
   FGChains get_fg_chains() {
     return FGChains(chains_set_.begin(), chains_set_.end());
   }
+
+  //! returns the score state that maintains the centroids of all TAMD
+  //! chains of the model if TAMD chains were added by
+  //! add_chain_restraints(), or nullptr otherwise
+  internal::TAMDForest* get_tamd_forest() const {
+    return tamd_forest_;
+  }
 #endif
 
   double get_range() const { return range_; }
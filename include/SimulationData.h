@@ -30,6 +30,7 @@
 #include <boost/unordered_map.hpp>
 #include <boost/unordered_set.hpp>
 #include "io.h"
+#include "BrownianDynamicsTAMDWithSlabSupport.h"
 #include "Parameter.h"
 #include "Scoring.h"
 #include "Statistics.h"
@@ -51,6 +52,7 @@ class IMPNPCTRANSPORTEXPORT SimulationData : public Object {
   Parameter<double> box_side_;
   Parameter<double> tunnel_radius_; // note this is the initial pore radius (major radius if toroidal pore)
   Parameter<double> tunnel_radius_k_; // k for harmonic restraint on pore radius
+  Parameter<double> tunnel_radius_tau_ns_; // relaxation time of dynamic pore radius
   Parameter<double> pore_anchored_beads_k_; // k for harmonic restraint on beads anchored to pore
   Parameter<double> slab_thickness_; // note this is the initial thickness (also minor vertical radius if toroidal pore)
   Parameter<bool> box_is_on_;
@@ -60,11 +62,13 @@ class IMPNPCTRANSPORTEXPORT SimulationData : public Object {
   Parameter<int> dump_interval_frames_;
   Parameter<bool> is_backbone_harmonic_;
   Parameter<double> backbone_tau_ns_;
+  Parameter<double> free_diffusion_safety_shell_;
   Parameter<double> angular_d_factor_;
   Parameter<double> range_;
   Parameter<double> statistics_fraction_;
   Parameter<int> statistics_interval_frames_;
   Parameter<int> output_statistics_interval_frames_;
+  Parameter<int> spatial_sort_interval_frames_;
   Parameter<double> time_step_;
   Parameter<double> time_step_wave_factor_;
   Parameter<double> maximum_number_of_minutes_;
@@ -73,6 +77,7 @@ class IMPNPCTRANSPORTEXPORT SimulationData : public Object {
   Parameter<int> is_exclude_floaters_from_slab_initially_;
   Parameter<double> are_floaters_on_one_slab_side_;
   Parameter<int> is_xyz_hist_stats_;
+  Parameter<int> is_rotational_correlation_stats_;
 
  // time when simulation has started for this process
   Parameter<double> initial_simulation_time_ns_;
@@ -100,6 +105,11 @@ class IMPNPCTRANSPORTEXPORT SimulationData : public Object {
   bool get_is_xyz_hist_stats()
   { return is_xyz_hist_stats_; }
 
+  /** returns whether rotational correlation times of FG beads and
+      floaters are estimated */
+  bool get_is_rotational_correlation_stats()
+  { return is_rotational_correlation_stats_; }
+
   /** returns the simulation angular d factor */
   double get_angular_d_factor() const
   { return angular_d_factor_; }
@@ -110,7 +120,7 @@ class IMPNPCTRANSPORTEXPORT SimulationData : public Object {
   PointerMember<Model> m_;
 
   // The BrownianDynamic simulator
-  PointerMember<atom::BrownianDynamics> bd_;
+  PointerMember<BrownianDynamicsTAMDWithSlabSupport> bd_;
 
   // The scoring function wrapper for the simulation
   PointerMember <IMP::npctransport::Scoring >
@@ -267,7 +277,7 @@ class IMPNPCTRANSPORTEXPORT SimulationData : public Object {
 
       @param recreate if true, forces recreation of the bd object
   */
- atom::BrownianDynamics *get_bd(bool recreate = false);
+ BrownianDynamicsTAMDWithSlabSupport *get_bd(bool recreate = false);
 
   //! activates Brownian Dynamics statistics tracking
  //! by adding all appropriate optimizer states, if they weren't already
@@ -387,6 +397,13 @@ class IMPNPCTRANSPORTEXPORT SimulationData : public Object {
     return backbone_tau_ns_;
   }
 
+  //! returns the safety shell beyond interaction range for analytic
+  //! free-diffusion propagation of isolated floaters, or a non-positive
+  //! value if floaters are always propagated step by step
+  double get_free_diffusion_safety_shell() const {
+    return free_diffusion_safety_shell_;
+  }
+
   double get_temperature_k() const
   { return temperature_k_; }
 
@@ -636,6 +653,11 @@ class IMPNPCTRANSPORTEXPORT SimulationData : public Object {
     return get_tunnel_radius_k();
   }
 
+  //! returns the relaxation time of a dynamic tunnel radius in ns
+  double get_tunnel_radius_tau_ns() const {
+    return tunnel_radius_tau_ns_;
+  }
+
   //! returns true if pore radius can change dynamically
   bool get_is_pore_radius_dynamic() const {
     return get_has_slab() && get_tunnel_radius_k()>0.0;
@@ -111,11 +111,30 @@ class IMPNPCTRANSPORTEXPORT SlabWithPore
     get_particle()->set_is_optimized(get_pore_radius_key(), tf);
   }
 
+  //! returns true if a diffusion coefficient was set for the pore radius
+  bool get_has_pore_radius_diffusion_coefficient() const {
+    return get_particle()->has_attribute
+      (get_pore_radius_diffusion_coefficient_key());
+  }
+
+  //! get the diffusion coefficient of the pore radius in A^2/fs
+  Float get_pore_radius_diffusion_coefficient() const {
+    return get_particle()->get_value
+      (get_pore_radius_diffusion_coefficient_key());
+  }
+
+  //! set the diffusion coefficient of the pore radius in A^2/fs, which
+  //! is used by the simulator to advance an optimized pore radius
+  void set_pore_radius_diffusion_coefficient(double D) const;
+
   //! Get the decorator key for is_last_entry_from_top
   static FloatKey get_thickness_key();
 
   //! Get the key for the pore radius.
   static FloatKey get_pore_radius_key();
+
+  //! Get the key for the pore radius diffusion coefficient
+  static FloatKey get_pore_radius_diffusion_coefficient_key();
 };
 
 
@@ -29,16 +29,18 @@
 #include <IMP/set_map_macros.h>
 #include <RMF/HDF5/File.h>
 #include "io.h"
-#include "BodyStatisticsOptimizerState.h"
+#include "BodiesStatisticsOptimizerState.h"
 #include "GlobalStatisticsOptimizerState.h"
-#include "ParticleTransportStatisticsOptimizerState.h"
+#include "ParticlesTransportStatisticsOptimizerState.h"
 #include "ChainStatisticsOptimizerState.h"
 #include "BipartitePairsStatisticsOptimizerState.h"
 #include "Parameter.h"
 #include "Scoring.h"
+#include "internal/StatisticsOptimizerStatesGroup.h"
 #include "typedefs.h"
 
 #include <boost/timer.hpp>
+#include <boost/shared_ptr.hpp>
 #include "boost/tuple/tuple.hpp"
 #include <boost/utility/value_init.hpp>
 #include <boost/unordered_map.hpp>
@@ -71,46 +73,66 @@ class IMPNPCTRANSPORTEXPORT Statistics : public Object {
   // the file to which simulation statistics are dumped:
   std::string output_file_name_;
 
+#ifndef SWIG
+  // resident copy of the output file contents, loaded on first access
+  // after activation and written back by each update()
+  boost::shared_ptr< ::npctransport_proto::Output > output_;
+#endif
+
   IMP::PointerMember<GlobalStatisticsOptimizerState> global_stats_;
 
-  // statistics about all fgs, per particle, per chain, per particle type
-  typedef std::vector< BodyStatisticsOptimizerStates >
-    FGsBodyStatisticsOSs;
-  typedef IMP_KERNEL_LARGE_UNORDERED_MAP<core::ParticleType, FGsBodyStatisticsOSs>
+  // updates all statistics optimizer states below on behalf of the
+  // optimizer, once statistics are activated
+  IMP::PointerMember<internal::StatisticsOptimizerStatesGroup>
+    optimizer_states_group_;
+
+  // statistics about all fgs, per chain, per particle type
+  // (each tracking all beads of that type in that chain)
+  typedef IMP_KERNEL_LARGE_UNORDERED_MAP<core::ParticleType,
+    BodiesStatisticsOptimizerStates>
     FGsBodyStatisticsOSsMap;
   FGsBodyStatisticsOSsMap fgs_bodies_stats_map_;
 
   // statistics about all floaters (kaps etc.), per particle type
-  typedef IMP_KERNEL_LARGE_UNORDERED_MAP<core::ParticleType, BodyStatisticsOptimizerStates>
+  typedef IMP_KERNEL_LARGE_UNORDERED_MAP<core::ParticleType,
+    PointerMember<BodiesStatisticsOptimizerState> >
     BodyStatisticsOSsMap;
   BodyStatisticsOSsMap floaters_stats_map_;
 
   // transport statistics about all floaters (kaps etc.) per particle type
   typedef IMP_KERNEL_LARGE_UNORDERED_MAP< core::ParticleType,
-    ParticleTransportStatisticsOptimizerStates>
+    PointerMember<ParticlesTransportStatisticsOptimizerState> >
     ParticleTransportStatisticsOSsMap;
   ParticleTransportStatisticsOSsMap floaters_transport_stats_map_;
 
 #ifndef SWIG
-  // distributions
+  // particles whose z-r or x-y-z distributions are collected,
+  // per particle type
+  typedef IMP_KERNEL_LARGE_UNORDERED_MAP< core::ParticleType,
+    ParticlesTemp >
+    ParticleTypeParticlesMap;
+  ParticleTypeParticlesMap distribution_particles_map_;
+  // dense z-r histograms, each stored contiguously in row-major
+  // order with dimensions zr_distribution_sizes_
   typedef IMP_KERNEL_LARGE_UNORDERED_MAP< core::ParticleType,
-    std::vector< std::vector<int> > >
+    std::vector<int> >
     ParticleTypeZRDistributionMap;
   ParticleTypeZRDistributionMap particle_type_zr_distribution_map_;
-  typedef IMP_KERNEL_LARGE_UNORDERED_MAP< uint_fast8_t,
-    IMP_KERNEL_LARGE_UNORDERED_MAP< uint_fast8_t,
-    IMP_KERNEL_LARGE_UNORDERED_MAP< uint_fast8_t,
-    boost::value_initialized<unsigned int> > > >
-    t_sparse_3d_matrix;
+  struct t_size_2d_matrix{
+    unsigned int d0;
+    unsigned int d1;
+  };
+  t_size_2d_matrix zr_distribution_sizes_;
+  // dense x-y-z histograms, each stored contiguously in row-major
+  // order with dimensions xyz_distribution_sizes_
   typedef IMP_KERNEL_LARGE_UNORDERED_MAP< core::ParticleType,
-    t_sparse_3d_matrix >
-    //    std::vector< std::vector< std::vector<int> > > >
+    std::vector<int> >
     ParticleTypeXYZDistributionMap;
   ParticleTypeXYZDistributionMap particle_type_xyz_distribution_map_;
   struct t_size_3d_matrix{
-    uint_fast8_t d0;
-    uint_fast8_t d1;
-    uint_fast8_t d2;
+    unsigned int d0;
+    unsigned int d1;
+    unsigned int d2;
   };
   t_size_3d_matrix xyz_distribution_sizes_;
 #endif
@@ -177,11 +199,22 @@ class IMPNPCTRANSPORTEXPORT Statistics : public Object {
   void add_interaction_stats
     ( core::ParticleType type0, core::ParticleType type1);
 
-  //! add all statistics-related optimizer states to o
+  //! returns the optimizer states that track statistics of
+  //! interactions, one for each interaction type
+  BipartitePairsStatisticsOptimizerStates
+    get_interaction_statistics_optimizer_states() const;
+
+  //! track all statistics-related optimizer states during optimization by o
   /**
-      @param o optimizer to which optimizer states are added,
+      The statistics optimizer states are not added to o. Instead, a
+      single optimizer state is added to o, which updates all of them
+      every statistics interval. Optimizer states that evaluate the
+      scoring function are updated first, one after the other, and then
+      all the others are updated concurrently (when OpenMP is enabled).
+
+      @param o optimizer to which the updating optimizer state is added,
                use get_sd()->get_bd() if nullptr
-      @return the list of optimizer states that were added
+      @return the list of statistics optimizer states that are updated
 
       @note If called for more than one optimizer, only the last
             optimizer will be guaranteed to work well.
@@ -197,6 +230,17 @@ class IMPNPCTRANSPORTEXPORT Statistics : public Object {
    */
   void update_particle_type_zr_distribution_map(Particle* p);
 
+  /**
+     updates the z-r distribution of particle type pt with the binned
+     position counts of all particles in ps, in a single batched pass
+     (bins are computed in parallel and then accumulated)
+
+     @param pt the particle type of all particles in ps
+     @param ps the particles
+  */
+  void update_particle_type_zr_distribution_map(core::ParticleType pt,
+                                                const ParticlesTemp& ps);
+
     /**
      updates the map of x-y-z distributions of particle coordinates
      with p's binned position counts (if z-symmetry flag is on,
@@ -206,6 +250,30 @@ class IMPNPCTRANSPORTEXPORT Statistics : public Object {
    */
   void update_particle_type_xyz_distribution_map(Particle* p);
 
+  /**
+     updates the x-y-z distribution of particle type pt with the binned
+     position counts of all particles in ps, in a single batched pass
+     (bins are computed in parallel and then accumulated)
+
+     @param pt the particle type of all particles in ps
+     @param ps the particles
+  */
+  void update_particle_type_xyz_distribution_map(core::ParticleType pt,
+                                                 const ParticlesTemp& ps);
+
+  /**
+     updates the z-r distributions (or x-y-z distributions, if
+     get_sd()->get_is_xyz_hist_stats() is true) of all floaters and
+     FG beads that were added to this object, one particle type at a time.
+     This is invoked once per statistics period by the global statistics
+     optimizer state.
+  */
+  void update_particle_distributions();
+
+  //! returns the indexes of all floaters and FG beads that were added to
+  //! this object, whose coordinates are read by its optimizer states
+  ParticleIndexes get_read_particle_indexes() const;
+
 
   /**
       opens / creates statistics protobuf file, and update it
@@ -233,9 +301,36 @@ class IMPNPCTRANSPORTEXPORT Statistics : public Object {
       and the simulation time to zero */
   void reset_statistics_optimizer_states();
 
-  //! Loads the stats file and set the interrupted flag to true
+  //! Sets the interrupted flag of the statistics in the output file
   void set_interrupted(bool tf);
 
+#ifndef SWIG
+  /** returns the output protobuf message that is kept in memory between
+      statistics updates, loading it from get_output_file_name() if it
+      was not loaded yet. Changes are saved to disk by the next update()
+      or by write_output().
+
+      @throw IOException if the output file could not be read
+  */
+  ::npctransport_proto::Output* get_mutable_output();
+#endif
+
+  //! discard the output message kept in memory, and load it again from
+  //! get_output_file_name() (e.g. after the file was modified externally)
+  void load_output();
+
+  //! write the output message kept in memory to get_output_file_name()
+  void write_output();
+
+  //! save the current conformation as an RMF buffer in the output file
+  /** Statistics updates save only a compact checkpoint of the dynamic
+      state of the simulation, unless the save_rmf_to_output flag is
+      set, as building and saving the RMF hierarchy is costly. This
+      saves an RMF conformation on demand (e.g. at the end of a run)
+      together with an up to date checkpoint.
+  */
+  void save_rmf_conformation_to_output();
+
   /************************************************************/
   /************* various simple getters and setters *******************/
   /************************************************************/
@@ -272,6 +367,20 @@ class IMPNPCTRANSPORTEXPORT Statistics : public Object {
 
  private:
 
+  //! recompute the dimensions of the zr histograms from the box size,
+  //! clearing all zr histograms if these dimensions have changed
+  void update_zr_distribution_sizes();
+
+  //! returns the zr histogram of particle type pt, adding it if needed
+  std::vector<int>& get_zr_distribution(core::ParticleType pt);
+
+  //! recompute the dimensions of the xyz histograms from the box size,
+  //! clearing all xyz histograms if these dimensions have changed
+  void update_xyz_distribution_sizes();
+
+  //! returns the xyz histogram of particle type pt, adding it if needed
+  std::vector<int>& get_xyz_distribution(core::ParticleType pt);
+
   //! update the xyz distribution of type p_type to a dataset in
   //! hdf5_group, with name p_type.get_string()
   bool update_xyz_distribution_to_hdf5
@@ -279,6 +388,9 @@ class IMPNPCTRANSPORTEXPORT Statistics : public Object {
      core::ParticleType p_type);
 
 
+  //! save the current conformation as an RMF buffer in output
+  void save_rmf_conformation( ::npctransport_proto::Output& output );
+
   //! updates pStats with all statistics related to fgs, averaged over
   //! nf_new additional frames
   void update_fg_stats( ::npctransport_proto::Statistics* pStats,
@@ -1,11 +1,55 @@
 #ifndef IMPNPCTRANSPORT_AVRO_H
 #define IMPNPCTRANSPORT_AVRO_H
 #include <IMP/npctransport/npctransport_config.h>
+#ifndef SWIG
 #include <ValidSchema.hh>
+#endif
+#include <IMP/types.h>
+#include <string>
 
 IMPNPCTRANSPORT_BEGIN_NAMESPACE
 
+#ifndef SWIG
 IMPNPCTRANSPORTEXPORT IMP_NPCTRANSPORT_AVRO_NAMESPACE::ValidSchema get_avro_data_file_schema();
+#endif
+
+//! the name of the random-access index file of an avro archive
+IMPNPCTRANSPORTEXPORT std::string get_avro_index_file_name
+(std::string avro_filename);
+
+/** Index the output entries of the avro archive avro_filename by their
+    work unit, and save the index next to it (see
+    get_avro_index_file_name()), for Avro2PBReader::seek_to_work_unit().
+    The index must be recreated whenever the archive changes.
+
+    @return the number of indexed entries
+    @throw IOException if the archive cannot be read
+*/
+IMPNPCTRANSPORTEXPORT unsigned int create_avro_index
+(std::string avro_filename);
+
+/** Write the output files output_files to the avro archive avro_filename,
+    in order, as done by the avro_cat utility. Outputs are read and
+    compressed on n_threads threads. Truncated or unreadable outputs,
+    and outputs with the same work unit and random seed as an output
+    written before, are skipped with a warning. The archive is indexed
+    when done (see create_avro_index()).
+
+    @param output_files the output protobuf files to be written
+    @param avro_filename the archive to write
+    @param codec compression of archive blocks, null or deflate
+    @param append if true and the archive exists, append to it using its
+                 own codec, skipping outputs already in it; otherwise the
+                 archive is overwritten
+    @param n_threads number of output files read concurrently
+
+    @return the number of outputs written
+    @throw IOException if the archive cannot be written, or codec is not
+           supported
+*/
+IMPNPCTRANSPORTEXPORT unsigned int write_outputs_to_avro_archive
+(const Strings& output_files, std::string avro_filename,
+ std::string codec, bool append = false, unsigned int n_threads = 1);
 
 IMPNPCTRANSPORT_END_NAMESPACE
 
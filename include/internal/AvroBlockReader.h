@@ -0,0 +1,96 @@
+/**
+ *  \file internal/AvroBlockReader.h
+ *  \brief block-level access to avro archives of output files
+ *
+ *  Copyright 2007-2018 IMP Inventors. All rights reserved.
+ */
+
+#ifndef IMPNPCTRANSPORT_INTERNAL_AVRO_BLOCK_READER_H
+#define IMPNPCTRANSPORT_INTERNAL_AVRO_BLOCK_READER_H
+
+#include "../npctransport_config.h"
+#include <boost/noncopyable.hpp>
+#include <boost/shared_ptr.hpp>
+#include <cstddef>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+IMPNPCTRANSPORT_BEGIN_INTERNAL_NAMESPACE
+
+/** Reads the entries of an avro object container file of output
+    wrappers (a key string and a value of bytes, see
+    AvroDataFileData.json) block by block, keeping track of the file
+    offset of each block, so that reading can start at any block.
+
+    This decodes the avro container format directly, as the avro
+    library does not expose block offsets. Blocks may be compressed
+    with the null or, if built with zlib, the deflate codec.
+*/
+class IMPNPCTRANSPORTEXPORT AvroBlockReader : public boost::noncopyable {
+ public:
+  //! an entry of the archive, pointing into the block being read
+  struct Entry {
+    std::string key;
+    char const* value;
+    std::size_t value_size;
+    int64_t block_offset;  // offset of the block of the entry in the file
+    unsigned int index_in_block;
+  };
+
+ private:
+  std::string file_name_;
+  std::ifstream in_;
+  std::string codec_;
+  char sync_[16];
+  int64_t first_block_offset_;
+  // data of the current block, replaced rather than reused while it is
+  // still referenced by get_block_data()
+  boost::shared_ptr<std::vector<char> > block_;
+  std::vector<char> compressed_;  // compressed data of the current block
+  std::size_t pos_;          // position of next entry in block_
+  int64_t n_left_;           // entries left in the current block
+  int64_t block_offset_;     // offset of the current block
+  unsigned int index_in_block_;
+
+  void read_header();
+
+  // read the next block, returns false at the end of the file
+  bool read_block();
+
+ public:
+  /** @throw IOException if the file cannot be read or is not an avro
+      container file */
+  AvroBlockReader(std::string file_name);
+
+  std::string get_file_name() const { return file_name_; }
+
+  //! the compression codec of blocks
+  std::string get_codec() const { return codec_; }
+
+  //! the 16 bytes that follow each block
+  std::string get_sync_marker() const { return std::string(sync_, 16); }
+
+  //! whether blocks compressed with codec can be read or written
+  static bool get_is_codec_supported(std::string codec);
+
+  //! continue reading from the start of the block at offset
+  void seek_to_block(int64_t offset);
+
+  //! read the next entry, valid until the next read
+  /** @return false if no entries are left */
+  bool read_next(Entry& entry);
+
+  //! the data of the block of the last entry read, which the value of
+  //! the entry points into
+  /** The data remains valid after the next read for as long as it
+      is referenced, so entries can be kept without copying them. */
+  boost::shared_ptr<std::vector<char> const> get_block_data() const {
+    return block_;
+  }
+};
+
+IMPNPCTRANSPORT_END_INTERNAL_NAMESPACE
+
+#endif /* IMPNPCTRANSPORT_INTERNAL_AVRO_BLOCK_READER_H */
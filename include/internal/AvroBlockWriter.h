@@ -0,0 +1,86 @@
+/**
+ *  \file internal/AvroBlockWriter.h
+ *  \brief block-level writing of avro archives of output files
+ *
+ *  Copyright 2007-2018 IMP Inventors. All rights reserved.
+ */
+
+#ifndef IMPNPCTRANSPORT_INTERNAL_AVRO_BLOCK_WRITER_H
+#define IMPNPCTRANSPORT_INTERNAL_AVRO_BLOCK_WRITER_H
+
+#include "../npctransport_config.h"
+#include <boost/noncopyable.hpp>
+#include <cstddef>
+#include <fstream>
+#include <string>
+#include <stdint.h>
+
+IMPNPCTRANSPORT_BEGIN_INTERNAL_NAMESPACE
+
+/** Writes entries of output wrappers (see AvroBlockReader) to an avro
+    object container file in blocks that are encoded and compressed
+    beforehand, so that blocks can be prepared concurrently and then
+    written in order.
+*/
+class IMPNPCTRANSPORTEXPORT AvroBlockWriter : public boost::noncopyable {
+ public:
+  //! entries encoded as an avro block
+  class IMPNPCTRANSPORTEXPORT Block {
+    std::string data_;
+    int64_t n_entries_;
+    std::string codec_;  // empty if not compressed yet
+
+   public:
+    Block() : n_entries_(0) {}
+
+    //! add an entry with a value of size bytes
+    void add_entry(std::string const& key, char const* value,
+                   std::size_t size);
+
+    //! compress the block with codec, after all entries were added
+    void compress(std::string codec);
+
+    int64_t get_number_of_entries() const { return n_entries_; }
+
+    std::string const& get_data() const { return data_; }
+
+    std::string get_codec() const { return codec_; }
+  };
+
+ private:
+  std::string file_name_;
+  std::string codec_;
+  std::string sync_;
+  std::ofstream out_;
+
+  void write_header();
+
+ public:
+  /** Create the archive file_name with blocks compressed by codec, or
+      if append is true and file_name is a nonempty avro archive,
+      append blocks to it using its own codec.
+
+      @throw IOException if the file cannot be written or read, or
+             codec is unsupported
+  */
+  AvroBlockWriter(std::string file_name, std::string codec,
+                  bool append = false);
+
+  std::string get_file_name() const { return file_name_; }
+
+  //! the codec blocks must be compressed with
+  std::string get_codec() const { return codec_; }
+
+  //! write block, which must have been compressed with get_codec()
+  void write_block(Block const& block);
+
+  //! flush the blocks written so far, so they can be read by others
+  void flush();
+
+  //! flush and close the file, after which no blocks can be written
+  void close();
+};
+
+IMPNPCTRANSPORT_END_INTERNAL_NAMESPACE
+
+#endif /* IMPNPCTRANSPORT_INTERNAL_AVRO_BLOCK_WRITER_H */
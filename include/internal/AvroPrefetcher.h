@@ -0,0 +1,119 @@
+/**
+ *  \file internal/AvroPrefetcher.h
+ *  \brief decodes records of avro files on background threads
+ *
+ *  Copyright 2007-2018 IMP Inventors. All rights reserved.
+ */
+
+#ifndef IMPNPCTRANSPORT_INTERNAL_AVRO_PREFETCHER_H
+#define IMPNPCTRANSPORT_INTERNAL_AVRO_PREFETCHER_H
+
+#include "../npctransport_config.h"
+#include <IMP/types.h>
+#include <boost/noncopyable.hpp>
+#include <boost/shared_ptr.hpp>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+IMPNPCTRANSPORT_BEGIN_INTERNAL_NAMESPACE
+
+/** Decodes the records of a list of avro files concurrently, each file
+    on one of several background threads, and delivers them in the
+    order of the files and of the records within each file.
+
+    Records are decoded in chunks that are handed to the reader as is.
+    Each record points into the decoded avro block that holds it, which
+    the chunk keeps alive, so records are never copied. Decoding of
+    files ahead of the one being read pauses while more than a maximal
+    number of bytes are waiting to be read, so memory use is bounded
+    regardless of the size of the files.
+*/
+class IMPNPCTRANSPORTEXPORT AvroPrefetcher : public boost::noncopyable {
+ public:
+  //! a record, pointing into the data of its block
+  struct Record {
+    char const* data;
+    std::size_t size;
+  };
+
+ private:
+  struct Chunk {
+    std::vector<Record> records;
+    // the blocks that records point into
+    std::vector<boost::shared_ptr<std::vector<char> const> > blocks;
+    std::size_t n_bytes;
+    Chunk() : n_bytes(0) {}
+  };
+  typedef boost::shared_ptr<Chunk> ChunkP;
+
+  struct FileSlot {
+    std::deque<ChunkP> chunks;  // decoded and not read yet
+    bool is_done;               // all records were decoded
+    std::string error;          // set if decoding failed
+    FileSlot() : is_done(false) {}
+  };
+
+  Strings file_names_;
+  std::size_t max_buffered_bytes_;
+  unsigned int chunk_size_;  // records per chunk
+
+  std::mutex mutex_;
+  std::condition_variable cv_;
+  std::vector<FileSlot> slots_;
+  unsigned int next_file_;  // next file to be decoded
+  unsigned int cur_file_;   // file being read
+  std::size_t buffered_bytes_;
+  bool is_stopped_;
+  std::vector<std::thread> threads_;
+
+  // the chunk being read and the index of the next record in it
+  ChunkP cur_chunk_;
+  unsigned int cur_record_;
+
+  // whether decoders of files other than the one being read should wait
+  bool get_is_full(unsigned int i) const {
+    return i != cur_file_ && buffered_bytes_ >= max_buffered_bytes_;
+  }
+
+  void decode_files();
+
+  void decode_file(unsigned int i);
+
+  // pass a chunk of decoded records of file i to the reader, returns
+  // false if the prefetcher was stopped
+  bool push_chunk(unsigned int i, ChunkP chunk);
+
+ public:
+  /**
+     @param file_names the avro files to be read
+     @param n_threads number of files decoded concurrently
+     @param max_buffered_bytes maximal number of bytes of decoded records
+            waiting to be read, beyond the file being read
+     @param chunk_size number of records passed to the reader at once
+  */
+  AvroPrefetcher(const Strings& file_names, unsigned int n_threads,
+                 std::size_t max_buffered_bytes,
+                 unsigned int chunk_size = 16);
+
+  //! stops and joins all decoding threads
+  ~AvroPrefetcher();
+
+  //! returns the next record, or nullptr if none is left
+  /** The record remains valid until the next call.
+      @throw IOException if the file of the record could not be decoded
+  */
+  Record const* read_next();
+
+  //! the index of the file being read, or the number of files if all
+  //! files were read
+  unsigned int get_current_file_index() const { return cur_file_; }
+};
+
+IMPNPCTRANSPORT_END_INTERNAL_NAMESPACE
+
+#endif /* IMPNPCTRANSPORT_INTERNAL_AVRO_PREFETCHER_H */
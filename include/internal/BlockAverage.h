@@ -0,0 +1,96 @@
+/**
+ *  \file internal/BlockAverage.h
+ *  \brief online block averaging of correlated time series
+ *
+ *  Copyright 2007-2018 IMP Inventors. All rights reserved.
+ */
+
+#ifndef IMPNPCTRANSPORT_INTERNAL_BLOCK_AVERAGE_H
+#define IMPNPCTRANSPORT_INTERNAL_BLOCK_AVERAGE_H
+
+#include "../npctransport_config.h"
+#include <vector>
+
+IMPNPCTRANSPORT_BEGIN_INTERNAL_NAMESPACE
+
+/** Estimates the mean of a correlated time series and its standard
+    error by the blocking method of Flyvbjerg and Petersen (J. Chem.
+    Phys. 91:461, 1989), online and in memory logarithmic in the number
+    of samples.
+
+    Level k of the accumulator keeps the running sums of the means of
+    consecutive blocks of 2^k samples. The standard error estimated
+    from level k grows with k until blocks are longer than the
+    correlation time of the series, and then plateaus. The standard
+    error of the mean is taken from the first level at which the
+    estimate of the next level is within the statistical uncertainty
+    of that next estimate. If no such level is reached with enough
+    blocks, the series is not converged and the estimate of the
+    deepest level with enough blocks is used as a lower bound.
+*/
+class IMPNPCTRANSPORTEXPORT BlockAverage {
+ public:
+  struct Level {
+    unsigned int n; // number of complete blocks
+    double sum;     // sum of block means
+    double sum2;    // sum of squared block means
+    bool has_pending;
+    double pending; // mean of a block not yet paired into the next level
+    Level() : n(0), sum(0.0), sum2(0.0), has_pending(false), pending(0.0) {}
+  };
+  typedef std::vector<Level> Levels;
+
+ private:
+  Levels levels_;
+  unsigned int min_blocks_;
+
+ public:
+  /**
+     @param min_blocks minimal number of blocks in a level for its
+                       standard error estimate to be trusted
+  */
+  BlockAverage(unsigned int min_blocks = 16)
+    : min_blocks_(min_blocks) {}
+
+  //! restore an accumulator from levels returned by get_levels()
+  BlockAverage(Levels const& levels, unsigned int min_blocks = 16)
+    : levels_(levels), min_blocks_(min_blocks) {}
+
+  //! add the next sample of the time series
+  void add(double x);
+
+  Levels const& get_levels() const { return levels_; }
+
+  unsigned int get_number_of_samples() const {
+    return levels_.empty() ? 0 : levels_[0].n;
+  }
+
+  //! the mean of all samples
+  double get_mean() const;
+
+  //! the standard error of the mean estimated from blocks of 2^k samples
+  /** Returns 0 if level k has less than two blocks. */
+  double get_standard_error(unsigned int k) const;
+
+  //! the level whose standard error estimate is used
+  unsigned int get_plateau_level() const;
+
+  //! whether the standard error estimates have plateaued
+  bool get_is_converged() const;
+
+  //! the standard error of the mean, taking correlations into account
+  double get_standard_error() const {
+    return get_standard_error(get_plateau_level());
+  }
+
+  //! the number of samples per effectively independent sample
+  /** That is, the ratio between the squared standard error and the
+      squared standard error had the samples been uncorrelated */
+  double get_statistical_inefficiency() const;
+
+  void reset() { levels_.clear(); }
+};
+
+IMPNPCTRANSPORT_END_INTERNAL_NAMESPACE
+
+#endif /* IMPNPCTRANSPORT_INTERNAL_BLOCK_AVERAGE_H */
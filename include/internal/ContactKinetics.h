@@ -0,0 +1,168 @@
+/**
+ *  \file internal/ContactKinetics.h
+ *  \brief streaming residence times and rebinding intervals of contacts
+ *
+ *  Copyright 2007-2018 IMP Inventors. All rights reserved.
+ */
+
+#ifndef IMPNPCTRANSPORT_INTERNAL_CONTACT_KINETICS_H
+#define IMPNPCTRANSPORT_INTERNAL_CONTACT_KINETICS_H
+
+#include "../npctransport_config.h"
+#include <IMP/base_types.h>
+#include <IMP/types.h>
+#include <IMP/set_map_macros.h>
+#include <vector>
+
+IMPNPCTRANSPORT_BEGIN_INTERNAL_NAMESPACE
+
+/** A histogram of time intervals with logarithmically spaced bins,
+    bins_per_decade bins per decade starting at min_ns. Intervals
+    shorter than min_ns are counted in the first bin, and intervals
+    longer than the last bin are counted in the last bin. Intervals that
+    were not observed to end within the tracked time are counted
+    separately as censored.
+*/
+class IMPNPCTRANSPORTEXPORT LogTimeHistogram {
+ private:
+  double min_ns_;
+  double bins_per_decade_;
+  std::vector<int> counts_;
+  unsigned int n_censored_;
+
+ public:
+  LogTimeHistogram(double min_ns, double bins_per_decade,
+                   unsigned int n_bins);
+
+  double get_min_ns() const { return min_ns_; }
+
+  double get_bins_per_decade() const { return bins_per_decade_; }
+
+  unsigned int get_number_of_bins() const { return counts_.size(); }
+
+  //! returns the bin into which an interval of t_ns is counted
+  unsigned int get_bin(double t_ns) const;
+
+  void add(double t_ns) { counts_[get_bin(t_ns)]++; }
+
+  int get_count(unsigned int i) const { return counts_[i]; }
+
+  Ints get_counts() const { return Ints(counts_.begin(), counts_.end()); }
+
+  unsigned int get_total_count() const;
+
+  //! count an interval that was still open when it stopped being tracked
+  void add_censored() { n_censored_++; }
+
+  unsigned int get_number_of_censored() const { return n_censored_; }
+
+  void reset() {
+    counts_.assign(counts_.size(), 0);
+    n_censored_ = 0;
+  }
+};
+
+/** Tracks the binding kinetics of a set of contacts (pairs of
+    particles) from snapshots of the contacts that are present at
+    successive simulation times.
+
+    The start time of each present contact is kept in a hash table
+    keyed by the contact, and when a contact disappears its residence
+    time is added to a histogram. The time at which each contact was
+    last lost is kept as well, so that when it reforms the rebinding
+    interval is added to a second histogram. On each reset of the
+    histograms, contacts that were lost before the previous reset are
+    forgotten and counted as censored rebinding intervals, so memory
+    is bounded by the number of contacts present during the last two
+    statistics periods.
+
+    Contacts are assumed to form and break midway between the
+    snapshots in which they were first present and first missing, so
+    times are resolved only up to the interval between snapshots.
+*/
+class IMPNPCTRANSPORTEXPORT ContactKinetics {
+ private:
+  struct Contact {
+    double start_ns; // time the contact was first seen
+    unsigned int last_seen; // last snapshot in which it was present
+  };
+  typedef IMP_KERNEL_LARGE_UNORDERED_MAP<ParticleIndexPair, Contact>
+    t_contacts;
+  typedef IMP_KERNEL_LARGE_UNORDERED_MAP<ParticleIndexPair, double>
+    t_lost_contacts;
+  t_contacts contacts_;
+  t_lost_contacts lost_ns_; // time each lost contact was last lost
+  unsigned int n_snapshots_;
+  double last_time_ns_;
+  double last_reset_ns_; // time of the last reset_histograms()
+
+  LogTimeHistogram residence_times_;
+  LogTimeHistogram rebinding_intervals_;
+
+  // register pair as present in the current snapshot at time_ns
+  void add_contact(ParticleIndexPair const& pair, double time_ns);
+
+  // close all contacts not present in the current snapshot
+  void close_missing_contacts(double time_ns);
+
+ public:
+  /**
+     @param min_ns lower edge of the first histogram bin
+     @param bins_per_decade number of histogram bins per decade
+     @param n_bins number of histogram bins
+  */
+  ContactKinetics(double min_ns = 0.01, double bins_per_decade = 10,
+                  unsigned int n_bins = 80);
+
+  //! update with all contacts present at simulation time time_ns
+  /** Contacts are unordered particle index pairs, and time_ns
+      is expected to increase between calls.
+  */
+  template <class ContactsContainer>
+  void update(ContactsContainer const& contacts, double time_ns) {
+    ++n_snapshots_;
+    for (typename ContactsContainer::const_iterator it = contacts.begin();
+         it != contacts.end(); it++) {
+      add_contact(*it, time_ns);
+    }
+    close_missing_contacts(time_ns);
+    last_time_ns_ = time_ns;
+  }
+
+  //! number of contacts present in the last update
+  unsigned int get_number_of_contacts() const { return contacts_.size(); }
+
+  LogTimeHistogram const& get_residence_times() const
+  { return residence_times_; }
+
+  LogTimeHistogram const& get_rebinding_intervals() const
+  { return rebinding_intervals_; }
+
+  //! clear the histograms, but keep tracking present and recently lost
+  //! contacts, so their kinetics are accounted for in the next histograms
+  /** Contacts lost before the previous reset are forgotten, and counted
+      as censored in the next rebinding intervals histogram.
+  */
+  void reset_histograms();
+
+  //! the tracked contacts, from which tracking can be resumed
+  struct State {
+    ParticleIndexPairs contacts; // present in the last update
+    Floats start_ns; // start time of each present contact
+    ParticleIndexPairs lost_contacts; // recently lost
+    Floats lost_ns; // time each recently lost contact was lost
+    unsigned int n_snapshots;
+    double last_time_ns;
+    double last_reset_ns;
+  };
+
+  State get_state() const;
+
+  //! resume tracking the contacts in state, e.g. from a checkpoint of
+  //! a previous simulation (histograms are kept as is)
+  void set_state(State const& state);
+};
+
+IMPNPCTRANSPORT_END_INTERNAL_NAMESPACE
+
+#endif /* IMPNPCTRANSPORT_INTERNAL_CONTACT_KINETICS_H */
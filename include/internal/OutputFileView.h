@@ -0,0 +1,143 @@
+/**
+ *  \file internal/OutputFileView.h
+ *  \brief lazy read-only access to the fields of an output file
+ *
+ *  Copyright 2007-2018 IMP Inventors. All rights reserved.
+ */
+
+#ifndef IMPNPCTRANSPORT_INTERNAL_OUTPUT_FILE_VIEW_H
+#define IMPNPCTRANSPORT_INTERNAL_OUTPUT_FILE_VIEW_H
+
+#include "../npctransport_config.h"
+#include "../npctransport_proto.fwd.h"
+#include <RMF/BufferConstHandle.h>
+#include <boost/noncopyable.hpp>
+#include <cstddef>
+#include <ostream>
+#include <string>
+#include <vector>
+
+namespace npctransport_proto {
+  class Checkpoint;
+  class Conformation;
+}
+namespace google {
+  namespace protobuf {
+    class MessageLite;
+  }
+}
+
+IMPNPCTRANSPORT_BEGIN_INTERNAL_NAMESPACE
+
+/** A read-only view of an Output protobuf file, for restarting from it
+    without parsing the statistics accumulated in it, which make up most
+    of the file in long runs.
+
+    The file is memory-mapped, and its top-level fields are located by
+    scanning the protobuf wire format. Each field is decoded only
+    on demand, and fields can be copied verbatim to a new file.
+*/
+class IMPNPCTRANSPORTEXPORT OutputFileView : public boost::noncopyable {
+ public:
+  // field numbers of the Output message
+  enum Field {
+    ASSIGNMENT = 1,
+    STATISTICS = 2,
+    CONFORMATION = 3,
+    RMF_CONFORMATION = 4,
+    CHECKPOINT = 5
+  };
+
+ private:
+  struct FieldRecord {
+    int field_number;
+    std::size_t begin;         // offset of the tag of the field
+    std::size_t value_begin;   // offset of the value of the field
+    std::size_t end;           // offset past the end of the field
+  };
+  std::vector<FieldRecord> records_;
+  char const* data_;
+  std::size_t size_;
+  void* mapped_;
+  std::vector<char> buffer_;  // file contents if it cannot be mapped
+
+  void map_file(std::string fname);
+
+  // scan the top-level fields of a message in [begin, end)
+  static bool scan_fields(char const* data, std::size_t begin,
+                          std::size_t end,
+                          std::vector<FieldRecord>& records);
+
+  // the last record of the field, or nullptr if none
+  FieldRecord const* get_last_record(int field_number) const;
+
+  // merge all occurrences of a message field into msg, return true
+  // if there is at least one and msg is initialized
+  bool get_message_field(int field_number,
+                         ::google::protobuf::MessageLite* msg) const;
+
+ public:
+  //! map and scan file fname
+  /** @throw IOException if the file cannot be read or is corrupt */
+  OutputFileView(std::string fname);
+
+  //! scan an output message of size bytes at data, which must outlive
+  //! this view (e.g. an entry of an avro archive)
+  /** @throw IOException if the message is corrupt */
+  OutputFileView(char const* data, std::size_t size);
+
+  ~OutputFileView();
+
+  bool get_has_field(int field_number) const {
+    return get_last_record(field_number) != nullptr;
+  }
+
+  //! parse the assignment field into assignment
+  /** @return true if successful */
+  bool get_assignment(::npctransport_proto::Assignment* assignment) const;
+
+  //! parse the (legacy) conformation field into conformation
+  /** @return true if successful */
+  bool get_conformation
+    (::npctransport_proto::Conformation* conformation) const;
+
+  //! parse the checkpoint field into checkpoint
+  /** @return true if successful */
+  bool get_checkpoint(::npctransport_proto::Checkpoint* checkpoint) const;
+
+  //! the RMF conformation, copied once from the mapped file
+  RMF::BufferConstHandle get_rmf_conformation() const;
+
+  //! whether the statistics field has a bd_simulation_time_ns field
+  bool get_has_bd_simulation_time_ns() const;
+
+  //! the bd_simulation_time_ns field of the statistics field,
+  //! decoded without parsing the rest of the statistics
+  double get_bd_simulation_time_ns() const;
+
+  //! the number_of_frames field of the statistics field, i.e. the
+  //! frames for which statistics were gathered, decoded without parsing
+  //! the rest of the statistics
+  int get_number_of_frames() const;
+
+  //! whether the interrupted field of the statistics field is set,
+  //! decoded without parsing the rest of the statistics
+  bool get_is_interrupted() const;
+
+  //! the random_number_generator_state field of the checkpoint field,
+  //! decoded without parsing the rest of the checkpoint, or an empty
+  //! string if there is none
+  std::string get_random_number_generator_state() const;
+
+  //! write all fields except field_number verbatim to out
+  /** If is_clear_interrupted is true, the interrupted field is dropped
+      from the statistics field, and all other statistics are still
+      copied verbatim.
+  */
+  void write_fields_except(int field_number, std::ostream& out,
+                           bool is_clear_interrupted = false) const;
+};
+
+IMPNPCTRANSPORT_END_INTERNAL_NAMESPACE
+
+#endif /* IMPNPCTRANSPORT_INTERNAL_OUTPUT_FILE_VIEW_H */
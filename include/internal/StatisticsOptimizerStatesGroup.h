@@ -0,0 +1,136 @@
+/**
+ * \file internal/StatisticsOptimizerStatesGroup.h
+ * \brief runs statistics optimizer states of the same frame concurrently
+ *
+ *  Copyright 2007-2018 IMP Inventors. All rights reserved.
+ */
+
+#ifndef IMPNPCTRANSPORT_INTERNAL_STATISTICS_OPTIMIZER_STATES_GROUP_H
+#define IMPNPCTRANSPORT_INTERNAL_STATISTICS_OPTIMIZER_STATES_GROUP_H
+
+#include "../npctransport_config.h"
+#include <IMP/Pointer.h>
+#include <IMP/atom/Simulator.h>
+#include <IMP/core/PeriodicOptimizerState.h>
+#include <string>
+
+IMPNPCTRANSPORT_BEGIN_INTERNAL_NAMESPACE
+
+/**
+   A simulator that does not simulate anything, and only mirrors the
+   current time and maximal time step of another simulator. Optimizer
+   states that are added to it can query simulation time from
+   get_optimizer() the same way as if they were added to the mirrored
+   simulator, while being updated by someone else.
+*/
+class StatisticsClock : public atom::Simulator {
+ public:
+  StatisticsClock(Model* m, std::string name = "StatisticsClock%1%")
+    : atom::Simulator(m, name) {}
+
+  //! copy the current time and maximal time step of s
+  void synchronize_with(atom::Simulator const* s) {
+    set_current_time(s->get_current_time());
+    set_maximum_time_step(s->get_maximum_time_step());
+  }
+
+ protected:
+  virtual double do_step(const ParticleIndexes&, double) IMP_OVERRIDE {
+    IMP_THROW("StatisticsClock cannot simulate", UsageException);
+  }
+
+  virtual bool get_is_simulation_particle(ParticleIndex) const IMP_OVERRIDE {
+    return false;
+  }
+
+ public:
+  IMP_OBJECT_METHODS(StatisticsClock);
+};
+
+/**
+   Updates a group of periodic statistics optimizer states of the
+   same period in a single optimizer state, instead of adding each of
+   them to the simulator. Each update, all serial states are first
+   updated one after the other in the order they were added, and then
+   all parallel states are updated concurrently (when OpenMP is
+   enabled), each as a separate task. Serial states are those that
+   modify the model, e.g. because they evaluate scoring functions (which
+   updates score states and derivatives), so they may not run
+   concurrently with any other state.
+
+   Parallel states must only read the model, and not modify any state
+   shared with other member states during their updates - results are
+   collected (merged) from each state serially by their owner (e.g.
+   Statistics::update()) after the group update.
+
+   Member states query time from a StatisticsClock that mirrors the
+   simulator to which this group was added.
+
+   If the group was added to a BrownianDynamicsTAMDWithSlabSupport
+   simulator, the particles registered with add_read_particles() are
+   landed from free flight before each update. Other particles in flight
+   are isolated from all others, so they do not affect states that only
+   evaluate the scoring function.
+*/
+class StatisticsOptimizerStatesGroup : public core::PeriodicOptimizerState {
+ private:
+  typedef core::PeriodicOptimizerState P;
+  PointerMember<StatisticsClock> clock_;
+  IMP::Vector<PointerMember<core::PeriodicOptimizerState> > serial_states_;
+  IMP::Vector<PointerMember<core::PeriodicOptimizerState> > parallel_states_;
+  ParticleIndexes read_pis_;
+
+  void update_serial_states();
+
+ public:
+  /**
+     @param m the model
+     @param periodicity frame interval for updating all member states,
+                        which overrides the period of each of them
+  */
+  StatisticsOptimizerStatesGroup(Model* m, unsigned int periodicity = 1);
+
+  ~StatisticsOptimizerStatesGroup();
+
+  //! add os to be updated after all previously added serial states,
+  //! and before all parallel states
+  void add_serial_optimizer_state(core::PeriodicOptimizerState* os);
+
+  //! add os to be updated concurrently with all other parallel states,
+  //! so os may only read the model
+  void add_parallel_optimizer_state(core::PeriodicOptimizerState* os);
+
+  //! remove os from the group, if it is in it
+  void remove_optimizer_state(OptimizerState* os);
+
+  //! remove all states from the group
+  void clear_optimizer_states();
+
+  //! register pis as particles whose coordinates are read by member
+  //! states, so they are landed from free flight before each update
+  void add_read_particles(const ParticleIndexes& pis) {
+    read_pis_.insert(read_pis_.end(), pis.begin(), pis.end());
+  }
+
+  //! set the time of the clock of member states to that of s
+  /** This is done automatically on each update, and is needed only if
+      member states are updated or queried outside of the group
+  */
+  void synchronize_clock_with(atom::Simulator const* s) {
+    clock_->synchronize_with(s);
+  }
+
+  unsigned int get_number_of_optimizer_states() const {
+    return serial_states_.size() + parallel_states_.size();
+  }
+
+  virtual void do_update(unsigned int call_num) IMP_OVERRIDE;
+
+  IMP_OBJECT_METHODS(StatisticsOptimizerStatesGroup);
+};
+
+IMP_OBJECTS(StatisticsOptimizerStatesGroup, StatisticsOptimizerStatesGroups);
+
+IMPNPCTRANSPORT_END_INTERNAL_NAMESPACE
+
+#endif /* IMPNPCTRANSPORT_INTERNAL_STATISTICS_OPTIMIZER_STATES_GROUP_H */
@@ -11,6 +11,7 @@
 #include "../npctransport_config.h"
 #include <IMP/npctransport/ParticleFactory.h>
 #include <IMP/npctransport/FGChain.h>
+#include "TAMDForest.h"
 #include <IMP/atom/Hierarchy.h>
 #include <IMP/core/DistancePairScore.h>
 #include <string>
@@ -37,17 +38,17 @@ class TAMDChain : public npctransport::FGChain{
     beads - fine chain particles
     centroids - the list of centroids in tree(p)
     images - corresponding TAMD images for each centroid in centroids
-    tamd_restraints - corresponding springs that attch each TAMD
-                       image to each centroid
-    tamd_springs - springs stored in R (in same order)
+    tamd_springs - corresponding springs that attach each TAMD
+                   image to each centroid
+    tamd_springs_restraint - a single restraint on all tamd_springs
   */
   typedef npctransport::FGChain P;
  private:
   // TODO: keep those in the hierarchy?
   IMP::Particles centroids_;
   IMP::Particles images_;
-  IMP::Restraints tamd_restraints_;
   core::HarmonicDistancePairScores tamd_springs_;
+  PointerMember<TAMDImageSpringsRestraint> tamd_springs_restraint_;
   bool is_initialized;
 
  private:
@@ -71,7 +72,8 @@ class TAMDChain : public npctransport::FGChain{
      - Add d children and n beads generated by pf to chain root;
      - T_factors, F_factors and Ks are TAMD params as in
        create_tamd_chain()
-     - Set root as centroid of its children (with updated list);
+     - Set root mass to the total mass of its children (its coordinates
+       are maintained by the TAMDForest of the model, see get_tamd_forest());
      - Assumes root is not null
   */
   void add_children
@@ -134,7 +136,8 @@ class TAMDChain : public npctransport::FGChain{
                        unsigned int d,
                        std::vector<double> T_factors,
                        std::vector<double> F_factors,
-                       std::vector<double> Ks );
+                       std::vector<double> Ks,
+                       bool is_add_to_forest );
 
   friend TAMDChain*
     create_singleton_tamd_chain( ParticleFactory* pf);
@@ -160,6 +163,10 @@ class TAMDChain : public npctransport::FGChain{
                     at each level from top to bottom
      @param Ks      Spring constants at each level between a particle and its TAMD
                     image (a list of length nlevels)
+     @param is_add_to_forest if true, the centroids of the chain are
+                    maintained by the TAMD forest of the model from now on
+                    (see get_tamd_forest()). Only false for sub-chains
+                    that are added to a parent chain.
 
      @return a tuple with <root particle, centroids, images, restraints>
 */
@@ -169,7 +176,8 @@ create_tamd_chain( ParticleFactory* pf,
                    unsigned int d,
                    std::vector<double> T_factors,
                    std::vector<double> F_factors,
-                   std::vector<double> Ks );
+                   std::vector<double> Ks,
+                   bool is_add_to_forest = true );
 
 
 //! create a degenerate TAMDChain with a single bead (that is also the root),
@@ -0,0 +1,143 @@
+/**
+ * \file internal/TAMDForest.h
+ * \brief flattened representation of all TAMD hierarchies in a model
+ *
+ *  Copyright 2007-2018 IMP Inventors. All rights reserved.
+ */
+
+#ifndef IMPNPCTRANSPORT_INTERNAL_TAMD_FOREST_H
+#define IMPNPCTRANSPORT_INTERNAL_TAMD_FOREST_H
+
+#include "../npctransport_config.h"
+#include "../FGChain.h"
+#include <IMP/Restraint.h>
+#include <IMP/ScoreState.h>
+#include <IMP/WeakPointer.h>
+#include <IMP/core/DistancePairScore.h>
+#include <string>
+
+IMPNPCTRANSPORT_BEGIN_INTERNAL_NAMESPACE
+
+class TAMDChain; // fwd incomplete declaration
+
+/**
+   Maintains the centroids of all TAMD chains that were added to it,
+   replacing a CenterOfMass constraint per centroid. The hierarchies
+   are flattened once into arrays in which the centroids of each chain
+   are stored contiguously, children before parents, so that updating
+   all centroids is a single bottom-up pass (parallel across chains)
+   with no hierarchy traversal.
+
+   Centroid derivatives are distributed back to their children by
+   mass fraction after evaluation, same as CenterOfMass.
+
+   Each model has a single forest, see get_tamd_forest(), to which TAMD
+   chains are added when they are created by create_tamd_chain().
+*/
+class TAMDForest : public ScoreState {
+ private:
+  // TAMD chains, kept alive by the forest
+  IMP::Vector< PointerMember<FGChain> > chains_;
+
+  // flattened centroids of all chains, children before parents
+  ParticleIndexes centroids_;
+  // TAMD images of each centroid in centroids_
+  ParticleIndexes images_;
+  // children of centroids_[i] are children_[children_begin_[i]] ...
+  // children_[children_begin_[i+1]-1], with mass fractions in weights_
+  Ints children_begin_;
+  ParticleIndexes children_;
+  Floats weights_;
+  // centroids of chains_[j] are centroids_[trees_begin_[j]] ...
+  // centroids_[trees_begin_[j+1]-1]
+  Ints trees_begin_;
+
+ public:
+  TAMDForest(Model* m, std::string name = "TAMDForest%1%");
+
+  //! add the centroids of chain to the forest, in time linear in the
+  //! size of chain
+  void add_chain(TAMDChain* chain);
+
+  //! remove chain from the forest, if it was added (this flattens all
+  //! remaining chains again)
+  void remove_chain(TAMDChain* chain);
+
+  unsigned int get_number_of_chains() const
+  { return chains_.size(); }
+
+  unsigned int get_number_of_centroids() const
+  { return centroids_.size(); }
+
+  //! recompute the coordinates of all centroids from their children
+  void update_centroids();
+
+  //! update all centroids and move each TAMD image onto its centroid
+  void reset_images_to_centroids();
+
+  virtual void do_before_evaluate() IMP_OVERRIDE;
+  virtual void do_after_evaluate(DerivativeAccumulator *da) IMP_OVERRIDE;
+  virtual ModelObjectsTemp do_get_inputs() const IMP_OVERRIDE;
+  virtual ModelObjectsTemp do_get_outputs() const IMP_OVERRIDE;
+  IMP_OBJECT_METHODS(TAMDForest);
+
+ private:
+  // flatten all trees in chains_ from scratch
+  void rebuild();
+
+  // append the flattened tree of chain to the forest
+  void add_tree(TAMDChain* chain);
+
+  // update the centroids of chains_[j]
+  void update_tree_centroids(unsigned int j);
+
+  // distribute the centroid derivatives of chains_[j] to their leaves
+  void distribute_tree_derivatives(unsigned int j,
+                                   DerivativeAccumulator& da);
+};
+
+IMP_OBJECTS(TAMDForest, TAMDForests);
+
+//! returns the TAMD forest of model m, which is created and added to m
+//! as a score state on first use
+TAMDForest* get_tamd_forest(Model* m);
+
+
+/**
+   All TAMD springs of a single chain, each tying a centroid to its
+   image, evaluated in one loop over contiguous arrays instead of a
+   PairRestraint per image. The spring constants are read from the
+   chain's HarmonicDistancePairScores on every evaluation, so scaling
+   them (e.g. by TAMDChainScaleKRAII) takes effect immediately.
+*/
+class TAMDImageSpringsRestraint : public Restraint {
+ private:
+  ParticleIndexes centroids_;
+  ParticleIndexes images_;
+  core::HarmonicDistancePairScores springs_;
+
+ public:
+  /**
+     @param m the model
+     @param centroids centroid particles
+     @param images TAMD images of centroids
+     @param springs zero rest-length springs between each centroid
+                    and its image
+     @param name restraint name
+  */
+  TAMDImageSpringsRestraint(Model* m,
+                            const ParticleIndexes& centroids,
+                            const ParticleIndexes& images,
+                            const core::HarmonicDistancePairScores& springs,
+                            std::string name = "TAMDImageSprings%1%");
+
+  virtual double unprotected_evaluate(DerivativeAccumulator *da) const
+    IMP_OVERRIDE;
+  virtual ModelObjectsTemp do_get_inputs() const IMP_OVERRIDE;
+  IMP_OBJECT_METHODS(TAMDImageSpringsRestraint);
+};
+
+IMPNPCTRANSPORT_END_INTERNAL_NAMESPACE
+
+
+#endif /* IMPNPCTRANSPORT_INTERNAL_TAMD_FOREST_H */
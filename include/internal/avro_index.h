@@ -0,0 +1,64 @@
+/**
+ *  \file internal/avro_index.h
+ *  \brief random-access indexes of avro archives of output files
+ *
+ *  Copyright 2007-2018 IMP Inventors. All rights reserved.
+ */
+
+#ifndef IMPNPCTRANSPORT_INTERNAL_AVRO_INDEX_H
+#define IMPNPCTRANSPORT_INTERNAL_AVRO_INDEX_H
+
+#include "../npctransport_config.h"
+#include "../npctransport_proto.fwd.h"
+#include <set>
+#include <string>
+#include <stdint.h>
+
+IMPNPCTRANSPORT_BEGIN_INTERNAL_NAMESPACE
+
+//! a hash of assignment that identifies its parameters, ignoring its
+//! work unit, random seed, module versions and stored configuration hash
+IMPNPCTRANSPORTEXPORT uint64_t get_configuration_hash
+( ::npctransport_proto::Assignment const& assignment );
+
+//! the configuration hash of assignment when it was assigned, as stored
+//! in it by assign_ranges(), or its current hash if none was stored
+/** Unlike get_configuration_hash(), this is not affected by defaults
+    and adjustments that are applied to the assignment at run time. */
+IMPNPCTRANSPORTEXPORT uint64_t get_assigned_configuration_hash
+( ::npctransport_proto::Assignment const& assignment );
+
+//! index all entries of the avro archive avro_filename into index,
+//! parsing only the assignment of each entry
+/** @throw IOException if the archive cannot be read */
+IMPNPCTRANSPORTEXPORT void build_avro_index
+( std::string avro_filename, ::npctransport_proto::AvroArchiveIndex* index );
+
+//! load the index file of avro_filename into index
+/** @return false if there is no index file, or if it is out of date,
+            i.e. the size or modification time of the archive changed
+            since it was indexed */
+IMPNPCTRANSPORTEXPORT bool load_avro_index
+( std::string avro_filename, ::npctransport_proto::AvroArchiveIndex* index );
+
+//! write index as the index file of avro_filename
+/** @return false if the index file could not be written */
+IMPNPCTRANSPORTEXPORT bool save_avro_index
+( std::string avro_filename,
+  ::npctransport_proto::AvroArchiveIndex const& index );
+
+//! the key of an output in avro archives, made of the work unit and
+//! random seed of its assignment
+IMPNPCTRANSPORTEXPORT std::string get_avro_key
+( ::npctransport_proto::Assignment const& assignment );
+
+//! the keys of all entries of the avro archive avro_filename, read from
+//! its index if it is up to date, or none if the archive is missing or
+//! empty
+/** @throw IOException if the archive cannot be read */
+IMPNPCTRANSPORTEXPORT std::set<std::string> get_avro_archive_keys
+( std::string avro_filename );
+
+IMPNPCTRANSPORT_END_INTERNAL_NAMESPACE
+
+#endif /* IMPNPCTRANSPORT_INTERNAL_AVRO_INDEX_H */
@@ -0,0 +1,231 @@
+/**
+ *  \file internal/body_statistics_estimators.h
+ *  \brief streaming estimators of diffusion coefficients and rotational
+ *         correlation times
+ *
+ *  Copyright 2007-2018 IMP Inventors. All rights reserved.
+ */
+
+#ifndef IMPNPCTRANSPORT_INTERNAL_BODY_STATISTICS_ESTIMATORS_H
+#define IMPNPCTRANSPORT_INTERNAL_BODY_STATISTICS_ESTIMATORS_H
+
+#include "../npctransport_config.h"
+#include <IMP/algebra/Rotation3D.h>
+#include <IMP/algebra/Vector3D.h>
+#include <IMP/check_macros.h>
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <vector>
+
+IMPNPCTRANSPORT_BEGIN_INTERNAL_NAMESPACE
+
+/** Accumulates displacements of a single particle and estimates its
+    diffusion coefficient the same way as atom::get_diffusion_coefficient()
+    does from the full list of displacements and time steps - the
+    variance of the displacement along each axis, normalized by 2*dt per
+    displacement, averaged over the three axes.
+
+    Only sums are kept, so each displacement is added in O(1) time and
+    memory does not grow with the number of samples.
+*/
+class DiffusionCoefficientEstimator {
+ private:
+  unsigned int n_;
+  double sum_inv_dt_; // sum of 1/dt
+  double sum_d_[3]; // sum of d
+  double sum_d_over_dt_[3]; // sum of d/dt
+  double sum_d2_over_dt_[3]; // sum of d^2/dt
+
+ public:
+  DiffusionCoefficientEstimator() { reset(); }
+
+  void reset() {
+    n_ = 0;
+    sum_inv_dt_ = 0.0;
+    for (unsigned int i = 0; i < 3; i++) {
+      sum_d_[i] = sum_d_over_dt_[i] = sum_d2_over_dt_[i] = 0.0;
+    }
+  }
+
+  //! add displacement d that took place over time dt
+  void add_displacement(const algebra::Vector3D& d, double dt) {
+    IMP_USAGE_CHECK(dt > 0.0, "time step must be positive");
+    double inv_dt = 1.0 / dt;
+    n_++;
+    sum_inv_dt_ += inv_dt;
+    for (unsigned int i = 0; i < 3; i++) {
+      sum_d_[i] += d[i];
+      sum_d_over_dt_[i] += d[i] * inv_dt;
+      sum_d2_over_dt_[i] += d[i] * d[i] * inv_dt;
+    }
+  }
+
+  unsigned int get_number_of_displacements() const { return n_; }
+
+  //! the estimated diffusion coefficient, or 0 if no displacements
+  //! were added
+  double get_diffusion_coefficient() const {
+    if (n_ == 0) {
+      return 0.0;
+    }
+    double D = 0.0;
+    for (unsigned int i = 0; i < 3; i++) {
+      // sum((d-mean)^2/dt) expanded into the accumulated sums
+      double mean = sum_d_[i] / n_;
+      double sum_sq = sum_d2_over_dt_[i] - 2.0 * mean * sum_d_over_dt_[i]
+        + mean * mean * sum_inv_dt_;
+      D += sum_sq / (2.0 * n_);
+    }
+    return D / 3.0;
+  }
+};
+
+/** Estimates the rotational correlation time of a body from the
+    autocorrelation of its orientation C(t) = <u(0).u(t)>, averaged over
+    the three body axes u (one for free rotational diffusion at rate D_r
+    decays as exp(-2 D_r t)). The correlation time is the lag at which C
+    drops below 1/e, interpolated exponentially between tabulated lags.
+
+    C is computed by a multi-tau correlator (Ramirez et al., J Chem Phys
+    133:154103, 2010). Level 0 correlates each orientation with the last
+    p ones, and level l>0 correlates averages of blocks of 2^l
+    consecutive orientations at lags p/2..p-1 in units of 2^l updates,
+    so lags of up to p*2^(n_levels-1) updates are covered, with O(p)
+    amortized time per update and O(p*n_levels) memory. Memory is only
+    allocated on the first update.
+*/
+class RotationalCorrelationTimeEstimator {
+ private:
+  // the body axes of an orientation, or their average over a block
+  struct Axes {
+    double x[9];
+  };
+  struct Level {
+    std::vector<Axes> entries; // the last p entries, in a ring buffer
+    unsigned int n; // number of entries added so far
+    Axes pending; // sum of entries not averaged into the next level yet
+    unsigned int n_pending;
+    std::vector<double> sum_correlations; // at lag j in the j'th entry
+    std::vector<unsigned int> n_correlations;
+  };
+  unsigned int p_;
+  unsigned int n_levels_;
+  std::vector<Level> levels_;
+
+  void add(unsigned int l, Axes const& a) {
+    Level& level = levels_[l];
+    level.entries[level.n % p_] = a;
+    level.n++;
+    unsigned int n_lags = std::min(level.n, p_);
+    for (unsigned int j = (l == 0 ? 0 : p_ / 2); j < n_lags; j++) {
+      Axes const& b = level.entries[(level.n - 1 - j) % p_];
+      double c = 0.0;
+      for (unsigned int k = 0; k < 9; k++) {
+        c += a.x[k] * b.x[k];
+      }
+      level.sum_correlations[j] += c / 3.0;
+      level.n_correlations[j]++;
+    }
+    if (l + 1 == n_levels_) {
+      return;
+    }
+    for (unsigned int k = 0; k < 9; k++) {
+      level.pending.x[k] += a.x[k];
+    }
+    if (++level.n_pending == 2) {
+      Axes average;
+      for (unsigned int k = 0; k < 9; k++) {
+        average.x[k] = 0.5 * level.pending.x[k];
+        level.pending.x[k] = 0.0;
+      }
+      level.n_pending = 0;
+      add(l + 1, average);
+    }
+  }
+
+ public:
+  /**
+     @param p number of lags per level (even)
+     @param n_levels number of levels
+  */
+  RotationalCorrelationTimeEstimator(unsigned int p = 8,
+                                     unsigned int n_levels = 12)
+    : p_(p), n_levels_(n_levels) {
+    IMP_USAGE_CHECK(p >= 2 && p % 2 == 0 && n_levels > 0,
+                    "invalid multi-tau correlator parameters");
+  }
+
+  void reset() { levels_.clear(); }
+
+  //! the longest lag that is tracked, in units of updates
+  unsigned int get_maximal_lag() const {
+    return (p_ - 1) << (n_levels_ - 1);
+  }
+
+  //! add the orientation of the body in the next update
+  void add_rotation(const algebra::Rotation3D& rot) {
+    if (levels_.empty()) {
+      Level level;
+      level.entries.resize(p_);
+      level.n = 0;
+      std::fill(level.pending.x, level.pending.x + 9, 0.0);
+      level.n_pending = 0;
+      level.sum_correlations.assign(p_, 0.0);
+      level.n_correlations.assign(p_, 0);
+      levels_.assign(n_levels_, level);
+    }
+    Axes a;
+    for (unsigned int i = 0; i < 3; i++) {
+      algebra::Vector3D e(0.0, 0.0, 0.0);
+      e[i] = 1.0;
+      algebra::Vector3D u = rot.get_rotated(e);
+      for (unsigned int k = 0; k < 3; k++) {
+        a.x[3 * i + k] = u[k];
+      }
+    }
+    add(0, a);
+  }
+
+  //! the autocorrelation of the orientation at lag j * 2^l updates, or 0
+  //! if it was not sampled yet
+  double get_correlation(unsigned int l, unsigned int j) const {
+    if (l >= levels_.size() || levels_[l].n_correlations[j] == 0) {
+      return 0.0;
+    }
+    return levels_[l].sum_correlations[j] / levels_[l].n_correlations[j];
+  }
+
+  //! the correlation time in units of updates, or infinity if the
+  //! autocorrelation did not drop below 1/e within the sampled lags
+  double get_correlation_time() const {
+    double const threshold = std::exp(-1.0);
+    double last_lag = 0.0;
+    double last_c = 1.0;
+    for (unsigned int l = 0; l < levels_.size(); l++) {
+      for (unsigned int j = (l == 0 ? 0 : p_ / 2); j < p_; j++) {
+        if (levels_[l].n_correlations[j] == 0) {
+          continue;
+        }
+        double lag = std::ldexp(static_cast<double>(j), l);
+        double c = get_correlation(l, j);
+        if (c < threshold) {
+          if (c <= 0.0) {
+            return last_lag +
+              (lag - last_lag) * (last_c - threshold) / (last_c - c);
+          }
+          // exact for an exponential decay between the two lags
+          return last_lag + (lag - last_lag) * (std::log(last_c) + 1.0)
+            / (std::log(last_c) - std::log(c));
+        }
+        last_lag = lag;
+        last_c = c;
+      }
+    }
+    return std::numeric_limits<double>::infinity();
+  }
+};
+
+IMPNPCTRANSPORT_END_INTERNAL_NAMESPACE
+
+#endif /* IMPNPCTRANSPORT_INTERNAL_BODY_STATISTICS_ESTIMATORS_H */
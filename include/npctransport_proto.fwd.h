@@ -16,6 +16,8 @@ namespace npctransport_proto {
   class Assignment;
   class Configuration;
   class Statistics;
+  class Output;
+  class AvroArchiveIndex;
   class Assignment_FGAssignment;
   class Assignment_InteractionAssignment;
   class Assignment_FloaterAssignment;
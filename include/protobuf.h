@@ -9,6 +9,7 @@
 #define IMPNPCTRANSPORT_PROTOBUF_H
 
 #include "npctransport_config.h"
+#include "work_unit_cost.h"
 #include <IMP/SingletonContainer.h>
 #include <IMP/core/Typed.h>
 #include <boost/cstdint.hpp>
@@ -18,6 +19,7 @@
 // instead of including protobuf header, which is problematic due to
 // minor issue with google headers namespaces
 namespace npctransport_proto {
+  class Checkpoint;
   class Conformation;
   class Output;
 }
@@ -25,6 +27,8 @@ namespace npctransport_proto {
 
 IMPNPCTRANSPORT_BEGIN_NAMESPACE
 
+class SimulationData;
+
 
 IMPNPCTRANSPORTEXPORT void show_ranges(std::string fname);
 
@@ -69,7 +73,56 @@ IMPNPCTRANSPORTEXPORT int assign_ranges(
 IMPNPCTRANSPORTEXPORT int get_number_of_work_units(
     std::string configuration_file);
 
+/**
+   Enumerates all work units of the configuration in configuration_file
+   in one pass, and writes a WorkUnitsManifest protobuf to manifest_file
+   with the range indexes of each work unit and the configuration hash
+   of its assignment, which assign_ranges() stores in the assignment of
+   the work unit, and which avro archive indexes read from there. The
+   hash ignores the work unit and random seed, and is not affected by
+   defaults and adjustments applied when the work unit is run, so that
+   planned work units can be matched against archived outputs, and
+   launchers of a sweep need not parse the configuration once
+   per work unit. The estimated run time and memory of each work unit
+   are also written, based on calibration, so that launchers can pack
+   work units of similar cost together.
+
+   @return the number of work units
+*/
+IMPNPCTRANSPORTEXPORT int write_work_units_manifest(
+    std::string configuration_file, std::string manifest_file,
+    const CostCalibration& calibration = CostCalibration());
+
+/**
+   Writes output file output_fname for restarting a simulation from the
+   output file prev_output_fname. Only the assignment of the previous
+   output is parsed: the interaction k factor of floaters whose type
+   begins with "kap" is multiplied by kap_interaction_k_factor, and the
+   random seed is set to random_seed unless the checkpoint saved the
+   state of the random number generator, as its sequence is then resumed.
+   The interrupted flag is dropped from the statistics, and all other
+   fields, notably the statistics accumulated in long runs, are copied
+   verbatim. prev_output_fname and output_fname may be the same file.
+
+   @return the state of the random number generator saved in the
+           checkpoint of prev_output_fname, or an empty string if none
+
+   @throw IOException if prev_output_fname cannot be read
+*/
+IMPNPCTRANSPORTEXPORT std::string write_restart_output_file(
+    std::string prev_output_fname, std::string output_fname,
+    double kap_interaction_k_factor,
+    boost::uint64_t random_seed);
+
 #ifndef SWIG
+/**
+   Multiplies the interaction k factor of all floaters in assignment
+   whose type begins with "kap" by kap_interaction_k_factor
+*/
+void adjust_kap_interaction_k_factors
+( ::npctransport_proto::Assignment* assignment,
+  double kap_interaction_k_factor );
+
 /**
    Loads a protobuf conformation into the diffusers and sites
 
@@ -105,6 +158,42 @@ void save_pb_conformation
   const boost::unordered_map<core::ParticleType, algebra::Sphere3Ds> &sites,
   ::npctransport_proto::Conformation *conformation );
 
+/**
+   Saves a compact checkpoint of the dynamic state of the simulation in
+   sd: the coordinates of all particles with optimized coordinates, the
+   rotations of rigid bodies, the rest lengths of relaxing springs, the
+   transport state of Transporting particles, the pore radius, the
+   state of the random number generator and the contacts that interaction
+   statistics track across updates. Particles are stored by their
+   ordinal among all particles of the model. Particles in free flight
+   are landed first (see
+   BrownianDynamicsTAMDWithSlabSupport::synchronize_free_diffusion_flights()),
+   so that the checkpoint holds their current coordinates.
+
+   \see load_pb_checkpoint
+*/
+void save_pb_checkpoint
+( SimulationData* sd,
+  ::npctransport_proto::Checkpoint* checkpoint );
+
+/**
+   Restores the dynamic state of the simulation in sd from a checkpoint
+   saved by save_pb_checkpoint() for a simulation created from the same
+   assignment. Interaction statistics of sd are resumed from the
+   checkpoint, so they must have been added to sd beforehand.
+
+   @param checkpoint the checkpoint
+   @param sd the simulation data to be updated
+   @param is_restore_random_number_generator if true, also restore
+          the state of the random number generator, if saved
+
+   @throw ValueException if the checkpoint does not match the model of sd
+*/
+void load_pb_checkpoint
+( const ::npctransport_proto::Checkpoint& checkpoint,
+  SimulationData* sd,
+  bool is_restore_random_number_generator = false );
+
 //! load file output_fname into protobuf output object output
 //! return true if succesful
 bool load_output_protobuf(std::string output_fname,
@@ -60,7 +60,7 @@ class IMPNPCTRANSPORTEXPORT HierarchyWithSitesLoadLink
   /** load the values of a hierarchy. also
       loads dynamic Transporting decorator transport directionality
       information if needed (which is used in
-      ParticleTransportStatisticsOptimizerState)
+      ParticlesTransportStatisticsOptimizerState)
   */
   virtual void do_load_hierarchy(RMF::NodeConstHandle root_node,
                                  Model *m,
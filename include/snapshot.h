@@ -0,0 +1,73 @@
+/**
+ *  \file snapshot.h
+ *  \brief snapshots of initialized models, shared by work units of the
+ *         same geometry
+ *
+ *  Copyright 2007-2018 IMP Inventors. All rights reserved.
+ */
+
+#ifndef IMPNPCTRANSPORT_SNAPSHOT_H
+#define IMPNPCTRANSPORT_SNAPSHOT_H
+
+#include "npctransport_config.h"
+#include <boost/cstdint.hpp>
+#include <string>
+
+IMPNPCTRANSPORT_BEGIN_NAMESPACE
+
+class SimulationData;
+
+/**
+   A hash of everything that determines the initial conformation of
+   the model of sd up to its random seed: the fields of its assignment
+   other than interaction parameters, run lengths and statistics
+   settings, and the coordinates of all particles whose coordinates are
+   not optimized, such as FG anchors and obstacles. Work units of a
+   sweep over interaction parameters thus share the same hash.
+*/
+IMPNPCTRANSPORTEXPORT boost::uint64_t get_geometry_hash(SimulationData* sd);
+
+/**
+   The file of the snapshot of the model of sd in snapshot_dir, for
+   models initialized with short_init_factor (see initialize_positions()).
+
+   Each geometry has a pool of n_snapshots snapshots, and the model of
+   sd uses the one indexed by the random seed of its assignment modulo
+   n_snapshots, so that replicates of a work unit do not all start from
+   the same initialized conformation.
+*/
+IMPNPCTRANSPORTEXPORT std::string get_snapshot_file_name
+( std::string snapshot_dir, SimulationData* sd,
+  double short_init_factor = 1.0, unsigned int n_snapshots = 1 );
+
+/**
+   Saves a snapshot of the initialized model of sd to snapshot_file:
+   the coordinates of its particles, rest lengths of relaxing springs
+   and pore radius, as in checkpoints (see save_pb_checkpoint()), but
+   without the state of statistics, transport tracking and the random
+   number generator. The file is replaced at once, so that concurrent
+   runs can share snapshots. Snapshots should be saved right after
+   initialize_positions(), which does not apply interaction potentials,
+   and before any relaxation that does, since they are shared by models
+   with different interaction parameters.
+
+   @throw IOException if the file cannot be written
+*/
+IMPNPCTRANSPORTEXPORT void save_snapshot
+( SimulationData* sd, std::string snapshot_file );
+
+/**
+   Initializes the model of sd from a snapshot saved by save_snapshot()
+   for a model with the same geometry hash, instead of initializing its
+   positions. All scores are those of sd, so models may differ from the
+   snapshot in their interaction parameters.
+
+   @return false if there is no snapshot in snapshot_file, or if it was
+           saved for a different geometry
+*/
+IMPNPCTRANSPORTEXPORT bool load_snapshot
+( std::string snapshot_file, SimulationData* sd );
+
+IMPNPCTRANSPORT_END_NAMESPACE
+
+#endif /* IMPNPCTRANSPORT_SNAPSHOT_H */
@@ -233,6 +233,18 @@ IMPNPCTRANSPORTEXPORT
 void copy_FGs_coordinates(SimulationData const* src_sd,
                           SimulationData* trg_sd);
 
+//! Sort particle indexes along a Morton (Z-order) curve of their coordinates
+/** Returns the indexes in pis ordered by the Morton code of their current
+    coordinates within the bounding box of all of them, such that particles
+    that are close in space are mostly close in the returned list.
+
+    @param m the model
+    @param pis particle indexes decorated with core::XYZ
+*/
+IMPNPCTRANSPORTEXPORT
+ParticleIndexes get_spatially_sorted_particle_indexes
+(Model* m, const ParticleIndexes& pis);
+
 IMPNPCTRANSPORT_END_NAMESPACE
 
 
@@ -0,0 +1,141 @@
+/**
+ *  \file work_unit_cost.h
+ *  \brief estimates of the runtime and memory of simulating an assignment
+ *
+ *  Copyright 2007-2018 IMP Inventors. All rights reserved.
+ */
+
+#ifndef IMPNPCTRANSPORT_WORK_UNIT_COST_H
+#define IMPNPCTRANSPORT_WORK_UNIT_COST_H
+
+#include "npctransport_config.h"
+#include <IMP/value_macros.h>
+#include <IMP/showable_macros.h>
+#include <string>
+#ifndef SWIG
+namespace npctransport_proto {
+class Assignment;
+}
+#endif
+
+IMPNPCTRANSPORT_BEGIN_NAMESPACE
+
+/**
+   The measured throughput of the main simulation kernels on a given
+   machine, used to estimate the cost of work units. The default values
+   are rough single-core estimates. They can be measured by running
+   utility calibrate_cost_model on a few representative assignments, and
+   scaled uniformly with get_scaled().
+ */
+struct IMPNPCTRANSPORTEXPORT CostCalibration {
+  double ns_per_particle; // BD propagation of a particle per frame
+  double ns_per_close_pair; // pair scores of a close pair per frame
+  double ns_per_site_pair; // interaction between two sites per frame
+  double ns_per_restraint; // a bond or boundary restraint term per frame
+  double bytes_per_particle;
+  double bytes_per_close_pair;
+  double base_bytes; // memory independent of the system size
+
+  CostCalibration(double ns_per_particle = 200.0,
+                  double ns_per_close_pair = 50.0,
+                  double ns_per_site_pair = 10.0,
+                  double ns_per_restraint = 50.0,
+                  double bytes_per_particle = 2048.0,
+                  double bytes_per_close_pair = 16.0,
+                  double base_bytes = 64.0 * 1024 * 1024)
+    : ns_per_particle(ns_per_particle),
+      ns_per_close_pair(ns_per_close_pair),
+      ns_per_site_pair(ns_per_site_pair),
+      ns_per_restraint(ns_per_restraint),
+      bytes_per_particle(bytes_per_particle),
+      bytes_per_close_pair(bytes_per_close_pair),
+      base_bytes(base_bytes)
+  {}
+
+  //! a copy with all time costs multiplied by time_factor, e.g. the
+  //! ratio between a measured and an estimated time per frame
+  CostCalibration get_scaled(double time_factor) const {
+    return CostCalibration(ns_per_particle * time_factor,
+                           ns_per_close_pair * time_factor,
+                           ns_per_site_pair * time_factor,
+                           ns_per_restraint * time_factor,
+                           bytes_per_particle, bytes_per_close_pair,
+                           base_bytes);
+  }
+
+  IMP_SHOWABLE_INLINE(CostCalibration,
+                      out << "cost calibration"
+                      << " ns/particle " << ns_per_particle
+                      << " ns/close-pair " << ns_per_close_pair
+                      << " ns/site-pair " << ns_per_site_pair
+                      << " ns/restraint " << ns_per_restraint
+                      << " bytes/particle " << bytes_per_particle
+                      << " bytes/close-pair " << bytes_per_close_pair
+                      << " base bytes " << base_bytes);
+};
+
+IMP_VALUES(CostCalibration, CostCalibrations);
+
+//! the number of simulated particles in an assignment
+IMPNPCTRANSPORTEXPORT
+unsigned int get_number_of_particles(const ::npctransport_proto::Assignment& a);
+
+/** the expected number of close pairs of particles in an assignment,
+    assuming particles are distributed uniformly in the simulation box,
+    where two particles are close if their spheres are within the
+    close pairs range plus slack of each other */
+IMPNPCTRANSPORTEXPORT
+double get_expected_number_of_close_pairs
+(const ::npctransport_proto::Assignment& a);
+
+/** the expected number of pairs of interaction sites evaluated per
+    frame, that is the number of sites of the two particles of each
+    expected close pair whose types interact */
+IMPNPCTRANSPORTEXPORT
+double get_expected_number_of_site_pairs
+(const ::npctransport_proto::Assignment& a);
+
+/** the number of restraint terms evaluated per frame besides close
+    pairs, that is FG chain bonds and per-particle box and slab terms */
+IMPNPCTRANSPORTEXPORT
+unsigned int get_number_of_restraint_terms
+(const ::npctransport_proto::Assignment& a);
+
+/** the estimated wall-clock time in ns of simulating a frame of an
+    assignment, based on the throughput in calibration */
+IMPNPCTRANSPORTEXPORT
+double get_estimated_ns_per_frame
+(const ::npctransport_proto::Assignment& a,
+ const CostCalibration& calibration = CostCalibration());
+
+/** the estimated wall-clock time in seconds of simulating all frames of
+    an assignment (a.number_of_frames()) */
+IMPNPCTRANSPORTEXPORT
+double get_estimated_run_time
+(const ::npctransport_proto::Assignment& a,
+ const CostCalibration& calibration = CostCalibration());
+
+//! the estimated peak memory in bytes of simulating an assignment
+IMPNPCTRANSPORTEXPORT
+double get_estimated_memory
+(const ::npctransport_proto::Assignment& a,
+ const CostCalibration& calibration = CostCalibration());
+
+/** the estimated wall-clock time in seconds of simulating the
+    assignment in the output file output_file, e.g. one written
+    by assign_ranges() */
+IMPNPCTRANSPORTEXPORT
+double get_estimated_run_time
+(std::string output_file,
+ const CostCalibration& calibration = CostCalibration());
+
+/** the estimated peak memory in bytes of simulating the assignment
+    in the output file output_file */
+IMPNPCTRANSPORTEXPORT
+double get_estimated_memory
+(std::string output_file,
+ const CostCalibration& calibration = CostCalibration());
+
+IMPNPCTRANSPORT_END_NAMESPACE
+
+#endif /* IMPNPCTRANSPORT_WORK_UNIT_COST_H */
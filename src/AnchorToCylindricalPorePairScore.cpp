@@ -21,7 +21,8 @@ AnchorToCylidnricalPorePairScore
   normalized_xy_(cos(rot_angle),
                  sin(rot_angle)),
   pore_radial_d_(radial_d),
-  ds_(k)
+  ds_(k),
+  reference_pore_radius_(-1.0)
 {
   reference_point_[2]= z; // z is constant
 }
@@ -33,7 +34,8 @@ AnchorToCylidnricalPorePairScore
   algebra::Vector3D initial_anchor_point,
   Float k )
   :
-  ds_(k)
+  ds_(k),
+  reference_pore_radius_(-1.0)
 {
   Float x(initial_anchor_point[0]);
   Float y(initial_anchor_point[1]);
@@ -11,6 +11,9 @@
 #include <ValidSchema.hh>
 #include <IMP/npctransport/avro.h>
 #include <IMP/npctransport/AvroDataFileData.h>
+#include <IMP/npctransport/internal/AvroPrefetcher.h>
+#include <IMP/npctransport/internal/AvroBlockReader.h>
+#include <IMP/npctransport/internal/avro_index.h>
 #if __GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 6)
 IMP_GCC_PRAGMA(diagnostic push)
 #endif
@@ -20,9 +23,10 @@ IMP_GCC_PRAGMA(diagnostic ignored "-Wsign-compare")
 IMP_GCC_PRAGMA(diagnostic pop)
 #endif
 
-#include <DataFile.hh>
 //#include <google/protobuf/text_format.h>
 #include <IMP/exception.h>
+#include <IMP/check_macros.h>
+#include <IMP/log_macros.h>
 #include <fstream>
 #include <iomanip>
 
@@ -39,43 +43,126 @@ Avro2PBReader::Avro2PBReader(std::string avro_filename)
   init(Strings(1, avro_filename));
 }
 
+Avro2PBReader::Avro2PBReader(const Strings& avro_filenames,
+                             unsigned int n_threads,
+                             unsigned int max_buffered_mb) {
+  init(avro_filenames);
+  prefetcher_.reset(new internal::AvroPrefetcher
+                    (avro_filenames, n_threads,
+                     static_cast<std::size_t>(max_buffered_mb) << 20));
+}
+
 void Avro2PBReader::init(const Strings& avro_filenames) {
   avro_filenames_ = avro_filenames;
-  avro_reader_ = nullptr;
   cur_file_ = 0;
+  indexes_.clear();
+  indexes_.resize(avro_filenames.size());
 }
 
 /** closes any open files */
 Avro2PBReader::~Avro2PBReader() { advance_current_reader(); }
 
 std::string Avro2PBReader::read_next() {
-  if (!get_is_valid()) {
+  EntryView entry;
+  if (!read_next_view(entry)) {
     return "";
   }
-  if (!avro_reader_) {
-    avro_reader_ =
-        new t_avro_reader(avro_filenames_[cur_file_].c_str(),
-                          IMP::npctransport::get_avro_data_file_schema());
+  return std::string(entry.data, entry.size);
+}
+
+std::vector<std::string> Avro2PBReader::read_next_batch(unsigned int n) {
+  std::vector<std::string> ret;
+  ret.reserve(n);
+  EntryView entry;
+  while (ret.size() < n && read_next_view(entry)) {
+    ret.push_back(std::string(entry.data, entry.size));
+  }
+  return ret;
+}
+
+bool Avro2PBReader::read_next_view(EntryView& entry) {
+  if (prefetcher_) {
+    internal::AvroPrefetcher::Record const* record = prefetcher_->read_next();
+    if (!record) {
+      return false;
+    }
+    entry.data = record->data;
+    entry.size = record->size;
+    return true;
+  }
+  while (get_is_valid()) {
+    if (!block_reader_) {
+      block_reader_.reset
+        (new internal::AvroBlockReader(avro_filenames_[cur_file_]));
+    }
+    internal::AvroBlockReader::Entry block_entry;
+    if (block_reader_->read_next(block_entry)) {
+      entry.data = block_entry.value;
+      entry.size = block_entry.value_size;
+      return true;
+    }
+    advance_current_reader();  // no more data = go to next
   }
-  IMP_npctransport::wrapper data;
+  return false;
+}
 
-  if (!(avro_reader_->read(data))) {  // no more data = go to next
-    advance_current_reader();
-    return read_next();
+bool Avro2PBReader::seek_to_work_unit(int work_unit) {
+  IMP_ALWAYS_CHECK(!prefetcher_,
+                   "Seeking is not supported when prefetching",
+                   UsageException);
+  for (unsigned int i = 0; i < avro_filenames_.size(); i++) {
+    std::string const& fname = avro_filenames_[i];
+    if (!indexes_[i]) {
+      boost::shared_ptr< ::npctransport_proto::AvroArchiveIndex > loaded
+        (new ::npctransport_proto::AvroArchiveIndex());
+      if (!internal::load_avro_index(fname, loaded.get())) {
+        internal::build_avro_index(fname, loaded.get());
+        // best effort, the archive may be in a read-only location
+        if (!internal::save_avro_index(fname, *loaded)) {
+          IMP_WARN("Unable to write avro index "
+                   << get_avro_index_file_name(fname) << std::endl);
+        }
+      }
+      indexes_[i] = loaded;
+    }
+    ::npctransport_proto::AvroArchiveIndex const& index = *indexes_[i];
+    for (int j = 0; j < index.entries_size(); j++) {
+      ::npctransport_proto::AvroArchiveIndex::Entry const& ie =
+          index.entries(j);
+      if (ie.work_unit() != work_unit) {
+        continue;
+      }
+      boost::shared_ptr<internal::AvroBlockReader> block_reader
+        (new internal::AvroBlockReader(fname));
+      block_reader->seek_to_block(ie.block_offset());
+      internal::AvroBlockReader::Entry skipped;
+      for (int k = 0; k < ie.index_in_block(); k++) {
+        IMP_ALWAYS_CHECK(block_reader->read_next(skipped),
+                         "Avro index of " << fname << " is out of date",
+                         IOException);
+      }
+      advance_current_reader();
+      cur_file_ = i;
+      block_reader_ = block_reader;
+      return true;
+    }
   }
-  return std::string(data.value.begin(), data.value.end());
+  return false;
 }
 
 bool Avro2PBReader::get_is_valid() {
-  bool is_valid = (cur_file_ < avro_filenames_.size());
+  bool is_valid = (get_cur_file_index() < avro_filenames_.size());
   return is_valid;
 }
 
 /*************** Private ****************/
 
+unsigned int Avro2PBReader::get_cur_file_index() const {
+  return prefetcher_ ? prefetcher_->get_current_file_index() : cur_file_;
+}
+
 void Avro2PBReader::advance_current_reader() {
-  if (avro_reader_) delete avro_reader_;
-  avro_reader_ = nullptr;
+  block_reader_.reset();
   cur_file_++;
 }
 
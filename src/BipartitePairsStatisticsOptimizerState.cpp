@@ -95,6 +95,32 @@ void BipartitePairsStatisticsOptimizerState::reset() {
   on_stats_time_ns_ = 0.0;
   on_I_stats_time_ns_ = 0.0;
   on_II_stats_time_ns_ = 0.0;
+  contact_kinetics_.reset_histograms();
+}
+
+BipartitePairsStatisticsOptimizerState::History
+BipartitePairsStatisticsOptimizerState::get_history() const {
+  History ret;
+  ret.time_ns = time_ns_;
+  ret.bounds_I.assign(bounds_I_.begin(), bounds_I_.end());
+  ret.bounds_II.assign(bounds_II_.begin(), bounds_II_.end());
+  ret.contact_kinetics = contact_kinetics_.get_state();
+  return ret;
+}
+
+void BipartitePairsStatisticsOptimizerState::set_history
+(History const& history) {
+  time_ns_ = history.time_ns;
+  is_reset_ = false; // resume from time_ns_ rather than from next update
+  bounds_I_.clear();
+  bounds_I_.insert(history.bounds_I.begin(), history.bounds_I.end());
+  bounds_II_.clear();
+  bounds_II_.insert(history.bounds_II.begin(), history.bounds_II.end());
+  // the contacts of the last update are those tracked for their kinetics
+  ParticleIndexPairs const& contacts = history.contact_kinetics.contacts;
+  contacts_.clear();
+  contacts_.insert(contacts.begin(), contacts.end());
+  contact_kinetics_.set_state(history.contact_kinetics);
 }
 
 namespace {
@@ -142,7 +168,7 @@ namespace {
 
 // count all the pairs that are currently in contact
 // and update stats
-void BipartitePairsStatisticsOptimizerState::do_update(unsigned int call_num)
+void BipartitePairsStatisticsOptimizerState::do_update(unsigned int)
 {
   // Get simulation time and reset if needed:
   atom::Simulator* simulator =
@@ -196,11 +222,6 @@ void BipartitePairsStatisticsOptimizerState::do_update(unsigned int call_num)
                             new_bounds_II.insert(pip[1]);
                             new_contacts.insert
                               ( make_unordered_particle_index_pair( _1 ) );
-                            if(call_num % 10 == 0) {
-                              //                              statistics_manager->get_fgs_markov_states->update_contact(pip[0],
-                              //                                                                                        pip[1],
-                              //                                                                                        new_time_ns)
-                            }
                           }
                           accumulate_bound_sites_by_pi(bound_sites_I_by_pi,
                                                           pip[0],
@@ -209,6 +230,7 @@ void BipartitePairsStatisticsOptimizerState::do_update(unsigned int call_num)
                                                           pip[1],
                                                           bound_sites_II);
                         });
+  contact_kinetics_.update(new_contacts, new_time_ns);
   unsigned int n_bound_sites_I= get_number_of_bound_sites(bound_sites_I_by_pi);
   unsigned int n_bound_sites_II= get_number_of_bound_sites(bound_sites_II_by_pi);
   double fraction_bound_sites_I= (n_sites_I_>0) ? n_bound_sites_I/ (n_sites_I_+.0) : 0.0;
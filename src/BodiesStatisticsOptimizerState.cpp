@@ -0,0 +1,112 @@
+/**
+ *  \file BodiesStatisticsOptimizerState.cpp
+ *  \brief batched body statistics over a group of particles
+ *
+ *  Copyright 2007-2018 IMP Inventors. All rights reserved.
+ *
+ */
+
+#include <IMP/npctransport/BodiesStatisticsOptimizerState.h>
+#include <IMP/atom/Simulator.h>
+#include <IMP/core/XYZ.h>
+#include <IMP/core/rigid_bodies.h>
+#include <limits>
+
+IMPNPCTRANSPORT_BEGIN_NAMESPACE
+
+BodiesStatisticsOptimizerState::BodiesStatisticsOptimizerState
+( const ParticlesTemp& ps,
+  IMP::npctransport::Statistics* statistics_manager,
+  unsigned int periodicity)
+  : P(ps.empty() ? nullptr : ps[0]->get_model(),
+      "BodiesStatisticsOptimizerState%1%"),
+    pis_(IMP::get_indexes(ps)),
+    statistics_manager_(statistics_manager),
+    has_last_(false),
+    is_correlation_time_on_(false)
+{
+  IMP_USAGE_CHECK(!ps.empty(), "at least one particle is expected");
+  set_period(periodicity);
+  reset();
+}
+
+void BodiesStatisticsOptimizerState::add_particle(Particle* p) {
+  IMP_USAGE_CHECK(p->get_model() == get_model(),
+                  "all particles must belong to the same model");
+  pis_.push_back(p->get_index());
+  reset();
+}
+
+void BodiesStatisticsOptimizerState::set_is_correlation_time_on(bool is_on) {
+  is_correlation_time_on_= is_on;
+  reset();
+}
+
+ParticlesTemp BodiesStatisticsOptimizerState::get_particles() const {
+  return IMP::get_particles(get_model(), pis_);
+}
+
+void BodiesStatisticsOptimizerState::reset() {
+  P::reset();
+  has_last_= false;
+  diffusion_estimators_.assign(pis_.size(),
+                               internal::DiffusionCoefficientEstimator());
+  correlation_estimators_.assign
+    (pis_.size(), internal::RotationalCorrelationTimeEstimator());
+}
+
+Floats BodiesStatisticsOptimizerState::get_diffusion_coefficients() const {
+  Floats ret(pis_.size());
+  for(unsigned int i= 0; i < pis_.size(); i++) {
+    ret[i]= diffusion_estimators_[i].get_diffusion_coefficient();
+  }
+  return ret;
+}
+
+double
+BodiesStatisticsOptimizerState::get_diffusion_coefficient
+(unsigned int i) const {
+  IMP_USAGE_CHECK(i < pis_.size(), "particle index out of range");
+  return diffusion_estimators_[i].get_diffusion_coefficient();
+}
+
+double
+BodiesStatisticsOptimizerState::get_correlation_time
+(unsigned int i) const {
+  IMP_USAGE_CHECK(i < pis_.size(), "particle index out of range");
+  double n_updates= correlation_estimators_[i].get_correlation_time();
+  if (n_updates == std::numeric_limits<double>::infinity()) {
+    return n_updates;
+  }
+  double dt= dynamic_cast<atom::Simulator*>(get_optimizer())
+    ->get_maximum_time_step();
+  return get_period() * dt * n_updates;
+}
+
+void BodiesStatisticsOptimizerState::do_update(unsigned int) {
+  atom::Simulator* simulator =
+    dynamic_cast< atom::Simulator* >( get_optimizer() );
+  double cur_time_fs= simulator->get_current_time();
+  Model* m= get_model();
+  unsigned int n= pis_.size();
+  last_positions_.resize(n);
+  bool is_displaced= has_last_ && cur_time_fs > last_time_fs_;
+  double dt= cur_time_fs - last_time_fs_;
+  for(unsigned int i= 0; i < n; i++) {
+    algebra::Vector3D const& x= m->get_sphere(pis_[i]).get_center();
+    if(is_displaced) {
+      diffusion_estimators_[i].add_displacement(x - last_positions_[i], dt);
+    }
+    last_positions_[i]= x;
+    if(is_correlation_time_on_ &&
+       core::RigidBody::get_is_setup(m, pis_[i])) {
+      correlation_estimators_[i].add_rotation
+        ( core::RigidBody(m, pis_[i]).get_reference_frame()
+          .get_transformation_to().get_rotation() );
+    }
+  }
+  has_last_= true;
+  last_time_fs_= cur_time_fs;
+}
+
+IMPNPCTRANSPORT_END_NAMESPACE
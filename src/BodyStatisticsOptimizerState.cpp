@@ -17,6 +17,7 @@
 #include <IMP/npctransport/Statistics.h>
 #include <IMP/npctransport/SimulationData.h>
 #include <IMP/npctransport/enums.h>
+#include <limits>
 
 IMPNPCTRANSPORT_BEGIN_NAMESPACE
 BodyStatisticsOptimizerState::BodyStatisticsOptimizerState
@@ -24,15 +25,23 @@ BodyStatisticsOptimizerState::BodyStatisticsOptimizerState
   IMP::npctransport::Statistics* statistics_manager,
   unsigned int periodicity)
   : P(p->get_model(), "BodyStatisticsOptimizerState%1%"), p_(p),
-        statistics_manager_(statistics_manager)
+    statistics_manager_(statistics_manager),
+    has_last_(false),
+    is_correlation_time_on_(false)
 {
   set_period(periodicity);
 }
 
+void BodyStatisticsOptimizerState::set_is_correlation_time_on(bool is_on) {
+  is_correlation_time_on_= is_on;
+  reset();
+}
+
 void BodyStatisticsOptimizerState::reset() {
   P::reset();
-  positions_.clear();
-  times_fs_.clear();
+  has_last_= false;
+  diffusion_estimator_.reset();
+  correlation_estimator_.reset();
 }
 
 double BodyStatisticsOptimizerState::get_dt() const {
@@ -41,101 +50,36 @@ double BodyStatisticsOptimizerState::get_dt() const {
 }
 
 double BodyStatisticsOptimizerState::get_correlation_time() const {
-  bool IS_DISABLED=true; // DISABLE FOR NOW CAUSE TIME CONSUMING
-  if(IS_DISABLED){
-    return std::numeric_limits<double>::infinity();
-  }
-  double sum = 0;
-  int n = 0;
-  Floats angles;
-  for (unsigned int i = 0; i < positions_.size(); ++i) {
-    double last = 0;
-    for (unsigned int j = i + 1; j < positions_.size(); ++j) {
-      algebra::Rotation3D rel =
-          positions_[j].get_rotation() / positions_[i].get_rotation();
-      double angle = algebra::get_axis_and_angle(rel).second;
-      if (i == 0) angles.push_back(angle);
-      if (angle > 1) {
-        sum += get_period() * get_dt() * (j - i - 1 + (angle - last));
-        ++n;
-        break;
-      }
-      last = angle;
-    }
-  }
-  /*std::cout << n << " events from " << angles
-    << " with " << positions_.size() << " samples " << std::endl;*/
-  if (n == 0) {
-    return std::numeric_limits<double>::infinity();
+  double n_updates= correlation_estimator_.get_correlation_time();
+  if (n_updates == std::numeric_limits<double>::infinity()) {
+    return n_updates;
   }
-  return sum / n;
+  return get_period() * get_dt() * n_updates;
 }
 
-namespace{
-  struct subtract_translations {
-    algebra::Vector3D operator()(algebra::Transformation3D const &a,
-                                 algebra::Transformation3D const &b)
-    {
-      return a.get_translation() - b.get_translation();
-    }
-  };
-};
-
 double BodyStatisticsOptimizerState::get_diffusion_coefficient() const {
-    IMP_OBJECT_LOG;
-  // Checks:
-  unsigned int n= positions_.size();
-  IMP_USAGE_CHECK(times_fs_.size() == n,
-                  "Length of times and positions lists is expected to be equal");
-  if (n<2){
-    return 0;
-  }
-  if (times_fs_.front() - times_fs_.back() == 0.0) {
-    return 0;
-  }
-  // Compute displacements and dT vectors:
-  algebra::Vector3Ds displacements;
-  displacements.reserve(n-1);
-  std::transform(positions_.begin()+1, positions_.end(),
-                 positions_.begin(),
-                 std::back_inserter(displacements),
-                 subtract_translations());
-  IMP::Floats dts;
-  dts.reserve(n-1);
-  std::transform(times_fs_.begin()+1, times_fs_.end(),
-                   times_fs_.begin(),
-                 std::back_inserter(dts),
-                 std::minus<double>());
-  return atom::get_diffusion_coefficient
-    (displacements, dts); //  get_period() * get_dt());
+  return diffusion_estimator_.get_diffusion_coefficient();
 }
 
-void
-BodyStatisticsOptimizerState
-::update_particle_type_zr_distribution_map() {
-  if (statistics_manager_ == nullptr){
-    return;
-  }
-  if(statistics_manager_->get_sd()->get_is_xyz_hist_stats()){
-    statistics_manager_->update_particle_type_xyz_distribution_map(p_);
-  } else {
-    statistics_manager_->update_particle_type_zr_distribution_map(p_);
-  }
-}
-
-
+// note: the z-r distribution of p_ is collected in batch for all
+// particles by Statistics::update_particle_distributions()
 void BodyStatisticsOptimizerState::do_update(unsigned int) {
-  this->update_particle_type_zr_distribution_map();
   atom::Simulator* simulator =
     dynamic_cast< atom::Simulator* >( get_optimizer() );
-  double cur_time_ns = simulator->get_current_time();
-  times_fs_.push_back( cur_time_ns );
-  positions_.push_back(core::RigidBody(p_)
-                           .get_reference_frame().get_transformation_to());
-  while (positions_.size() > 1000) {
-    times_fs_.pop_front();
-    positions_.pop_front();
+  double cur_time_fs = simulator->get_current_time();
+  algebra::Transformation3D tr=
+    core::RigidBody(p_).get_reference_frame().get_transformation_to();
+  if (has_last_ && cur_time_fs > last_time_fs_) {
+    diffusion_estimator_.add_displacement
+      ( tr.get_translation() - last_translation_,
+        cur_time_fs - last_time_fs_ );
+  }
+  if(is_correlation_time_on_) {
+    correlation_estimator_.add_rotation(tr.get_rotation());
   }
+  has_last_= true;
+  last_translation_= tr.get_translation();
+  last_time_fs_= cur_time_fs;
 }
 
 IMPNPCTRANSPORT_END_NAMESPACE
@@ -8,10 +8,27 @@
 
 #include <IMP/npctransport/BrownianDynamicsTAMDWithSlabSupport.h>
 #include <IMP/npctransport/RelaxingSpring.h>
+#include <IMP/npctransport/SlabWithPore.h>
+#include <IMP/npctransport/util.h>
 #include <IMP/atom/BrownianDynamicsTAMD.h>
+#include <IMP/atom/Diffusion.h>
+#include <IMP/algebra/vector_search.h>
+#include <IMP/algebra/vector_generators.h>
+#include <IMP/core/rigid_bodies.h>
+#include <IMP/core/XYZR.h>
+#include <IMP/thread_macros.h>
+#include <algorithm>
+#include <cmath>
+#include <limits>
 
 IMPNPCTRANSPORT_BEGIN_NAMESPACE
 
+namespace {
+  // the number of standard deviations of the displacement along each
+  // axis that bound the displacement of a particle in free flight
+  const double FREE_FLIGHT_REACH_SIGMAS = 4.0;
+}
+
 void
 BrownianDynamicsTAMDWithSlabSupport
 ::do_advance_chunk
@@ -22,8 +39,6 @@ BrownianDynamicsTAMDWithSlabSupport
  unsigned int end)
 {
   BrownianDynamicsTAMD::do_advance_chunk(dtfs, ikt, ps, begin, end);
-  // TODO: update slab here
-  // TODO: move to .cpp
 
   // Relax all FG springs by going over all FGs and then updating all their springs by random diffusion + gradient just as BD of XYZ particles
   // Note that this is inefficient if there are no harmonic springs (backward support), but we only care about performance of new version
@@ -45,4 +60,546 @@ BrownianDynamicsTAMDWithSlabSupport
   }
 }
 
+double
+BrownianDynamicsTAMDWithSlabSupport
+::do_step(const ParticleIndexes &unsorted_ps, double dt)
+{
+  const ParticleIndexes& ps(get_spatially_sorted(unsorted_ps));
+  if(!get_is_free_diffusion_propagation()){
+    double ret(BrownianDynamicsTAMD::do_step(ps, dt));
+    advance_pore_radius(dt, 1.0 / get_kt());
+    if(!constrained_chains_.empty()){
+      apply_bond_constraints();
+    }
+    return ret;
+  }
+  // Advance the clock of all free flights and land those that are over -
+  // all other particles are advanced by a regular BD step
+  ParticleIndexes active_ps;
+  active_ps.reserve(ps.size());
+  for(unsigned int i=0; i<ps.size(); i++){
+    FreeFlightsMap::iterator it(free_flights_.find(ps[i]));
+    if(it==free_flights_.end()){
+      active_ps.push_back(ps[i]);
+      continue;
+    }
+    it->second.elapsed_fs += dt;
+    if(it->second.elapsed_fs >= it->second.duration_fs){
+      propagate_free_diffusion(it->first, it->second.elapsed_fs);
+      free_flights_.erase(it);
+    }
+  }
+  double ret(BrownianDynamicsTAMD::do_step(active_ps, dt));
+  advance_pore_radius(dt, 1.0 / get_kt());
+  if(!constrained_chains_.empty()){
+    apply_bond_constraints();
+  }
+  bool is_check
+    (++n_steps_since_free_diffusion_check_ >= free_diffusion_check_interval_);
+  if(is_check){
+    n_steps_since_free_diffusion_check_= 0;
+  }
+  if(free_diffusion_obstacles_.size() < 2){
+    return ret;
+  }
+  // obstacles are indexed only on checks - in between, flights are
+  // tested against their clearance from the last check
+  if(is_check){
+    update_free_diffusion_obstacles_index();
+    update_free_diffusion_flights();
+    // new flights are inflated by their reach as obstacles of others
+    update_free_diffusion_obstacles_radii();
+  }
+  if(!free_flights_.empty()){
+    abort_breached_free_diffusion_flights(is_check);
+  }
+  return ret;
+}
+
+void
+BrownianDynamicsTAMDWithSlabSupport
+::setup(const ParticleIndexes &ps)
+{
+  BrownianDynamicsTAMD::setup(ps);
+  spatially_sorted_ps_.clear();
+  // particles may have been moved since the last step, so the cached
+  // clearances of flights are rechecked on the next step
+  n_steps_since_free_diffusion_check_= free_diffusion_check_interval_;
+}
+
+const ParticleIndexes&
+BrownianDynamicsTAMDWithSlabSupport
+::get_spatially_sorted(const ParticleIndexes& ps)
+{
+  if(spatial_sort_interval_ == 0){
+    return ps;
+  }
+  // setup() clears the sorted list whenever the simulated particles may
+  // change, so comparing sizes suffices here
+  if(spatially_sorted_ps_.size() != ps.size() ||
+     ++n_steps_since_spatial_sort_ >= spatial_sort_interval_){
+    spatially_sorted_ps_=
+      get_spatially_sorted_particle_indexes(get_model(), ps);
+    n_steps_since_spatial_sort_= 0;
+  }
+  return spatially_sorted_ps_;
+}
+
+void
+BrownianDynamicsTAMDWithSlabSupport
+::set_slab(Particle* slab)
+{
+  IMP_USAGE_CHECK(SlabWithPore::get_is_setup(slab),
+                  "slab must be decorated as SlabWithPore");
+  slab_= slab->get_index();
+  is_slab_= true;
+}
+
+void
+BrownianDynamicsTAMDWithSlabSupport
+::advance_pore_radius(double dtfs, double ikt)
+{
+  if(!is_slab_){
+    return;
+  }
+  SlabWithPore slab(get_model(), slab_);
+  if(!slab.get_pore_radius_is_optimized()){
+    return;
+  }
+  IMP_USAGE_CHECK(slab.get_has_pore_radius_diffusion_coefficient(),
+                  "an optimized pore radius requires a diffusion coefficient");
+  // the derivative was accumulated by the scoring function evaluation
+  // of the current step, along with those of all particles
+  double D(slab.get_pore_radius_diffusion_coefficient());
+  double derivative(get_model()->get_derivative
+                    (SlabWithPore::get_pore_radius_key(), slab_));
+  double sigma(std::sqrt(2*dtfs*D)); // single d.o.f.
+  double pore_radius(slab.get_pore_radius());
+  pore_radius += get_sample(sigma);
+  pore_radius -= derivative*D*dtfs*ikt;
+  slab.set_pore_radius(std::max(pore_radius, 0.0));
+}
+
+void
+BrownianDynamicsTAMDWithSlabSupport
+::set_free_diffusion_propagation
+(const ParticleIndexes& candidates,
+ const ParticleIndexes& obstacles,
+ double interaction_range,
+ double safety_shell,
+ double max_flight_time_fs)
+{
+  IMP_USAGE_CHECK(interaction_range >= 0.0,
+                  "interaction range must be non-negative");
+  synchronize_free_diffusion_flights();
+  free_diffusion_candidates_= candidates;
+  free_diffusion_obstacles_= obstacles;
+  free_diffusion_interaction_range_= interaction_range;
+  free_diffusion_safety_shell_= safety_shell;
+  max_free_diffusion_time_= max_flight_time_fs;
+  n_steps_since_free_diffusion_check_= 0;
+}
+
+void
+BrownianDynamicsTAMDWithSlabSupport
+::synchronize_free_diffusion_flights()
+{
+  for(FreeFlightsMap::const_iterator it= free_flights_.begin();
+      it != free_flights_.end(); it++){
+    propagate_free_diffusion(it->first, it->second.elapsed_fs);
+  }
+  free_flights_.clear();
+}
+
+void
+BrownianDynamicsTAMDWithSlabSupport
+::synchronize_free_diffusion_flights(const ParticleIndexes& pis)
+{
+  if(free_flights_.empty()){
+    return;
+  }
+  for(unsigned int i= 0; i<pis.size(); i++){
+    FreeFlightsMap::iterator it(free_flights_.find(pis[i]));
+    if(it != free_flights_.end()){
+      propagate_free_diffusion(it->first, it->second.elapsed_fs);
+      free_flights_.erase(it);
+    }
+  }
+}
+
+void
+BrownianDynamicsTAMDWithSlabSupport
+::propagate_free_diffusion
+(ParticleIndex pi, double dtfs)
+{
+  if(dtfs <= 0.0){
+    return;
+  }
+  Model* m= get_model();
+  // translation - an exact sample from the free diffusion Green's function
+  double D(atom::Diffusion(m, pi).get_diffusion_coefficient());
+  double sigma(std::sqrt(2*dtfs*D)); // per axis
+  algebra::Vector3D dx(get_sample(sigma),
+                       get_sample(sigma),
+                       get_sample(sigma));
+  if(!core::RigidBody::get_is_setup(m, pi)){
+    core::XYZ xyz(m, pi);
+    xyz.set_coordinates(xyz.get_coordinates() + dx);
+    return;
+  }
+  // rotation - composed of small isotropic rotations, since a single
+  // rotation vector is a good approximation only for small angles
+  core::RigidBody rb(m, pi);
+  algebra::Transformation3D tr(rb.get_reference_frame().get_transformation_to());
+  algebra::Rotation3D rot(tr.get_rotation());
+  if(atom::RigidBodyDiffusion::get_is_setup(m, pi)){
+    double Dr(atom::RigidBodyDiffusion(m, pi)
+              .get_rotational_diffusion_coefficient());
+    static const double max_sigma_rad(0.25);
+    double sigma_rad_total(std::sqrt(2*dtfs*Dr)); // per axis
+    unsigned int n(std::ceil(std::pow(sigma_rad_total / max_sigma_rad, 2)));
+    n= std::max(n, 1U);
+    double sigma_rad(sigma_rad_total / std::sqrt(static_cast<double>(n)));
+    for(unsigned int i= 0; i<n; i++){
+      algebra::Vector3D w(get_sample(sigma_rad),
+                          get_sample(sigma_rad),
+                          get_sample(sigma_rad));
+      double angle(w.get_magnitude());
+      if(angle > 0.0){
+        rot= algebra::get_rotation_about_normalized_axis(w / angle, angle) * rot;
+      }
+    }
+  }
+  rb.set_reference_frame_lazy
+    ( algebra::ReferenceFrame3D
+      ( algebra::Transformation3D(rot, tr.get_translation() + dx) ) );
+}
+
+double
+BrownianDynamicsTAMDWithSlabSupport
+::get_free_diffusion_walls_clearance
+(const algebra::Vector3D& center, double radius) const
+{
+  double ret(std::numeric_limits<double>::max());
+  if(is_free_diffusion_box_){
+    // box restraint applies to particle centers
+    for(unsigned int i= 0; i<3; i++){
+      ret= std::min(ret, center[i] - free_diffusion_box_.get_corner(0)[i]);
+      ret= std::min(ret, free_diffusion_box_.get_corner(1)[i] - center[i]);
+    }
+  }
+  if(is_slab_){
+    SlabWithPore slab(get_model(), slab_);
+    double half_thickness(0.5 * slab.get_thickness());
+    double pore_radius(slab.get_pore_radius());
+    double r(std::sqrt(center[0]*center[0] + center[1]*center[1]));
+    double dz(std::abs(center[2]) - half_thickness);
+    double d;
+    if(dz <= 0.0){
+      d= pore_radius - r; // inside pore (or inside slab if negative)
+    } else if(r >= pore_radius){
+      d= dz; // above or below slab
+    } else {
+      d= std::sqrt(dz*dz + (pore_radius-r)*(pore_radius-r)); // above pore rim
+    }
+    ret= std::min(ret, d - radius);
+  }
+  return ret;
+}
+
+double
+BrownianDynamicsTAMDWithSlabSupport
+::get_free_diffusion_reach(ParticleIndex pi) const
+{
+  FreeFlightsMap::const_iterator it(free_flights_.find(pi));
+  return it == free_flights_.end() ? 0.0 : it->second.reach;
+}
+
+void
+BrownianDynamicsTAMDWithSlabSupport
+::update_free_diffusion_obstacles_index()
+{
+  Model* m= get_model();
+  unsigned int n(free_diffusion_obstacles_.size());
+  free_diffusion_obstacles_centers_.resize(n);
+  for(unsigned int i= 0; i<n; i++){
+    free_diffusion_obstacles_centers_[i]=
+      core::XYZ(m, free_diffusion_obstacles_[i]).get_coordinates();
+  }
+  update_free_diffusion_obstacles_radii();
+  free_diffusion_obstacles_nn_=
+    new algebra::NearestNeighbor3D(free_diffusion_obstacles_centers_);
+}
+
+void
+BrownianDynamicsTAMDWithSlabSupport
+::update_free_diffusion_obstacles_radii()
+{
+  Model* m= get_model();
+  unsigned int n(free_diffusion_obstacles_.size());
+  free_diffusion_obstacles_radii_.resize(n);
+  free_diffusion_obstacles_max_radius_= 0.0;
+  free_diffusion_obstacles_max_D_= 0.0;
+  for(unsigned int i= 0; i<n; i++){
+    ParticleIndex pi(free_diffusion_obstacles_[i]);
+    // particles in flight may be anywhere within their reach
+    double radius(get_free_diffusion_reach(pi));
+    if(core::XYZR::get_is_setup(m, pi)){
+      radius += core::XYZR(m, pi).get_radius();
+    }
+    free_diffusion_obstacles_radii_[i]= radius;
+    free_diffusion_obstacles_max_radius_=
+      std::max(free_diffusion_obstacles_max_radius_, radius);
+    if(atom::Diffusion::get_is_setup(m, pi)){
+      free_diffusion_obstacles_max_D_=
+        std::max(free_diffusion_obstacles_max_D_,
+                 atom::Diffusion(m, pi).get_diffusion_coefficient());
+    }
+  }
+}
+
+double
+BrownianDynamicsTAMDWithSlabSupport
+::get_free_diffusion_obstacles_reach(unsigned int n_steps) const
+{
+  if(n_steps == 0){
+    return 0.0;
+  }
+  // the force term of each BD step is limited by the maximal move, and
+  // the random term is bounded as the reach of flights
+  double max_time_fs(n_steps * get_maximum_time_step());
+  return n_steps * get_max_step()
+    + FREE_FLIGHT_REACH_SIGMAS
+    * std::sqrt(2 * free_diffusion_obstacles_max_D_ * max_time_fs);
+}
+
+double
+BrownianDynamicsTAMDWithSlabSupport
+::get_free_diffusion_clearance
+(ParticleIndex pi, const algebra::Vector3D& center, double radius,
+ double max_clearance) const
+{
+  double ret(std::min(get_free_diffusion_walls_clearance(center, radius),
+                      max_clearance));
+  // all obstacles whose surface is closer than max_clearance, with
+  // their own radius rather than the maximal one
+  Ints close
+    (free_diffusion_obstacles_nn_->get_in_ball
+     (center, radius + free_diffusion_obstacles_max_radius_ + max_clearance));
+  for(unsigned int j= 0; j<close.size(); j++){
+    if(free_diffusion_obstacles_[close[j]] == pi){
+      continue;
+    }
+    double d(algebra::get_distance
+             (center, free_diffusion_obstacles_centers_[close[j]]));
+    ret= std::min(ret, d - radius - free_diffusion_obstacles_radii_[close[j]]);
+  }
+  return ret;
+}
+
+void
+BrownianDynamicsTAMDWithSlabSupport
+::abort_breached_free_diffusion_flights(bool is_index_updated)
+{
+  Model* m= get_model();
+  // obstacles may have approached flights by at most this much since
+  // they were indexed
+  double obstacles_reach(get_free_diffusion_obstacles_reach
+                         (n_steps_since_free_diffusion_check_));
+  // clearances beyond those that may be breached before the next check
+  // do not matter
+  double max_clearance(free_diffusion_interaction_range_
+                       + get_free_diffusion_obstacles_reach
+                       (free_diffusion_check_interval_));
+  if(!(max_clearance < std::numeric_limits<double>::max())){
+    // no maximal move was set, so flights are aborted on the first step
+    // after the check anyway
+    max_clearance= free_diffusion_interaction_range_;
+  }
+  ParticleIndexes breached;
+  for(FreeFlightsMap::iterator it= free_flights_.begin();
+      it != free_flights_.end(); it++){
+    ParticleIndex pi(it->first);
+    algebra::Vector3D center(core::XYZ(m, pi).get_coordinates());
+    double radius(core::XYZR::get_is_setup(m, pi) ?
+                  core::XYZR(m, pi).get_radius() : 0.0);
+    radius += it->second.reach;
+    double clearance;
+    if(is_index_updated){
+      it->second.clearance=
+        get_free_diffusion_clearance(pi, center, radius, max_clearance);
+      clearance= it->second.clearance;
+    } else {
+      // walls such as the pore may move too, but are cheap to recheck
+      clearance= std::min(it->second.clearance - obstacles_reach,
+                          get_free_diffusion_walls_clearance(center, radius));
+    }
+    if(clearance <= free_diffusion_interaction_range_){
+      breached.push_back(pi);
+    }
+  }
+  for(unsigned int i= 0; i<breached.size(); i++){
+    FreeFlightsMap::iterator it(free_flights_.find(breached[i]));
+    propagate_free_diffusion(it->first, it->second.elapsed_fs);
+    free_flights_.erase(it);
+  }
+  if(!breached.empty()){
+    IMP_LOG(VERBOSE, "Aborted " << breached.size()
+            << " breached free diffusion flights" << std::endl);
+  }
+}
+
+void
+BrownianDynamicsTAMDWithSlabSupport
+::update_free_diffusion_flights()
+{
+  if(free_diffusion_candidates_.empty() || free_diffusion_obstacles_.size() < 2){
+    return;
+  }
+  Model* m= get_model();
+  double min_clearance(free_diffusion_interaction_range_
+                       + free_diffusion_safety_shell_);
+  // the expected relative displacement along each axis during a flight
+  // is a quarter of the clearance beyond interaction range, so that a
+  // flight is unlikely to breach the clearance of the flying particle
+  static const double clearance_to_sigma(0.25);
+  unsigned int n_new_flights(0);
+  for(unsigned int i= 0; i<free_diffusion_candidates_.size(); i++){
+    ParticleIndex pi(free_diffusion_candidates_[i]);
+    if(free_flights_.find(pi) != free_flights_.end()){
+      continue;
+    }
+    if(!core::XYZ(m, pi).get_coordinates_are_optimized()){
+      continue;
+    }
+    algebra::Vector3D center(core::XYZ(m, pi).get_coordinates());
+    double radius(core::XYZR::get_is_setup(m, pi) ?
+                  core::XYZR(m, pi).get_radius() : 0.0);
+    double D(atom::Diffusion(m, pi).get_diffusion_coefficient());
+    double D_relative(D + free_diffusion_obstacles_max_D_);
+    // clearances beyond that of the longest possible flight do not matter
+    double max_clearance
+      (free_diffusion_interaction_range_
+       + std::sqrt(2 * D_relative * max_free_diffusion_time_)
+       / clearance_to_sigma);
+    double clearance(get_free_diffusion_clearance
+                     (pi, center, radius,
+                      std::max(max_clearance, min_clearance)));
+    if(clearance <= min_clearance){
+      continue;
+    }
+    double sigma(clearance_to_sigma
+                 * (clearance - free_diffusion_interaction_range_));
+    FreeFlight flight;
+    flight.duration_fs= std::min(sigma * sigma / (2 * D_relative),
+                                 max_free_diffusion_time_);
+    flight.elapsed_fs= 0.0;
+    flight.reach= FREE_FLIGHT_REACH_SIGMAS
+      * std::sqrt(2 * D * flight.duration_fs);
+    // recomputed against other new flights in the same check
+    flight.clearance= clearance - flight.reach;
+    if(flight.duration_fs < get_maximum_time_step()){
+      continue;
+    }
+    free_flights_[pi]= flight;
+    n_new_flights++;
+  }
+  IMP_LOG(VERBOSE, "Started " << n_new_flights << " new free diffusion flights, "
+          << free_flights_.size() << " flights overall" << std::endl);
+}
+
+void
+BrownianDynamicsTAMDWithSlabSupport
+::add_constrained_chain(FGChain* chain)
+{
+  ParticleIndexes beads(IMP::get_indexes(chain->get_beads()));
+  for(unsigned int i= 0; i<beads.size(); i++){
+    IMP_USAGE_CHECK(!RelaxingSpring::get_is_setup(get_model(), beads[i]),
+                    "constrained bonds are not supported for chains"
+                    " with relaxing springs");
+  }
+  constrained_chains_.push_back(chain);
+  constrained_chains_beads_.push_back(beads);
+}
+
+double
+BrownianDynamicsTAMDWithSlabSupport
+::apply_bond_constraints()
+{
+  int n(constrained_chains_.size());
+  double max_error(0.0);
+  // chains are disjoint so they can be processed independently
+  IMP_OMP_PRAGMA(parallel for schedule(dynamic) reduction(max:max_error))
+  for(int i= 0; i<n; i++){
+    double error_i(apply_chain_bond_constraints(i));
+    max_error= std::max(max_error, error_i);
+  }
+  IMP_LOG(VERBOSE, "Maximal relative bond error after constraints: "
+          << max_error << std::endl);
+  return max_error;
+}
+
+double
+BrownianDynamicsTAMDWithSlabSupport
+::apply_chain_bond_constraints(unsigned int i)
+{
+  Model* m= get_model();
+  ParticleIndexes const& beads(constrained_chains_beads_[i]);
+  unsigned int n(beads.size());
+  if(n < 2){
+    return 0.0;
+  }
+  double rest_length_factor(constrained_chains_[i]->get_rest_length_factor());
+  // gather coordinates, mobilities and rest lengths of the chain
+  algebra::Vector3Ds x(n);
+  Floats w(n); // displacement weights ~ mobility
+  Floats rest_lengths(n-1);
+  for(unsigned int j= 0; j<n; j++){
+    core::XYZR xyzr(m, beads[j]);
+    x[j]= xyzr.get_coordinates();
+    if(!xyzr.get_coordinates_are_optimized()){
+      w[j]= 0.0;
+    } else if(atom::Diffusion::get_is_setup(m, beads[j])){
+      w[j]= atom::Diffusion(m, beads[j]).get_diffusion_coefficient();
+    } else {
+      w[j]= 1.0;
+    }
+    if(j>0){
+      rest_lengths[j-1]= rest_length_factor
+        * (core::XYZR(m, beads[j-1]).get_radius() + xyzr.get_radius());
+    }
+  }
+  // iterate over bonds till all are within tolerance
+  double max_error(0.0);
+  for(unsigned int iter= 0; iter<bond_constraints_max_iterations_; iter++){
+    max_error= 0.0;
+    for(unsigned int j= 0; j<n-1; j++){
+      double w_sum(w[j] + w[j+1]);
+      if(w_sum <= 0.0){
+        continue;
+      }
+      algebra::Vector3D d(x[j+1] - x[j]);
+      double length(d.get_magnitude());
+      if(length == 0.0){
+        continue;
+      }
+      double delta(length - rest_lengths[j]);
+      max_error= std::max(max_error, std::abs(delta) / rest_lengths[j]);
+      algebra::Vector3D correction(d * (delta / (length * w_sum)));
+      x[j] += correction * w[j];
+      x[j+1] -= correction * w[j+1];
+    }
+    if(max_error <= bond_constraints_tolerance_){
+      break;
+    }
+  }
+  // scatter updated coordinates
+  for(unsigned int j= 0; j<n; j++){
+    if(w[j] > 0.0){
+      core::XYZ(m, beads[j]).set_coordinates(x[j]);
+    }
+  }
+  return max_error;
+}
+
 IMPNPCTRANSPORT_END_NAMESPACE
@@ -14,6 +14,9 @@
 #include <IMP/atom/distance.h>
 #include <IMP/atom/Simulator.h>
 #include <IMP/core/XYZ.h>
+#include <algorithm>
+#include <cmath>
+#include <limits>
 
 IMPNPCTRANSPORT_BEGIN_NAMESPACE
 
@@ -22,7 +25,10 @@ ChainStatisticsOptimizerState::ChainStatisticsOptimizerState
   unsigned int periodicity )
   :
   P(ps[0]->get_model(), "ChainStatisticsOptimizerState%1%"),
-  ps_(ps),
+  pis_(IMP::get_indexes(ps)),
+  positions_(ps.size()),
+  last_positions_(ps.size()),
+  has_last_(false),
   mean_rgyr_(-1.0),
   mean_rgyr2_(-1.0),
   mean_end_to_end_(-1.0),
@@ -40,8 +46,10 @@ void ChainStatisticsOptimizerState::reset()
 {
   IMP_OBJECT_LOG;
   P::reset();
-  positions_.clear();
-  times_fs_.clear();
+  has_last_= false;
+  diffusion_estimator_.reset();
+  local_diffusion_estimators_.assign
+    (pis_.size(), internal::DiffusionCoefficientEstimator());
   mean_rgyr_= -1.0;
   mean_rgyr2_= -1.0;
   mean_end_to_end_= -1.0;
@@ -57,59 +65,25 @@ double ChainStatisticsOptimizerState::get_dt() const {
       ->get_maximum_time_step();
 }
 
+// disabled since it requires aligning the chain with each of its past
+// conformations, which is time consuming
 double ChainStatisticsOptimizerState::get_correlation_time() const
 {
-  IMP_OBJECT_LOG;
-  bool IS_DISABLED=true; // DISABLE FOR NOW CAUSE TIME CONSUMING
-  if(IS_DISABLED){
-    return std::numeric_limits<double>::infinity();
-  }
-  double sum= 0;
-  int n= 0;
-  for (unsigned int i= 0; i < positions_.size(); ++i) {
-    double last= 0;
-    for (unsigned int j= i + 1; j < positions_.size(); ++j) {
-      algebra::Transformation3D tr =
-          algebra::get_transformation_aligning_first_to_second(positions_[i],
-                                                               positions_[j]);
-      algebra::Rotation3D rel = tr.get_rotation();
-      double angle = algebra::get_axis_and_angle(rel).second;
-      if (angle > 1) {
-        sum += get_period() * (j - i - 1 + (angle - last)) * get_dt();
-        ++n;
-        break;
-      }
-      last = angle;
-    }
-  }
-  IMP_LOG(VERBOSE, n << " correlation events" << std::endl);
-
-  if (n == 0) {
-    return std::numeric_limits<double>::infinity();
-  }
-  return sum / n;
+  return std::numeric_limits<double>::infinity();
 }
 
 Floats
 ChainStatisticsOptimizerState::get_local_diffusion_coefficients() const
 {
   IMP_OBJECT_LOG;
-  if (positions_.empty()) return Floats();
-  Vector<algebra::Vector3Ds> displacements(
-      positions_[0].size(), algebra::Vector3Ds(positions_.size() - 1));
-  for (unsigned int i= 1; i < positions_.size(); ++i) {
-    algebra::Transformation3D rel =
-        algebra::get_transformation_aligning_first_to_second(positions_[i - 1],
-                                                             positions_[i]);
-    for (unsigned int j= 0; j < positions_[i].size(); ++j) {
-      displacements[j][i - 1] =
-          rel.get_transformed(positions_[i - 1][j]) - positions_[i][j];
-    }
+  // not enough data before the first displacement
+  if (pis_.empty() ||
+      local_diffusion_estimators_[0].get_number_of_displacements() == 0) {
+    return Floats();
   }
-  Floats ret;
-  for (unsigned int i = 0; i < displacements.size(); ++i) {
-    ret.push_back(atom::get_diffusion_coefficient(displacements[i],
-                                                  get_period() * get_dt()));
+  Floats ret(local_diffusion_estimators_.size());
+  for (unsigned int i = 0; i < ret.size(); ++i) {
+    ret[i]= local_diffusion_estimators_[i].get_diffusion_coefficient();
   }
   return ret;
 }
@@ -117,37 +91,7 @@ ChainStatisticsOptimizerState::get_local_diffusion_coefficients() const
 double ChainStatisticsOptimizerState::get_diffusion_coefficient() const
 {
   IMP_OBJECT_LOG;
-  // Checks:
-  unsigned int n= positions_.size();
-  IMP_USAGE_CHECK(times_fs_.size() == n,
-                  "Length of times and positions lists is expected to be equal");
-  if (n<2){
-    return 0;
-  }
-  if (times_fs_.front() - times_fs_.back() == 0.0) {
-    return 0;
-  }
-  // Compute chain center-of-mass displacement and dT vectors:
-  algebra::Vector3Ds positions(positions_.size());
-  for (unsigned int i= 0; i < positions_.size(); ++i) {
-    positions[i] = std::accumulate(positions_[i].begin(), positions_[i].end(),
-                                   algebra::get_zero_vector_d<3>()) /
-                   positions_[i].size();
-  }
-  algebra::Vector3Ds displacements;
-  displacements.reserve(n-1);
-  std::transform(positions.begin()+1, positions.end(),
-                 positions.begin(),
-                 std::back_inserter(displacements),
-                 std::minus<algebra::Vector3D>());
-  IMP::Floats dts;
-  dts.reserve(n-1);
-  std::transform(times_fs_.begin()+1, times_fs_.end(),
-                   times_fs_.begin(),
-                 std::back_inserter(dts),
-                 std::minus<double>());
-  return atom::get_diffusion_coefficient
-    (displacements, dts); //  get_period() * get_dt());
+  return diffusion_estimator_.get_diffusion_coefficient();
 }
 
 void ChainStatisticsOptimizerState::do_update(unsigned int) {
@@ -156,41 +100,64 @@ void ChainStatisticsOptimizerState::do_update(unsigned int) {
     dynamic_cast< atom::Simulator* >( get_optimizer() );
   IMP_USAGE_CHECK( simulator, "Optimizer must be a simulator in order to use "
                    "ChainStatisticsOptimizerState, for time stats" );
-  // Get positions and times from current round:
-  algebra::Vector3Ds vs;
-  for (unsigned int i= 0; i < ps_.size(); ++i) {
-    vs.push_back(core::XYZ(ps_[i]).get_coordinates());
+  Model* m= get_model();
+  unsigned int n= pis_.size();
+  // Get positions from current round, and their center, mean square
+  // magnitude and mean square radius for the radius of gyration:
+  std::swap(positions_, last_positions_);
+  algebra::Vector3D center(0.0, 0.0, 0.0);
+  double mean_square= 0.0;
+  double mean_square_radius= 0.0;
+  for (unsigned int i= 0; i < n; ++i) {
+    algebra::Sphere3D const& s= m->get_sphere(pis_[i]);
+    algebra::Vector3D const& x= s.get_center();
+    positions_[i]= x;
+    center+= x;
+    mean_square+= x.get_squared_magnitude();
+    mean_square_radius+= s.get_radius() * s.get_radius();
   }
+  center/= n;
+  mean_square/= n;
+  mean_square_radius/= n;
+  // Diffusion of chain and of each particle in the chain frame:
   double cur_time_fs = simulator->get_current_time();
-  times_fs_.push_back( cur_time_fs );
-  positions_.push_back(vs);
-  while (positions_.size() > 1000) {
-    times_fs_.pop_front();
-    positions_.pop_front();
+  if (has_last_ && cur_time_fs > last_time_fs_) {
+    diffusion_estimator_.add_displacement(center - last_center_,
+                                          cur_time_fs - last_time_fs_);
+    algebra::Transformation3D rel =
+      algebra::get_transformation_aligning_first_to_second(last_positions_,
+                                                           positions_);
+    double dt= get_period() * get_dt();
+    for (unsigned int i= 0; i < n; ++i) {
+      local_diffusion_estimators_[i].add_displacement
+        ( rel.get_transformed(last_positions_[i]) - positions_[i], dt );
+    }
   }
+  has_last_= true;
+  last_center_= center;
+  last_time_fs_= cur_time_fs;
   // Radius of gyration and end-to-end distance of chain/bond:
   double w= 1.0/(++n_);
-#ifdef IMP_NPCTRANSPORT_USE_IMP_CGAL
-  double rgyr= atom::get_radius_of_gyration(ps_, false);
-#else
-  double rgyr=-1.0;
-#endif
-  double rgyr2= rgyr*rgyr;
+  // same as atom::get_radius_of_gyration(), including the 0.6*r^2
+  // contribution of each sphere about its own center
+  double rgyr2= std::max(mean_square - center.get_squared_magnitude(), 0.0)
+    + 0.6 * mean_square_radius;
+  double rgyr= std::sqrt(rgyr2);
   mean_rgyr_=  w*rgyr  + (1-w)*mean_rgyr_;
   mean_rgyr2_= w*rgyr2 + (1-w)*mean_rgyr2_;
-  double end_to_end= core::get_distance( core::XYZ(ps_.front()),
-                                         core::XYZ(ps_.back() ) );
+  double end_to_end= algebra::get_distance( positions_.front(),
+                                            positions_.back() );
   double end_to_end2 = end_to_end*end_to_end;
   mean_end_to_end_=  w*end_to_end +  (1-w)*mean_end_to_end_;
   mean_end_to_end2_= w*end_to_end2 + (1-w)*mean_end_to_end2_;
 
   double cur_mean_bond_distance(0.0);
   double cur_mean_bond_distance2(0.0);
-  for(unsigned int i=1; i<ps_.size(); i++){
-    double distance_i= core::get_distance( core::XYZ(ps_[i-1]),
-                                           core::XYZ(ps_[i]) );
-    cur_mean_bond_distance+=  distance_i/(ps_.size()-1);
-    cur_mean_bond_distance2+= (distance_i*distance_i)/(ps_.size()-1);
+  for(unsigned int i=1; i<n; i++){
+    double distance_i= algebra::get_distance( positions_[i-1],
+                                              positions_[i] );
+    cur_mean_bond_distance+=  distance_i/(n-1);
+    cur_mean_bond_distance2+= (distance_i*distance_i)/(n-1);
   }
   mean_bond_distance_= w*cur_mean_bond_distance + (1-w)*mean_bond_distance_;
   mean_bond_distance2_= w*cur_mean_bond_distance2 + (1-w)*mean_bond_distance2_;
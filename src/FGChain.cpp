@@ -83,6 +83,11 @@ FGChain::get_chain_restraints
   if(!bonds_restraint_){ // TODO: fix for dynamic chain topology?
     update_bonds_restraint(scoring_manager);
   }
+  if(scoring_manager->get_is_backbone_constrained()){
+    // bonds are enforced by the simulator, but the restraint is still
+    // created above so that bonded pairs are excluded from close pairs
+    return Restraints();
+  }
   return Restraints(1,bonds_restraint_);
 }
 
@@ -0,0 +1,143 @@
+/**
+ *  \file ParticlesTransportStatisticsOptimizerState.cpp
+ *  \brief batched transport statistics over a group of particles
+ *
+ *  Copyright 2007-2018 IMP Inventors. All rights reserved.
+ *
+ */
+
+#include <IMP/npctransport/ParticlesTransportStatisticsOptimizerState.h>
+#include <IMP/npctransport/Transporting.h>
+#include <IMP/npctransport/Statistics.h>
+#include <IMP/check_macros.h>
+#include <IMP/exception.h>
+#include <IMP/log.h>
+
+IMPNPCTRANSPORT_BEGIN_NAMESPACE
+
+ParticlesTransportStatisticsOptimizerState::
+    ParticlesTransportStatisticsOptimizerState(
+        const ParticlesTemp& ps, Float bottom_z, Float top_z,
+        WeakPointer<IMP::npctransport::Statistics> statistics_manager,
+        WeakPointer<IMP::atom::Simulator> owner)
+      : P(ps.empty() ? nullptr : ps[0]->get_model(),
+          "ParticlesTransportStatisticsOptimizerState%1%"),
+        bottom_z_(bottom_z),
+        top_z_(top_z),
+        statistics_manager_(statistics_manager),
+        owner_(owner) {
+  IMP_USAGE_CHECK(!ps.empty(), "at least one particle is expected");
+  for (unsigned int i = 0; i < ps.size(); i++) {
+    add_particle(ps[i]);
+  }
+}
+
+void ParticlesTransportStatisticsOptimizerState::add_particle(Particle* p) {
+  IMP_USAGE_CHECK(p->get_model() == get_model(),
+                  "all particles must belong to the same model");
+  IMP_ALWAYS_CHECK(!Transporting::get_is_setup(p),
+                   "Particle already defined as a transporting particle,"
+                   " and cannot be tracked by this object",
+                   IMP::ValueException);
+  Transporting::setup_particle(p, false);  // initial value doesn't matter
+  pis_.push_back(p->get_index());
+  this->reset();
+}
+
+ParticlesTemp ParticlesTransportStatisticsOptimizerState::get_particles()
+    const {
+  return IMP::get_particles(get_model(), pis_);
+}
+
+void ParticlesTransportStatisticsOptimizerState::reset() {
+  P::reset();
+  unsigned int n = pis_.size();
+  n_transports_up_.assign(n, 0);
+  n_transports_down_.assign(n, 0);
+  transport_time_points_in_ns_.clear();
+  Model* m = get_model();
+  for (unsigned int i = 0; i < n; i++) {
+    m->set_attribute(Transporting::get_n_entries_bottom_key(), pis_[i], 0);
+    m->set_attribute(Transporting::get_n_entries_top_key(), pis_[i], 0);
+  }
+  is_reset_ = true;
+  IMP_LOG(PROGRESS, "ParticlesTransportStatistics - RESET" << std::endl);
+}
+
+void ParticlesTransportStatisticsOptimizerState::load_from_decorators() {
+  Model* m = get_model();
+  unsigned int n = pis_.size();
+  last_z_.resize(n);
+  n_entries_bottom_.resize(n);
+  n_entries_top_.resize(n);
+  is_last_entry_from_top_.resize(n);
+  for (unsigned int i = 0; i < n; i++) {
+    n_entries_bottom_[i] =
+      m->get_attribute(Transporting::get_n_entries_bottom_key(), pis_[i]);
+    n_entries_top_[i] =
+      m->get_attribute(Transporting::get_n_entries_top_key(), pis_[i]);
+    is_last_entry_from_top_[i] =
+      m->get_attribute(Transporting::get_is_last_entry_from_top_key(),
+                       pis_[i]) != 0;
+  }
+}
+
+void ParticlesTransportStatisticsOptimizerState::do_update(unsigned int) {
+  const double fs_in_ns = 1.0E+6;
+  Model* m = get_model();
+  unsigned int n = pis_.size();
+  if (is_reset_) {
+    load_from_decorators();
+  }
+  FloatKey last_z_key = Transporting::get_last_tracked_z_key();
+  double time_ns = 0.0;
+  if (owner_ != nullptr) {
+    time_ns = owner_->get_current_time() / fs_in_ns;
+  }
+  for (unsigned int i = 0; i < n; i++) {
+    double cur_z = m->get_sphere(pis_[i]).get_center()[2];
+    double prev_z = is_reset_ ? cur_z : last_z_[i];  // ignore previous z if reset
+    last_z_[i] = cur_z;
+    m->set_attribute(last_z_key, pis_[i], cur_z);  // save for RMF, etc.
+    bool is_exit_up = cur_z > top_z_ && prev_z <= top_z_;
+    bool is_exit_down = cur_z < bottom_z_ && prev_z >= bottom_z_;
+    bool is_entry_top = cur_z < top_z_ && prev_z >= top_z_;
+    bool is_entry_bottom = cur_z > bottom_z_ && prev_z <= bottom_z_;
+    if (!(is_exit_up || is_exit_down || is_entry_top || is_entry_bottom)) {
+      continue; // most particles in most updates
+    }
+    // update transport events
+    if (is_exit_up && n_entries_bottom_[i] > 0 &&
+        !is_last_entry_from_top_[i]) {
+      n_transports_up_[i]++;
+      transport_time_points_in_ns_.push_back(time_ns);
+      IMP_LOG(PROGRESS, "EXIT UP " << m->get_particle_name(pis_[i])
+              << " n_transports_up = " << n_transports_up_[i]
+              << " prev_z = " << prev_z << std::endl);
+    }
+    if (is_exit_down && n_entries_top_[i] > 0 &&
+        is_last_entry_from_top_[i]) {
+      n_transports_down_[i]++;
+      transport_time_points_in_ns_.push_back(time_ns);
+      IMP_LOG(PROGRESS, "EXIT DOWN " << m->get_particle_name(pis_[i])
+              << " n_transports_down = " << n_transports_down_[i]
+              << " prev_z = " << prev_z << std::endl);
+    }
+    // update channel entry directionality
+    if (is_entry_top) {
+      is_last_entry_from_top_[i] = true;
+      n_entries_top_[i]++;
+    }
+    if (is_entry_bottom) {
+      is_last_entry_from_top_[i] = false;
+      n_entries_bottom_[i]++;
+    }
+    Transporting pt(m, pis_[i]);
+    pt.set_is_last_entry_from_top(is_last_entry_from_top_[i]);
+    pt.set_n_entries_top(n_entries_top_[i]);
+    pt.set_n_entries_bottom(n_entries_bottom_[i]);
+  }
+  is_reset_ = false;
+}
+
+IMPNPCTRANSPORT_END_NAMESPACE
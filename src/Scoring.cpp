@@ -18,6 +18,7 @@
 #include <IMP/npctransport/AnchorToCylindricalPorePairScore.h>
 #include <IMP/npctransport/PoreRadiusSingletonScore.h>
 #include <IMP/npctransport/ZBiasSingletonScore.h>
+#include <IMP/npctransport/internal/TAMDChain.h>
 #include <IMP/npctransport/internal/npctransport.pb.h>
 #include <IMP/npctransport/typedefs.h>
 #include <IMP/npctransport/util.h>
@@ -86,6 +87,11 @@ Scoring::Scoring
   GET_ASSIGNMENT(interaction_range);
   GET_ASSIGNMENT(backbone_k);
   GET_VALUE(is_backbone_harmonic);
+  GET_VALUE(is_backbone_constrained);
+  IMP_ALWAYS_CHECK(!(is_backbone_constrained_ && is_backbone_harmonic_),
+                   "constrained backbone bonds are not supported"
+                   " for a harmonic backbone",
+                   IMP::ValueException);
   GET_ASSIGNMENT(slack);
   GET_ASSIGNMENT(nonspecific_k);
   GET_ASSIGNMENT(nonspecific_range);
@@ -514,6 +520,13 @@ Scoring::add_chain_restraints(FGChain* chain)
     ParticleIndex bi = chain->get_bead_index(i);
     bead_to_chain_map_[bi] = chain;
   }
+  // TAMD centroids are maintained by the forest of the model, to which
+  // the chain was added when it was created
+  internal::TAMDChain* tamd_chain =
+    dynamic_cast<internal::TAMDChain*>(chain);
+  if(tamd_chain && !tamd_chain->get_tamd_centroids().empty()){
+    tamd_forest_ = internal::get_tamd_forest(get_model());
+  }
 }
 
 
@@ -588,6 +601,11 @@ Scoring::remove_particle_type
     core::ParticleType cur_type= core::Typed(get_model(),
                                        h_root.get_particle_index()).get_type();
     if(pt == cur_type){
+      internal::TAMDChain* tamd_chain =
+        dynamic_cast<internal::TAMDChain*>(iter->get());
+      if(tamd_chain && tamd_forest_){
+        tamd_forest_->remove_chain(tamd_chain);
+      }
       chains_set_.erase(iter++);
     }else{
       iter++;
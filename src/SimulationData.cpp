@@ -21,11 +21,13 @@
 // #include <IMP/npctransport/particle_types.h>
 #include <IMP/npctransport/protobuf.h>
 #include <IMP/npctransport/internal/npctransport.pb.h>
+#include <IMP/npctransport/internal/OutputFileView.h>
 #include <IMP/npctransport/enums.h>
 #include <IMP/npctransport/io.h>
 #include <IMP/npctransport/typedefs.h>
 #include <IMP/npctransport/util.h>
 #include <IMP/algebra/vector_generators.h>
+#include <IMP/atom/constants.h>
 #include <IMP/atom/distance.h>
 #include <IMP/atom/Diffusion.h>
 #include <IMP/atom/Mass.h>
@@ -51,6 +53,7 @@
 #include <IMP/rmf/atom_io.h>
 #include <IMP/rmf/frames.h>
 #include <algorithm>
+#include <cstdio>
 #include <iterator>
 #include <numeric>
 #include <set>
@@ -107,6 +110,27 @@ namespace {
   {
     return SlabWithPore::get_is_setup(p);
   }
+
+  // an RMF writer that lands the saved particles that are in free
+  // flight before saving their coordinates
+  class FreeFlightsSynchronizedSaveOptimizerState
+    : public rmf::SaveOptimizerState {
+    ParticleIndexes saved_pis_;
+  public:
+    FreeFlightsSynchronizedSaveOptimizerState(Model* m, RMF::FileHandle fh,
+                                              const ParticleIndexes& saved_pis)
+      : rmf::SaveOptimizerState(m, fh), saved_pis_(saved_pis) {}
+
+  protected:
+    virtual void do_update(unsigned int call_num) IMP_OVERRIDE {
+      BrownianDynamicsTAMDWithSlabSupport* bd =
+        dynamic_cast<BrownianDynamicsTAMDWithSlabSupport*>(get_optimizer());
+      if(bd) {
+        bd->synchronize_free_diffusion_flights(saved_pis_);
+      }
+      rmf::SaveOptimizerState::do_update(call_num);
+    }
+  };
 };
 
 SimulationData::SimulationData(std::string prev_output_file, bool quick,
@@ -132,23 +156,14 @@ void SimulationData::initialize(std::string prev_output_file,
                                 std::string new_output_file,
                                 bool quick) {
   m_ = new Model("NPC model %1%");
-  ::npctransport_proto::Output pb_data;
-  //  std::ifstream file(prev_output_file.c_str(), std::ios::binary);
-  //  bool read = pb_data.ParseFromIstream(&file);
-  bool read(false);
-  int fd= IMP_C_OPEN(prev_output_file.c_str(),
-                     IMP_C_OPEN_FLAG(O_RDONLY) | IMP_C_OPEN_BINARY);
-  if(fd!=-1){
-    google::protobuf::io::FileInputStream fis(fd);
-    google::protobuf::io::CodedInputStream cis(&fis);
-    cis.SetTotalBytesLimit(500000000,200000000);
-    read= pb_data.ParseFromCodedStream(&cis);
-    IMP_C_CLOSE(fd);
-  }
+  // scan the previous output without parsing its accumulated statistics,
+  // which are needed only by the Statistics object and loaded by it later
+  internal::OutputFileView prev_output(prev_output_file);
+  ::npctransport_proto::Output pb_data; // assignment only
+  bool read= prev_output.get_assignment(pb_data.mutable_assignment());
   IMP_ALWAYS_CHECK(read,
                    "Unable to read data from protobuf" << prev_output_file,
                    IMP::IOException);
-  pb_data.mutable_statistics(); // create it if not there
   const ::npctransport_proto::Assignment &
       pb_assignment= pb_data.assignment();
   ::npctransport_proto::Assignment*
@@ -157,6 +172,7 @@ void SimulationData::initialize(std::string prev_output_file,
   GET_ASSIGNMENT(box_side);
   GET_ASSIGNMENT(tunnel_radius);
   GET_ASSIGNMENT_DEF(tunnel_radius_k, -1.0);
+  GET_ASSIGNMENT_DEF(tunnel_radius_tau_ns, 1.0);
   GET_ASSIGNMENT_DEF(pore_anchored_beads_k, -1.0);
   GET_ASSIGNMENT(slab_thickness);
   GET_ASSIGNMENT(slab_is_on);
@@ -168,6 +184,7 @@ void SimulationData::initialize(std::string prev_output_file,
   GET_VALUE(range);
   GET_VALUE(statistics_interval_frames);
   GET_VALUE_DEF(output_statistics_interval_frames,10000);
+  GET_VALUE_DEF(spatial_sort_interval_frames, 0);
   GET_ASSIGNMENT(statistics_fraction);
   GET_VALUE(time_step);
   GET_ASSIGNMENT_DEF(time_step_wave_factor, 0.0);
@@ -177,14 +194,14 @@ void SimulationData::initialize(std::string prev_output_file,
   GET_VALUE_DEF(is_exclude_floaters_from_slab_initially, false);
   GET_ASSIGNMENT_DEF(temperature_k, strip_units(IMP::internal::DEFAULT_TEMPERATURE));
   GET_VALUE_DEF(is_xyz_hist_stats, false)
+  GET_VALUE_DEF(is_rotational_correlation_stats, false);
   GET_VALUE_DEF(is_backbone_harmonic, false);
   GET_ASSIGNMENT_DEF(backbone_tau_ns, 1.0);
+  GET_ASSIGNMENT_DEF(free_diffusion_safety_shell, -1.0);
   initial_simulation_time_ns_ = 0.0; // default
-  if (pb_data.has_statistics()) {
-    if (pb_data.statistics().has_bd_simulation_time_ns()) {
-      initial_simulation_time_ns_ =
-        (pb_data.statistics().bd_simulation_time_ns() * FS_IN_NS);
-    }
+  if (prev_output.get_has_bd_simulation_time_ns()) {
+    initial_simulation_time_ns_ =
+      (prev_output.get_bd_simulation_time_ns() * FS_IN_NS);
   }
   if (quick) {
     number_of_frames_ = 2;
@@ -249,18 +266,31 @@ void SimulationData::initialize(std::string prev_output_file,
     create_obstacles(pb_assignment.obstacles(i));
   }
 
-  // Load coordinates from RMF conformation (or conformation) if they exist in protobuf:
-  if (pb_data.has_rmf_conformation())
+  // Load dynamic state from RMF conformation or conformation if they exist
+  // in protobuf (a checkpoint is loaded once interactions are added):
+  bool is_checkpoint =
+    prev_output.get_has_field(internal::OutputFileView::CHECKPOINT);
+  if (is_checkpoint)
+    {
+      IMP_LOG(VERBOSE, "Output file checkpoint is loaded after interactions"
+              << std::endl);
+    } else if
+        (prev_output.get_has_field(internal::OutputFileView::RMF_CONFORMATION))
     {
       IMP_LOG(VERBOSE, "Restarting from output file internal RMF conformation"
                 << std::endl);
-      RMF::BufferConstHandle buffer(pb_data.rmf_conformation());
+      RMF::BufferConstHandle buffer(prev_output.get_rmf_conformation());
       RMF::FileConstHandle fh =
         RMF::open_rmf_buffer_read_only(buffer);
       initialize_positions_from_rmf(fh, 0);
-    } else if (pb_data.has_conformation())
+    } else if
+        (prev_output.get_has_field(internal::OutputFileView::CONFORMATION))
     {
       IMP_LOG(VERBOSE, "Restarting from output file conformation" << std::endl);
+      IMP_ALWAYS_CHECK(prev_output.get_conformation
+                       (pb_data.mutable_conformation()),
+                       "Corrupt conformation in " << prev_output_file,
+                       IMP::IOException);
       load_pb_conformation(pb_data.conformation(), get_beads(), sites_);
     }
 
@@ -272,13 +302,47 @@ void SimulationData::initialize(std::string prev_output_file,
     add_interaction(interaction_i);
   }
 
+  // Load dynamic state and interaction statistics history from checkpoint:
+  if (is_checkpoint)
+    {
+      IMP_LOG(VERBOSE, "Restarting from output file checkpoint" << std::endl);
+      ::npctransport_proto::Checkpoint checkpoint;
+      IMP_ALWAYS_CHECK(prev_output.get_checkpoint(&checkpoint),
+                       "Corrupt checkpoint in " << prev_output_file,
+                       IMP::IOException);
+      load_pb_checkpoint(checkpoint, this);
+    }
+
   get_bd()->set_current_time( initial_simulation_time_ns_ );
   pb_mutable_assignment->add_imp_module_version
     ( IMP::get_module_version() );
   pb_mutable_assignment->add_npc_module_version
     ( IMP::npctransport::get_module_version() );
-  std::ofstream outf(new_output_file.c_str(), std::ios::binary);
-  pb_data.SerializeToOstream(&outf);
+  // write the updated assignment, followed by all other fields of the
+  // previous output copied verbatim, to a temporary file that replaces
+  // the new output file (which may be mapped as the previous one)
+  std::string tmp_output_file = new_output_file + ".tmp";
+  {
+    std::ofstream outf(tmp_output_file.c_str(), std::ios::binary);
+    pb_data.clear_conformation(); // copied verbatim below
+    pb_data.SerializePartialToOstream(&outf);
+    prev_output.write_fields_except(internal::OutputFileView::ASSIGNMENT,
+                                    outf);
+    if (!prev_output.get_has_field(internal::OutputFileView::STATISTICS)) {
+      ::npctransport_proto::Output pb_empty_statistics;
+      pb_empty_statistics.mutable_statistics();
+      pb_empty_statistics.SerializePartialToOstream(&outf);
+    }
+    IMP_ALWAYS_CHECK(outf, "Unable to write output file " << tmp_output_file,
+                     IMP::IOException);
+  }
+#if defined(_MSC_VER)
+  std::remove(new_output_file.c_str());
+#endif
+  IMP_ALWAYS_CHECK(std::rename(tmp_output_file.c_str(),
+                               new_output_file.c_str()) == 0,
+                   "Unable to write output file " << new_output_file,
+                   IMP::IOException);
 }
 
 
@@ -297,8 +361,14 @@ SimulationData::create_slab_particle()
                                          tunnel_radius_,
                                          1.0); // TODO: add support for skewed toroids
   }
-  SlabWithPore(slab_particle_)
-    .set_pore_radius_is_optimized(get_is_pore_radius_dynamic());
+  SlabWithPore swp(slab_particle_);
+  swp.set_pore_radius_is_optimized(get_is_pore_radius_dynamic());
+  if(get_is_pore_radius_dynamic()){
+    // diffuse by kT/k per tau, similarly to relaxing springs
+    double tau_fs(get_tunnel_radius_tau_ns()*FS_IN_NS);
+    swp.set_pore_radius_diffusion_coefficient
+      ( atom::get_kt(get_temperature_k())/(tau_fs*get_tunnel_radius_k()) );
+  }
 }
 
 /**
@@ -663,12 +733,8 @@ SimulationData::remove_fgs_with_prefix
   }
   // Remove fg types from assignment in output protobuf and reset
   // protobuf statistics:
-  ::npctransport_proto::Output output;
-  bool is_read= load_output_protobuf(get_statistics()->get_output_file_name(),
-                                     output);
-  IMP_ALWAYS_CHECK(is_read,
-                   "Couldn't read output file" << get_statistics()->get_output_file_name(),
-                   IMP::IOException);
+  ::npctransport_proto::Output& output=
+    *get_statistics()->get_mutable_output();
   ::npctransport_proto::Assignment* m_assignment= output.mutable_assignment();
   for(int i= m_assignment->fgs_size()-1; i>=0; i--){
     // loop from end to start because deleting affects tail
@@ -701,10 +767,7 @@ SimulationData::remove_fgs_with_prefix
   output.clear_statistics();
   output.mutable_statistics(); // recreate
   // dump to file
-  std::ofstream outf(get_statistics()->get_output_file_name().c_str(),
-                     std::ios::binary);
-  output.SerializeToOstream(&outf);
-  outf.flush();
+  get_statistics()->write_output();
 }
 
 
@@ -871,7 +934,9 @@ rmf::SaveOptimizerState *SimulationData::get_rmf_sos_writer() {
     if (get_rmf_file_name().empty()) return nullptr;
     RMF::FileHandle fh = RMF::create_rmf_file(get_rmf_file_name());
     link_rmf_file_handle(fh, is_save_restraints_to_rmf_);
-    IMP_NEW(rmf::SaveOptimizerState, los, (get_model(), fh));
+    // the linked hierarchies hold all beads
+    IMP_NEW(FreeFlightsSynchronizedSaveOptimizerState, los,
+            (get_model(), fh, IMP::get_indexes(beads_)));
     IMP_LOG(VERBOSE, "Dump interval for RMF SaveOptimizerState set to "
               << dump_interval_frames_ << std::endl);
     los->set_period(dump_interval_frames_);
@@ -997,7 +1062,7 @@ Statistics const * SimulationData::get_statistics() const
   return statistics_;
 }
 
-atom::BrownianDynamics
+BrownianDynamicsTAMDWithSlabSupport
 *SimulationData::get_bd
 (bool recreate)
 {
@@ -1011,6 +1076,34 @@ atom::BrownianDynamics
     bd_->set_scoring_function
       ( get_scoring()->get_scoring_function(recreate) );
     bd_->set_temperature(temperature_k_);
+    if(get_has_slab()) {
+      bd_->set_slab(get_slab_particle());
+    }
+    bd_->set_spatial_sort_interval(spatial_sort_interval_frames_);
+    if(get_scoring()->get_is_backbone_constrained()) {
+      FGChains chains(get_scoring()->get_fg_chains());
+      for(unsigned int i = 0; i < chains.size(); i++) {
+        bd_->add_constrained_chain(chains[i]);
+      }
+    }
+    if(free_diffusion_safety_shell_ > 0.0) {
+      ParticleIndexes floaters;
+      for(unsigned int i = 0; i < beads_.size(); i++) {
+        core::ParticleType pt= core::Typed(beads_[i]).get_type();
+        if(floater_types_.find(pt) != floater_types_.end()) {
+          floaters.push_back(beads_[i]->get_index());
+        }
+      }
+      bd_->set_free_diffusion_propagation
+        ( floaters,
+          IMP::get_indexes(beads_),
+          range_,
+          free_diffusion_safety_shell_,
+          statistics_interval_frames_ * time_step_ );
+      if(box_is_on_) {
+        bd_->set_free_diffusion_bounding_box(get_box());
+      }
+    }
     //#ifdef _OPENMP
     if (dump_interval_frames_ > 0 && !get_rmf_file_name().empty()) {
       bd_->add_optimizer_state(get_rmf_sos_writer());
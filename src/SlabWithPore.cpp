@@ -31,6 +31,24 @@ FloatKey SlabWithPore::get_pore_radius_key() {
   return fk;
 }
 
+void
+SlabWithPore::set_pore_radius_diffusion_coefficient(double D) const
+{
+  IMP_USAGE_CHECK(D >= 0.0,
+                  "pore radius diffusion coefficient must be non-negative");
+  FloatKey k(get_pore_radius_diffusion_coefficient_key());
+  if(get_particle()->has_attribute(k)) {
+    get_particle()->set_value(k, D);
+  } else {
+    get_particle()->add_attribute(k, D, false/*is_optimizable*/);
+  }
+}
+
+FloatKey SlabWithPore::get_pore_radius_diffusion_coefficient_key() {
+  static FloatKey fk("pore_radius_diffusion_coefficient");
+  return fk;
+}
+
 void SlabWithPore::show(std::ostream &out) const {
   out << "SlabWithPore thickness="
       << get_thickness()
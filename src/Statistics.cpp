@@ -15,6 +15,7 @@
 #include <IMP/npctransport/io.h>
 #include <IMP/npctransport/typedefs.h>
 #include <IMP/npctransport/util.h>
+#include <IMP/npctransport/internal/BlockAverage.h>
 #include <IMP/algebra/vector_generators.h>
 #include <IMP/atom/estimates.h>
 #include <IMP/atom/distance.h>
@@ -24,6 +25,7 @@
 #include <IMP/check_macros.h>
 #include <IMP/compiler_macros.h>
 #include <IMP/flags.h>
+#include <IMP/thread_macros.h>
 #include <IMP/core/pair_predicates.h>
 #include <IMP/core/XYZR.h>
 #include <IMP/core/generic.h>
@@ -35,8 +37,10 @@
 
 #include <algorithm>
 #include <numeric>
+#include <map>
 #include <set>
 #include <math.h>
+#include <cmath>
 #include "boost/tuple/tuple.hpp"
 
 #include <IMP/npctransport/internal/npctransport.pb.h>
@@ -70,10 +74,18 @@
 
 // struct Int32Traits : RMF::HDF5::SimpleTraits<Int32TraitsBase> {};
 
+bool save_rmf_to_output = false;
+IMP::AddBoolFlag  save_rmf_to_output_adder
+( "save_rmf_to_output",
+  "If true, save an rmf buffer to output file on every statistics update,"
+  " in addition to the compact checkpoint [default=false]",
+  &save_rmf_to_output);
+
 bool no_save_rmf_to_output = false;
 IMP::AddBoolFlag  no_save_rmf_to_output_adder
 ( "no_save_rmf_to_output",
-  "If true, save final rmf buffer to output file [default=false]",
+  "If true, never save rmf buffers to output file, not even on demand"
+  " (e.g. at the end of a run) [default=false]",
   &no_save_rmf_to_output);
 
 // TODO: turn into a template inline in unamed space?
@@ -109,6 +121,11 @@ Statistics::Statistics
   output_file_name_(output_file_name),
   is_stats_reset_(false)
 {
+  zr_distribution_sizes_.d0= 0;
+  zr_distribution_sizes_.d1= 0;
+  xyz_distribution_sizes_.d0= 0;
+  xyz_distribution_sizes_.d1= 0;
+  xyz_distribution_sizes_.d2= 0;
   if(owner_sd){
     global_stats_=
       new GlobalStatisticsOptimizerState(this, statistics_interval_frames_);
@@ -128,19 +145,22 @@ void Statistics::add_fg_chain_stats
            (chain_beads, statistics_interval_frames_ ) );
   core::ParticleType chain_type = core::Typed(fg_chain->get_root()).get_type();
   chains_stats_map_[chain_type].push_back( csos );
-  // stats for each chain particle
-  std::set<core::ParticleType> p_types_encountered;
+  // stats for all chain particles of each type
+  std::map<core::ParticleType, ParticlesTemp> p_type_beads;
   for (unsigned int k = 0; k < chain_beads.size(); ++k) {
     Particle* p = chain_beads[k];
     core::ParticleType p_type = core::Typed(p).get_type(); // note individual types may differ from chain type (of root) - e.g. suffix list in protobuf
-    if(p_types_encountered.find(p_type) == p_types_encountered.end()) {
-      p_types_encountered.insert(p_type);
-      fgs_bodies_stats_map_[p_type].push_back( BodyStatisticsOptimizerStates() );
-    }
-    IMP_NEW(BodyStatisticsOptimizerState, bsos,
-            ( p, this,  statistics_interval_frames_ ) );
-    fgs_bodies_stats_map_[p_type].back().push_back( bsos );
+    p_type_beads[p_type].push_back( p );
+    distribution_particles_map_[p_type].push_back( p );
   }  // for k
+  for (std::map<core::ParticleType, ParticlesTemp>::const_iterator
+         it = p_type_beads.begin(); it != p_type_beads.end(); it++) {
+    IMP_NEW(BodiesStatisticsOptimizerState, bsos,
+            ( it->second, this,  statistics_interval_frames_ ) );
+    bsos->set_is_correlation_time_on
+      ( get_sd()->get_is_rotational_correlation_stats() );
+    fgs_bodies_stats_map_[it->first].push_back( bsos );
+  }
 }
 
 //! add statistics about a floater particle
@@ -148,20 +168,33 @@ void Statistics::add_floater_stats
 ( Particle* p )
 {
   core::ParticleType type = core::Typed(p).get_type();
-  IMP_NEW(BodyStatisticsOptimizerState, bsos,
-          (p, this, statistics_interval_frames_));
-  floaters_stats_map_[type].push_back(bsos);
+  BodyStatisticsOSsMap::iterator it = floaters_stats_map_.find(type);
+  if (it == floaters_stats_map_.end()) {
+    floaters_stats_map_[type] = new BodiesStatisticsOptimizerState
+      (ParticlesTemp(1, p), this, statistics_interval_frames_);
+    floaters_stats_map_[type]->set_is_correlation_time_on
+      ( get_sd()->get_is_rotational_correlation_stats() );
+  } else {
+    it->second->add_particle(p);
+  }
+  distribution_particles_map_[type].push_back(p);
   if (get_sd()->get_has_slab() )
     {  // only if has pore
-      IMP_NEW(ParticleTransportStatisticsOptimizerState, ptsos,
-              (p,
-               -0.5 * get_sd()->get_slab_thickness(),  // pore bottom
-               0.5 * get_sd()->get_slab_thickness(),  // pore top
-               this // statistics manager
-               )
-              );
-      ptsos->set_period(statistics_interval_frames_);
-      floaters_transport_stats_map_[type].push_back( ptsos );
+      ParticleTransportStatisticsOSsMap::iterator it2 =
+        floaters_transport_stats_map_.find(type);
+      if (it2 == floaters_transport_stats_map_.end()) {
+        IMP_NEW(ParticlesTransportStatisticsOptimizerState, ptsos,
+                (ParticlesTemp(1, p),
+                 -0.5 * get_sd()->get_slab_thickness(),  // pore bottom
+                 0.5 * get_sd()->get_slab_thickness(),  // pore top
+                 this // statistics manager
+                 )
+                );
+        ptsos->set_period(statistics_interval_frames_);
+        floaters_transport_stats_map_[type] = ptsos;
+      } else {
+        it2->second->add_particle(p);
+      }
     }
 }
 
@@ -203,26 +236,60 @@ void Statistics::add_interaction_stats
       }
 }
 
+BipartitePairsStatisticsOptimizerStates
+Statistics::get_interaction_statistics_optimizer_states() const
+{
+  BipartitePairsStatisticsOptimizerStates ret;
+  for (BipartitePairsStatisticsOSMap::const_iterator
+         iter = interaction_stats_map_.begin();
+       iter != interaction_stats_map_.end(); iter++)
+    {
+      ret.push_back( iter->second );
+    }
+  return ret;
+}
+
 // get all statistics periodic optimizer states in one list
 OptimizerStates Statistics::add_optimizer_states(Optimizer* o)
 {
+  // the output file may have been rewritten since it was last loaded
+  output_.reset();
   if(o == nullptr) o = get_sd()->get_bd();
   IMP_ALWAYS_CHECK( o, "add_optimizer_states() require either a vaild input"
                     " optimizer or a valid get_sd()->get_bd()",  ValueException);
+  if(optimizer_states_group_) {
+    // release states from a previous activation
+    optimizer_states_group_->clear_optimizer_states();
+  }
+  optimizer_states_group_ = new internal::StatisticsOptimizerStatesGroup
+    ( get_model(), statistics_interval_frames_ );
+  internal::StatisticsOptimizerStatesGroup* group = optimizer_states_group_;
+  group->add_read_particles( get_read_particle_indexes() );
   OptimizerStates ret;
+  // global stats and interactions stats evaluate the scoring function
+  // and its caches, so they are updated serially before all others
   ret.push_back(global_stats_);
+  group->add_serial_optimizer_state(global_stats_);
+  for (BipartitePairsStatisticsOSMap::iterator
+         iter = interaction_stats_map_.begin();
+       iter != interaction_stats_map_.end(); iter++)
+    {
+      ret.push_back( iter->second ) ;
+      group->add_serial_optimizer_state( iter->second );
+    }
   for (FGsBodyStatisticsOSsMap::iterator iter = fgs_bodies_stats_map_.begin();
        iter != fgs_bodies_stats_map_.end(); iter++)
     {
-      for (unsigned int j = 0; j < iter->second.size(); j++)
-        {
-          ret += iter->second[j];
-        } // for j
+      for(unsigned int i = 0; i < iter->second.size(); i++) {
+        ret.push_back(iter->second[i]);
+        group->add_parallel_optimizer_state(iter->second[i]);
+      }
     } // for iter
   for (BodyStatisticsOSsMap::iterator iter = floaters_stats_map_.begin();
        iter != floaters_stats_map_.end(); iter++)
     {
-      ret += iter->second;
+      ret.push_back(iter->second);
+      group->add_parallel_optimizer_state(iter->second);
     } // for iter
   if ( get_sd()->get_has_slab() )
     {
@@ -230,27 +297,23 @@ OptimizerStates Statistics::add_optimizer_states(Optimizer* o)
              iter = floaters_transport_stats_map_.begin();
            iter != floaters_transport_stats_map_.end(); iter++)
         {
-          ret += iter->second;
-          for(unsigned int j = 0; j < iter->second.size(); j++) {
-            // TODO: this is problematic encapsulation wise
-            //       perhaps needs to provide 'owner' as parameter,
-            //       with default being get_sd()->get_bd()
-            iter->second[j]->set_owner( get_sd()->get_bd() );
-          } // for j
+          ret.push_back(iter->second);
+          group->add_parallel_optimizer_state(iter->second);
+          // TODO: this is problematic encapsulation wise
+          //       perhaps needs to provide 'owner' as parameter,
+          //       with default being get_sd()->get_bd()
+          iter->second->set_owner( get_sd()->get_bd() );
         } // for iter
     }
   for (ChainStatisticsOSsMap::iterator iter = chains_stats_map_.begin();
        iter != chains_stats_map_.end(); iter++)
     {
-      ret += iter->second;
+      for(unsigned int i = 0; i < iter->second.size(); i++) {
+        ret.push_back(iter->second[i]);
+        group->add_parallel_optimizer_state(iter->second[i]);
+      }
     } // for iter
-  for (BipartitePairsStatisticsOSMap::iterator
-         iter = interaction_stats_map_.begin();
-       iter != interaction_stats_map_.end(); iter++)
-    {
-      ret.push_back( iter->second ) ;
-    }
-  o->add_optimizer_states(ret);
+  o->add_optimizer_state(group);
   is_activated_= true;
   return ret;
 }
@@ -261,34 +324,38 @@ void
 Statistics::remove_particle_type
 (core::ParticleType pt)
 {
-  IMP::Pointer<Optimizer> optimizer= get_sd()->get_bd();
+  internal::StatisticsOptimizerStatesGroup* group=
+    is_activated_ ? optimizer_states_group_.get() : nullptr;
   // fg body stats:
   {
-    if(is_activated_){
-      FGsBodyStatisticsOSs fbsos_list= fgs_bodies_stats_map_[pt];
-      IMP_FOREACH(BodyStatisticsOptimizerStates bsos, fbsos_list)
-        {
-          optimizer->remove_optimizer_states(bsos);
-        }
+    if(group){
+      for(unsigned int i = 0; i < fgs_bodies_stats_map_[pt].size(); i++) {
+        group->remove_optimizer_state(fgs_bodies_stats_map_[pt][i]);
+      }
     }
     fgs_bodies_stats_map_.erase(pt);
   }
   // floaters stats:
-  if(is_activated_){
-    optimizer->remove_optimizer_states(floaters_stats_map_[pt]);
+  if(group &&
+     floaters_stats_map_.find(pt) != floaters_stats_map_.end()){
+    group->remove_optimizer_state(floaters_stats_map_[pt]);
   }
   floaters_stats_map_.erase(pt);
   // floaters transport stats:
-  if(is_activated_){
-    optimizer->remove_optimizer_states(floaters_transport_stats_map_[pt]);
+  if(group && floaters_transport_stats_map_.find(pt) !=
+     floaters_transport_stats_map_.end()){
+    group->remove_optimizer_state(floaters_transport_stats_map_[pt]);
   }
   floaters_transport_stats_map_.erase(pt);
   // particle distributions:
+  distribution_particles_map_.erase(pt);
   particle_type_zr_distribution_map_.erase(pt);
   particle_type_xyz_distribution_map_.erase(pt);
   // chain stats:
-  if(is_activated_){
-    optimizer->remove_optimizer_states(chains_stats_map_[pt]);
+  if(group){
+    for(unsigned int i = 0; i < chains_stats_map_[pt].size(); i++) {
+      group->remove_optimizer_state(chains_stats_map_[pt][i]);
+    }
   }
   chains_stats_map_.erase(pt);
   // interactions stats:
@@ -297,11 +364,11 @@ Statistics::remove_particle_type
               interaction_stats_map_)
     {
       InteractionType itype= iter.first;
-      if(is_activated_){
+      if(group){
         BipartitePairsStatisticsOptimizerState* bpsos= iter.second;
         if(itype.first==pt || itype.second==pt)
           {
-            optimizer->remove_optimizer_state(bpsos);
+            group->remove_optimizer_state(bpsos);
           }
       }
       interaction_types_delete_list.push_back(itype);
@@ -323,7 +390,7 @@ Statistics::update_xyz_distribution_to_hdf5
   ParticleTypeXYZDistributionMap::const_iterator ptxyzdm_it=
     particle_type_xyz_distribution_map_.find(p_type);
   if(ptxyzdm_it != particle_type_xyz_distribution_map_.end()) {
-    ParticleTypeXYZDistributionMap::mapped_type xyz_hist=
+    ParticleTypeXYZDistributionMap::mapped_type const& xyz_hist=
       ptxyzdm_it->second;
     // retrieve or create dataset in hdf5
     RMF::HDF5::DataSetD<RMF::HDF5::IntTraits, 3> ds_xyz;
@@ -343,26 +410,13 @@ Statistics::update_xyz_distribution_to_hdf5
       ds_xyz= hdf5_group.add_child_data_set
         < RMF::HDF5::IntTraits,3 > (s_type, dscp);
     }
-    // set size (override any existing settings):
-    boost::uint_fast8_t& d0= xyz_distribution_sizes_.d0;
-    boost::uint_fast8_t& d1= xyz_distribution_sizes_.d1;
-    boost::uint_fast8_t& d2= xyz_distribution_sizes_.d2;
-    ds_xyz.set_size(RMF::HDF5::DataSetIndexD<3>(d0,d1,d2));
-    // set non-zero values:
-    for(t_sparse_3d_matrix::iterator iter_ii= xyz_hist.begin();
-        iter_ii != xyz_hist.end(); iter_ii++){
-      boost::uint_fast8_t ii= iter_ii->first;
-      for(t_sparse_3d_matrix::mapped_type::iterator iter_jj= iter_ii->second.begin();
-          iter_jj != iter_ii->second.end(); iter_jj++){
-        boost::uint_fast8_t jj= iter_jj->first;
-        for(t_sparse_3d_matrix::mapped_type::mapped_type::iterator iter_kk= iter_jj->second.begin();
-            iter_kk != iter_jj->second.end(); iter_kk++){
-          boost::uint_fast8_t kk= iter_kk->first;
-          RMF::HDF5::DataSetIndexD<3> iijjkk(ii,jj,kk);
-          ds_xyz.set_value(iijjkk, iter_kk->second);
-        } // iter_kk
-      } // iter_jj
-    } // iter_ii
+    // set size (override any existing settings) and write all values
+    // at once (the histogram is already dense and in row-major order):
+    RMF::HDF5::DataSetIndexD<3> size(xyz_distribution_sizes_.d0,
+                                     xyz_distribution_sizes_.d1,
+                                     xyz_distribution_sizes_.d2);
+    ds_xyz.set_size(size);
+    ds_xyz.set_block(RMF::HDF5::DataSetIndexD<3>(0,0,0), size, xyz_hist);
     //    std::cout << "Finished outputing stats for " << s_type << std::endl;
     return true;
   } //if ptxyzdm_it
@@ -498,24 +552,24 @@ void Statistics::update_fg_stats
         IMP_USAGE_CHECK(fgs_bodies_stats_map_.find(fg_bead_type_i) !=
                         fgs_bodies_stats_map_.end(),
                         "type missing from stats");
-        FGsBodyStatisticsOSs& fbs_i = fgs_bodies_stats_map_.find(fg_bead_type_i)->second;
+        BodiesStatisticsOptimizerStates& fbs_i = fgs_bodies_stats_map_.find(fg_bead_type_i)->second;
         for (unsigned int j = 0; j < fbs_i.size(); ++j)
           {
-            BodyStatisticsOptimizerStates& fbs_ij = fbs_i[j];
-            for (unsigned int k = 0; k < fbs_ij.size(); ++k)
+            BodiesStatisticsOptimizerState* fbs_ij = fbs_i[j];
+            fbs_ij->update_always();
+            Floats dcs_ij = fbs_ij->get_diffusion_coefficients();
+            unsigned int per_frame = fbs_i.size() * dcs_ij.size();
+            for (unsigned int k = 0; k < dcs_ij.size(); ++k)
               {
-                BodyStatisticsOptimizerState* fbs_ijk = fbs_ij[k];
-                fbs_ij[k]->update_always();
-                unsigned int per_frame = fbs_i.size() * fbs_ij.size();
-                unsigned int cnf = (nf) * per_frame + j * fbs_ij.size() + k;
+                unsigned int cnf = (nf) * per_frame + j * dcs_ij.size() + k;
                 UPDATE_AVG(cnf, nf_new, *stats->mutable_fg_beads(i),
                            particle_correlation_time,
-                           fbs_ijk->get_correlation_time());
+                           fbs_ij->get_correlation_time(k));
                 UPDATE_AVG(cnf, nf_new, *stats->mutable_fg_beads(i),
                            particle_diffusion_coefficient,
-                           fbs_ijk->get_diffusion_coefficient());
-                fbs_ijk->reset();
+                           dcs_ij[k]);
               } // for k
+            fbs_ij->reset();
           } // for j
       }
       // Recreate z-r histogram based on retrieved zr_hist for each type of FG bead (not chain):
@@ -528,16 +582,17 @@ void Statistics::update_fg_stats
           particle_type_zr_distribution_map_.find(fg_bead_type_i);
         if(ptzrdm_it != particle_type_zr_distribution_map_.end())
           {
-            ParticleTypeZRDistributionMap::mapped_type zr_hist=
+            ParticleTypeZRDistributionMap::mapped_type const& zr_hist=
               ptzrdm_it->second;
             stats->mutable_fg_beads(i)->clear_zr_hist();
-            for(unsigned int ii=0; ii < zr_hist.size(); ii++)
+            unsigned int nr= zr_distribution_sizes_.d1;
+            for(unsigned int ii=0; ii < zr_distribution_sizes_.d0; ii++)
               {
                 ::npctransport_proto::Statistics_Ints* zii_r_hist=
                   stats->mutable_fg_beads(i)->mutable_zr_hist()->add_ints_list();
-                for(unsigned int jj=0; jj < zr_hist[ii].size(); jj++)
+                for(unsigned int jj=0; jj < nr; jj++)
                   {
-                    zii_r_hist->add_ints(zr_hist[ii][jj]);
+                    zii_r_hist->add_ints(zr_hist[ii*nr + jj]);
                   } // for jj
               } // for ii
           } // if ptzed_it
@@ -545,107 +600,265 @@ void Statistics::update_fg_stats
     } // for it (fg bead type)
 }
 
+namespace {
+  const float ZR_GRID_RESOLUTION_ANGSTROMS= 10.0; // resolution of zr grid
+}
+
+void Statistics
+::update_zr_distribution_sizes()
+{
+  bool is_z_symmetric=
+    (get_sd()->get_output_npctransport_version() < 2.0);
+  float z_max =  get_sd()->get_box_size() / 2.0; // get_z_distribution_top();
+  float r_max =  get_sd()->get_box_size() / std::sqrt(2.0); // get_r_distribution_max();
+  unsigned int nz=
+    (1 + !is_z_symmetric) * (std::floor(z_max/ZR_GRID_RESOLUTION_ANGSTROMS) + 5); // +5 for slack
+  unsigned int nr=
+    std::floor(r_max/ZR_GRID_RESOLUTION_ANGSTROMS)+5; // +5 for slack
+  if(nz != zr_distribution_sizes_.d0 || nr != zr_distribution_sizes_.d1) {
+    // bins of existing histograms are meaningless in the new grid
+    particle_type_zr_distribution_map_.clear();
+    zr_distribution_sizes_.d0= nz;
+    zr_distribution_sizes_.d1= nr;
+  }
+}
+
+std::vector<int>&
+Statistics
+::get_zr_distribution(core::ParticleType pt)
+{
+  std::vector<int>& ret= particle_type_zr_distribution_map_[pt];
+  if(ret.empty()) {
+    ret.resize(zr_distribution_sizes_.d0 * zr_distribution_sizes_.d1, 0);
+  }
+  return ret;
+}
+
 void Statistics
 ::update_particle_type_zr_distribution_map
 ( Particle* p )
+{
+  update_particle_type_zr_distribution_map(core::Typed(p).get_type(),
+                                           ParticlesTemp(1, p));
+}
+
+void Statistics
+::update_particle_type_zr_distribution_map
+( core::ParticleType pt, const ParticlesTemp& ps )
 {
   IMP_OBJECT_LOG;
   if ( !get_sd()->get_has_slab() || !get_sd()->get_has_bounding_box() ){
     return;
   }
-  const float GRID_RESOLUTION_ANGSTROMS= 10.0; // resolution of zr grid
   bool is_z_symmetric=
     (get_sd()->get_output_npctransport_version() < 2.0);
-  core::ParticleType pt( core::Typed(p).get_type() );
-  std::pair<ParticleTypeZRDistributionMap::iterator, bool> it_pair;
-  it_pair.first= particle_type_zr_distribution_map_.find(pt);
-  // add distribution table if needed
-  if(it_pair.first==particle_type_zr_distribution_map_.end()) {
-    float z_max =  get_sd()->get_box_size() / 2.0; // get_z_distribution_top();
-    float r_max =  get_sd()->get_box_size() / std::sqrt(2.0); // get_r_distribution_max();
-    unsigned int nz=
-      (1 + !is_z_symmetric) * (std::floor(z_max/GRID_RESOLUTION_ANGSTROMS) + 5); // +5 for slack
-    unsigned int nr=
-      std::floor(r_max/GRID_RESOLUTION_ANGSTROMS)+5; // +5 for slack
-    ParticleTypeZRDistributionMap::value_type vt =
-      std::make_pair(pt,
-                     std::vector<std::vector<int> >
-                     (nz, std::vector<int>(nr, 0)));
-    it_pair=particle_type_zr_distribution_map_.insert(vt);
-    IMP_USAGE_CHECK(it_pair.second, "type " << pt << " already exists");
+  update_zr_distribution_sizes();
+  std::vector<int>& hist= get_zr_distribution(pt);
+  int nz= zr_distribution_sizes_.d0;
+  int nr= zr_distribution_sizes_.d1;
+  int z_offset= (nz/2)*(!is_z_symmetric);
+  Model* m= get_model();
+  // compute flat bin indexes in parallel (-1 if outside the grid),
+  // then accumulate them serially
+  int n= ps.size();
+  std::vector<int> bins(n);
+  IMP_OMP_PRAGMA(parallel for schedule(static) if(n > 1000))
+  for(int i= 0; i < n; i++) {
+    const algebra::Vector3D& v= m->get_sphere(ps[i]->get_index()).get_center();
+    float z= is_z_symmetric ? std::abs(v[2]) : v[2];
+    float r= std::sqrt(v[0]*v[0] + v[1]*v[1]);
+    int zz= std::floor(z/ZR_GRID_RESOLUTION_ANGSTROMS) + z_offset;
+    int rr= std::floor(r/ZR_GRID_RESOLUTION_ANGSTROMS);
+    bool is_in= (zz < nz && rr < nr && zz >= 0);
+    bins[i]= is_in ? zz*nr + rr : -1;
+  }
+  for(int i= 0; i < n; i++) {
+    if(bins[i] >= 0) {
+      hist[bins[i]]++;
+    }
+  }
+}
+
+void Statistics
+::update_particle_distributions()
+{
+  bool is_xyz= get_sd()->get_is_xyz_hist_stats();
+  for(ParticleTypeParticlesMap::const_iterator
+        it= distribution_particles_map_.begin();
+      it != distribution_particles_map_.end(); it++) {
+    if(is_xyz) {
+      update_particle_type_xyz_distribution_map(it->first, it->second);
+    } else {
+      update_particle_type_zr_distribution_map(it->first, it->second);
+    }
   }
-  ParticleTypeZRDistributionMap::iterator& it=it_pair.first;
-  //update distribution
-  core::XYZ xyz(p);
-  float x= xyz.get_x();
-  float y= xyz.get_x();
-  float z= xyz.get_z();
-  if(is_z_symmetric){
-    z= std::abs(z);
+}
+
+ParticleIndexes Statistics
+::get_read_particle_indexes() const
+{
+  ParticleIndexes ret;
+  for(ParticleTypeParticlesMap::const_iterator
+        it= distribution_particles_map_.begin();
+      it != distribution_particles_map_.end(); it++) {
+    for(unsigned int i= 0; i < it->second.size(); i++) {
+      ret.push_back(it->second[i]->get_index());
+    }
   }
-  float r= std::sqrt( x*x+y*y);
-  unsigned int nz= it->second.size();
-  unsigned int zz= std::floor(z/GRID_RESOLUTION_ANGSTROMS)
-    + (nz/2)*(!is_z_symmetric);
-  unsigned int rr= std::floor(r/GRID_RESOLUTION_ANGSTROMS);
-  it->second[zz][rr]++;
+  return ret;
+}
+
+namespace {
+  const float XYZ_GRID_RESOLUTION_ANGSTROMS=10; // resolution of xyz grid
+  const float XYZ_CROP_FACTOR=0.5; // crop 0.5*Crop x 2 on each dimension (e.g. for box size of 200, only include -50 to +50 and not -100 to +100 on each dimension
+  const double XYZ_MAX_CROP=1000.0;
+}
+
+void Statistics
+::update_xyz_distribution_sizes()
+{
+  bool is_z_symmetric=
+    (get_sd()->get_output_npctransport_version() < 2.0);
+  float box_half =  std::min(get_sd()->get_box_size() / 2.0, XYZ_MAX_CROP); // get_z_distribution_top();
+  unsigned int half_n_max= std::floor(box_half/XYZ_GRID_RESOLUTION_ANGSTROMS*XYZ_CROP_FACTOR) + 5; // +5 for slack
+  unsigned int nx= 2 * half_n_max;
+  unsigned int ny= 2 * half_n_max;
+  unsigned int nz= (1 + !is_z_symmetric) * half_n_max;
+  if(nx != xyz_distribution_sizes_.d0 ||
+     ny != xyz_distribution_sizes_.d1 ||
+     nz != xyz_distribution_sizes_.d2) {
+    // bins of existing histograms are meaningless in the new grid
+    particle_type_xyz_distribution_map_.clear();
+    xyz_distribution_sizes_.d0= nx;
+    xyz_distribution_sizes_.d1= ny;
+    xyz_distribution_sizes_.d2= nz;
+  }
+}
+
+std::vector<int>&
+Statistics
+::get_xyz_distribution(core::ParticleType pt)
+{
+  std::vector<int>& ret= particle_type_xyz_distribution_map_[pt];
+  if(ret.empty()) {
+    ret.resize(xyz_distribution_sizes_.d0 * xyz_distribution_sizes_.d1
+               * xyz_distribution_sizes_.d2, 0);
+  }
+  return ret;
 }
 
 void Statistics
 ::update_particle_type_xyz_distribution_map
 ( Particle* p )
+{
+  update_particle_type_xyz_distribution_map(core::Typed(p).get_type(),
+                                            ParticlesTemp(1, p));
+}
+
+void Statistics
+::update_particle_type_xyz_distribution_map
+( core::ParticleType pt, const ParticlesTemp& ps )
 {
   IMP_OBJECT_LOG;
   if ( !get_sd()->get_has_slab() || !get_sd()->get_has_bounding_box() ){
     return;
   }
-  const float GRID_RESOLUTION_ANGSTROMS=10; // resolution of zr grid
-  const float CROP_FACTOR=0.5; // crop 0.5*Crop x 2 on each dimension (e.g. for box size of 200, only include -50 to +50 and not -100 to +100 on each dimension
-  const double MAX_CROP=1000.0;
   bool is_z_symmetric=
     (get_sd()->get_output_npctransport_version() < 2.0);
-  core::ParticleType pt( core::Typed(p).get_type() );
-  // retrieve, add distribution table if needed
-  std::pair<ParticleTypeXYZDistributionMap::iterator, bool> it_pair;
-  it_pair.first= particle_type_xyz_distribution_map_.find(pt);
-  if(it_pair.first==particle_type_xyz_distribution_map_.end()) {
-    ParticleTypeXYZDistributionMap::value_type vt =
-      std::make_pair
-      (pt, t_sparse_3d_matrix());
-    it_pair=particle_type_xyz_distribution_map_.insert(vt);
-    IMP_USAGE_CHECK(it_pair.second, "type " << pt << " already exists");
+  update_xyz_distribution_sizes();
+  std::vector<int>& hist= get_xyz_distribution(pt);
+  int nx= xyz_distribution_sizes_.d0;
+  int ny= xyz_distribution_sizes_.d1;
+  int nz= xyz_distribution_sizes_.d2;
+  int z_offset= (nz/2)*(!is_z_symmetric);
+  Model* m= get_model();
+  // compute flat bin indexes in parallel (-1 if outside the grid),
+  // then accumulate them serially
+  int n= ps.size();
+  std::vector<int> bins(n);
+  IMP_OMP_PRAGMA(parallel for schedule(static) if(n > 1000))
+  for(int i= 0; i < n; i++) {
+    const algebra::Vector3D& v= m->get_sphere(ps[i]->get_index()).get_center();
+    float z= is_z_symmetric ? std::abs(v[2]) : v[2];
+    int xx= std::floor(v[0]/XYZ_GRID_RESOLUTION_ANGSTROMS) + nx/2;
+    int yy= std::floor(v[1]/XYZ_GRID_RESOLUTION_ANGSTROMS) + ny/2;
+    int zz= std::floor(z/XYZ_GRID_RESOLUTION_ANGSTROMS) + z_offset;
+    bool is_in= (xx<nx && yy < ny && zz<nz &&
+                 xx>=0 && yy>=0 && zz>=0);
+    bins[i]= is_in ? (xx*ny + yy)*nz + zz : -1;
   }
-  ParticleTypeXYZDistributionMap::iterator& it=it_pair.first;
-  //update distribution
-  float box_half =  std::min(get_sd()->get_box_size() / 2.0, MAX_CROP); // get_z_distribution_top();
-  unsigned int half_n_max= std::floor(box_half/GRID_RESOLUTION_ANGSTROMS*CROP_FACTOR) + 5; // +5 for slack
-  int nx= 2 * half_n_max;
-  int ny= 2 * half_n_max;
-  int nz= (1 + !is_z_symmetric) * half_n_max;
-  xyz_distribution_sizes_.d0= nx; // TODO: cap with maximal value of d0, which is (or used to be) uint8
-  xyz_distribution_sizes_.d1= ny;
-  xyz_distribution_sizes_.d2= nz;
-  core::XYZ xyz(p);
-  float x= xyz.get_x();
-  float y= xyz.get_y();
-  float z= xyz.get_z();
-  if(is_z_symmetric){
-    z= std::abs(z);
-  }
-  int xx=
-    std::floor(x/GRID_RESOLUTION_ANGSTROMS) + nx/2;
-  int yy=
-    std::floor(y/GRID_RESOLUTION_ANGSTROMS) + ny/2;
-  int zz=
-    std::floor(z/GRID_RESOLUTION_ANGSTROMS) + (nz/2)*(!is_z_symmetric);
-  if(xx<nx && yy < ny && zz<nz &&
-     xx>=0 && yy>=0 && zz>=0){
-    it->second[xx][yy][zz]++;
-    //    std::cout<<"xx "<<xx<<" yy "<<yy<<" zz "<<zz<<" = "<<it->second[xx][yy][zz]<<std::endl;
+  for(int i= 0; i < n; i++) {
+    if(bins[i] >= 0) {
+      hist[bins[i]]++;
+    }
   }
 }
 
+namespace {
+  // add the counts of h to the histogram in pb_hist, which is
+  // initialized to the bins of h if empty
+  void add_to_time_histogram
+  ( ::npctransport_proto::Statistics_TimeHistogram* pb_hist,
+    internal::LogTimeHistogram const& h )
+  {
+    if(pb_hist->counts_size() == 0) {
+      pb_hist->set_min_ns(h.get_min_ns());
+      pb_hist->set_bins_per_decade(h.get_bins_per_decade());
+      for(unsigned int i = 0; i < h.get_number_of_bins(); i++) {
+        pb_hist->add_counts(0);
+      }
+    }
+    IMP_ALWAYS_CHECK(pb_hist->min_ns() == h.get_min_ns() &&
+                     pb_hist->bins_per_decade() == h.get_bins_per_decade() &&
+                     pb_hist->counts_size() ==
+                     static_cast<int>(h.get_number_of_bins()),
+                     "Incompatible bins in stored time histogram",
+                     ValueException);
+    for(unsigned int i = 0; i < h.get_number_of_bins(); i++) {
+      pb_hist->set_counts(i, pb_hist->counts(i) + h.get_count(i));
+    }
+    pb_hist->set_n_censored
+      (pb_hist->n_censored() + h.get_number_of_censored());
+  }
 
+  // adds sample x to the block average stored in pb_ba, and updates
+  // its mean and error estimates (non-finite samples are ignored)
+  void add_to_block_average
+  ( ::npctransport_proto::Statistics_BlockAverage* pb_ba, double x )
+  {
+    if(!std::isfinite(x)) {
+      return;
+    }
+    internal::BlockAverage::Levels levels(pb_ba->levels_size());
+    for(unsigned int k = 0; k < levels.size(); k++) {
+      ::npctransport_proto::Statistics_BlockAverage_Level const& pb_k =
+        pb_ba->levels(k);
+      levels[k].n = pb_k.n();
+      levels[k].sum = pb_k.sum();
+      levels[k].sum2 = pb_k.sum2();
+      levels[k].has_pending = pb_k.has_pending();
+      levels[k].pending = pb_k.pending();
+    }
+    internal::BlockAverage ba(levels);
+    ba.add(x);
+    pb_ba->clear_levels();
+    for(unsigned int k = 0; k < ba.get_levels().size(); k++) {
+      internal::BlockAverage::Level const& level_k = ba.get_levels()[k];
+      ::npctransport_proto::Statistics_BlockAverage_Level* pb_k =
+        pb_ba->add_levels();
+      pb_k->set_n(level_k.n);
+      pb_k->set_sum(level_k.sum);
+      pb_k->set_sum2(level_k.sum2);
+      if(level_k.has_pending) {
+        pb_k->set_pending(level_k.pending);
+      }
+    }
+    pb_ba->set_mean(ba.get_mean());
+    pb_ba->set_standard_error(ba.get_standard_error());
+    pb_ba->set_statistical_inefficiency(ba.get_statistical_inefficiency());
+    pb_ba->set_is_converged(ba.get_is_converged());
+  }
+}
 
 // @param nf_new number of new frames accounted for in this statistics update
 void Statistics::update
@@ -656,12 +869,11 @@ void Statistics::update
   IMP_ALWAYS_CHECK(get_is_activated(), // TODO: would we rather a usage/always check?
                    "Cannot update a Statistics object that was not activated. Call Statistics::add_optimizer_states() first",
                    IMP::UsageException);
-  ::npctransport_proto::Output output;
-  bool is_read= load_output_protobuf(output_file_name_, output);
-  IMP_ALWAYS_CHECK(is_read,
-                   "Failed updating statistics to " << output_file_name_.c_str()
-                   << std::endl,
-                   IMP::IOException);
+  // member states are updated below outside of the group
+  optimizer_states_group_->synchronize_clock_with(get_sd()->get_bd());
+  get_sd()->get_bd()->synchronize_free_diffusion_flights
+    ( get_read_particle_indexes() );
+  ::npctransport_proto::Output& output= *get_mutable_output();
   RMF::HDF5::File hdf5_file= RMF::HDF5::create_file(output_file_name_ + ".hdf5");
   RMF::HDF5::Group hdf5_floater_xyz_hist_group;
   static const std::string  FLOATER_XYZ_GROUP("floater_xyz_hist");
@@ -682,7 +894,18 @@ void Statistics::update
     is_stats_reset_ = false;
     for (int i = 0; i < stats->floaters().size(); i++) {
       (*stats->mutable_floaters(i)).clear_transport_time_points_ns();
+      (*stats->mutable_floaters(i)).clear_diffusion_coefficient_block_avg();
+      (*stats->mutable_floaters(i)).clear_transport_rate_block_avg();
     }
+    for (int i = 0; i < stats->interactions().size(); i++) {
+      ::npctransport_proto::Statistics_InteractionStats* is_i =
+        stats->mutable_interactions(i);
+      is_i->clear_contacts_per_particle_i_block_avg();
+      is_i->clear_contacts_per_particle_ii_block_avg();
+      is_i->clear_fraction_bound_particles_i_block_avg();
+      is_i->clear_fraction_bound_particles_ii_block_avg();
+    }
+    stats->clear_energy_per_particle_block_avg();
   }
   IMP_LOG(VERBOSE, "Updating statistics file " << output_file_name_
             << " that currently has " << nf << " frames, with " << nf_new
@@ -691,6 +914,8 @@ void Statistics::update
   // gather the statistics one by one
   double sim_time_ns = const_cast<SimulationData *>( get_sd() )
     ->get_bd()->get_current_time() / FS_IN_NS;
+  // simulation time since the previous update, for rates
+  double delta_time_ns = sim_time_ns - stats->bd_simulation_time_ns();
 
   unsigned int zr_hist[4][3]={{0},{0},{0},{0}};
   update_fg_stats(stats, nf_new, zr_hist, hdf5_file);
@@ -702,26 +927,30 @@ void Statistics::update
        it != floaters_stats_map_.end(); it++)
     {
       unsigned int i= find_or_add_floater_of_type( stats, it->first );
-      BodyStatisticsOptimizerStates& bsos = it->second;
-      unsigned int n_particles_type_i = bsos.size();
+      BodiesStatisticsOptimizerState* bsos = it->second;
+      unsigned int n_particles_type_i = bsos->get_number_of_particles();
       type_to_diffusion_coefficeint_map[it->first]=0.0;
       int nf_weighted = nf * n_particles_type_i; // number of particle frames
+      bsos->update_always();
+      Floats dcs = bsos->get_diffusion_coefficients();
       for (unsigned int j= 0; j < n_particles_type_i; j++)
         {
-          bsos[j]->update_always();
-          double dc_j= bsos[j]->get_diffusion_coefficient();
+          double dc_j= dcs[j];
           UPDATE_AVG(nf_weighted, nf_new,
                      *stats->mutable_floaters(i),
                      diffusion_coefficient, dc_j);
           type_to_diffusion_coefficeint_map[it->first]+=
             dc_j/n_particles_type_i;
-          double ct_j= bsos[j]->get_correlation_time();
+          double ct_j= bsos->get_correlation_time(j);
           UPDATE_AVG(nf_weighted, nf_new,
                      *stats->mutable_floaters(i),
                      correlation_time, ct_j);
-          bsos[j]->reset();
           nf_weighted++;
         } // for j
+      add_to_block_average
+        ( stats->mutable_floaters(i)->mutable_diffusion_coefficient_block_avg(),
+          type_to_diffusion_coefficeint_map[it->first] );
+      bsos->reset();
       if(get_sd()->get_is_xyz_hist_stats()){ // TODO: floaters are disabled for xyz for now to save space - perhaps add it later
         update_xyz_distribution_to_hdf5(hdf5_floater_xyz_hist_group,
                                         it->first);
@@ -730,14 +959,15 @@ void Statistics::update
         ParticleTypeZRDistributionMap::const_iterator ptzrdm_it=
           particle_type_zr_distribution_map_.find(it->first);
         if(ptzrdm_it != particle_type_zr_distribution_map_.end()) {
-          ParticleTypeZRDistributionMap::mapped_type zr_hist=
+          ParticleTypeZRDistributionMap::mapped_type const& zr_hist=
             ptzrdm_it->second;
           stats->mutable_floaters(i)->clear_zr_hist();
-          for(unsigned int ii=0; ii < zr_hist.size(); ii++) {
+          unsigned int nr= zr_distribution_sizes_.d1;
+          for(unsigned int ii=0; ii < zr_distribution_sizes_.d0; ii++) {
             ::npctransport_proto::Statistics_Ints* zii_r_hist=
               stats->mutable_floaters(i)->mutable_zr_hist()->add_ints_list();
-            for(unsigned int jj=0; jj < zr_hist[ii].size(); jj++) {
-              zii_r_hist->add_ints(zr_hist[ii][jj]);
+            for(unsigned int jj=0; jj < nr; jj++) {
+              zii_r_hist->add_ints(zr_hist[ii*nr + jj]);
             } // for jj
           } // for ii
         } //if ptzrdm_it
@@ -751,20 +981,20 @@ void Statistics::update
          it1 != floaters_transport_stats_map_.end() ; it1++)
       {
         unsigned int i = find_or_add_floater_of_type( stats, it1->first );
-        ParticleTransportStatisticsOptimizerStates& pts_i = it1->second;
+        ParticlesTransportStatisticsOptimizerState* pts_i = it1->second;
         // fetch old ones from stats msg, add new ones and rewrite all:
         std::set<double> times_i
           ( stats->floaters(i).transport_time_points_ns().begin(),
             stats->floaters(i).transport_time_points_ns().end() );
-        for (unsigned int j = 0; j < pts_i.size(); ++j)
-          {
-            Floats const &new_times_ij =
-              pts_i[j]->get_transport_time_points_in_ns();
-            for (unsigned int k = 0; k < new_times_ij.size(); k++)
-              {
-                times_i.insert(new_times_ij[k]);
-              } // for k
-          } // for j
+        Floats const &new_times_i = pts_i->get_transport_time_points_in_ns();
+        unsigned int n_old_times_i = times_i.size();
+        times_i.insert(new_times_i.begin(), new_times_i.end());
+        if(delta_time_ns > 0.0) {
+          add_to_block_average
+            ( stats->mutable_floaters(i)->mutable_transport_rate_block_avg(),
+              (times_i.size() - n_old_times_i) /
+              ( pts_i->get_number_of_particles() * delta_time_ns ) );
+        }
         (*stats->mutable_floaters(i)).clear_transport_time_points_ns();
         for (std::set<double>::const_iterator it2 = times_i.begin();
              it2 != times_i.end(); it2++)
@@ -772,7 +1002,8 @@ void Statistics::update
             (*stats->mutable_floaters(i)).add_transport_time_points_ns(*it2);
           } // for it2
          // update avg too:
-         double avg_n_transports_i = times_i.size() * 1.0 / pts_i.size();
+         double avg_n_transports_i =
+           times_i.size() * 1.0 / pts_i->get_number_of_particles();
          (*stats->mutable_floaters(i)).set_avg_n_transports( avg_n_transports_i );
        } // for it1
    }
@@ -890,6 +1121,25 @@ void Statistics::update
         ( bps_i->get_average_fraction_bound_particle_sites_II());
       siop->set_misc_stats_period_ns
         ( bps_i->get_misc_stats_period_ns() );
+      add_to_block_average
+        ( pOutStats_i->mutable_contacts_per_particle_i_block_avg(),
+          avg_contacts_num / n0 );
+      add_to_block_average
+        ( pOutStats_i->mutable_contacts_per_particle_ii_block_avg(),
+          avg_contacts_num / n1 );
+      add_to_block_average
+        ( pOutStats_i->mutable_fraction_bound_particles_i_block_avg(),
+          bps_i->get_average_fraction_bound_particles_I() );
+      add_to_block_average
+        ( pOutStats_i->mutable_fraction_bound_particles_ii_block_avg(),
+          bps_i->get_average_fraction_bound_particles_II() );
+      // accumulate kinetics histograms
+      add_to_time_histogram
+        ( pOutStats_i->mutable_residence_time_hist(),
+          bps_i->get_contact_kinetics().get_residence_times() );
+      add_to_time_histogram
+        ( pOutStats_i->mutable_rebinding_interval_hist(),
+          bps_i->get_contact_kinetics().get_rebinding_intervals() );
       // reset till next udpate_statistics()
       bps_i->reset();
     }
@@ -909,6 +1159,8 @@ void Statistics::update
     UPDATE_AVG(nf, nf_new, (*stats), energy_per_particle,  // TODO: reset?
                // TODO: remove static beads from stats?
                energy_per_bead );
+    add_to_block_average
+      ( stats->mutable_energy_per_particle_block_avg(), energy_per_bead );
     global_stats_->reset();
     ::npctransport_proto::Statistics_GlobalOrderParams*
         sgop = stats->add_global_order_params();
@@ -932,22 +1184,41 @@ void Statistics::update
   //   output.mutable_conformation();
   //    save_pb_conformation(get_beads(), sites_, conformation);
 
-  // save RMF for future restarts
-  if(!no_save_rmf_to_output){
-    RMF::BufferHandle buf;
-    {
-      RMF::FileHandle fh = RMF::create_rmf_buffer(buf);
-      const_cast<SimulationData*>(get_sd())->link_rmf_file_handle(fh, false);
-      rmf::save_frame(fh);
-    }
-    output.set_rmf_conformation(buf.get_string());
+  // save checkpoint for future restarts
+  save_pb_checkpoint(const_cast<SimulationData*>(get_sd()),
+                     output.mutable_checkpoint());
+  if(save_rmf_to_output && !no_save_rmf_to_output){
+    save_rmf_conformation(output);
   }
 
   // dump to file
-  std::ofstream outf(output_file_name_.c_str(), std::ios::binary);
-  output.SerializeToOstream(&outf);
-  outf.flush();
+  write_output();
+  }
+
+void Statistics::save_rmf_conformation
+( ::npctransport_proto::Output& output )
+{
+  RMF::BufferHandle buf;
+  {
+    RMF::FileHandle fh = RMF::create_rmf_buffer(buf);
+    const_cast<SimulationData*>(get_sd())->link_rmf_file_handle(fh, false);
+    rmf::save_frame(fh);
   }
+  output.set_rmf_conformation(buf.get_string());
+}
+
+void Statistics::save_rmf_conformation_to_output()
+{
+  if(no_save_rmf_to_output) {
+    return;
+  }
+  ::npctransport_proto::Output& output= *get_mutable_output();
+  // keep the checkpoint consistent with the rmf conformation
+  save_pb_checkpoint(const_cast<SimulationData*>(get_sd()),
+                     output.mutable_checkpoint());
+  save_rmf_conformation(output);
+  write_output();
+}
 
 void Statistics::reset_statistics_optimizer_states()
 {
@@ -958,19 +1229,14 @@ void Statistics::reset_statistics_optimizer_states()
     {
       for (unsigned int j = 0; j < iter->second.size(); j++)
         {
-          for (unsigned int k = 0; k < iter->second[j].size(); ++k) {
-            iter->second[j][k]->reset();
-          } // for k
+          iter->second[j]->reset();
         } // for j
     } // for iter
 
   for (BodyStatisticsOSsMap::iterator iter = floaters_stats_map_.begin();
        iter != floaters_stats_map_.end(); iter++)
     {
-      for (unsigned int j = 0; j < iter->second.size(); j++)
-        {
-          iter->second[j]->reset();
-        } // for jb
+      iter->second->reset();
     } // for iter
 
   if (get_sd()->get_has_slab()) {
@@ -978,10 +1244,7 @@ void Statistics::reset_statistics_optimizer_states()
            iter = floaters_transport_stats_map_.begin();
          iter != floaters_transport_stats_map_.end(); iter++)
       {
-        for (unsigned int j = 0; j < iter->second.size(); j++)
-          {
-            iter->second[j]->reset();
-          } // for j
+        iter->second->reset();
       } // for iter
     particle_type_zr_distribution_map_.clear();
   }
@@ -1004,14 +1267,34 @@ void Statistics::reset_statistics_optimizer_states()
 }
 
 void Statistics::set_interrupted(bool tf) {
-  ::npctransport_proto::Output output;
-  std::ifstream inf(output_file_name_.c_str(), std::ios::binary);
-  output.ParseFromIstream(&inf);
-  inf.close();
-  ::npctransport_proto::Statistics* stats = output.mutable_statistics();
+  ::npctransport_proto::Statistics* stats =
+    get_mutable_output()->mutable_statistics();
   stats->set_interrupted(tf ? 1 : 0);
+  write_output();
+}
+
+::npctransport_proto::Output* Statistics::get_mutable_output() {
+  if(!output_) {
+    load_output();
+  }
+  return output_.get();
+}
+
+void Statistics::load_output() {
+  boost::shared_ptr< ::npctransport_proto::Output > output
+    ( new ::npctransport_proto::Output() );
+  bool is_read= load_output_protobuf(output_file_name_, *output);
+  IMP_ALWAYS_CHECK(is_read,
+                   "Failed reading statistics from " << output_file_name_
+                   << std::endl,
+                   IMP::IOException);
+  output_= output;
+}
+
+void Statistics::write_output() {
   std::ofstream outf(output_file_name_.c_str(), std::ios::binary);
-  stats->SerializeToOstream(&outf);
+  get_mutable_output()->SerializeToOstream(&outf);
+  outf.flush();
 }
 
 
@@ -200,7 +200,9 @@ double get_time_step(const ::npctransport_proto::Assignment& a,
   double min_range = std::numeric_limits<double>::max(); // in A
   double max_k = 0.0; // in kcal/mol/A
 
-  UPDATE_MAX(k, a.backbone_k);  // TODO: is this valid for harmonic k?
+  if(!a.is_backbone_constrained()) {
+    UPDATE_MAX(k, a.backbone_k);  // TODO: is this valid for harmonic k?
+  }
   if(a.nonspecific_range().value()>0.0 &&
      a.nonspecific_k().value()>0.0) {
     UPDATE_MAX(k, a.nonspecific_k);
@@ -3,10 +3,76 @@
 #include <ValidSchema.hh>
 #include <Compiler.hh>
 #include <Stream.hh>
+#include <IMP/npctransport/internal/AvroBlockWriter.h>
+#include <IMP/npctransport/internal/OutputFileView.h>
+#include <IMP/npctransport/internal/avro_index.h>
+#include <IMP/npctransport/internal/npctransport.pb.h>
 #include <IMP/file.h>
+#include <IMP/exception.h>
+#include <IMP/check_macros.h>
+#include <IMP/log_macros.h>
+#include <algorithm>
+#include <condition_variable>
+#include <exception>
+#include <fstream>
+#include <mutex>
+#include <set>
+#include <thread>
+#include <vector>
 
 IMPNPCTRANSPORT_BEGIN_NAMESPACE
 
+namespace {
+  using internal::AvroBlockWriter;
+
+  // an output file after it was read by a worker
+  struct Input {
+    enum Status { PENDING, OK, UNREADABLE, TRUNCATED };
+    Status status;
+    std::string key;        // work unit and random seed
+    AvroBlockWriter::Block block;  // the output as a single entry block
+    Input() : status(PENDING) {}
+  };
+
+  bool read_file(std::string fname, std::string& data) {
+    std::ifstream f(fname.c_str(), std::ios::in | std::ios::binary);
+    if (!f) {
+      return false;
+    }
+    char buf[1 << 16];
+    while (f.read(buf, sizeof(buf)) || f.gcount() > 0) {
+      data.append(buf, f.gcount());
+    }
+    return f.eof();
+  }
+
+  // read fname into input, checking only the top-level fields and the
+  // assignment of the output
+  void read_input(std::string fname, std::string codec, Input& input) {
+    std::string data;
+    if (!read_file(fname, data)) {
+      input.status = Input::UNREADABLE;
+      return;
+    }
+    ::npctransport_proto::Assignment assignment;
+    try {
+      internal::OutputFileView view(data.data(), data.size());
+      if (!view.get_has_field(view.STATISTICS) ||
+          !view.get_assignment(&assignment)) {
+        input.status = Input::TRUNCATED;
+        return;
+      }
+    } catch (IOException&) {
+      input.status = Input::TRUNCATED;
+      return;
+    }
+    input.key = internal::get_avro_key(assignment);
+    input.block.add_entry(input.key, data.data(), data.size());
+    input.block.compress(codec);
+    input.status = Input::OK;
+  }
+}
+
 IMP_NPCTRANSPORT_AVRO_NAMESPACE::ValidSchema get_avro_data_file_schema() {
   std::string path = get_data_path("AvroDataFileData.json");
   boost::shared_ptr<IMP_NPCTRANSPORT_AVRO_NAMESPACE::InputStream> is =
@@ -14,4 +80,110 @@ IMP_NPCTRANSPORT_AVRO_NAMESPACE::ValidSchema get_avro_data_file_schema() {
   return IMP_NPCTRANSPORT_AVRO_NAMESPACE::compileJsonSchemaFromStream(*is);
 }
 
+std::string get_avro_index_file_name(std::string avro_filename) {
+  return avro_filename + ".idx";
+}
+
+unsigned int create_avro_index(std::string avro_filename) {
+  ::npctransport_proto::AvroArchiveIndex index;
+  internal::build_avro_index(avro_filename, &index);
+  IMP_ALWAYS_CHECK(internal::save_avro_index(avro_filename, index),
+                   "Unable to write avro index "
+                   << get_avro_index_file_name(avro_filename),
+                   IOException);
+  return index.entries_size();
+}
+
+unsigned int write_outputs_to_avro_archive
+(const Strings& output_files, std::string avro_filename,
+ std::string codec, bool append, unsigned int n_threads) {
+  std::set<std::string> keys;
+  if (append) {
+    keys = internal::get_avro_archive_keys(avro_filename);
+  }
+  AvroBlockWriter writer(avro_filename, codec, append);
+
+  // workers read inputs in order, up to a window ahead of the writer
+  unsigned int n_workers = std::max(n_threads, 1U);
+  unsigned int window = 4 * n_workers;
+  std::vector<Input> inputs(output_files.size());
+  std::mutex mutex;
+  std::condition_variable cv;
+  unsigned int next_input = 0;
+  unsigned int n_done = 0;
+  std::string error;
+  std::vector<std::thread> workers;
+  for (unsigned int t = 0; t < n_workers; t++) {
+    workers.push_back(std::thread([&] {
+      while (true) {
+        unsigned int i;
+        {
+          std::unique_lock<std::mutex> lock(mutex);
+          cv.wait(lock, [&] {
+              return next_input >= output_files.size() ||
+                next_input < n_done + window;
+            });
+          if (next_input >= output_files.size()) {
+            return;
+          }
+          i = next_input++;
+        }
+        Input input;
+        try {
+          read_input(output_files[i], writer.get_codec(), input);
+        } catch (std::exception& e) {
+          std::lock_guard<std::mutex> lock(mutex);
+          error = e.what();
+          input.status = Input::UNREADABLE;
+        }
+        {
+          std::lock_guard<std::mutex> lock(mutex);
+          std::swap(inputs[i], input);
+        }
+        cv.notify_all();
+      }
+    }));
+  }
+
+  unsigned int n_written = 0;
+  for (unsigned int i = 0; i < output_files.size(); i++) {
+    Input input;
+    {
+      std::unique_lock<std::mutex> lock(mutex);
+      cv.wait(lock, [&] { return inputs[i].status != Input::PENDING; });
+      std::swap(inputs[i], input);
+    }
+    switch (input.status) {
+      case Input::OK:
+        if (keys.insert(input.key).second) {
+          writer.write_block(input.block);
+          n_written++;
+        } else {
+          IMP_WARN("Skipping duplicate " << input.key << " in "
+                   << output_files[i] << std::endl);
+        }
+        break;
+      case Input::TRUNCATED:
+        IMP_WARN("Skipping truncated " << output_files[i] << std::endl);
+        break;
+      default:
+        IMP_WARN("Skipping unreadable " << output_files[i] << std::endl);
+    }
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      n_done = i + 1;
+    }
+    cv.notify_all();
+  }
+  for (unsigned int t = 0; t < workers.size(); t++) {
+    workers[t].join();
+  }
+  if (!error.empty()) {
+    IMP_WARN("Last error reading outputs: " << error << std::endl);
+  }
+  writer.close();
+  create_avro_index(avro_filename);
+  return n_written;
+}
+
 IMPNPCTRANSPORT_END_NAMESPACE
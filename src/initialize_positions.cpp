@@ -11,12 +11,12 @@
 #include <IMP/npctransport/randomize_particles.h>
 #include <IMP/npctransport/internal/initialize_positions_RAIIs.h>
 #include <IMP/npctransport/internal/TAMDChain.h>
+#include <IMP/npctransport/internal/TAMDForest.h>
 #include <IMP/npctransport/util.h>
 #include <IMP/scoped.h>
 #include <IMP/Restraint.h>
 #include <IMP/ScoringFunction.h>
 #include <IMP/atom/BrownianDynamics.h>
-#include <IMP/atom/TAMDParticle.h>
 #include <IMP/Pointer.h>
 #include <IMP/exception.h>
 #include <IMP/object_macros.h>
@@ -52,22 +52,13 @@ IMPNPCTRANSPORT_BEGIN_NAMESPACE
 
 namespace {
 
-  // returns true if p is XYZ and TAMDParticle decorated
-  bool is_xyz_tamd(IMP::Particle* p)
-  {
-    return IMP::atom::TAMDParticle::get_is_setup(p) &&
-      IMP::core::XYZ::get_is_setup(p);
-  }
-
   // update the coordinates of all TAMD particles from their
-  // reference particles
-  void update_tamd_particles_coords_from_refs(atom::Hierarchy root)
+  // reference particles (centroids)
+  void update_tamd_particles_coords_from_refs(Scoring* scoring)
   {
-    Particles ps;
-    IMP::core::gather( root, is_xyz_tamd, std::back_inserter(ps));
-    for(unsigned int i=0; i < ps.size(); i++) {
-      IMP::atom::TAMDParticle t(ps[i]);
-      t.update_coordinates_from_ref();
+    internal::TAMDForest* forest = scoring->get_tamd_forest();
+    if(forest) {
+      forest->reset_images_to_centroids();
     }
   }
 
@@ -304,7 +295,7 @@ namespace {
                    sd->get_scoring()->get_fg_chains(),
                    PROGRESS,
                    debug, short_init_factor);
-    update_tamd_particles_coords_from_refs( sd->get_root() );
+    update_tamd_particles_coords_from_refs( sd->get_scoring() );
     return cur_fg_beads;
   }
 
@@ -341,7 +332,7 @@ namespace {
                    PROGRESS,
                    debug,
                    short_init_factor);
-    update_tamd_particles_coords_from_refs( sd->get_root() );
+    update_tamd_particles_coords_from_refs( sd->get_scoring() );
   }
 
 } // namespace {}
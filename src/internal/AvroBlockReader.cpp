@@ -0,0 +1,215 @@
+/**
+ *  \file internal/AvroBlockReader.cpp
+ *  \brief block-level access to avro archives of output files
+ *
+ *  Copyright 2007-2018 IMP Inventors. All rights reserved.
+ */
+
+#include <IMP/npctransport/internal/AvroBlockReader.h>
+#include <IMP/exception.h>
+#include <IMP/check_macros.h>
+#include <cstring>
+#ifdef IMP_NPCTRANSPORT_HAS_ZLIB
+#include <zlib.h>
+#endif
+
+IMPNPCTRANSPORT_BEGIN_INTERNAL_NAMESPACE
+
+namespace {
+  // avro longs are zig-zag encoded varints
+
+  bool read_long(std::istream& in, int64_t& value) {
+    uint64_t n = 0;
+    for (unsigned int shift = 0; shift < 64; shift += 7) {
+      int c = in.get();
+      if (c == EOF) {
+        return false;
+      }
+      n |= static_cast<uint64_t>(c & 0x7F) << shift;
+      if (!(c & 0x80)) {
+        value = static_cast<int64_t>(n >> 1) ^ -static_cast<int64_t>(n & 1);
+        return true;
+      }
+    }
+    return false;
+  }
+
+  bool read_long(std::vector<char> const& data, std::size_t& pos,
+                 int64_t& value) {
+    uint64_t n = 0;
+    for (unsigned int shift = 0; shift < 64 && pos < data.size();
+         shift += 7) {
+      unsigned char c = static_cast<unsigned char>(data[pos++]);
+      n |= static_cast<uint64_t>(c & 0x7F) << shift;
+      if (!(c & 0x80)) {
+        value = static_cast<int64_t>(n >> 1) ^ -static_cast<int64_t>(n & 1);
+        return true;
+      }
+    }
+    return false;
+  }
+
+  bool read_bytes(std::istream& in, std::string& s) {
+    int64_t size;
+    if (!read_long(in, size) || size < 0) {
+      return false;
+    }
+    s.resize(size);
+    return size == 0 || in.read(&s[0], size);
+  }
+
+#ifdef IMP_NPCTRANSPORT_HAS_ZLIB
+  // inflate raw deflate data (no zlib header), as in avro deflate blocks
+  bool inflate_raw(std::vector<char> const& in, std::vector<char>& out) {
+    z_stream zs;
+    std::memset(&zs, 0, sizeof(zs));
+    if (inflateInit2(&zs, -MAX_WBITS) != Z_OK) {
+      return false;
+    }
+    out.resize(4 * in.size() + 1024);
+    zs.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(in.data()));
+    zs.avail_in = in.size();
+    int ret;
+    do {
+      if (zs.total_out == out.size()) {
+        out.resize(2 * out.size());
+      }
+      zs.next_out = reinterpret_cast<Bytef*>(&out[zs.total_out]);
+      zs.avail_out = out.size() - zs.total_out;
+      ret = inflate(&zs, Z_NO_FLUSH);
+    } while (ret == Z_OK);
+    out.resize(zs.total_out);
+    inflateEnd(&zs);
+    return ret == Z_STREAM_END;
+  }
+#endif
+}
+
+AvroBlockReader::AvroBlockReader(std::string file_name)
+  : file_name_(file_name),
+    in_(file_name.c_str(), std::ios::binary),
+    pos_(0),
+    n_left_(0),
+    block_offset_(-1),
+    index_in_block_(0)
+{
+  IMP_ALWAYS_CHECK(in_, "Unable to read avro file " << file_name,
+                   IOException);
+  read_header();
+}
+
+void AvroBlockReader::read_header() {
+  char magic[4];
+  IMP_ALWAYS_CHECK(in_.read(magic, 4) && std::memcmp(magic, "Obj\x01", 4) == 0,
+                   file_name_ << " is not an avro file", IOException);
+  codec_ = "null";
+  // metadata map
+  while (true) {
+    int64_t count;
+    IMP_ALWAYS_CHECK(read_long(in_, count),
+                     "Corrupt avro header in " << file_name_, IOException);
+    if (count == 0) {
+      break;
+    }
+    if (count < 0) {  // followed by the size of the map block in bytes
+      int64_t size;
+      IMP_ALWAYS_CHECK(read_long(in_, size),
+                       "Corrupt avro header in " << file_name_, IOException);
+      count = -count;
+    }
+    for (int64_t i = 0; i < count; i++) {
+      std::string key, value;
+      IMP_ALWAYS_CHECK(read_bytes(in_, key) && read_bytes(in_, value),
+                       "Corrupt avro header in " << file_name_, IOException);
+      if (key == "avro.codec") {
+        codec_ = value;
+      }
+    }
+  }
+  IMP_ALWAYS_CHECK(in_.read(sync_, 16),
+                   "Corrupt avro header in " << file_name_, IOException);
+  IMP_ALWAYS_CHECK(get_is_codec_supported(codec_),
+                   "Unsupported avro codec " << codec_ << " in "
+                   << file_name_, IOException);
+  first_block_offset_ = in_.tellg();
+}
+
+bool AvroBlockReader::read_block() {
+  int64_t offset = in_.tellg();
+  int64_t count, size;
+  if (!read_long(in_, count)) {
+    return false;  // end of file
+  }
+  IMP_ALWAYS_CHECK(read_long(in_, size) && count >= 0 && size >= 0,
+                   "Corrupt avro block in " << file_name_, IOException);
+  if (!block_ || block_.use_count() > 1) {
+    block_.reset(new std::vector<char>());
+  }
+  std::vector<char>& data = codec_ == "null" ? *block_ : compressed_;
+  data.resize(size);
+  char sync[16];
+  IMP_ALWAYS_CHECK((size == 0 || in_.read(&data[0], size)) &&
+                   in_.read(sync, 16) && std::memcmp(sync, sync_, 16) == 0,
+                   "Corrupt avro block in " << file_name_, IOException);
+#ifdef IMP_NPCTRANSPORT_HAS_ZLIB
+  if (codec_ == "deflate") {
+    IMP_ALWAYS_CHECK(inflate_raw(compressed_, *block_),
+                     "Corrupt deflate avro block in " << file_name_,
+                     IOException);
+  }
+#endif
+  block_offset_ = offset;
+  pos_ = 0;
+  n_left_ = count;
+  index_in_block_ = 0;
+  return true;
+}
+
+bool AvroBlockReader::get_is_codec_supported(std::string codec) {
+#ifdef IMP_NPCTRANSPORT_HAS_ZLIB
+  if (codec == "deflate") {
+    return true;
+  }
+#endif
+  return codec == "null";
+}
+
+void AvroBlockReader::seek_to_block(int64_t offset) {
+  IMP_USAGE_CHECK(offset >= first_block_offset_, "invalid block offset");
+  in_.clear();
+  in_.seekg(offset);
+  n_left_ = 0;
+  IMP_ALWAYS_CHECK(read_block(),
+                   "No avro block at offset " << offset << " of "
+                   << file_name_, IOException);
+}
+
+bool AvroBlockReader::read_next(Entry& entry) {
+  while (n_left_ == 0) {
+    if (!read_block()) {
+      return false;
+    }
+  }
+  std::vector<char> const& block = *block_;
+  int64_t key_size, value_size;
+  bool is_ok = read_long(block, pos_, key_size) && key_size >= 0 &&
+    static_cast<uint64_t>(key_size) <= block.size() - pos_;
+  if (is_ok) {
+    entry.key.assign(block.begin() + pos_,
+                     block.begin() + pos_ + key_size);
+    pos_ += key_size;
+    is_ok = read_long(block, pos_, value_size) && value_size >= 0 &&
+      static_cast<uint64_t>(value_size) <= block.size() - pos_;
+  }
+  IMP_ALWAYS_CHECK(is_ok, "Corrupt avro entry in " << file_name_,
+                   IOException);
+  entry.value = value_size > 0 ? &block[pos_] : "";
+  entry.value_size = value_size;
+  entry.block_offset = block_offset_;
+  entry.index_in_block = index_in_block_++;
+  pos_ += value_size;
+  n_left_--;
+  return true;
+}
+
+IMPNPCTRANSPORT_END_INTERNAL_NAMESPACE
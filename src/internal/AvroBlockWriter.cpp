@@ -0,0 +1,163 @@
+/**
+ *  \file internal/AvroBlockWriter.cpp
+ *  \brief block-level writing of avro archives of output files
+ *
+ *  Copyright 2007-2018 IMP Inventors. All rights reserved.
+ */
+
+#include <IMP/npctransport/internal/AvroBlockWriter.h>
+#include <IMP/npctransport/internal/AvroBlockReader.h>
+#include <IMP/npctransport/avro.h>
+#include <IMP/exception.h>
+#include <IMP/check_macros.h>
+#include <cstring>
+#include <random>
+#include <sstream>
+#ifdef IMP_NPCTRANSPORT_HAS_ZLIB
+#include <zlib.h>
+#endif
+
+IMPNPCTRANSPORT_BEGIN_INTERNAL_NAMESPACE
+
+namespace {
+  // avro longs are zig-zag encoded varints
+  void write_long(std::string& out, int64_t value) {
+    uint64_t n = (static_cast<uint64_t>(value) << 1) ^
+      static_cast<uint64_t>(value >> 63);
+    while (n & ~static_cast<uint64_t>(0x7F)) {
+      out.push_back(static_cast<char>((n & 0x7F) | 0x80));
+      n >>= 7;
+    }
+    out.push_back(static_cast<char>(n));
+  }
+
+  void write_bytes(std::string& out, char const* data, std::size_t size) {
+    write_long(out, size);
+    out.append(data, size);
+  }
+
+  void write_bytes(std::string& out, std::string const& s) {
+    write_bytes(out, s.data(), s.size());
+  }
+
+#ifdef IMP_NPCTRANSPORT_HAS_ZLIB
+  // deflate without a zlib header, as in avro deflate blocks
+  bool deflate_raw(std::string const& in, std::string& out) {
+    z_stream zs;
+    std::memset(&zs, 0, sizeof(zs));
+    if (deflateInit2(&zs, Z_DEFAULT_COMPRESSION, Z_DEFLATED, -MAX_WBITS, 8,
+                     Z_DEFAULT_STRATEGY) != Z_OK) {
+      return false;
+    }
+    out.resize(deflateBound(&zs, in.size()));
+    zs.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(in.data()));
+    zs.avail_in = in.size();
+    zs.next_out = reinterpret_cast<Bytef*>(&out[0]);
+    zs.avail_out = out.size();
+    int ret = deflate(&zs, Z_FINISH);
+    out.resize(zs.total_out);
+    deflateEnd(&zs);
+    return ret == Z_STREAM_END;
+  }
+#endif
+}
+
+void AvroBlockWriter::Block::add_entry(std::string const& key,
+                                       char const* value, std::size_t size) {
+  IMP_USAGE_CHECK(codec_.empty(), "Cannot add entries to compressed blocks");
+  write_bytes(data_, key);
+  write_bytes(data_, value, size);
+  n_entries_++;
+}
+
+void AvroBlockWriter::Block::compress(std::string codec) {
+  IMP_USAGE_CHECK(codec_.empty(), "Block is already compressed");
+  IMP_ALWAYS_CHECK(AvroBlockReader::get_is_codec_supported(codec),
+                   "Unsupported avro codec " << codec, IOException);
+#ifdef IMP_NPCTRANSPORT_HAS_ZLIB
+  if (codec == "deflate") {
+    std::string compressed;
+    IMP_ALWAYS_CHECK(deflate_raw(data_, compressed),
+                     "Failed to compress avro block", IOException);
+    data_.swap(compressed);
+  }
+#endif
+  codec_ = codec;
+}
+
+AvroBlockWriter::AvroBlockWriter(std::string file_name, std::string codec,
+                                 bool append)
+  : file_name_(file_name), codec_(codec)
+{
+  bool is_new = true;
+  if (append) {
+    std::ifstream f(file_name.c_str(), std::ios::binary | std::ios::ate);
+    is_new = !f || f.tellg() <= 0;
+  }
+  if (is_new) {
+    IMP_ALWAYS_CHECK(AvroBlockReader::get_is_codec_supported(codec),
+                     "Unsupported avro codec " << codec, IOException);
+    std::random_device rd;
+    for (unsigned int i = 0; i < 16; i++) {
+      sync_.push_back(static_cast<char>(rd() & 0xFF));
+    }
+    out_.open(file_name.c_str(),
+              std::ios::out | std::ios::trunc | std::ios::binary);
+    IMP_ALWAYS_CHECK(out_, "Unable to write avro file " << file_name,
+                     IOException);
+    write_header();
+  } else {
+    // blocks must match the header of the existing archive
+    {
+      AvroBlockReader reader(file_name);
+      codec_ = reader.get_codec();
+      sync_ = reader.get_sync_marker();
+    }
+    out_.open(file_name.c_str(),
+              std::ios::out | std::ios::app | std::ios::binary);
+    IMP_ALWAYS_CHECK(out_, "Unable to append to avro file " << file_name,
+                     IOException);
+  }
+}
+
+void AvroBlockWriter::write_header() {
+  std::ostringstream schema;
+  get_avro_data_file_schema().toJson(schema);
+  std::string header("Obj\x01", 4);
+  write_long(header, 2);  // metadata map
+  write_bytes(header, "avro.codec");
+  write_bytes(header, codec_);
+  write_bytes(header, "avro.schema");
+  write_bytes(header, schema.str());
+  write_long(header, 0);
+  header += sync_;
+  IMP_ALWAYS_CHECK(out_.write(header.data(), header.size()),
+                   "Unable to write avro file " << file_name_, IOException);
+}
+
+void AvroBlockWriter::write_block(Block const& block) {
+  IMP_USAGE_CHECK(block.get_codec() == codec_,
+                  "Block compressed with '" << block.get_codec()
+                  << "' instead of " << codec_);
+  std::string prefix;
+  write_long(prefix, block.get_number_of_entries());
+  write_long(prefix, block.get_data().size());
+  IMP_ALWAYS_CHECK(out_.write(prefix.data(), prefix.size()) &&
+                   out_.write(block.get_data().data(),
+                              block.get_data().size()) &&
+                   out_.write(sync_.data(), sync_.size()),
+                   "Unable to write avro file " << file_name_, IOException);
+}
+
+void AvroBlockWriter::flush() {
+  IMP_ALWAYS_CHECK(out_.flush(), "Unable to write avro file " << file_name_,
+                   IOException);
+}
+
+void AvroBlockWriter::close() {
+  out_.close();
+  IMP_ALWAYS_CHECK(out_, "Unable to write avro file " << file_name_,
+                   IOException);
+}
+
+IMPNPCTRANSPORT_END_INTERNAL_NAMESPACE
@@ -0,0 +1,153 @@
+/**
+ *  \file internal/AvroPrefetcher.cpp
+ *  \brief decodes records of avro files on background threads
+ *
+ *  Copyright 2007-2018 IMP Inventors. All rights reserved.
+ */
+
+#include <IMP/npctransport/internal/AvroPrefetcher.h>
+#include <IMP/npctransport/internal/AvroBlockReader.h>
+#include <IMP/exception.h>
+#include <IMP/check_macros.h>
+#include <boost/make_shared.hpp>
+#include <exception>
+
+IMPNPCTRANSPORT_BEGIN_INTERNAL_NAMESPACE
+
+AvroPrefetcher::AvroPrefetcher(const Strings& file_names,
+                               unsigned int n_threads,
+                               std::size_t max_buffered_bytes,
+                               unsigned int chunk_size)
+  : file_names_(file_names),
+    max_buffered_bytes_(max_buffered_bytes),
+    chunk_size_(chunk_size > 0 ? chunk_size : 1),
+    slots_(file_names.size()),
+    next_file_(0),
+    cur_file_(0),
+    buffered_bytes_(0),
+    is_stopped_(false),
+    cur_record_(0)
+{
+  IMP_USAGE_CHECK(n_threads > 0, "at least one decoding thread is needed");
+  for (unsigned int i = 0; i < n_threads && i < file_names_.size(); i++) {
+    threads_.push_back(std::thread(&AvroPrefetcher::decode_files, this));
+  }
+}
+
+AvroPrefetcher::~AvroPrefetcher() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    is_stopped_ = true;
+  }
+  cv_.notify_all();
+  for (unsigned int i = 0; i < threads_.size(); i++) {
+    threads_[i].join();
+  }
+}
+
+void AvroPrefetcher::decode_files() {
+  while (true) {
+    unsigned int i;
+    {
+      // start decoding the next file once there is room for its records
+      std::unique_lock<std::mutex> lock(mutex_);
+      cv_.wait(lock, [this] {
+          return is_stopped_ || next_file_ >= slots_.size() ||
+            !get_is_full(next_file_);
+        });
+      if (is_stopped_ || next_file_ >= slots_.size()) {
+        return;
+      }
+      i = next_file_++;
+    }
+    std::string error;
+    try {
+      decode_file(i);
+    } catch (std::exception& e) {
+      error = e.what();
+      if (error.empty()) error = "unknown error";
+    }
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      slots_[i].is_done = true;
+      slots_[i].error = error;
+    }
+    cv_.notify_all();
+  }
+}
+
+void AvroPrefetcher::decode_file(unsigned int i) {
+  AvroBlockReader reader(file_names_[i]);
+  AvroBlockReader::Entry entry;
+  ChunkP chunk = boost::make_shared<Chunk>();
+  while (reader.read_next(entry)) {
+    boost::shared_ptr<std::vector<char> const> block =
+      reader.get_block_data();
+    if (chunk->blocks.empty() || chunk->blocks.back() != block) {
+      chunk->blocks.push_back(block);
+    }
+    Record record = {entry.value, entry.value_size};
+    chunk->records.push_back(record);
+    chunk->n_bytes += entry.value_size;
+    if (chunk->records.size() >= chunk_size_) {
+      if (!push_chunk(i, chunk)) {
+        return;
+      }
+      chunk = boost::make_shared<Chunk>();
+    }
+  }
+  if (!chunk->records.empty()) {
+    push_chunk(i, chunk);
+  }
+}
+
+bool AvroPrefetcher::push_chunk(unsigned int i, ChunkP chunk) {
+  {
+    // the file being read is never paused, so the reader always
+    // makes progress
+    std::unique_lock<std::mutex> lock(mutex_);
+    cv_.wait(lock, [this, i] { return is_stopped_ || !get_is_full(i); });
+    if (is_stopped_) {
+      return false;
+    }
+    slots_[i].chunks.push_back(chunk);
+    buffered_bytes_ += chunk->n_bytes;
+  }
+  cv_.notify_all();
+  return true;
+}
+
+AvroPrefetcher::Record const* AvroPrefetcher::read_next() {
+  if (cur_chunk_ && cur_record_ < cur_chunk_->records.size()) {
+    return &cur_chunk_->records[cur_record_++];
+  }
+  cur_chunk_.reset();
+  std::unique_lock<std::mutex> lock(mutex_);
+  while (cur_file_ < slots_.size()) {
+    FileSlot& slot = slots_[cur_file_];
+    if (!slot.chunks.empty()) {
+      cur_chunk_ = slot.chunks.front();
+      slot.chunks.pop_front();
+      cur_record_ = 0;
+      buffered_bytes_ -= cur_chunk_->n_bytes;
+      lock.unlock();
+      cv_.notify_all();
+      return &cur_chunk_->records[cur_record_++];
+    }
+    if (slot.is_done) {
+      // move on before reporting errors, so the next files can be read
+      std::string error = slot.error;
+      cur_file_++;
+      cv_.notify_all();
+      IMP_ALWAYS_CHECK(error.empty(),
+                       "Unable to read avro file "
+                       << file_names_[cur_file_ - 1] << ": " << error,
+                       IOException);
+      continue;
+    }
+    cv_.wait(lock);
+  }
+  return nullptr;
+}
+
+IMPNPCTRANSPORT_END_INTERNAL_NAMESPACE
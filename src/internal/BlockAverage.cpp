@@ -0,0 +1,88 @@
+/**
+ *  \file internal/BlockAverage.cpp
+ *  \brief online block averaging of correlated time series
+ *
+ *  Copyright 2007-2018 IMP Inventors. All rights reserved.
+ */
+
+#include <IMP/npctransport/internal/BlockAverage.h>
+#include <cmath>
+
+IMPNPCTRANSPORT_BEGIN_INTERNAL_NAMESPACE
+
+void BlockAverage::add(double x) {
+  for (unsigned int k = 0; ; k++) {
+    if (k == levels_.size()) {
+      levels_.push_back(Level());
+    }
+    Level& l = levels_[k];
+    l.n++;
+    l.sum += x;
+    l.sum2 += x * x;
+    if (!l.has_pending) {
+      l.has_pending = true;
+      l.pending = x;
+      return;
+    }
+    // pair with the pending block into a block of the next level
+    x = 0.5 * (l.pending + x);
+    l.has_pending = false;
+  }
+}
+
+double BlockAverage::get_mean() const {
+  if (get_number_of_samples() == 0) {
+    return 0.0;
+  }
+  return levels_[0].sum / levels_[0].n;
+}
+
+double BlockAverage::get_standard_error(unsigned int k) const {
+  if (k >= levels_.size() || levels_[k].n < 2) {
+    return 0.0;
+  }
+  Level const& l = levels_[k];
+  double mean = l.sum / l.n;
+  double var = l.sum2 / l.n - mean * mean;
+  if (var <= 0.0) {
+    return 0.0;
+  }
+  return std::sqrt(var / (l.n - 1));
+}
+
+unsigned int BlockAverage::get_plateau_level() const {
+  unsigned int k = 0;
+  for (; k + 1 < levels_.size() && levels_[k + 1].n >= min_blocks_; k++) {
+    double se_k = get_standard_error(k);
+    double se_next = get_standard_error(k + 1);
+    double se_next_error = se_next / std::sqrt(2.0 * (levels_[k + 1].n - 1));
+    if (se_next - se_k <= se_next_error) {
+      return k;
+    }
+  }
+  return k;
+}
+
+bool BlockAverage::get_is_converged() const {
+  if (get_number_of_samples() < min_blocks_) {
+    return false;
+  }
+  unsigned int k = get_plateau_level();
+  if (k + 1 >= levels_.size() || levels_[k + 1].n < min_blocks_) {
+    return false; // never confirmed by a deeper level
+  }
+  double se_next = get_standard_error(k + 1);
+  double se_next_error = se_next / std::sqrt(2.0 * (levels_[k + 1].n - 1));
+  return se_next - get_standard_error(k) <= se_next_error;
+}
+
+double BlockAverage::get_statistical_inefficiency() const {
+  double se0 = get_standard_error(0);
+  if (se0 <= 0.0) {
+    return 1.0;
+  }
+  double ratio = get_standard_error() / se0;
+  return ratio * ratio;
+}
+
+IMPNPCTRANSPORT_END_INTERNAL_NAMESPACE
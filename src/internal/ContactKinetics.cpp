@@ -0,0 +1,139 @@
+/**
+ *  \file internal/ContactKinetics.cpp
+ *  \brief streaming residence times and rebinding intervals of contacts
+ *
+ *  Copyright 2007-2018 IMP Inventors. All rights reserved.
+ */
+
+#include <IMP/npctransport/internal/ContactKinetics.h>
+#include <IMP/check_macros.h>
+#include <cmath>
+
+IMPNPCTRANSPORT_BEGIN_INTERNAL_NAMESPACE
+
+/********************* LogTimeHistogram methods ****************/
+
+LogTimeHistogram::LogTimeHistogram(double min_ns, double bins_per_decade,
+                                   unsigned int n_bins)
+  : min_ns_(min_ns),
+    bins_per_decade_(bins_per_decade),
+    counts_(n_bins, 0),
+    n_censored_(0)
+{
+  IMP_USAGE_CHECK(min_ns > 0.0 && bins_per_decade > 0.0 && n_bins > 0,
+                  "invalid histogram parameters");
+}
+
+unsigned int LogTimeHistogram::get_bin(double t_ns) const {
+  if (t_ns <= min_ns_) {
+    return 0;
+  }
+  double bin = std::floor(bins_per_decade_ * std::log10(t_ns / min_ns_));
+  if (bin >= counts_.size() - 1) {
+    return counts_.size() - 1;
+  }
+  return static_cast<unsigned int>(bin);
+}
+
+unsigned int LogTimeHistogram::get_total_count() const {
+  unsigned int ret = 0;
+  for (unsigned int i = 0; i < counts_.size(); i++) {
+    ret += counts_[i];
+  }
+  return ret;
+}
+
+/********************* ContactKinetics methods ****************/
+
+ContactKinetics::ContactKinetics(double min_ns, double bins_per_decade,
+                                 unsigned int n_bins)
+  : n_snapshots_(0),
+    last_time_ns_(0.0),
+    last_reset_ns_(0.0),
+    residence_times_(min_ns, bins_per_decade, n_bins),
+    rebinding_intervals_(min_ns, bins_per_decade, n_bins)
+{}
+
+void ContactKinetics::add_contact(ParticleIndexPair const& pair,
+                                  double time_ns) {
+  std::pair<t_contacts::iterator, bool> ret =
+    contacts_.insert(std::make_pair(pair, Contact()));
+  Contact& c = ret.first->second;
+  if (ret.second) {
+    // new contact - assume it formed midway since the last snapshot
+    c.start_ns = n_snapshots_ > 1
+      ? 0.5 * (last_time_ns_ + time_ns) : time_ns;
+    t_lost_contacts::iterator it = lost_ns_.find(pair);
+    if (it != lost_ns_.end()) {
+      rebinding_intervals_.add(c.start_ns - it->second);
+      lost_ns_.erase(it);
+    }
+  }
+  c.last_seen = n_snapshots_;
+}
+
+void ContactKinetics::close_missing_contacts(double time_ns) {
+  double lost_ns = 0.5 * (last_time_ns_ + time_ns);
+  for (t_contacts::iterator it = contacts_.begin(); it != contacts_.end(); ) {
+    if (it->second.last_seen == n_snapshots_) {
+      ++it;
+      continue;
+    }
+    residence_times_.add(lost_ns - it->second.start_ns);
+    lost_ns_[it->first] = lost_ns;
+    it = contacts_.erase(it);
+  }
+}
+
+void ContactKinetics::reset_histograms() {
+  residence_times_.reset();
+  rebinding_intervals_.reset();
+  for (t_lost_contacts::iterator it = lost_ns_.begin();
+       it != lost_ns_.end(); ) {
+    if (it->second < last_reset_ns_) {
+      rebinding_intervals_.add_censored();
+      it = lost_ns_.erase(it);
+    } else {
+      ++it;
+    }
+  }
+  last_reset_ns_ = last_time_ns_;
+}
+
+ContactKinetics::State ContactKinetics::get_state() const {
+  State ret;
+  for (t_contacts::const_iterator it = contacts_.begin();
+       it != contacts_.end(); it++) {
+    ret.contacts.push_back(it->first);
+    ret.start_ns.push_back(it->second.start_ns);
+  }
+  for (t_lost_contacts::const_iterator it = lost_ns_.begin();
+       it != lost_ns_.end(); it++) {
+    ret.lost_contacts.push_back(it->first);
+    ret.lost_ns.push_back(it->second);
+  }
+  ret.n_snapshots = n_snapshots_;
+  ret.last_time_ns = last_time_ns_;
+  ret.last_reset_ns = last_reset_ns_;
+  return ret;
+}
+
+void ContactKinetics::set_state(State const& state) {
+  IMP_USAGE_CHECK(state.contacts.size() == state.start_ns.size() &&
+                  state.lost_contacts.size() == state.lost_ns.size(),
+                  "inconsistent contact kinetics state");
+  contacts_.clear();
+  lost_ns_.clear();
+  for (unsigned int i = 0; i < state.contacts.size(); i++) {
+    Contact c = { state.start_ns[i], state.n_snapshots };
+    contacts_[state.contacts[i]] = c;
+  }
+  for (unsigned int i = 0; i < state.lost_contacts.size(); i++) {
+    lost_ns_[state.lost_contacts[i]] = state.lost_ns[i];
+  }
+  n_snapshots_ = state.n_snapshots;
+  last_time_ns_ = state.last_time_ns;
+  last_reset_ns_ = state.last_reset_ns;
+}
+
+IMPNPCTRANSPORT_END_INTERNAL_NAMESPACE
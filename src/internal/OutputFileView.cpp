@@ -0,0 +1,364 @@
+/**
+ *  \file internal/OutputFileView.cpp
+ *  \brief lazy read-only access to the fields of an output file
+ *
+ *  Copyright 2007-2018 IMP Inventors. All rights reserved.
+ */
+
+#include <IMP/npctransport/internal/OutputFileView.h>
+#include <IMP/npctransport/internal/npctransport.pb.h>
+#include <IMP/exception.h>
+#include <IMP/check_macros.h>
+#include <boost/make_shared.hpp>
+#include <google/protobuf/io/coded_stream.h>
+#include <climits>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <fcntl.h>
+#include <stdint.h>
+#if !defined(_MSC_VER)
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+IMPNPCTRANSPORT_BEGIN_INTERNAL_NAMESPACE
+
+namespace {
+  // protobuf wire types
+  const unsigned int WIRE_VARINT = 0;
+  const unsigned int WIRE_FIXED64 = 1;
+  const unsigned int WIRE_LENGTH_DELIMITED = 2;
+  const unsigned int WIRE_FIXED32 = 5;
+
+  // field number of bd_simulation_time_ns in the Statistics message
+  const int STATISTICS_BD_SIMULATION_TIME_NS = 8;
+
+  // field number of number_of_frames in the Statistics message
+  const int STATISTICS_NUMBER_OF_FRAMES = 4;
+
+  // field number of interrupted in the Statistics message
+  const int STATISTICS_INTERRUPTED = 7;
+
+  // field number of random_number_generator_state in the Checkpoint message
+  const int CHECKPOINT_RANDOM_NUMBER_GENERATOR_STATE = 15;
+
+  // reads a varint at data[pos], advancing pos, or returns false
+  // if it does not end before end
+  bool read_varint(char const* data, std::size_t& pos, std::size_t end,
+                   uint64_t& value) {
+    value = 0;
+    for (unsigned int shift = 0; shift < 64 && pos < end; shift += 7) {
+      unsigned char byte = static_cast<unsigned char>(data[pos++]);
+      value |= static_cast<uint64_t>(byte & 0x7F) << shift;
+      if (!(byte & 0x80)) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  // writes value as a varint to out
+  void write_varint(uint64_t value, std::ostream& out) {
+    while (value >= 0x80) {
+      out.put(static_cast<char>((value & 0x7F) | 0x80));
+      value >>= 7;
+    }
+    out.put(static_cast<char>(value));
+  }
+
+  // merges size bytes at data into msg
+  bool merge_from_array(char const* data, std::size_t size,
+                        ::google::protobuf::MessageLite* msg) {
+    ::google::protobuf::io::CodedInputStream cis
+      ( reinterpret_cast< ::google::protobuf::uint8 const* >(data),
+        static_cast<int>(size) );
+    cis.SetTotalBytesLimit(INT_MAX, INT_MAX);
+    return msg->MergePartialFromCodedStream(&cis);
+  }
+}
+
+OutputFileView::OutputFileView(std::string fname)
+  : data_(nullptr), size_(0), mapped_(nullptr)
+{
+  map_file(fname);
+  IMP_ALWAYS_CHECK(scan_fields(data_, 0, size_, records_),
+                   "Corrupt protobuf in output file " << fname,
+                   IOException);
+}
+
+OutputFileView::OutputFileView(char const* data, std::size_t size)
+  : data_(data), size_(size), mapped_(nullptr)
+{
+  IMP_ALWAYS_CHECK(scan_fields(data_, 0, size_, records_),
+                   "Corrupt protobuf output message", IOException);
+}
+
+OutputFileView::~OutputFileView() {
+#if !defined(_MSC_VER)
+  if (mapped_) {
+    munmap(mapped_, size_);
+  }
+#endif
+}
+
+void OutputFileView::map_file(std::string fname) {
+#if !defined(_MSC_VER)
+  int fd = open(fname.c_str(), O_RDONLY);
+  IMP_ALWAYS_CHECK(fd != -1,
+                   "Unable to read data from protobuf " << fname,
+                   IOException);
+  struct stat st;
+  if (fstat(fd, &st) == 0 && st.st_size > 0) {
+    void* p = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (p != MAP_FAILED) {
+      mapped_ = p;
+      data_ = static_cast<char const*>(p);
+      size_ = st.st_size;
+    }
+  }
+  close(fd);
+#endif
+  if (!mapped_) {
+    // no mmap support, or an empty file
+    std::ifstream in(fname.c_str(), std::ios::binary);
+    IMP_ALWAYS_CHECK(in, "Unable to read data from protobuf " << fname,
+                     IOException);
+    buffer_.assign(std::istreambuf_iterator<char>(in),
+                   std::istreambuf_iterator<char>());
+    data_ = buffer_.empty() ? nullptr : &buffer_[0];
+    size_ = buffer_.size();
+  }
+}
+
+bool OutputFileView::scan_fields(char const* data, std::size_t begin,
+                                 std::size_t end,
+                                 std::vector<FieldRecord>& records) {
+  std::size_t pos = begin;
+  while (pos < end) {
+    FieldRecord r;
+    r.begin = pos;
+    uint64_t tag;
+    if (!read_varint(data, pos, end, tag)) {
+      return false;
+    }
+    r.field_number = static_cast<int>(tag >> 3);
+    if (r.field_number == 0) {
+      return false;
+    }
+    uint64_t value;
+    switch (tag & 0x7) {
+      case WIRE_VARINT:
+        r.value_begin = pos;
+        if (!read_varint(data, pos, end, value)) {
+          return false;
+        }
+        break;
+      case WIRE_FIXED64:
+        r.value_begin = pos;
+        pos += 8;
+        break;
+      case WIRE_LENGTH_DELIMITED:
+        if (!read_varint(data, pos, end, value) || value > end - pos) {
+          return false;
+        }
+        r.value_begin = pos;
+        pos += value;
+        break;
+      case WIRE_FIXED32:
+        r.value_begin = pos;
+        pos += 4;
+        break;
+      default:  // groups are not used in npctransport messages
+        return false;
+    }
+    if (pos > end) {
+      return false;
+    }
+    r.end = pos;
+    records.push_back(r);
+  }
+  return true;
+}
+
+OutputFileView::FieldRecord const*
+OutputFileView::get_last_record(int field_number) const {
+  for (std::size_t i = records_.size(); i > 0; i--) {
+    if (records_[i - 1].field_number == field_number) {
+      return &records_[i - 1];
+    }
+  }
+  return nullptr;
+}
+
+bool OutputFileView::get_message_field
+(int field_number, ::google::protobuf::MessageLite* msg) const {
+  msg->Clear();
+  bool found = false;
+  // multiple occurrences of a message field are merged
+  for (std::size_t i = 0; i < records_.size(); i++) {
+    FieldRecord const& r = records_[i];
+    if (r.field_number != field_number) continue;
+    if (!merge_from_array(data_ + r.value_begin, r.end - r.value_begin,
+                          msg)) {
+      return false;
+    }
+    found = true;
+  }
+  return found && msg->IsInitialized();
+}
+
+bool OutputFileView::get_assignment
+(::npctransport_proto::Assignment* assignment) const {
+  return get_message_field(ASSIGNMENT, assignment);
+}
+
+bool OutputFileView::get_conformation
+(::npctransport_proto::Conformation* conformation) const {
+  return get_message_field(CONFORMATION, conformation);
+}
+
+bool OutputFileView::get_checkpoint
+(::npctransport_proto::Checkpoint* checkpoint) const {
+  return get_message_field(CHECKPOINT, checkpoint);
+}
+
+RMF::BufferConstHandle OutputFileView::get_rmf_conformation() const {
+  FieldRecord const* r = get_last_record(RMF_CONFORMATION);
+  IMP_USAGE_CHECK(r, "No RMF conformation in output file");
+  return RMF::BufferConstHandle
+    ( boost::make_shared< std::vector<char> >
+      ( data_ + r->value_begin, data_ + r->end ) );
+}
+
+bool OutputFileView::get_has_bd_simulation_time_ns() const {
+  for (std::size_t i = 0; i < records_.size(); i++) {
+    FieldRecord const& r = records_[i];
+    if (r.field_number != STATISTICS) continue;
+    std::vector<FieldRecord> stats_records;
+    if (!scan_fields(data_, r.value_begin, r.end, stats_records)) continue;
+    for (std::size_t j = 0; j < stats_records.size(); j++) {
+      if (stats_records[j].field_number ==
+          STATISTICS_BD_SIMULATION_TIME_NS) {
+        return true;
+      }
+    }
+  }
+  return false;
+}
+
+double OutputFileView::get_bd_simulation_time_ns() const {
+  // the last occurrence of a scalar field wins
+  double ret = 0.0;
+  for (std::size_t i = 0; i < records_.size(); i++) {
+    FieldRecord const& r = records_[i];
+    if (r.field_number != STATISTICS) continue;
+    std::vector<FieldRecord> stats_records;
+    IMP_ALWAYS_CHECK(scan_fields(data_, r.value_begin, r.end, stats_records),
+                     "Corrupt statistics in output file", IOException);
+    for (std::size_t j = 0; j < stats_records.size(); j++) {
+      FieldRecord const& sr = stats_records[j];
+      if (sr.field_number == STATISTICS_BD_SIMULATION_TIME_NS &&
+          sr.end - sr.value_begin == sizeof(double)) {
+        // fixed64 fields are little-endian, as are all supported platforms
+        std::memcpy(&ret, data_ + sr.value_begin, sizeof(double));
+      }
+    }
+  }
+  return ret;
+}
+
+bool OutputFileView::get_is_interrupted() const {
+  uint64_t ret = 0;
+  for (std::size_t i = 0; i < records_.size(); i++) {
+    FieldRecord const& r = records_[i];
+    if (r.field_number != STATISTICS) continue;
+    std::vector<FieldRecord> stats_records;
+    IMP_ALWAYS_CHECK(scan_fields(data_, r.value_begin, r.end, stats_records),
+                     "Corrupt statistics in output file", IOException);
+    for (std::size_t j = 0; j < stats_records.size(); j++) {
+      FieldRecord const& sr = stats_records[j];
+      if (sr.field_number == STATISTICS_INTERRUPTED) {
+        std::size_t pos = sr.value_begin;
+        IMP_ALWAYS_CHECK(read_varint(data_, pos, sr.end, ret),
+                         "Corrupt statistics in output file", IOException);
+      }
+    }
+  }
+  return ret != 0;
+}
+
+int OutputFileView::get_number_of_frames() const {
+  // the last occurrence of a scalar field wins
+  uint64_t ret = 0;
+  for (std::size_t i = 0; i < records_.size(); i++) {
+    FieldRecord const& r = records_[i];
+    if (r.field_number != STATISTICS) continue;
+    std::vector<FieldRecord> stats_records;
+    IMP_ALWAYS_CHECK(scan_fields(data_, r.value_begin, r.end, stats_records),
+                     "Corrupt statistics in output file", IOException);
+    for (std::size_t j = 0; j < stats_records.size(); j++) {
+      FieldRecord const& sr = stats_records[j];
+      if (sr.field_number == STATISTICS_NUMBER_OF_FRAMES) {
+        std::size_t pos = sr.value_begin;
+        IMP_ALWAYS_CHECK(read_varint(data_, pos, sr.end, ret),
+                         "Corrupt statistics in output file", IOException);
+      }
+    }
+  }
+  return static_cast<int>(ret);
+}
+
+std::string OutputFileView::get_random_number_generator_state() const {
+  // the last occurrence of a scalar field wins
+  std::string ret;
+  for (std::size_t i = 0; i < records_.size(); i++) {
+    FieldRecord const& r = records_[i];
+    if (r.field_number != CHECKPOINT) continue;
+    std::vector<FieldRecord> checkpoint_records;
+    IMP_ALWAYS_CHECK(scan_fields(data_, r.value_begin, r.end,
+                                 checkpoint_records),
+                     "Corrupt checkpoint in output file", IOException);
+    for (std::size_t j = 0; j < checkpoint_records.size(); j++) {
+      FieldRecord const& cr = checkpoint_records[j];
+      if (cr.field_number == CHECKPOINT_RANDOM_NUMBER_GENERATOR_STATE) {
+        ret.assign(data_ + cr.value_begin, data_ + cr.end);
+      }
+    }
+  }
+  return ret;
+}
+
+void OutputFileView::write_fields_except(int field_number,
+                                         std::ostream& out,
+                                         bool is_clear_interrupted) const {
+  for (std::size_t i = 0; i < records_.size(); i++) {
+    FieldRecord const& r = records_[i];
+    if (r.field_number == field_number) continue;
+    if (!is_clear_interrupted || r.field_number != STATISTICS) {
+      out.write(data_ + r.begin, r.end - r.begin);
+      continue;
+    }
+    // rewrite the statistics without their interrupted field
+    std::vector<FieldRecord> stats_records;
+    IMP_ALWAYS_CHECK(scan_fields(data_, r.value_begin, r.end, stats_records),
+                     "Corrupt statistics in output file", IOException);
+    std::size_t size = 0;
+    for (std::size_t j = 0; j < stats_records.size(); j++) {
+      FieldRecord const& sr = stats_records[j];
+      if (sr.field_number == STATISTICS_INTERRUPTED) continue;
+      size += sr.end - sr.begin;
+    }
+    write_varint((STATISTICS << 3) | WIRE_LENGTH_DELIMITED, out);
+    write_varint(size, out);
+    for (std::size_t j = 0; j < stats_records.size(); j++) {
+      FieldRecord const& sr = stats_records[j];
+      if (sr.field_number == STATISTICS_INTERRUPTED) continue;
+      out.write(data_ + sr.begin, sr.end - sr.begin);
+    }
+  }
+}
+
+IMPNPCTRANSPORT_END_INTERNAL_NAMESPACE
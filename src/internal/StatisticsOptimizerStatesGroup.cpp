@@ -0,0 +1,100 @@
+/**
+ * \file internal/StatisticsOptimizerStatesGroup.cpp
+ * \brief runs statistics optimizer states of the same frame concurrently
+ *
+ *  Copyright 2007-2018 IMP Inventors. All rights reserved.
+ */
+
+#include <IMP/npctransport/internal/StatisticsOptimizerStatesGroup.h>
+#include <IMP/npctransport/BrownianDynamicsTAMDWithSlabSupport.h>
+#include <IMP/check_macros.h>
+#include <IMP/thread_macros.h>
+
+IMPNPCTRANSPORT_BEGIN_INTERNAL_NAMESPACE
+
+StatisticsOptimizerStatesGroup::StatisticsOptimizerStatesGroup
+( Model* m, unsigned int periodicity )
+  : P(m, "StatisticsOptimizerStatesGroup%1%"),
+    clock_(new StatisticsClock(m))
+{
+  set_period(periodicity);
+}
+
+StatisticsOptimizerStatesGroup::~StatisticsOptimizerStatesGroup()
+{
+  // so members can be added to other optimizers
+  clear_optimizer_states();
+}
+
+void StatisticsOptimizerStatesGroup::add_serial_optimizer_state
+( core::PeriodicOptimizerState* os )
+{
+  clock_->add_optimizer_state(os);
+  serial_states_.push_back(os);
+}
+
+void StatisticsOptimizerStatesGroup::add_parallel_optimizer_state
+( core::PeriodicOptimizerState* os )
+{
+  clock_->add_optimizer_state(os);
+  parallel_states_.push_back(os);
+}
+
+void StatisticsOptimizerStatesGroup::remove_optimizer_state
+( OptimizerState* os )
+{
+  for(unsigned int i = 0; i < serial_states_.size(); i++) {
+    if(serial_states_[i].get() == os) {
+      serial_states_.erase(serial_states_.begin() + i);
+      clock_->remove_optimizer_state(os);
+      return;
+    }
+  }
+  for(unsigned int i = 0; i < parallel_states_.size(); i++) {
+    if(parallel_states_[i].get() == os) {
+      parallel_states_.erase(parallel_states_.begin() + i);
+      clock_->remove_optimizer_state(os);
+      return;
+    }
+  }
+}
+
+void StatisticsOptimizerStatesGroup::clear_optimizer_states()
+{
+  clock_->clear_optimizer_states();
+  serial_states_.clear();
+  parallel_states_.clear();
+  read_pis_.clear();
+}
+
+void StatisticsOptimizerStatesGroup::update_serial_states()
+{
+  for(unsigned int i = 0; i < serial_states_.size(); i++) {
+    serial_states_[i]->update_always();
+  }
+}
+
+void StatisticsOptimizerStatesGroup::do_update(unsigned int)
+{
+  atom::Simulator* simulator =
+    dynamic_cast< atom::Simulator* >( get_optimizer() );
+  IMP_USAGE_CHECK( simulator, "Optimizer must be a simulator in order to use "
+                   "StatisticsOptimizerStatesGroup, for time stats" );
+  clock_->synchronize_with(simulator);
+  BrownianDynamicsTAMDWithSlabSupport* bd =
+    dynamic_cast< BrownianDynamicsTAMDWithSlabSupport* >( simulator );
+  if(bd) {
+    bd->synchronize_free_diffusion_flights(read_pis_);
+  }
+  // serial states may evaluate scoring functions, which updates score
+  // states and writes derivatives, so they must be done before any other
+  // state reads the model
+  update_serial_states();
+  int n = parallel_states_.size();
+  IMP_OMP_PRAGMA(parallel for schedule(dynamic, 1) if(n > 1))
+  for(int i = 0; i < n; i++) {
+    parallel_states_[i]->update_always();
+  }
+}
+
+IMPNPCTRANSPORT_END_INTERNAL_NAMESPACE
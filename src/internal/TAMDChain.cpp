@@ -9,12 +9,10 @@
 #include <IMP/npctransport/Scoring.h>
 #include <IMP/atom/Diffusion.h>
 #include <IMP/atom/Hierarchy.h>
-#include <IMP/atom/CenterOfMass.h>
 #include <IMP/atom/Mass.h>
 #include <IMP/atom/TAMDParticle.h>
 #include <IMP/Pointer.h>
 #include <IMP/core/ChildrenRefiner.h>
-#include <IMP/core/PairRestraint.h>
 #include <IMP/core/rigid_bodies.h>
 #include <IMP/core/XYZR.h>
 #include <IMP/display/Colored.h>
@@ -32,7 +30,18 @@ Restraints TAMDChain::get_chain_restraints(Scoring const* scoring_manager)
 {
   IMP_USAGE_CHECK( is_initialized,
                    "TAMD chain must be initialized by restraint generation");
-  Restraints ret = tamd_restraints_;
+  Restraints ret;
+  if(!centroids_.empty()){
+    if(!tamd_springs_restraint_){
+      tamd_springs_restraint_ = new TAMDImageSpringsRestraint
+        ( get_root().get_model(),
+          IMP::get_indexes(ParticlesTemp(centroids_.begin(), centroids_.end())),
+          IMP::get_indexes(ParticlesTemp(images_.begin(), images_.end())),
+          tamd_springs_,
+          "TAMD springs of " + get_name() );
+    }
+    ret.push_back(tamd_springs_restraint_);
+  }
   ret += FGChain::get_chain_restraints(scoring_manager);
   return ret;
 }
@@ -40,7 +49,7 @@ Restraints TAMDChain::get_chain_restraints(Scoring const* scoring_manager)
 
 // add d children and n beads to root root_h (accessory method for
 // create_tamd_chain()) ; params are same as create_tamd_chain() ;
-// Set root as centroid of its children (with updated list)
+// Set root mass to the total mass of its children
 void TAMDChain::add_children
 ( ParticleFactory* pf,
   unsigned int n,
@@ -58,22 +67,24 @@ void TAMDChain::add_children
   while(n_left > 0){
     int n1 = n1_base + (n_excess-- > 0 ? 1 : 0); // actual beads per child
     Pointer<TAMDChain> child_chain =
-      create_tamd_chain(pf, n1, d, T_factors, F_factors1, Ks1);
+      create_tamd_chain(pf, n1, d, T_factors, F_factors1, Ks1, false);
     n_left -= n1;
     get_root().add_child( child_chain->get_root() );
     centroids_ += child_chain->centroids_;
     images_ += child_chain->images_;
-    tamd_restraints_ += child_chain->tamd_restraints_;
     tamd_springs_ += child_chain->tamd_springs_;
     std::cout << "Added child chain with " << n1 << " beads; "
               << n_left << " left" << std::endl;
   }
 
-  // Setup root as center of mass of its children:
-  // Pointer<core::ChildrenRefiner> refiner =
-  //  new core::ChildrenRefiner( atom::Hierarchy::get_default_traits() );
-  atom::CenterOfMass::setup_particle(get_root(),
-                                     get_root().get_children());
+  // The root is the center of mass of its children, but its coordinates
+  // are updated by a TAMDForest shared by all chains rather than by a
+  // CenterOfMass constraint per centroid (see create_tamd_chain())
+  double mass = 0.0;
+  for(unsigned int i = 0; i < get_root().get_number_of_children(); i++){
+    mass += atom::Mass(get_root().get_child(i)).get_mass();
+  }
+  atom::Mass(get_root()).set_mass(mass);
 
 }
 
@@ -107,7 +118,8 @@ create_tamd_chain( ParticleFactory* pf,
                    unsigned int d,
                    std::vector<double> T_factors,
                     std::vector<double> F_factors,
-                   std::vector<double> Ks )
+                   std::vector<double> Ks,
+                   bool is_add_to_forest )
 {
   // Exceptionalize singletons (recursion stop condition)
   if (n==1)
@@ -135,7 +147,7 @@ create_tamd_chain( ParticleFactory* pf,
   atom::Diffusion::setup_particle(root); // TODO: is needed?
   core::Typed::setup_particle(root,
                               core::ParticleType("TAMD Centroid") );
-  atom::Mass::setup_particle(root, 1.0); // dummy - will be updated by CenterOfMass
+  atom::Mass::setup_particle(root, 1.0); // dummy - will be updated in add_children
 
   // Build TAMD image of root + tamd spring restraint:
   std::string image_name = "Image " + root->get_name();
@@ -145,19 +157,19 @@ create_tamd_chain( ParticleFactory* pf,
                                         F_factors[0]);
   Pointer<core::HarmonicDistancePairScore> tamd_spring=
     new core::HarmonicDistancePairScore(0, Ks[0]);
-  Pointer<IMP::Restraint> tamd_restraint = new core::PairRestraint
-    ( pf->get_model(), tamd_spring,
-      ParticleIndexPair(root->get_index(), image->get_index()), image_name );
 
   // build TAMD chain object with children and return it:
   IMP_NEW(TAMDChain, ret_chain, ());
   ret_chain->set_root(root);
   ret_chain->centroids_.push_back( root_h );
   ret_chain->images_.push_back(image);
-  ret_chain->tamd_restraints_.push_back(tamd_restraint);
   ret_chain->tamd_springs_.push_back( tamd_spring );
   ret_chain->add_children(pf, n, d, T_factors, F_factors, Ks);
   ret_chain->is_initialized = true;
+  if(is_add_to_forest) {
+    // without it, centroids would never follow their beads
+    get_tamd_forest(pf->get_model())->add_chain(ret_chain);
+  }
   for(unsigned int i=0 ; i < ret_chain->get_number_of_beads(); i++){
         std::cout << "n = " << n << " Bead # " << i << " - "
                   << ret_chain->get_bead(i) << std::endl;
@@ -0,0 +1,249 @@
+/**
+ * \file internal/TAMDForest.cpp
+ * \brief flattened representation of all TAMD hierarchies in a model
+ *
+ *  Copyright 2007-2018 IMP Inventors. All rights reserved.
+ */
+
+#include <IMP/npctransport/internal/TAMDForest.h>
+#include <IMP/npctransport/internal/TAMDChain.h>
+#include <IMP/atom/Hierarchy.h>
+#include <IMP/atom/Mass.h>
+#include <IMP/core/XYZ.h>
+#include <IMP/thread_macros.h>
+#include <algorithm>
+
+IMPNPCTRANSPORT_BEGIN_INTERNAL_NAMESPACE
+
+/********************* TAMDForest methods ****************/
+
+namespace {
+  ModelKey get_tamd_forest_key() {
+    static ModelKey k("npctransport TAMD forest");
+    return k;
+  }
+}
+
+TAMDForest* get_tamd_forest(Model* m)
+{
+  ModelKey k = get_tamd_forest_key();
+  if(!m->get_has_data(k)) {
+    IMP_NEW(TAMDForest, forest, (m));
+    m->add_score_state(forest);
+    m->add_data(k, forest);
+  }
+  return static_cast<TAMDForest*>(m->get_data(k));
+}
+
+TAMDForest::TAMDForest(Model* m, std::string name)
+  : ScoreState(m, name)
+{
+  trees_begin_.push_back(0);
+  children_begin_.push_back(0);
+}
+
+void TAMDForest::add_chain(TAMDChain* chain)
+{
+  IMP_USAGE_CHECK(std::find(chains_.begin(), chains_.end(),
+                            static_cast<FGChain*>(chain))
+                  == chains_.end(),
+                  "chain " << chain->get_name() << " already in forest");
+  chains_.push_back(chain);
+  add_tree(chain);
+}
+
+void TAMDForest::remove_chain(TAMDChain* chain)
+{
+  IMP::Vector< PointerMember<FGChain> >::iterator it =
+    std::find(chains_.begin(), chains_.end(), static_cast<FGChain*>(chain));
+  if(it == chains_.end()) {
+    return;
+  }
+  chains_.erase(it);
+  rebuild();
+}
+
+void TAMDForest::rebuild()
+{
+  centroids_.clear();
+  images_.clear();
+  children_begin_.assign(1, 0);
+  children_.clear();
+  weights_.clear();
+  trees_begin_.assign(1, 0);
+  for(unsigned int j = 0; j < chains_.size(); j++) {
+    add_tree(static_cast<TAMDChain*>(chains_[j].get()));
+  }
+}
+
+// Flatten the chain such that children always precede their parents.
+// Centroids in TAMDChain::get_tamd_centroids() are in pre-order (each
+// centroid precedes its subtree), so reversing them suffices.
+void TAMDForest::add_tree(TAMDChain* chain)
+{
+  Model* m = get_model();
+  Particles centroids = chain->get_tamd_centroids();
+  Particles images = chain->get_tamd_images();
+  IMP_USAGE_CHECK(centroids.size() == images.size(),
+                  "each TAMD centroid must have exactly one image");
+  for(int i = static_cast<int>(centroids.size()) - 1; i >= 0; i--) {
+    atom::Hierarchy h(centroids[i]);
+    double total_mass = 0.0;
+    unsigned int first = children_.size();
+    for(unsigned int k = 0; k < h.get_number_of_children(); k++) {
+      ParticleIndex ck = h.get_child(k).get_particle_index();
+      double mk = atom::Mass(m, ck).get_mass();
+      children_.push_back(ck);
+      weights_.push_back(mk);
+      total_mass += mk;
+    }
+    IMP_USAGE_CHECK(total_mass > 0.0,
+                    "TAMD centroid " << centroids[i]->get_name()
+                    << " has no mass");
+    for(unsigned int k = first; k < children_.size(); k++) {
+      weights_[k] /= total_mass;
+    }
+    // a parent centroid reads this mass when it is flattened later
+    atom::Mass(centroids[i]).set_mass(total_mass);
+    centroids_.push_back(centroids[i]->get_index());
+    images_.push_back(images[i]->get_index());
+    children_begin_.push_back(children_.size());
+  }
+  trees_begin_.push_back(centroids_.size());
+}
+
+void TAMDForest::update_tree_centroids(unsigned int j)
+{
+  Model* m = get_model();
+  for(int i = trees_begin_[j]; i < trees_begin_[j+1]; i++) {
+    algebra::Vector3D x(0, 0, 0);
+    for(int k = children_begin_[i]; k < children_begin_[i+1]; k++) {
+      x += weights_[k] * m->get_sphere(children_[k]).get_center();
+    }
+    core::XYZ(m, centroids_[i]).set_coordinates(x);
+  }
+}
+
+void TAMDForest::update_centroids()
+{
+  int n = chains_.size();
+  IMP_OMP_PRAGMA(parallel for schedule(static) if(n > 1))
+  for(int j = 0; j < n; j++) {
+    update_tree_centroids(j);
+  }
+}
+
+void TAMDForest::reset_images_to_centroids()
+{
+  update_centroids();
+  Model* m = get_model();
+  for(unsigned int i = 0; i < centroids_.size(); i++) {
+    core::XYZ(m, images_[i]).set_coordinates
+      ( m->get_sphere(centroids_[i]).get_center() );
+  }
+}
+
+// Parents precede their children when the flattened tree is traversed
+// backwards, so derivatives are pushed down level by level in one pass
+void TAMDForest::distribute_tree_derivatives(unsigned int j,
+                                             DerivativeAccumulator& da)
+{
+  Model* m = get_model();
+  for(int i = trees_begin_[j+1] - 1; i >= trees_begin_[j]; i--) {
+    algebra::Vector3D d = core::XYZ(m, centroids_[i]).get_derivatives();
+    for(int k = children_begin_[i]; k < children_begin_[i+1]; k++) {
+      core::XYZ(m, children_[k]).add_to_derivatives(weights_[k] * d, da);
+    }
+  }
+}
+
+void TAMDForest::do_before_evaluate()
+{
+  update_centroids();
+}
+
+void TAMDForest::do_after_evaluate(DerivativeAccumulator *da)
+{
+  if(!da) {
+    return;
+  }
+  int n = chains_.size();
+  IMP_OMP_PRAGMA(parallel for schedule(static) if(n > 1))
+  for(int j = 0; j < n; j++) {
+    distribute_tree_derivatives(j, *da);
+  }
+}
+
+ModelObjectsTemp TAMDForest::do_get_inputs() const
+{
+  Model* m = get_model();
+  ModelObjectsTemp ret;
+  for(unsigned int k = 0; k < children_.size(); k++) {
+    ret.push_back(m->get_particle(children_[k]));
+  }
+  return ret;
+}
+
+ModelObjectsTemp TAMDForest::do_get_outputs() const
+{
+  Model* m = get_model();
+  ModelObjectsTemp ret;
+  for(unsigned int i = 0; i < centroids_.size(); i++) {
+    ret.push_back(m->get_particle(centroids_[i]));
+  }
+  return ret;
+}
+
+
+/************** TAMDImageSpringsRestraint methods ****************/
+
+TAMDImageSpringsRestraint::TAMDImageSpringsRestraint
+( Model* m,
+  const ParticleIndexes& centroids,
+  const ParticleIndexes& images,
+  const core::HarmonicDistancePairScores& springs,
+  std::string name )
+  : Restraint(m, name),
+    centroids_(centroids),
+    images_(images),
+    springs_(springs)
+{
+  IMP_USAGE_CHECK(centroids_.size() == images_.size() &&
+                  centroids_.size() == springs_.size(),
+                  "centroids, images and springs must correspond");
+}
+
+// TAMD springs have zero rest length, so the force on the image is
+// simply k times its displacement from the centroid
+double
+TAMDImageSpringsRestraint::unprotected_evaluate
+( DerivativeAccumulator *da ) const
+{
+  Model* m = get_model();
+  double score = 0.0;
+  for(unsigned int i = 0; i < centroids_.size(); i++) {
+    double k = springs_[i]->get_score_functor().get_k();
+    algebra::Vector3D dv = m->get_sphere(images_[i]).get_center()
+      - m->get_sphere(centroids_[i]).get_center();
+    score += 0.5 * k * dv.get_squared_magnitude();
+    if(da) {
+      algebra::Vector3D f = k * dv;
+      core::XYZ(m, images_[i]).add_to_derivatives(f, *da);
+      core::XYZ(m, centroids_[i]).add_to_derivatives(-f, *da);
+    }
+  }
+  return score;
+}
+
+ModelObjectsTemp TAMDImageSpringsRestraint::do_get_inputs() const
+{
+  Model* m = get_model();
+  ModelObjectsTemp ret;
+  for(unsigned int i = 0; i < centroids_.size(); i++) {
+    ret.push_back(m->get_particle(centroids_[i]));
+    ret.push_back(m->get_particle(images_[i]));
+  }
+  return ret;
+}
+
+IMPNPCTRANSPORT_END_INTERNAL_NAMESPACE
@@ -0,0 +1,140 @@
+/**
+ *  \file internal/avro_index.cpp
+ *  \brief random-access indexes of avro archives of output files
+ *
+ *  Copyright 2007-2018 IMP Inventors. All rights reserved.
+ */
+
+#include <IMP/npctransport/internal/avro_index.h>
+#include <IMP/npctransport/internal/AvroBlockReader.h>
+#include <IMP/npctransport/internal/OutputFileView.h>
+#include <IMP/npctransport/internal/npctransport.pb.h>
+#include <IMP/npctransport/avro.h>
+#include <IMP/exception.h>
+#include <IMP/check_macros.h>
+#include <boost/lexical_cast.hpp>
+#include <fstream>
+#include <sys/stat.h>
+
+IMPNPCTRANSPORT_BEGIN_INTERNAL_NAMESPACE
+
+namespace {
+  int64_t get_file_size(std::string file_name) {
+    std::ifstream f(file_name.c_str(), std::ios::binary | std::ios::ate);
+    if (!f) {
+      return -1;
+    }
+    return f.tellg();
+  }
+
+  int64_t get_file_mtime(std::string file_name) {
+    struct stat st;
+    if (stat(file_name.c_str(), &st) != 0) {
+      return -1;
+    }
+    return st.st_mtime;
+  }
+}
+
+uint64_t get_configuration_hash
+( ::npctransport_proto::Assignment const& assignment )
+{
+  ::npctransport_proto::Assignment a(assignment);
+  a.clear_work_unit();
+  a.clear_random_seed();
+  a.clear_imp_module_version();
+  a.clear_npc_module_version();
+  a.clear_configuration_hash();
+  std::string s;
+  a.SerializePartialToString(&s);
+  // 64-bit FNV-1a
+  uint64_t hash = 14695981039346656037ULL;
+  for (std::size_t i = 0; i < s.size(); i++) {
+    hash ^= static_cast<unsigned char>(s[i]);
+    hash *= 1099511628211ULL;
+  }
+  return hash;
+}
+
+uint64_t get_assigned_configuration_hash
+( ::npctransport_proto::Assignment const& assignment )
+{
+  if (assignment.has_configuration_hash()) {
+    return assignment.configuration_hash();
+  }
+  return get_configuration_hash(assignment);
+}
+
+void build_avro_index
+( std::string avro_filename, ::npctransport_proto::AvroArchiveIndex* index )
+{
+  index->Clear();
+  index->set_archive_size(get_file_size(avro_filename));
+  index->set_archive_mtime(get_file_mtime(avro_filename));
+  AvroBlockReader reader(avro_filename);
+  AvroBlockReader::Entry entry;
+  ::npctransport_proto::Assignment assignment;
+  while (reader.read_next(entry)) {
+    OutputFileView view(entry.value, entry.value_size);
+    IMP_ALWAYS_CHECK(view.get_assignment(&assignment),
+                     "Entry " << entry.key << " of " << avro_filename
+                     << " has no valid assignment", IOException);
+    ::npctransport_proto::AvroArchiveIndex::Entry* ie = index->add_entries();
+    ie->set_work_unit(assignment.work_unit());
+    ie->set_key(entry.key);
+    ie->set_configuration_hash(get_assigned_configuration_hash(assignment));
+    ie->set_block_offset(entry.block_offset);
+    ie->set_index_in_block(entry.index_in_block);
+  }
+}
+
+bool load_avro_index
+( std::string avro_filename, ::npctransport_proto::AvroArchiveIndex* index )
+{
+  std::ifstream f(get_avro_index_file_name(avro_filename).c_str(),
+                  std::ios::binary);
+  if (!f || !index->ParseFromIstream(&f)) {
+    return false;
+  }
+  return index->archive_size() == get_file_size(avro_filename) &&
+    index->archive_mtime() == get_file_mtime(avro_filename);
+}
+
+bool save_avro_index
+( std::string avro_filename,
+  ::npctransport_proto::AvroArchiveIndex const& index )
+{
+  std::ofstream f(get_avro_index_file_name(avro_filename).c_str(),
+                  std::ios::out | std::ios::trunc | std::ios::binary);
+  return f && index.SerializeToOstream(&f);
+}
+
+std::string get_avro_key
+( ::npctransport_proto::Assignment const& assignment )
+{
+  return boost::lexical_cast<std::string>(assignment.work_unit()) + "_" +
+    boost::lexical_cast<std::string>(assignment.random_seed());
+}
+
+std::set<std::string> get_avro_archive_keys(std::string avro_filename)
+{
+  std::set<std::string> ret;
+  if (get_file_size(avro_filename) <= 0) {
+    return ret;
+  }
+  ::npctransport_proto::AvroArchiveIndex index;
+  if (load_avro_index(avro_filename, &index)) {
+    for (int i = 0; i < index.entries_size(); i++) {
+      ret.insert(index.entries(i).key());
+    }
+  } else {
+    AvroBlockReader reader(avro_filename);
+    AvroBlockReader::Entry entry;
+    while (reader.read_next(entry)) {
+      ret.insert(entry.key);
+    }
+  }
+  return ret;
+}
+
+IMPNPCTRANSPORT_END_INTERNAL_NAMESPACE
@@ -18,9 +18,11 @@
 #include <IMP/npctransport/internal/npctransport.pb.h>
 #include <IMP/npctransport/internal/boost_main.h>
 #include <IMP/npctransport/internal/initialize_positions_RAIIs.h>
+#include <IMP/npctransport/internal/OutputFileView.h>
 #include <IMP/npctransport.h>
 #include <IMP/npctransport/initialize_positions.h>
 #include <IMP/npctransport/protobuf.h>
+#include <IMP/npctransport/snapshot.h>
 #include <IMP/npctransport/util.h>
 #include <IMP/rmf/frames.h>
 #include <IMP/core/rigid_bodies.h>
@@ -46,6 +48,8 @@
 #include <ctime>
 #include <iostream>
 #include <numeric>
+#include <sstream>
+#include <string>
 #include <fcntl.h>
 #if defined(_MSC_VER)
 #include <io.h>
@@ -83,6 +87,14 @@ IMP::AddStringFlag restart_adder
   " file)"
   " [default: %default]",
   &restart);
+bool is_resume = false;
+IMP::AddBoolFlag is_resume_adder
+( "resume",
+  "with --restart, resume an interrupted run: run only the frames of the"
+  " full run that were not simulated yet, according to the number of"
+  " frames in the statistics of the restarted output, instead of all"
+  " frames again",
+  &is_resume);
 std::string restart_fgs_only = "";
 IMP::AddStringFlag restart_fgs_only_adder
 ( "restart_fgs_only",
@@ -150,6 +162,28 @@ AddFloatFlag short_init_adder
   " Note: initialization does not run in restart mode, unless --force_initialization_on_restart"
   " flag is specified explicitly",
   &short_init_factor);
+std::string snapshot_dir = "";
+IMP::AddStringFlag snapshot_dir_adder
+( "snapshot_dir",
+  "directory of snapshots of initialized models, shared by work units"
+  " that differ only in their interaction parameters, random seed or run"
+  " length. The initialization of the first trial loads a snapshot of"
+  " the same geometry from it if one exists, or saves one otherwise."
+  " Snapshots are taken before any interaction potentials are applied,"
+  " so the post-initialization relaxation and equilibration still run"
+  " with the interactions and random seed of each work unit. Each"
+  " geometry has a pool of --n_snapshots snapshots, selected by the"
+  " random seed of the work unit, so replicates whose seeds select the"
+  " same snapshot start from the same initialized conformation and"
+  " diverge only during this relaxation and equilibration."
+  " Ignored on restart",
+  &snapshot_dir);
+boost::int64_t n_snapshots = 8;
+IMP::AddIntFlag n_snapshots_adder
+( "n_snapshots",
+  "number of snapshots per geometry in --snapshot_dir, each initialized"
+  " independently [default: %default]",
+  &n_snapshots);
 bool is_force_initialization_on_restart= false;
 IMP::AddBoolFlag is_force_initialization_on_restart_adder
 ( "force_initialization_on_restart",
@@ -181,6 +215,9 @@ AddFloatFlag kap_interaction_k_factor_adder
   &kap_interaction_k_factor );
 
 namespace {
+  // frames of the full run simulated before a resumed restart
+  unsigned int n_resumed_frames = 0;
+
   /*********************************** internal functions
    * *********************************/
 
@@ -208,25 +245,6 @@ namespace {
     }
   }
 
-  void adjust_kap_stickiness
-  ( ::npctransport_proto::Assignment* pb_assignment );
-
-  inline void adjust_kap_stickiness
-  ( ::npctransport_proto::Assignment* pb_assignment )
-  {
-    for (int i = 0; i < pb_assignment->floaters_size(); ++i) {
-      ::npctransport_proto::Assignment_FloaterAssignment* f_data=
-        pb_assignment->mutable_floaters(i);
-      std::string prefix("kap");
-      if( std::mismatch(prefix.begin(),prefix.end(), f_data->type().begin()).first ==
-          prefix.end() ) { // = if "kap" is a prefix of f_data->type
-        double new_k_factor=
-          f_data->interaction_k_factor().value() * kap_interaction_k_factor;
-        f_data->mutable_interaction_k_factor()->set_value( new_k_factor );
-      }
-    }
-  }
-
   //! Use output file specified in ref_output_fname to load
   //! coordinates of FGs into target_sd. It is assumed that the FGs
   //! from ref_output_fname have the same topology as in target_sd
@@ -243,37 +261,45 @@ namespace {
       from a previous output file
 
       @param actual_seed the actual random seed used in the simulation,
-      to be saved in the output file
+      to be saved in the output file, unless the random number sequence
+      of a restarted simulation is resumed from its checkpoint
+
+      @return the state of the random number generator saved in the
+              checkpoint of the restarted simulation, or an empty string
+              if not restarting from a checkpoint
   */
-  inline void write_output_based_on_flags(boost::uint64_t actual_seed) {
-    std::string prev_output_fname;
-    if (restart.empty()) {
-      int num = IMP::npctransport::assign_ranges(configuration, output, work_unit,
-                                                 show_steps, actual_seed);
-      if (show_number_of_work_units) {
+  inline std::string write_output_based_on_flags(boost::uint64_t actual_seed) {
+    if (!restart.empty()) {
+      IMP_OMP_PRAGMA(critical)
+        std::cout << "Restart simulation from " << restart << std::endl;
+      if (is_resume) {
+        n_resumed_frames = internal::OutputFileView(restart)
+          .get_number_of_frames();
         IMP_OMP_PRAGMA(critical)
-          std::cout << "work units " << num << std::endl;
+          std::cout << "Resuming after " << n_resumed_frames
+                    << " simulated frames" << std::endl;
       }
-      prev_output_fname= output;
-    } else {  // resart.empty()
-      prev_output_fname= restart;
+      // copy to new file to avoid modifying input file, without parsing
+      // the statistics accumulated in it
+      return write_restart_output_file(restart, output,
+                                       kap_interaction_k_factor,
+                                       actual_seed);
+    }
+    int num = IMP::npctransport::assign_ranges(configuration, output, work_unit,
+                                               show_steps, actual_seed);
+    if (show_number_of_work_units) {
       IMP_OMP_PRAGMA(critical)
-        std::cout << "Restart simulation from " << restart << std::endl;
+        std::cout << "work units " << num << std::endl;
     }
-
-    // copy to new file to avoid modifying input file
-    ::npctransport_proto::Output prev_output;
-    bool is_read= load_output_protobuf(prev_output_fname, prev_output);
-    IMP_ALWAYS_CHECK(is_read, "Couldn't read previous output file "
-                     << prev_output_fname,
+    ::npctransport_proto::Output new_output;
+    bool is_read= load_output_protobuf(output, new_output);
+    IMP_ALWAYS_CHECK(is_read, "Couldn't read output file " << output,
                      IMP::ValueException);
-    ::npctransport_proto::Assignment* pb_assignment = prev_output.mutable_assignment();
-    adjust_kap_stickiness(pb_assignment);
-    if(!restart.empty()) {
-      pb_assignment->set_random_seed(actual_seed);
-    }
+    adjust_kap_interaction_k_factors(new_output.mutable_assignment(),
+                                     kap_interaction_k_factor);
     std::ofstream outf(output.c_str(), std::ios::binary);
-    prev_output.SerializeToOstream(&outf);
+    new_output.SerializeToOstream(&outf);
+    return std::string();
   }
 
   /**
@@ -314,6 +340,8 @@ namespace {
       std::cout << "Optimizing for " << cur_nframes << " frames in this iteration"
                 << std::endl;
       sd->get_bd()->optimize(cur_nframes);
+      // land floaters in free flight before using their coordinates
+      sd->get_bd()->synchronize_free_diffusion_flights();
       print_score_and_positions(sd);
       //});
       if (sd->get_maximum_number_of_minutes() > 0 &&
@@ -347,11 +375,24 @@ IMP::npctransport::SimulationData *startup(int argc, char *argv[])
   IMP_ALWAYS_CHECK( short_init_factor > 0,
                     "short_init_factor must be positive",
                     IMP::ValueException );
+  IMP_ALWAYS_CHECK( n_snapshots > 0,
+                    "n_snapshots must be positive",
+                    IMP::ValueException );
   IMP_OMP_PRAGMA(critical)
     std::cout << "Random seed is " << IMP::get_random_seed() << std::endl;
   IMP::Pointer<IMP::npctransport::SimulationData> sd;
-  write_output_based_on_flags(IMP::get_random_seed());
+  std::string random_number_generator_state =
+    write_output_based_on_flags(IMP::get_random_seed());
   sd = new IMP::npctransport::SimulationData(output, IMP::run_quick_test);
+  if (!random_number_generator_state.empty()) {
+    // resume the random number sequence of the restarted simulation
+    // exactly where its checkpoint was saved
+    std::istringstream iss(random_number_generator_state);
+    iss >> IMP::random_number_generator;
+    IMP_OMP_PRAGMA(critical)
+      std::cout << "Resuming random number sequence from checkpoint"
+                << std::endl;
+  }
   if (!conformations.empty()) {
     sd->set_rmf_file(conformations,
                      !no_save_restraints_to_rmf);
@@ -487,12 +528,9 @@ void inflate_floater
     //   conformations_rmf_sos->update_always("Inflating");
     // }
   } // r
-  // Update output file (read, find floater, update radius):
-  ::npctransport_proto::Output new_output;
-  bool is_read= load_output_protobuf(output, new_output);
-  IMP_ALWAYS_CHECK(is_read, "Couldn't read output file " << output,
-                   IMP::ValueException);
-  ::npctransport_proto::Assignment* pb_assignment = new_output.mutable_assignment();
+  // Update output file (find floater, update radius):
+  ::npctransport_proto::Assignment* pb_assignment =
+    sd->get_statistics()->get_mutable_output()->mutable_assignment();
   for (int i = 0; i < pb_assignment->floaters_size(); ++i) {
     ::npctransport_proto::Assignment_FloaterAssignment* f_data=
       pb_assignment->mutable_floaters(i);
@@ -501,22 +539,16 @@ void inflate_floater
       break;
     }
   }
-  std::ofstream outf(output.c_str(), std::ios::binary);
-  new_output.SerializeToOstream(&outf);
+  sd->get_statistics()->write_output();
 }
 
 void reset_box_size(SimulationData* sd, double box_size){
   sd->set_box_size(box_size);
   // Update output file:
-  ::npctransport_proto::Output new_output;
-  bool is_read= load_output_protobuf(output, new_output);
-  IMP_ALWAYS_CHECK(is_read,
-                   "Couldn't read output file " << output,
-                   IMP::ValueException);
-  ::npctransport_proto::Assignment* pb_assignment = new_output.mutable_assignment();
+  ::npctransport_proto::Assignment* pb_assignment =
+    sd->get_statistics()->get_mutable_output()->mutable_assignment();
   pb_assignment->mutable_box_side()->set_value(box_size);
-  std::ofstream outf(output.c_str(), std::ios::binary);
-  new_output.SerializeToOstream(&outf);
+  sd->get_statistics()->write_output();
 }
 
 //!  Run simulation using preconstructed SimulationData object sd,
@@ -549,15 +581,36 @@ void do_main_loop(SimulationData *sd, const RestraintsTemp &init_restraints) {
               << sd->get_number_of_trials() << std::endl;
     if (is_initial_optimization) {
       sd->switch_suspend_rmf(true);
-      std::cout << "Doing initial coordinates optimization..." << std::endl;
-      bool is_disable_randomize=
-        is_force_initialization_on_restart; // if restarting, shouldn't randomize even if re-initializing cause want to preserve old starting point
-      initialize_positions(sd,
-                           init_restraints,
-                           verbose,
-                           short_init_factor,
-                           is_disable_randomize,
-                           !restart_fgs_only.empty());
+      // a snapshot of a model with the same geometry replaces the
+      // initialization of the first trial of a new run
+      std::string snapshot_file;
+      if (!snapshot_dir.empty() && i == 0 && restart.empty() &&
+          init_rmffile.empty() && restart_fgs_only.empty()) {
+        snapshot_file =
+          get_snapshot_file_name(snapshot_dir, sd, short_init_factor,
+                                 n_snapshots);
+      }
+      if (!snapshot_file.empty() && load_snapshot(snapshot_file, sd)) {
+        std::cout << "Initialized coordinates from snapshot "
+                  << snapshot_file << std::endl;
+      } else {
+        std::cout << "Doing initial coordinates optimization..." << std::endl;
+        bool is_disable_randomize=
+          is_force_initialization_on_restart; // if restarting, shouldn't randomize even if re-initializing cause want to preserve old starting point
+        initialize_positions(sd,
+                             init_restraints,
+                             verbose,
+                             short_init_factor,
+                             is_disable_randomize,
+                             !restart_fgs_only.empty());
+        // initialize_positions() does not use interaction potentials, so
+        // the snapshot is shared before the interactions of this run relax
+        // it below
+        if (!snapshot_file.empty()) {
+          save_snapshot(sd, snapshot_file);
+          std::cout << "Saved snapshot " << snapshot_file << std::endl;
+        }
+      }
       {
         // do a short post-relaxation of the entire system at low temperature
         IMP::npctransport::internal::BDSetTemporaryTemperatureRAII
@@ -590,6 +643,12 @@ void do_main_loop(SimulationData *sd, const RestraintsTemp &init_restraints) {
     unsigned int nframes_run = (unsigned int)(actual_nframes *
                                               sd->get_statistics_fraction());
     unsigned int nframes_equilibrate = actual_nframes - nframes_run;
+    // a resumed run that was interrupted after its last frame is done
+    bool is_resumed_run_done = false;
+    if (i == 0 && !restart.empty() && is_resume) {
+      nframes_run -= std::min(nframes_run, n_resumed_frames);
+      is_resumed_run_done = (nframes_run == 0);
+    }
     if (is_BD_equilibration) {
       std::cout << "Equilibrating for " << nframes_equilibrate << " frames..."
                 << std::endl;
@@ -624,7 +683,7 @@ void do_main_loop(SimulationData *sd, const RestraintsTemp &init_restraints) {
       }
       sd->switch_suspend_rmf(false);
     }
-    if (is_BD_full_run) {
+    if (is_BD_full_run && !is_resumed_run_done) {
       timer.restart();
       std::cout << "Running for " << nframes_run << " frames..." << std::endl;
       if (conformations_rmf_sos) {
@@ -650,6 +709,8 @@ void do_main_loop(SimulationData *sd, const RestraintsTemp &init_restraints) {
                 << std::endl;
       IMP::rmf::save_frame(final_rmf_fh);
     }
+    // statistics updates save only a compact checkpoint
+    sd->get_statistics()->save_rmf_conformation_to_output();
   }
   std::cout << "Entire run finished" << std::endl;
   print_score_and_positions(sd, verbose, "Final score = ");
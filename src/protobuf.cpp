@@ -10,7 +10,19 @@
 #include <IMP/npctransport/protobuf.h>
 #include <IMP/npctransport/automatic_parameters.h>
 #include <IMP/npctransport/internal/npctransport.pb.h>
+#include <IMP/npctransport/internal/avro_index.h>
+#include <IMP/npctransport/internal/OutputFileView.h>
+#include <IMP/npctransport/RelaxingSpring.h>
+#include <IMP/npctransport/SimulationData.h>
+#include <IMP/npctransport/SlabWithPore.h>
+#include <IMP/npctransport/Statistics.h>
+#include <IMP/npctransport/Transporting.h>
+#include <IMP/npctransport/work_unit_cost.h>
+#include <IMP/npctransport/enums.h>
+#include <IMP/npctransport/typedefs.h>
 #include <IMP/SingletonContainer.h>
+#include <IMP/random.h>
+#include <IMP/core/rigid_bodies.h>
 #include <IMP/utility.h>
 #include <IMP/algebra/GridD.h>
 #include <IMP/atom/estimates.h>
@@ -24,8 +36,10 @@
 #include <google/protobuf/io/coded_stream.h>
 // C++ and boost headers:
 #include <boost/scoped_ptr.hpp>
+#include <cstdio>
 #include <fstream>
 #include <iostream>
+#include <sstream>
 #include <fcntl.h>
 #if defined(_MSC_VER)
 #include <io.h>
@@ -284,38 +298,58 @@ namespace {
     IMP::algebra::VectorKD lb = IMP::algebra::get_zero_vector_kd(r.size());
     IMP::algebra::VectorKD ub = IMP::algebra::get_zero_vector_kd(r.size());
     IMP::algebra::VectorKD factors(IMP::Floats(lb.get_dimension(), 2.0));
+    unsigned int nv = 1;
     for (unsigned int i = 0; i < r.size(); ++i) {
       lb[i] = r[i].lb;
       ub[i] = r[i].ub;
       factors[i] = r[i].base;
       steps[i] = r[i].steps;
+      nv *= steps[i];
     }
-    Grid g(Storage(steps, 0),
-           Embedding(IMP::algebra::BoundingBoxKD(IMP::algebra::VectorKD(lb),
-                                                 IMP::algebra::VectorKD(ub)),
-                     factors, steps, true));
+    // only the embedding is needed, as the grid storage would have a
+    // voxel per work unit
+    Embedding e(IMP::algebra::BoundingBoxKD(IMP::algebra::VectorKD(lb),
+                                            IMP::algebra::VectorKD(ub)),
+                factors, steps, true);
     if (show_steps) {
-      Ints dzeros(g.get_dimension(), 0);
+      Ints dzeros(r.size(), 0);
       Grid::ExtendedIndex ei(dzeros.begin(), dzeros.end());
-      for (unsigned int i = 0; i < g.get_dimension(); ++i) {
+      for (unsigned int i = 0; i < r.size(); ++i) {
         std::cout << r[i].name << ": ";
-        for (unsigned int j = 0; j < g.get_number_of_voxels(i); ++j) {
+        for (int j = 0; j < steps[i]; ++j) {
           ei[i] = j;
-          std::cout << g.get_center(ei)[i] << " ";
+          std::cout << e.get_center(ei)[i] << " ";
         }
         std::cout << std::endl;
         ei[i] = 0;
       }
     }
-    Grid::AllIndexIterator it = g.all_indexes_begin();
-    unsigned int nv = std::distance(g.all_indexes_begin(), g.all_indexes_end());
-    std::advance(it, work_unit % nv);
-    IMP::algebra::VectorKD center = g.get_center(*it);
+    // decode work_unit as a mixed-radix number, whose i'th digit is the
+    // index of the i'th range, with the first range varying fastest, in
+    // the order of Grid::all_indexes_begin()
+    indexes.resize(r.size());
+    unsigned int k = work_unit % nv;
+    for (unsigned int i = 0; i < r.size(); ++i) {
+      indexes[i] = k % steps[i];
+      k /= steps[i];
+    }
+    IMP_IF_CHECK(INTERNAL) {
+      if (!r.empty()) {
+        Grid g(Storage(steps, 0), e);
+        Grid::AllIndexIterator it = g.all_indexes_begin();
+        std::advance(it, work_unit % nv);
+        Ints grid_indexes(indexes.size());
+        // it-> returns a copy
+        copy(*it, grid_indexes.begin());
+        IMP_INTERNAL_CHECK(grid_indexes == indexes,
+                           "Work unit " << work_unit
+                           << " decoded differently than enumerated");
+      }
+    }
+    Grid::ExtendedIndex ei(indexes.begin(), indexes.end());
+    IMP::algebra::VectorKD center = e.get_center(ei);
     values = Floats(center.begin(), center.end());
-    indexes.resize(values.size());
-    // it-> returns a copy
-    copy(*it, indexes.begin());
-    return g.get_number_of_voxels();
+    return nv;
   }
 } // anonymous namespace
 
@@ -349,22 +383,100 @@ namespace {
     } // for
   }
 #undef SET_DEFAULT_POSITIVE_FLOAT
-}; // anonymous namespace
 
+  // read the configuration in file fname into config
+  void read_configuration(std::string fname,
+                          ::npctransport_proto::Configuration& config) {
+    std::fstream in(fname.c_str(), std::ios::in | std::ios::binary);
+    if (!in) {
+      IMP_THROW("Could not open file " << fname, IOException);
+    }
+    bool success = config.ParseFromIstream(&in);
+    if (!success) {
+      IMP_THROW("Unable to read from protobuf " << fname, IOException);
+    }
+  }
+
+  // assign the [work_unit]'th combination of ranges into the message
+  // indicated for each range entry (ranges[i].m), return the number of
+  // combinations
+  int assign_work_unit(const Ranges& ranges, unsigned int work_unit,
+                       bool show_steps, Ints& indexes) {
+    Floats values;
+    int ret = assign_internal(ranges, work_unit, values, indexes, show_steps);
+    for (unsigned int i = 0; i < ranges.size(); ++i) {
+      const Reflection* r(ranges[i].m->GetReflection());
+      const Descriptor* d(ranges[i].m->GetDescriptor());
+      IMP_LOG(VERBOSE, "Assigning range " << ranges[i].name << std::endl);
+      const FieldDescriptor* vfd(d->FindFieldByName("value"));
+      set_value(r, ranges[i].m, vfd, values[i]);
+      const FieldDescriptor* ifd(d->FindFieldByName("index"));
+      IMP_INTERNAL_CHECK(ifd, "No index found?");
+      r->SetInt32(ranges[i].m, ifd, indexes[i]);
+    }
+    return ret;
+  }
+
+  // set the work unit, random seed and automatic parameters of an
+  // assignment whose ranges were assigned
+  void finalize_assignment(::npctransport_proto::Assignment& assignment,
+                           unsigned int work_unit,
+                           boost::uint64_t random_seed) {
+    double max_trans_relative_to_radius = 0.05; // TODO: param?
+    double time_step = get_time_step(assignment, max_trans_relative_to_radius);
+    assignment.set_time_step(time_step);
+    assignment.set_work_unit(work_unit);
+    assignment.set_number_of_frames(get_number_of_frames(assignment, time_step));
+    assignment.set_dump_interval_frames
+      ( get_dump_interval_in_frames(assignment, time_step) );
+    assignment.set_statistics_interval_frames
+      ( get_statistics_interval_in_frames(assignment, time_step) );
+    assignment.set_output_statistics_interval_frames
+      ( get_output_statistics_interval_in_frames(assignment, time_step) );
+    assignment.set_range(get_close_pairs_range(assignment));
+    IMP_LOG(VERBOSE, "Close pair sphere-sphere distance range in A: "
+            << assignment.range() << std::endl);
+    assignment.set_random_seed(random_seed);
+
+    set_default_tamd_options(assignment);
+
+    // Fill in types for fgs and floaters if needed
+    // TODO: this is just for backward support -
+    //       should be removed once deprecated
+    {
+      for (int i = 0; i < assignment.fgs_size(); ++i)
+        {
+          // store default type if one does not exist
+          bool has_type =  assignment.fgs(i).has_type();
+          if(has_type) {
+            has_type = ( assignment.fgs(i).type() != "" );
+          }
+          IMP_ALWAYS_CHECK(has_type, "fg " << i << " lacking type",
+                           ValueException);
+        } // for i
+      for (int i = 0; i < assignment.floaters_size(); ++i)
+        {
+          bool has_type = assignment.floaters(i).has_type();
+          if(has_type) {
+            has_type = (assignment.floaters(i).type() != "" );
+          }
+          IMP_ALWAYS_CHECK(has_type, "floater " << i << " lacking type",
+                           ValueException);
+        } // for i
+    }
+    // identifies the work unit regardless of run time changes to the
+    // assignment (defaults, command line adjustments)
+    assignment.set_configuration_hash
+      ( internal::get_configuration_hash(assignment) );
+  }
+}; // anonymous namespace
 
 // see documentation in .h file
 int assign_ranges(std::string ifname, std::string ofname, unsigned int work_unit,
                   bool show_steps, boost::uint64_t random_seed) {
   IMP_FUNCTION_LOG;
-  std::fstream in(ifname.c_str(), std::ios::in | std::ios::binary);
-  if (!in) {\
-    IMP_THROW("Could not open file " << ifname, IOException);
-  }
   ::npctransport_proto::Configuration config;
-  bool success = config.ParseFromIstream(&in);
-  if (!success) {
-    IMP_THROW("Unable to read from protobuf " << ifname, IOException);
-  }
+  read_configuration(ifname, config);
   npctransport_proto::Output output;
   npctransport_proto::Assignment& assignment = *output.mutable_assignment();
   output.mutable_statistics(); // create if not there
@@ -379,70 +491,16 @@ int assign_ranges(std::string ifname, std::string ofname, unsigned int work_unit
     IMP_WARN("No message with value ranges detected for file '" << ifname
              << "' - this is probably fine" << std::endl);
   } else {
-    Floats values;
     Ints indexes;
-    // assign the [work_unit]'th combination of ranges into the
-    // message indicated for each range entry (ranges[i].m)
-    ret = assign_internal(ranges, work_unit, values, indexes, show_steps);
-    for (unsigned int i = 0; i < ranges.size(); ++i) {
-      const Reflection* r(ranges[i].m->GetReflection());
-      const Descriptor* d(ranges[i].m->GetDescriptor());
-      IMP_LOG(VERBOSE, "Assigning range " << ranges[i].name << std::endl);
-      const FieldDescriptor* vfd(d->FindFieldByName("value"));
-      set_value(r, ranges[i].m, vfd, values[i]);
-      const FieldDescriptor* ifd(d->FindFieldByName("index"));
-      IMP_INTERNAL_CHECK(ifd, "No index found?");
-      r->SetInt32(ranges[i].m, ifd, indexes[i]);
-    }
+    ret = assign_work_unit(ranges, work_unit, show_steps, indexes);
   }
   // assignment work units and automatic parameters
-  double max_trans_relative_to_radius = 0.05; // TODO: param?
-  double time_step = get_time_step(assignment, max_trans_relative_to_radius);
-  assignment.set_time_step(time_step);
-  assignment.set_work_unit(work_unit);
-  assignment.set_number_of_frames(get_number_of_frames(assignment, time_step));
-  assignment.set_dump_interval_frames
-    ( get_dump_interval_in_frames(assignment, time_step) );
-  assignment.set_statistics_interval_frames
-    ( get_statistics_interval_in_frames(assignment, time_step) );
-  assignment.set_output_statistics_interval_frames
-    ( get_output_statistics_interval_in_frames(assignment, time_step) );
-  assignment.set_range(get_close_pairs_range(assignment));
-  IMP_LOG(VERBOSE, "Close pair sphere-sphere distance range in A: "
-            << assignment.range() << std::endl);
-  assignment.set_random_seed(random_seed);
-
-  set_default_tamd_options(assignment);
+  finalize_assignment(assignment, work_unit, random_seed);
   std::fstream out(ofname.c_str(), std::ios::out | std::ios::binary);
   if (!out) {
     IMP_THROW("Could not open file " << ofname, IOException);
   }
 
-  // Fill in types for fgs and floaters if needed
-  // TODO: this is just for backward support -
-  //       should be removed once deprecated
-  {
-    for (int i = 0; i < assignment.fgs_size(); ++i)
-      {
-        // store default type if one does not exist
-        bool has_type =  assignment.fgs(i).has_type();
-        if(has_type) {
-          has_type = ( assignment.fgs(i).type() != "" );
-        }
-        IMP_ALWAYS_CHECK(has_type, "fg " << i << " lacking type",
-                         ValueException);
-      } // for i
-    for (int i = 0; i < assignment.floaters_size(); ++i)
-      {
-        bool has_type = assignment.floaters(i).has_type();
-        if(has_type) {
-          has_type = (assignment.floaters(i).type() != "" );
-        }
-        IMP_ALWAYS_CHECK(has_type, "floater " << i << " lacking type",
-                         ValueException);
-      } // for i
-  }
-
   bool written = output.SerializeToOstream(&out);
   if (!written) {
     IMP_THROW("Unable to write to " << ofname, IOException);
@@ -453,11 +511,7 @@ int assign_ranges(std::string ifname, std::string ofname, unsigned int work_unit
 
 int get_number_of_work_units(std::string assignment_file) {
   ::npctransport_proto::Configuration config;
-  std::fstream in(assignment_file.c_str(), std::ios::in | std::ios::binary);
-  if (!in) {
-    IMP_THROW("Could not open file " << assignment_file, IOException);
-  }
-  config.ParseFromIstream(&in);
+  read_configuration(assignment_file, config);
   npctransport_proto::Assignment assignment;
   SetLogState sls(VERBOSE);
   Ranges ranges = get_ranges("all", &config, &assignment);
@@ -467,6 +521,49 @@ int get_number_of_work_units(std::string assignment_file) {
   return ret;
 }
 
+int write_work_units_manifest(std::string configuration_file,
+                              std::string manifest_file,
+                              const CostCalibration& calibration) {
+  IMP_FUNCTION_LOG;
+  ::npctransport_proto::Configuration config;
+  read_configuration(configuration_file, config);
+  npctransport_proto::Assignment assignment;
+  Ranges ranges = get_ranges("all", &config, &assignment);
+  ::npctransport_proto::WorkUnitsManifest manifest;
+  manifest.set_configuration_file(configuration_file);
+  for (unsigned int i = 0; i < ranges.size(); ++i) {
+    manifest.add_range_names(ranges[i].name);
+  }
+  Ints indexes;
+  int n = 1;
+  for (int work_unit = 0; work_unit < n; ++work_unit) {
+    if (!ranges.empty()) {
+      n = assign_work_unit(ranges, work_unit, false, indexes);
+    }
+    // the ranges of the template assignment are overwritten by the next
+    // work unit, so it is finalized on a copy
+    npctransport_proto::Assignment cur(assignment);
+    finalize_assignment(cur, work_unit, 0);
+    ::npctransport_proto::WorkUnitsManifest::WorkUnit* wu =
+      manifest.add_work_units();
+    wu->set_work_unit(work_unit);
+    for (unsigned int i = 0; i < indexes.size(); ++i) {
+      wu->add_range_indexes(indexes[i]);
+    }
+    wu->set_configuration_hash(cur.configuration_hash());
+    wu->set_estimated_run_time_s(get_estimated_run_time(cur, calibration));
+    wu->set_estimated_memory_mb
+      (get_estimated_memory(cur, calibration) / (1024 * 1024));
+  }
+  manifest.set_number_of_work_units(n);
+  std::fstream out(manifest_file.c_str(),
+                   std::ios::out | std::ios::trunc | std::ios::binary);
+  if (!out || !manifest.SerializeToOstream(&out)) {
+    IMP_THROW("Unable to write to " << manifest_file, IOException);
+  }
+  return n;
+}
+
 void load_pb_conformation
 ( const ::npctransport_proto::Conformation &conformation,
   IMP::SingletonContainerAdaptor beads,
@@ -540,6 +637,265 @@ void save_pb_conformation
     }
 }
 
+namespace {
+  // the particle with the specified checkpoint ordinal among pis
+  ParticleIndex get_ordinal_particle(ParticleIndexes const& pis,
+                                     int ordinal) {
+    IMP_ALWAYS_CHECK(ordinal >= 0 && ordinal < static_cast<int>(pis.size()),
+                     "Checkpoint particle ordinal " << ordinal
+                     << " out of range", ValueException);
+    return pis[ordinal];
+  }
+
+  typedef IMP_KERNEL_LARGE_UNORDERED_MAP<ParticleIndex, int> t_ordinals_map;
+
+  // save the history of interaction statistics in sd to checkpoint,
+  // with particles stored by their ordinals
+  void save_pb_interaction_histories
+  ( SimulationData* sd,
+    t_ordinals_map const& ordinals,
+    ::npctransport_proto::Checkpoint* checkpoint )
+  {
+    BipartitePairsStatisticsOptimizerStates bpsoss =
+      sd->get_statistics()->get_interaction_statistics_optimizer_states();
+    for (unsigned int i = 0; i < bpsoss.size(); i++) {
+      BipartitePairsStatisticsOptimizerState::History history =
+        bpsoss[i]->get_history();
+      internal::ContactKinetics::State const& ck = history.contact_kinetics;
+      ::npctransport_proto::Checkpoint_InteractionHistory* ih =
+        checkpoint->add_interaction_histories();
+      ih->set_type0(bpsoss[i]->get_interaction_type().first.get_string());
+      ih->set_type1(bpsoss[i]->get_interaction_type().second.get_string());
+      ih->set_time_ns(history.time_ns);
+      for (unsigned int j = 0; j < history.bounds_I.size(); j++) {
+        ih->add_bound_i_ordinals(ordinals.find(history.bounds_I[j])->second);
+      }
+      for (unsigned int j = 0; j < history.bounds_II.size(); j++) {
+        ih->add_bound_ii_ordinals(ordinals.find(history.bounds_II[j])->second);
+      }
+      for (unsigned int j = 0; j < ck.contacts.size(); j++) {
+        ih->add_contact_ordinals(ordinals.find(ck.contacts[j][0])->second);
+        ih->add_contact_ordinals(ordinals.find(ck.contacts[j][1])->second);
+        ih->add_contact_start_ns(ck.start_ns[j]);
+      }
+      for (unsigned int j = 0; j < ck.lost_contacts.size(); j++) {
+        ih->add_lost_contact_ordinals
+          (ordinals.find(ck.lost_contacts[j][0])->second);
+        ih->add_lost_contact_ordinals
+          (ordinals.find(ck.lost_contacts[j][1])->second);
+        ih->add_lost_contact_ns(ck.lost_ns[j]);
+      }
+      ih->set_n_snapshots(ck.n_snapshots);
+      ih->set_last_snapshot_time_ns(ck.last_time_ns);
+      ih->set_last_histograms_reset_ns(ck.last_reset_ns);
+    }
+  }
+
+  // restore the history of interaction statistics in sd from checkpoint,
+  // for interaction types whose statistics are tracked in sd
+  void load_pb_interaction_histories
+  ( const ::npctransport_proto::Checkpoint& checkpoint,
+    ParticleIndexes const& pis,
+    SimulationData* sd )
+  {
+    BipartitePairsStatisticsOptimizerStates bpsoss =
+      sd->get_statistics()->get_interaction_statistics_optimizer_states();
+    for (int i = 0; i < checkpoint.interaction_histories_size(); i++) {
+      ::npctransport_proto::Checkpoint_InteractionHistory const& ih =
+        checkpoint.interaction_histories(i);
+      IMP_ALWAYS_CHECK
+        ( ih.contact_ordinals_size() == 2 * ih.contact_start_ns_size()
+          && ih.lost_contact_ordinals_size() == 2 * ih.lost_contact_ns_size(),
+          "Corrupt checkpoint", ValueException );
+      BipartitePairsStatisticsOptimizerState* bpsos = nullptr;
+      for (unsigned int j = 0; j < bpsoss.size(); j++) {
+        InteractionType it = bpsoss[j]->get_interaction_type();
+        if (it.first.get_string() == ih.type0() &&
+            it.second.get_string() == ih.type1()) {
+          bpsos = bpsoss[j];
+        }
+      }
+      if (!bpsos) {
+        continue; // not tracked in this simulation
+      }
+      BipartitePairsStatisticsOptimizerState::History history;
+      internal::ContactKinetics::State& ck = history.contact_kinetics;
+      history.time_ns = ih.time_ns();
+      for (int j = 0; j < ih.bound_i_ordinals_size(); j++) {
+        history.bounds_I.push_back
+          ( get_ordinal_particle(pis, ih.bound_i_ordinals(j)) );
+      }
+      for (int j = 0; j < ih.bound_ii_ordinals_size(); j++) {
+        history.bounds_II.push_back
+          ( get_ordinal_particle(pis, ih.bound_ii_ordinals(j)) );
+      }
+      for (int j = 0; j < ih.contact_start_ns_size(); j++) {
+        ck.contacts.push_back
+          ( ParticleIndexPair
+            ( get_ordinal_particle(pis, ih.contact_ordinals(2 * j)),
+              get_ordinal_particle(pis, ih.contact_ordinals(2 * j + 1)) ) );
+        ck.start_ns.push_back(ih.contact_start_ns(j));
+      }
+      for (int j = 0; j < ih.lost_contact_ns_size(); j++) {
+        ck.lost_contacts.push_back
+          ( ParticleIndexPair
+            ( get_ordinal_particle(pis, ih.lost_contact_ordinals(2 * j)),
+              get_ordinal_particle(pis, ih.lost_contact_ordinals(2 * j + 1)) ) );
+        ck.lost_ns.push_back(ih.lost_contact_ns(j));
+      }
+      ck.n_snapshots = ih.n_snapshots();
+      ck.last_time_ns = ih.last_snapshot_time_ns();
+      ck.last_reset_ns = ih.last_histograms_reset_ns();
+      bpsos->set_history(history);
+    }
+  }
+}
+
+void save_pb_checkpoint
+( SimulationData* sd,
+  ::npctransport_proto::Checkpoint* checkpoint )
+{
+  // particles in free flight are behind the current time, and landing
+  // them draws random numbers, so this precedes saving the generator
+  sd->get_bd()->synchronize_free_diffusion_flights();
+  Model* m = sd->get_model();
+  ParticleIndexes pis = m->get_particle_indexes();
+  checkpoint->Clear();
+  checkpoint->set_time_ns(sd->get_bd()->get_current_time() / FS_IN_NS);
+  checkpoint->set_n_particles(pis.size());
+  t_ordinals_map ordinals;
+  for (unsigned int i = 0; i < pis.size(); i++) {
+    ParticleIndex pi = pis[i];
+    ordinals[pi] = i;
+    if (core::RigidBody::get_is_setup(m, pi)) {
+      algebra::Transformation3D tr = core::RigidBody(m, pi)
+        .get_reference_frame().get_transformation_to();
+      checkpoint->add_rigid_body_ordinals(i);
+      for (unsigned int j = 0; j < 3; j++) {
+        checkpoint->add_rigid_body_frames(tr.get_translation()[j]);
+      }
+      for (unsigned int j = 0; j < 4; j++) {
+        checkpoint->add_rigid_body_frames
+          (tr.get_rotation().get_quaternion()[j]);
+      }
+    } else if (core::XYZ::get_is_setup(m, pi) &&
+               !core::RigidMember::get_is_setup(m, pi) &&
+               core::XYZ(m, pi).get_coordinates_are_optimized()) {
+      algebra::Vector3D const& xyz = m->get_sphere(pi).get_center();
+      checkpoint->add_mobile_ordinals(i);
+      for (unsigned int j = 0; j < 3; j++) {
+        checkpoint->add_coordinates(xyz[j]);
+      }
+    }
+    if (RelaxingSpring::get_is_setup(m, pi)) {
+      checkpoint->add_relaxing_spring_ordinals(i);
+      checkpoint->add_rest_lengths(RelaxingSpring(m, pi).get_rest_length());
+    }
+    if (Transporting::get_is_setup(m, pi)) {
+      Transporting t(m, pi);
+      checkpoint->add_transporting_ordinals(i);
+      checkpoint->add_last_tracked_z(t.get_last_tracked_z());
+      checkpoint->add_n_entries_bottom(t.get_n_entries_bottom());
+      checkpoint->add_n_entries_top(t.get_n_entries_top());
+      checkpoint->add_is_last_entry_from_top(t.get_is_last_entry_from_top());
+    }
+  }
+  if (sd->get_has_slab()) {
+    checkpoint->set_pore_radius
+      ( SlabWithPore(sd->get_slab_particle()).get_pore_radius() );
+  }
+  std::ostringstream rng_state;
+  rng_state << IMP::random_number_generator;
+  checkpoint->set_random_number_generator_state(rng_state.str());
+  save_pb_interaction_histories(sd, ordinals, checkpoint);
+}
+
+void load_pb_checkpoint
+( const ::npctransport_proto::Checkpoint& checkpoint,
+  SimulationData* sd,
+  bool is_restore_random_number_generator )
+{
+  Model* m = sd->get_model();
+  ParticleIndexes pis = m->get_particle_indexes();
+  IMP_ALWAYS_CHECK(checkpoint.n_particles() == static_cast<int>(pis.size()),
+                   "Checkpoint of " << checkpoint.n_particles()
+                   << " particles does not match model with "
+                   << pis.size() << " particles",
+                   ValueException);
+  IMP_ALWAYS_CHECK
+    ( checkpoint.coordinates_size() == 3 * checkpoint.mobile_ordinals_size()
+      && checkpoint.rigid_body_frames_size()
+         == 7 * checkpoint.rigid_body_ordinals_size()
+      && checkpoint.rest_lengths_size()
+         == checkpoint.relaxing_spring_ordinals_size()
+      && checkpoint.last_tracked_z_size()
+         == checkpoint.transporting_ordinals_size()
+      && checkpoint.n_entries_bottom_size()
+         == checkpoint.transporting_ordinals_size()
+      && checkpoint.n_entries_top_size()
+         == checkpoint.transporting_ordinals_size()
+      && checkpoint.is_last_entry_from_top_size()
+         == checkpoint.transporting_ordinals_size(),
+      "Corrupt checkpoint", ValueException);
+  for (int i = 0; i < checkpoint.mobile_ordinals_size(); i++) {
+    ParticleIndex pi =
+      get_ordinal_particle(pis, checkpoint.mobile_ordinals(i));
+    IMP_ALWAYS_CHECK(core::XYZ::get_is_setup(m, pi),
+                     "Checkpoint does not match model", ValueException);
+    core::XYZ(m, pi).set_coordinates
+      ( algebra::Vector3D(checkpoint.coordinates(3 * i),
+                          checkpoint.coordinates(3 * i + 1),
+                          checkpoint.coordinates(3 * i + 2)) );
+  }
+  for (int i = 0; i < checkpoint.rigid_body_ordinals_size(); i++) {
+    ParticleIndex pi =
+      get_ordinal_particle(pis, checkpoint.rigid_body_ordinals(i));
+    IMP_ALWAYS_CHECK(core::RigidBody::get_is_setup(m, pi),
+                     "Checkpoint does not match model", ValueException);
+    int k = 7 * i;
+    algebra::Vector3D translation(checkpoint.rigid_body_frames(k),
+                                  checkpoint.rigid_body_frames(k + 1),
+                                  checkpoint.rigid_body_frames(k + 2));
+    algebra::Rotation3D rotation
+      ( algebra::Vector4D(checkpoint.rigid_body_frames(k + 3),
+                          checkpoint.rigid_body_frames(k + 4),
+                          checkpoint.rigid_body_frames(k + 5),
+                          checkpoint.rigid_body_frames(k + 6)) );
+    core::RigidBody(m, pi).set_reference_frame
+      ( algebra::ReferenceFrame3D
+        ( algebra::Transformation3D(rotation, translation) ) );
+  }
+  for (int i = 0; i < checkpoint.relaxing_spring_ordinals_size(); i++) {
+    ParticleIndex pi =
+      get_ordinal_particle(pis, checkpoint.relaxing_spring_ordinals(i));
+    IMP_ALWAYS_CHECK(RelaxingSpring::get_is_setup(m, pi),
+                     "Checkpoint does not match model", ValueException);
+    RelaxingSpring(m, pi).set_rest_length(checkpoint.rest_lengths(i));
+  }
+  for (int i = 0; i < checkpoint.transporting_ordinals_size(); i++) {
+    ParticleIndex pi =
+      get_ordinal_particle(pis, checkpoint.transporting_ordinals(i));
+    if (!Transporting::get_is_setup(m, pi)) {
+      continue; // not tracked for transport in this simulation
+    }
+    Transporting t(m, pi);
+    t.set_last_tracked_z(checkpoint.last_tracked_z(i));
+    t.set_n_entries_bottom(checkpoint.n_entries_bottom(i));
+    t.set_n_entries_top(checkpoint.n_entries_top(i));
+    t.set_is_last_entry_from_top(checkpoint.is_last_entry_from_top(i));
+  }
+  if (sd->get_has_slab() && checkpoint.has_pore_radius()) {
+    SlabWithPore(sd->get_slab_particle())
+      .set_pore_radius(checkpoint.pore_radius());
+  }
+  load_pb_interaction_histories(checkpoint, pis, sd);
+  if (is_restore_random_number_generator &&
+      checkpoint.has_random_number_generator_state()) {
+    std::istringstream rng_state(checkpoint.random_number_generator_state());
+    rng_state >> IMP::random_number_generator;
+  }
+}
+
 //! load file output_fname into protobuf output object output
 bool load_output_protobuf
 (std::string output_fname,
@@ -558,6 +914,63 @@ bool load_output_protobuf
   return is_ok;
 }
 
+void adjust_kap_interaction_k_factors
+( ::npctransport_proto::Assignment* assignment,
+  double kap_interaction_k_factor )
+{
+  std::string prefix("kap");
+  for (int i = 0; i < assignment->floaters_size(); ++i) {
+    ::npctransport_proto::Assignment_FloaterAssignment* f_data=
+      assignment->mutable_floaters(i);
+    if(f_data->type().compare(0, prefix.size(), prefix) == 0) {
+      double new_k_factor=
+        f_data->interaction_k_factor().value() * kap_interaction_k_factor;
+      f_data->mutable_interaction_k_factor()->set_value( new_k_factor );
+    }
+  }
+}
+
+std::string write_restart_output_file
+( std::string prev_output_fname, std::string output_fname,
+  double kap_interaction_k_factor,
+  boost::uint64_t random_seed )
+{
+  std::string random_number_generator_state;
+  // write to a temporary file that replaces output_fname, which may be
+  // mapped as the previous output file
+  std::string tmp_output_fname = output_fname + ".tmp";
+  {
+    internal::OutputFileView prev_output(prev_output_fname);
+    ::npctransport_proto::Output pb_output;
+    ::npctransport_proto::Assignment* pb_assignment=
+      pb_output.mutable_assignment();
+    IMP_ALWAYS_CHECK(prev_output.get_assignment(pb_assignment),
+                     "Couldn't read assignment from previous output file "
+                     << prev_output_fname, IMP::IOException);
+    adjust_kap_interaction_k_factors(pb_assignment, kap_interaction_k_factor);
+    random_number_generator_state=
+      prev_output.get_random_number_generator_state();
+    if(random_number_generator_state.empty()) {
+      pb_assignment->set_random_seed(random_seed);
+    } // else keep the original seed, as its sequence is resumed
+    std::ofstream outf(tmp_output_fname.c_str(), std::ios::binary);
+    pb_output.SerializePartialToOstream(&outf);
+    // the restarted run is interrupted only if it is interrupted again
+    prev_output.write_fields_except(internal::OutputFileView::ASSIGNMENT,
+                                    outf, true);
+    IMP_ALWAYS_CHECK(outf, "Unable to write output file " << tmp_output_fname,
+                     IMP::IOException);
+  }
+#if defined(_MSC_VER)
+  std::remove(output_fname.c_str());
+#endif
+  IMP_ALWAYS_CHECK(std::rename(tmp_output_fname.c_str(),
+                               output_fname.c_str()) == 0,
+                   "Unable to write output file " << output_fname,
+                   IMP::IOException);
+  return random_number_generator_state;
+}
+
 
 
 IMPNPCTRANSPORT_END_NAMESPACE
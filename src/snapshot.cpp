@@ -0,0 +1,176 @@
+/**
+ *  \file snapshot.cpp
+ *  \brief snapshots of initialized models, shared by work units of the
+ *         same geometry
+ *
+ *  Copyright 2007-2018 IMP Inventors. All rights reserved.
+ *
+ */
+
+#include <IMP/npctransport/snapshot.h>
+#include <IMP/npctransport/SimulationData.h>
+#include <IMP/npctransport/Statistics.h>
+#include <IMP/npctransport/protobuf.h>
+#include <IMP/npctransport/internal/avro_index.h>
+#include <IMP/npctransport/internal/npctransport.pb.h>
+#include <IMP/core/XYZ.h>
+#include <IMP/core/rigid_bodies.h>
+#include <IMP/Model.h>
+#include <IMP/exception.h>
+#include <IMP/check_macros.h>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+#if defined(_MSC_VER)
+#include <process.h>
+#else
+#include <unistd.h>
+#endif
+
+IMPNPCTRANSPORT_BEGIN_NAMESPACE
+
+namespace {
+  // continue a 64-bit FNV-1a hash with size bytes at data
+  void mix(boost::uint64_t& hash, void const* data, std::size_t size) {
+    unsigned char const* bytes = static_cast<unsigned char const*>(data);
+    for (std::size_t i = 0; i < size; i++) {
+      hash ^= bytes[i];
+      hash *= 1099511628211ULL;
+    }
+  }
+
+  // assignment without the fields that do not affect the particles of
+  // a model or their initialization
+  void clear_non_geometry_fields(::npctransport_proto::Assignment& a) {
+    a.clear_interaction_k();
+    a.clear_interaction_range();
+    a.clear_nonspecific_k();
+    a.clear_nonspecific_range();
+    a.clear_interactions();
+    for (int i = 0; i < a.fgs_size(); i++) {
+      a.mutable_fgs(i)->clear_interaction_k_factor();
+      a.mutable_fgs(i)->clear_interaction_range_factor();
+    }
+    for (int i = 0; i < a.floaters_size(); i++) {
+      a.mutable_floaters(i)->clear_interaction_k_factor();
+      a.mutable_floaters(i)->clear_interaction_range_factor();
+    }
+    for (int i = 0; i < a.obstacles_size(); i++) {
+      a.mutable_obstacles(i)->clear_interaction_k_factor();
+      a.mutable_obstacles(i)->clear_interaction_range_factor();
+    }
+    a.clear_number_of_trials();
+    a.clear_maximal_number_of_frames();
+    a.clear_number_of_frames();
+    a.clear_simulation_time_ns();
+    a.clear_statistics_fraction();
+    a.clear_maximum_number_of_minutes();
+    a.clear_dump_interval_ns();
+    a.clear_dump_interval_frames();
+    a.clear_statistics_interval_ns();
+    a.clear_statistics_interval_frames();
+    a.clear_output_statistics_interval_ns();
+    a.clear_output_statistics_interval_frames();
+    a.clear_is_xyz_hist_stats();
+    a.clear_is_rotational_correlation_stats();
+    a.clear_output_npctransport_version();
+    a.clear_spatial_sort_interval_frames();
+  }
+}
+
+boost::uint64_t get_geometry_hash(SimulationData* sd) {
+  ::npctransport_proto::Assignment a
+    ( sd->get_statistics()->get_mutable_output()->assignment() );
+  clear_non_geometry_fields(a);
+  boost::uint64_t hash = internal::get_configuration_hash(a);
+  Model* m = sd->get_model();
+  ParticleIndexes pis = m->get_particle_indexes();
+  boost::uint64_t n = pis.size();
+  mix(hash, &n, sizeof(n));
+  for (unsigned int i = 0; i < pis.size(); i++) {
+    ParticleIndex pi = pis[i];
+    if (core::XYZ::get_is_setup(m, pi) &&
+        !core::RigidMember::get_is_setup(m, pi) &&
+        !core::XYZ(m, pi).get_coordinates_are_optimized()) {
+      algebra::Vector3D const& xyz = m->get_sphere(pi).get_center();
+      mix(hash, &i, sizeof(i));
+      for (unsigned int j = 0; j < 3; j++) {
+        double x = xyz[j];
+        mix(hash, &x, sizeof(x));
+      }
+    }
+  }
+  return hash;
+}
+
+std::string get_snapshot_file_name
+( std::string snapshot_dir, SimulationData* sd, double short_init_factor,
+  unsigned int n_snapshots )
+{
+  IMP_USAGE_CHECK(n_snapshots > 0, "at least one snapshot per geometry");
+  std::ostringstream oss;
+  oss << snapshot_dir << "/snapshot_" << std::hex << std::setw(16)
+      << std::setfill('0') << get_geometry_hash(sd) << std::dec;
+  if (short_init_factor != 1.0) {
+    oss << "_init" << short_init_factor;
+  }
+  if (n_snapshots > 1) {
+    boost::uint64_t random_seed =
+      sd->get_statistics()->get_mutable_output()->assignment().random_seed();
+    oss << "_" << random_seed % n_snapshots;
+  }
+  oss << ".pb";
+  return oss.str();
+}
+
+void save_snapshot(SimulationData* sd, std::string snapshot_file) {
+  ::npctransport_proto::Snapshot snapshot;
+  snapshot.set_geometry_hash(get_geometry_hash(sd));
+  ::npctransport_proto::Checkpoint* checkpoint =
+    snapshot.mutable_checkpoint();
+  save_pb_checkpoint(sd, checkpoint);
+  checkpoint->clear_time_ns();
+  checkpoint->clear_random_number_generator_state();
+  checkpoint->clear_interaction_histories();
+  checkpoint->clear_transporting_ordinals();
+  checkpoint->clear_last_tracked_z();
+  checkpoint->clear_n_entries_bottom();
+  checkpoint->clear_n_entries_top();
+  checkpoint->clear_is_last_entry_from_top();
+  // write to a file of this process that replaces snapshot_file, in
+  // case another run saves the same snapshot
+  std::ostringstream tmp;
+#if defined(_MSC_VER)
+  tmp << snapshot_file << ".tmp" << _getpid();
+#else
+  tmp << snapshot_file << ".tmp" << getpid();
+#endif
+  {
+    std::ofstream outf(tmp.str().c_str(), std::ios::binary);
+    IMP_ALWAYS_CHECK(snapshot.SerializeToOstream(&outf) && outf.flush(),
+                     "Unable to write snapshot " << tmp.str(),
+                     IMP::IOException);
+  }
+#if defined(_MSC_VER)
+  std::remove(snapshot_file.c_str());
+#endif
+  IMP_ALWAYS_CHECK(std::rename(tmp.str().c_str(),
+                               snapshot_file.c_str()) == 0,
+                   "Unable to write snapshot " << snapshot_file,
+                   IMP::IOException);
+}
+
+bool load_snapshot(std::string snapshot_file, SimulationData* sd) {
+  std::ifstream inf(snapshot_file.c_str(), std::ios::binary);
+  ::npctransport_proto::Snapshot snapshot;
+  if (!inf || !snapshot.ParseFromIstream(&inf) ||
+      snapshot.geometry_hash() != get_geometry_hash(sd)) {
+    return false;
+  }
+  load_pb_checkpoint(snapshot.checkpoint(), sd);
+  return true;
+}
+
+IMPNPCTRANSPORT_END_NAMESPACE
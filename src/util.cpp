@@ -14,9 +14,14 @@
 #include <IMP/core/XYZR.h>
 #include <IMP/core/Typed.h>
 #include <IMP/base_types.h>
+#include <IMP/algebra/BoundingBoxD.h>
+#include <algorithm>
 #include <cmath>
 #include <iostream>
+#include <stdint.h>
 #include <string>
+#include <utility>
+#include <vector>
 
 IMP_GCC_PUSH_POP(diagnostic push)
 IMP_GCC_PRAGMA(diagnostic ignored "-Wsign-compare")
@@ -286,4 +291,53 @@ copy_FGs_coordinates( SimulationData const* src_sd,
 }
 
 
+namespace {
+  // spread the 10 lower bits of x such that there are two zero bits
+  // between every two consecutive bits
+  inline uint32_t spread_bits_by_3(uint32_t x)
+  {
+    x &= 0x000003ff;
+    x = (x | (x << 16)) & 0xff0000ff;
+    x = (x | (x << 8)) & 0x0300f00f;
+    x = (x | (x << 4)) & 0x030c30c3;
+    x = (x | (x << 2)) & 0x09249249;
+    return x;
+  }
+}
+
+ParticleIndexes
+get_spatially_sorted_particle_indexes
+(Model* m, const ParticleIndexes& pis)
+{
+  if(pis.size() < 2) {
+    return pis;
+  }
+  algebra::BoundingBox3D bb;
+  for(unsigned int i = 0; i < pis.size(); i++) {
+    bb += m->get_sphere(pis[i]).get_center();
+  }
+  const double n_cells = 1024.0; // 10 bits per axis
+  algebra::Vector3D cell_scale;
+  for(unsigned int k = 0; k < 3; k++) {
+    double extent = bb.get_corner(1)[k] - bb.get_corner(0)[k];
+    cell_scale[k] = extent > 0.0 ? (n_cells - 1.0) / extent : 0.0;
+  }
+  std::vector< std::pair<uint32_t, ParticleIndex> > coded(pis.size());
+  for(unsigned int i = 0; i < pis.size(); i++) {
+    algebra::Vector3D v = m->get_sphere(pis[i]).get_center() - bb.get_corner(0);
+    uint32_t code = 0;
+    for(unsigned int k = 0; k < 3; k++) {
+      code |= spread_bits_by_3(static_cast<uint32_t>(v[k] * cell_scale[k])) << k;
+    }
+    coded[i] = std::make_pair(code, pis[i]);
+  }
+  std::sort(coded.begin(), coded.end());
+  ParticleIndexes ret(pis.size());
+  for(unsigned int i = 0; i < coded.size(); i++) {
+    ret[i] = coded[i].second;
+  }
+  return ret;
+}
+
+
 IMPNPCTRANSPORT_END_NAMESPACE
@@ -0,0 +1,199 @@
+/**
+ *  \file work_unit_cost.cpp
+ *  \brief estimates of the runtime and memory of simulating an assignment
+ *
+ *  Copyright 2007-2018 IMP Inventors. All rights reserved.
+ *
+ */
+
+#include <IMP/npctransport/work_unit_cost.h>
+#include <IMP/npctransport/internal/OutputFileView.h>
+#include <IMP/exception.h>
+#include <IMP/check_macros.h>
+#include <IMP/npctransport/internal/npctransport.pb.h>
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+IMPNPCTRANSPORT_BEGIN_NAMESPACE
+
+namespace {
+  // the particles of one type in an assignment
+  struct TypeCount {
+    std::string type;
+    double n;       // number of particles
+    double radius;
+    double sites;   // interaction sites per particle
+  };
+
+  std::vector<TypeCount> get_type_counts
+  (const ::npctransport_proto::Assignment& a)
+  {
+    std::vector<TypeCount> ret;
+    for (int i = 0; i < a.fgs_size(); ++i) {
+      TypeCount tc = { a.fgs(i).type(),
+                       1.0 * a.fgs(i).number().value() *
+                       a.fgs(i).number_of_beads().value(),
+                       a.fgs(i).radius().value(),
+                       1.0 * a.fgs(i).interactions().value() };
+      ret.push_back(tc);
+    }
+    for (int i = 0; i < a.floaters_size(); ++i) {
+      TypeCount tc = { a.floaters(i).type(),
+                       1.0 * a.floaters(i).number().value(),
+                       a.floaters(i).radius().value(),
+                       1.0 * a.floaters(i).interactions().value() };
+      ret.push_back(tc);
+    }
+    for (int i = 0; i < a.obstacles_size(); ++i) {
+      TypeCount tc = { a.obstacles(i).type(),
+                       1.0 * a.obstacles(i).xyzs_size(),
+                       a.obstacles(i).radius().value(),
+                       1.0 * a.obstacles(i).interactions().value() };
+      ret.push_back(tc);
+    }
+    return ret;
+  }
+
+  // the expected number of close pairs between particles of types i and j
+  double get_expected_number_of_close_pairs_of_types
+  (const ::npctransport_proto::Assignment& a,
+   const TypeCount& i, const TypeCount& j, bool is_same_type)
+  {
+    const double pi = 3.1415926535897;
+    double volume = std::pow(a.box_side().value(), 3);
+    if (volume <= 0.0) {
+      return 0.0;
+    }
+    double d = i.radius + j.radius + a.range() + a.slack().value();
+    double p = std::min(1.0, 4.0 / 3.0 * pi * d * d * d / volume);
+    double n_pairs = is_same_type ? 0.5 * i.n * (i.n - 1) : i.n * j.n;
+    return n_pairs * p;
+  }
+
+  bool get_is_interacting
+  (const ::npctransport_proto::Assignment& a,
+   std::string type0, std::string type1)
+  {
+    for (int k = 0; k < a.interactions_size(); ++k) {
+      const ::npctransport_proto::Assignment::InteractionAssignment&
+        ia = a.interactions(k);
+      if (ia.is_on().value() == 0) {
+        continue;
+      }
+      if ((ia.type0() == type0 && ia.type1() == type1) ||
+          (ia.type0() == type1 && ia.type1() == type0)) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  ::npctransport_proto::Assignment get_assignment(std::string output_file) {
+    ::npctransport_proto::Assignment ret;
+    internal::OutputFileView view(output_file);
+    IMP_ALWAYS_CHECK(view.get_assignment(&ret),
+                     "No valid assignment in " << output_file, IOException);
+    return ret;
+  }
+}
+
+unsigned int get_number_of_particles
+(const ::npctransport_proto::Assignment& a)
+{
+  std::vector<TypeCount> tcs = get_type_counts(a);
+  double ret = 0;
+  for (unsigned int i = 0; i < tcs.size(); ++i) {
+    ret += tcs[i].n;
+  }
+  return static_cast<unsigned int>(ret);
+}
+
+double get_expected_number_of_close_pairs
+(const ::npctransport_proto::Assignment& a)
+{
+  std::vector<TypeCount> tcs = get_type_counts(a);
+  double ret = 0.0;
+  for (unsigned int i = 0; i < tcs.size(); ++i) {
+    for (unsigned int j = i; j < tcs.size(); ++j) {
+      ret += get_expected_number_of_close_pairs_of_types
+        (a, tcs[i], tcs[j], i == j);
+    }
+  }
+  return ret;
+}
+
+double get_expected_number_of_site_pairs
+(const ::npctransport_proto::Assignment& a)
+{
+  std::vector<TypeCount> tcs = get_type_counts(a);
+  double ret = 0.0;
+  for (unsigned int i = 0; i < tcs.size(); ++i) {
+    for (unsigned int j = i; j < tcs.size(); ++j) {
+      if (get_is_interacting(a, tcs[i].type, tcs[j].type)) {
+        ret += tcs[i].sites * tcs[j].sites *
+          get_expected_number_of_close_pairs_of_types
+          (a, tcs[i], tcs[j], i == j);
+      }
+    }
+  }
+  return ret;
+}
+
+unsigned int get_number_of_restraint_terms
+(const ::npctransport_proto::Assignment& a)
+{
+  unsigned int ret = 0;
+  for (int i = 0; i < a.fgs_size(); ++i) {
+    int n_beads = a.fgs(i).number_of_beads().value();
+    if (n_beads > 1) {
+      ret += a.fgs(i).number().value() * (n_beads - 1);
+    }
+  }
+  unsigned int n_boundaries =
+    (a.box_is_on().value() != 0) + (a.slab_is_on().value() != 0);
+  ret += n_boundaries * get_number_of_particles(a);
+  return ret;
+}
+
+double get_estimated_ns_per_frame
+(const ::npctransport_proto::Assignment& a,
+ const CostCalibration& calibration)
+{
+  return calibration.ns_per_particle * get_number_of_particles(a)
+    + calibration.ns_per_close_pair * get_expected_number_of_close_pairs(a)
+    + calibration.ns_per_site_pair * get_expected_number_of_site_pairs(a)
+    + calibration.ns_per_restraint * get_number_of_restraint_terms(a);
+}
+
+double get_estimated_run_time
+(const ::npctransport_proto::Assignment& a,
+ const CostCalibration& calibration)
+{
+  return 1e-9 * a.number_of_frames() *
+    get_estimated_ns_per_frame(a, calibration);
+}
+
+double get_estimated_memory
+(const ::npctransport_proto::Assignment& a,
+ const CostCalibration& calibration)
+{
+  return calibration.base_bytes
+    + calibration.bytes_per_particle * get_number_of_particles(a)
+    + calibration.bytes_per_close_pair *
+      get_expected_number_of_close_pairs(a);
+}
+
+double get_estimated_run_time
+(std::string output_file, const CostCalibration& calibration)
+{
+  return get_estimated_run_time(get_assignment(output_file), calibration);
+}
+
+double get_estimated_memory
+(std::string output_file, const CostCalibration& calibration)
+{
+  return get_estimated_memory(get_assignment(output_file), calibration);
+}
+
+IMPNPCTRANSPORT_END_NAMESPACE
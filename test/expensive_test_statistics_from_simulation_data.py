@@ -103,6 +103,21 @@ class Tests(IMP.test.TestCase):
             print("Kd_i",  koff_i /(kon_i+0.00000001) )
             print("Kd_ii", koff_ii/(kon_ii+0.00000001))
             print("%% bound: I %.1f%% II %.1f%%" % ( 100*fb_i, 100*fb_ii))
+            # Residence times and rebinding intervals share the same bins
+            if i.HasField("residence_time_hist"):
+                self.assertEqual(len(i.residence_time_hist.counts),
+                                 len(i.rebinding_interval_hist.counts))
+                print("Contacts lost", sum(i.residence_time_hist.counts),
+                      "rebound", sum(i.rebinding_interval_hist.counts))
+            # Block averages are accumulated once per statistics update
+            ba_i = i.fraction_bound_particles_i_block_avg
+            if ba_i.levels:
+                self.assertLessEqual(ba_i.levels[0].n, len(i.order_params))
+                # anticorrelated or noisy samples may have a plateau error
+                # somewhat below the naive one
+                self.assertGreater(ba_i.statistical_inefficiency, 0.5)
+                print("Fraction bound I %.3f +- %.3f" %
+                      (ba_i.mean, ba_i.standard_error))
  #            # Verify results
             if IMP.get_check_level() >= IMP.USAGE_AND_INTERNAL:
                 return
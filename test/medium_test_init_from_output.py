@@ -136,6 +136,17 @@ class Tests(IMP.test.TestCase):
         print("Config ", config)
         print("RT output: ", rt_output)
         sd = self.run_from_config(config, rt_output)
+        # statistics updates save a compact checkpoint rather than rmf
+        output = IMP.npctransport.Output()
+        output.ParseFromString(open(rt_output, "rb").read())
+        self.assertTrue(output.HasField("checkpoint"))
+        self.assertFalse(output.HasField("rmf_conformation"))
+        # and the contacts tracked by interaction statistics, to resume them
+        bpsoss = sd.get_statistics().get_interaction_statistics_optimizer_states()
+        self.assertEqual(len(output.checkpoint.interaction_histories),
+                         len(bpsoss))
+        self.assertTrue(output.checkpoint.HasField(
+            "random_number_generator_state"))
 
         print("reloading from output file ", rt_output)
         sdp = IMP.npctransport.SimulationData(rt_output, False)
@@ -31,6 +31,7 @@ class Tests(IMP.test.TestCase):
         sd.get_rmf_sos_writer().update_always()
         # write statistics and final rmf conformation
         sd.get_statistics().update( timer )
+        sd.get_statistics().save_rmf_conformation_to_output()
         return sd
 
     def _get_bead_coords( self, p ):
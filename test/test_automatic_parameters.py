@@ -16,7 +16,8 @@ class ProtobufTests(IMP.test.TestCase):
                      nonspecific_range= 1,
                      fg_radii= [10, 100],
                      kap_radii= [50, 500],
-                     slack= 2.5):
+                     slack= 2.5,
+                     n_kaps= 1):
         config= IMP.npctransport.Configuration()
         IMP.npctransport.set_default_configuration(config)
         config.interaction_k.lower = 1
@@ -40,7 +41,7 @@ class ProtobufTests(IMP.test.TestCase):
                  ( config,
                    type_name="kap{0}".format(kap_radius),
                    radius=kap_radius,
-                   number= 1,
+                   number= n_kaps,
                    interactions= 4 )
             kaps.append(kap)
         for a in (fgs+kaps):
@@ -69,5 +70,28 @@ class ProtobufTests(IMP.test.TestCase):
         test_protobuf_installed(self)
         assignment_filename= self.get_tmp_file_name("assignment.pb")
         a= self._get_assignment(assignment_filename)
+    def test_estimated_cost(self):
+        """Check that estimated costs grow with the number of particles"""
+        test_protobuf_installed(self)
+        run_times= []
+        memories= []
+        for n_kaps in [1, 10]:
+            config_filename= self.get_tmp_file_name("configuration.pb")
+            self._make_config(config_filename, n_kaps= n_kaps)
+            assignment_filename= self.get_tmp_file_name("assignment.pb")
+            IMP.npctransport.assign_ranges(config_filename,
+                                           assignment_filename, 0, False, 1)
+            run_times.append(IMP.npctransport.get_estimated_run_time
+                             (assignment_filename))
+            memories.append(IMP.npctransport.get_estimated_memory
+                            (assignment_filename))
+        self.assertGreater(run_times[0], 0.0)
+        self.assertGreater(run_times[1], run_times[0])
+        self.assertGreater(memories[1], memories[0])
+        slow= IMP.npctransport.CostCalibration().get_scaled(2.0)
+        self.assertAlmostEqual(IMP.npctransport.get_estimated_run_time
+                               (assignment_filename, slow),
+                               2.0 * run_times[1], delta=1e-6 * run_times[1])
+
 if __name__ == '__main__':
     IMP.test.main()
@@ -1,6 +1,7 @@
 from __future__ import print_function
 import IMP.npctransport
 import IMP.test
+import os
 import sys
 import test_util
 
@@ -20,5 +21,152 @@ class Tests(IMP.test.TestCase):
       s = a.read_next()
     self.assertAlmostEqual(rg, 40.2645193868, 7)
 
+  def test_prefetching_Avro2PBReader(self):
+    """ Testing whether a prefetching Avro2PBReader reads the same entries """
+    in_avro= self.get_input_file_name( "avro.sample");
+    a = IMP.npctransport.Avro2PBReader([in_avro, in_avro])
+    expected = []
+    s = a.read_next()
+    while len(s) > 0:
+      expected.append(s)
+      s = a.read_next()
+    b = IMP.npctransport.Avro2PBReader([in_avro, in_avro], 2, 1)
+    entries = []
+    batch = b.read_next_batch(3)
+    while len(batch) > 0:
+      self.assertLessEqual(len(batch), 3)
+      entries.extend(batch)
+      batch = b.read_next_batch(3)
+    self.assertFalse(b.get_is_valid())
+    self.assertEqual(entries, expected)
+
+  def test_seek_to_work_unit(self):
+    """ Testing whether Avro2PBReader seeks to work units using an index """
+    test_util.test_protobuf_installed(self)
+    in_avro = self.get_tmp_file_name("indexed.avro")
+    with open(self.get_input_file_name("avro.sample"), "rb") as f_in:
+      with open(in_avro, "wb") as f_out:
+        f_out.write(f_in.read())
+    a = IMP.npctransport.Avro2PBReader(in_avro)
+    entries = []
+    s = a.read_next()
+    while len(s) > 0:
+      entries.append(s)
+      s = a.read_next()
+    n = IMP.npctransport.create_avro_index(in_avro)
+    self.assertEqual(n, len(entries))
+    o = IMP.npctransport.Output()
+    for i in [len(entries) - 1, len(entries) // 2, 0]:
+      o.ParseFromString(entries[i])
+      b = IMP.npctransport.Avro2PBReader(in_avro)
+      self.assertTrue(b.seek_to_work_unit(o.assignment.work_unit))
+      self.assertEqual(b.read_next_batch(len(entries)), entries[i:])
+    self.assertFalse(b.seek_to_work_unit(-1))
+
+  def test_seek_writes_index(self):
+    """ Testing whether seeking writes a missing or outdated index """
+    test_util.test_protobuf_installed(self)
+    in_avro = self.get_tmp_file_name("unindexed.avro")
+    with open(self.get_input_file_name("avro.sample"), "rb") as f_in:
+      with open(in_avro, "wb") as f_out:
+        f_out.write(f_in.read())
+    index_file = IMP.npctransport.get_avro_index_file_name(in_avro)
+    if os.path.exists(index_file):
+      os.unlink(index_file)
+    o = IMP.npctransport.Output()
+    o.ParseFromString(IMP.npctransport.Avro2PBReader(in_avro).read_next())
+    a = IMP.npctransport.Avro2PBReader(in_avro)
+    self.assertTrue(a.seek_to_work_unit(o.assignment.work_unit))
+    self.assertTrue(os.path.exists(index_file))
+    index = IMP.npctransport.AvroArchiveIndex()
+    with open(index_file, "rb") as f:
+      index.ParseFromString(f.read())
+    self.assertEqual(index.archive_size, os.path.getsize(in_avro))
+    self.assertEqual(index.archive_mtime, int(os.stat(in_avro).st_mtime))
+    # an index with a different modification time is outdated
+    index.archive_mtime -= 1
+    with open(index_file, "wb") as f:
+      f.write(index.SerializeToString())
+    b = IMP.npctransport.Avro2PBReader(in_avro)
+    self.assertTrue(b.seek_to_work_unit(o.assignment.work_unit))
+    with open(index_file, "rb") as f:
+      index.ParseFromString(f.read())
+    self.assertEqual(index.archive_mtime, int(os.stat(in_avro).st_mtime))
+
+  def _write_outputs(self, n):
+    """ output files of work units 0..n-1 of a basic configuration """
+    config = test_util.get_basic_config()
+    config_file = self.get_tmp_file_name("archive_config.pb")
+    test_util.write_config_file(config_file, config)
+    ret = []
+    for i in range(n):
+      fname = self.get_tmp_file_name("archive_output%d.pb" % i)
+      IMP.npctransport.assign_ranges(config_file, fname, i, False, 10 + i)
+      ret.append(fname)
+    return ret
+
+  def _read_files(self, fnames):
+    ret = []
+    for fname in fnames:
+      with open(fname, "rb") as f:
+        ret.append(f.read())
+    return ret
+
+  def _read_archive(self, avro):
+    a = IMP.npctransport.Avro2PBReader(avro)
+    ret = []
+    s = a.read_next()
+    while len(s) > 0:
+      ret.append(s)
+      s = a.read_next()
+    return ret
+
+  def test_write_avro_archive(self):
+    """ Testing whether outputs written to archives read back the same """
+    test_util.test_protobuf_installed(self)
+    IMP.set_log_level(IMP.SILENT)
+    outputs = self._write_outputs(3)
+    expected = self._read_files(outputs)
+    for codec in ["null", "deflate"]:
+      avro = self.get_tmp_file_name("written_%s.avro" % codec)
+      try:
+        n = IMP.npctransport.write_outputs_to_avro_archive \
+            (outputs, avro, codec, False, 2)
+      except IMP.IOException:
+        print("codec", codec, "is not supported")
+        continue
+      self.assertEqual(n, 3)
+      self.assertEqual(self._read_archive(avro), expected)
+      b = IMP.npctransport.Avro2PBReader([avro, avro], 2, 1)
+      self.assertEqual(b.read_next_batch(10), expected + expected)
+      # the archive is indexed when written
+      c = IMP.npctransport.Avro2PBReader(avro)
+      self.assertTrue(c.seek_to_work_unit(1))
+      self.assertEqual(c.read_next_batch(10), expected[1:])
+
+  def test_append_to_avro_archive(self):
+    """ Testing whether archives skip duplicate and truncated outputs """
+    test_util.test_protobuf_installed(self)
+    IMP.set_log_level(IMP.SILENT)
+    outputs = self._write_outputs(3)
+    expected = self._read_files(outputs)
+    truncated = self.get_tmp_file_name("archive_truncated.pb")
+    with open(truncated, "wb") as f:
+      f.write(expected[0][:len(expected[0]) // 2])
+    avro = self.get_tmp_file_name("appended.avro")
+    n = IMP.npctransport.write_outputs_to_avro_archive \
+        ([outputs[0], outputs[1], outputs[0], truncated], avro, "null")
+    self.assertEqual(n, 2)
+    self.assertEqual(self._read_archive(avro), expected[:2])
+    n = IMP.npctransport.write_outputs_to_avro_archive \
+        ([outputs[1], outputs[2]], avro, "null", True)
+    self.assertEqual(n, 1)
+    self.assertEqual(self._read_archive(avro), expected)
+    # without appending, the archive is overwritten
+    n = IMP.npctransport.write_outputs_to_avro_archive \
+        ([outputs[2]], avro, "null")
+    self.assertEqual(n, 1)
+    self.assertEqual(self._read_archive(avro), expected[2:])
+
 if __name__ == '__main__':
     IMP.test.main()
@@ -0,0 +1,55 @@
+from __future__ import print_function
+import IMP
+import IMP.test
+import IMP.core
+import IMP.atom
+import IMP.algebra
+import IMP.npctransport
+from test_util import *
+
+radius=8
+
+class Tests(IMP.test.TestCase):
+    def test_bodies_vs_body(self):
+        """Check batched body statistics match per-particle statistics"""
+        m= IMP.Model()
+        ps= [create_diffusing_rb_particle(m, radius) for i in range(5)]
+        bd= IMP.atom.BrownianDynamics(m)
+        bd.set_scoring_function([IMP.RestraintSet(m, "empty set")])
+        bd.set_maximum_time_step(1000)
+        oss= [IMP.npctransport.BodyStatisticsOptimizerState(p) for p in ps]
+        bos= IMP.npctransport.BodiesStatisticsOptimizerState(ps[:3])
+        bos.add_particle(ps[3])
+        bos.add_particle(ps[4])
+        self.assertEqual(bos.get_number_of_particles(), 5)
+        for os in oss + [bos]:
+            self.assertFalse(os.get_is_correlation_time_on())
+            os.set_is_correlation_time_on(True)
+            os.set_period(10)
+            bd.add_optimizer_state(os)
+        IMP.set_log_level(IMP.SILENT)
+        # long enough for the orientations to decorrelate
+        bd.optimize(20000)
+        dcs= bos.get_diffusion_coefficients()
+        self.assertEqual(len(dcs), 5)
+        for i in range(5):
+            self.assertAlmostEqual(dcs[i],
+                                   oss[i].get_diffusion_coefficient(),
+                                   delta=1e-6 * dcs[i])
+            self.assertAlmostEqual(dcs[i], bos.get_diffusion_coefficient(i),
+                                   delta=1e-6 * dcs[i])
+            ct= bos.get_correlation_time(i)
+            self.assertLess(ct, float('inf'))
+            self.assertGreater(ct, 0.0)
+            self.assertAlmostEqual(ct, oss[i].get_correlation_time(),
+                                   delta=1e-6 * ct)
+        bos.reset()
+        self.assertEqual(bos.get_diffusion_coefficients(), [0.0]*5)
+        self.assertEqual(bos.get_correlation_time(0), float('inf'))
+        # not estimated once turned off
+        bos.set_is_correlation_time_on(False)
+        bd.optimize(20000)
+        self.assertEqual(bos.get_correlation_time(0), float('inf'))
+
+if __name__ == '__main__':
+    IMP.test.main()
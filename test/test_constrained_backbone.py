@@ -0,0 +1,41 @@
+from __future__ import print_function
+import IMP
+import IMP.test
+import IMP.core
+import IMP.atom
+import IMP.algebra
+import IMP.npctransport
+
+radius=5
+
+class Tests(IMP.test.TestCase):
+    def test_constrained_backbone(self):
+        """Check that chain bonds are restored to their rest length"""
+        m=IMP.Model()
+        beads=[]
+        for i in range(10):
+            p=IMP.Particle(m)
+            d=IMP.core.XYZR.setup_particle(p)
+            d.set_radius(radius)
+            d.set_coordinates(IMP.algebra.Vector3D(i*15.0, (i%2)*3.0, 0))
+            d.set_coordinates_are_optimized(True)
+            IMP.atom.Hierarchy.setup_particle(p)
+            IMP.atom.Mass.setup_particle(p, 1.0)
+            IMP.atom.Diffusion.setup_particle(p)
+            beads.append(p)
+        root=IMP.atom.Hierarchy.setup_particle(IMP.Particle(m), beads)
+        chain=IMP.npctransport.get_fg_chain(root)
+        chain.set_rest_length_factor(1.2)
+        bd=IMP.npctransport.BrownianDynamicsTAMDWithSlabSupport(m)
+        bd.add_constrained_chain(chain)
+        self.assertEqual(bd.get_number_of_constrained_chains(), 1)
+        bd.set_bond_constraints_tolerance(1e-6)
+        bd.set_bond_constraints_max_iterations(1000)
+        bd.apply_bond_constraints()
+        for i in range(len(beads)-1):
+            d=IMP.core.get_distance(IMP.core.XYZ(beads[i]),
+                                    IMP.core.XYZ(beads[i+1]))
+            self.assertAlmostEqual(d, 1.2*2*radius, delta=1e-3)
+
+if __name__ == '__main__':
+    IMP.test.main()
@@ -0,0 +1,155 @@
+/**
+ * \file test_contact_kinetics.cpp
+ * \brief Test log binning of time histograms and the bookkeeping of
+ *        contact residence times and rebinding intervals
+ * Copyright 2007-2018 IMP Inventors. All rights reserved.
+ */
+
+#include <IMP/npctransport/internal/ContactKinetics.h>
+#include <IMP/exception.h>
+#include <IMP/flags.h>
+#include <IMP/base_types.h>
+#include <IMP/types.h>
+#include <iostream>
+#include <string>
+
+namespace {
+
+using IMP::npctransport::internal::ContactKinetics;
+using IMP::npctransport::internal::LogTimeHistogram;
+
+void check_counts(LogTimeHistogram const& h, IMP::Ints const& expected,
+                  std::string name) {
+  IMP::Ints counts = h.get_counts();
+  for (unsigned int i = 0; i < expected.size(); i++) {
+    if (counts[i] != expected[i]) {
+      IMP_THROW("Wrong " << name << " count in bin " << i << ": "
+                << counts[i] << " instead of " << expected[i],
+                IMP::ValueException);
+    }
+  }
+}
+
+IMP::Ints get_ints(int a, int b, int c, int d) {
+  IMP::Ints ret;
+  ret.push_back(a);
+  ret.push_back(b);
+  ret.push_back(c);
+  ret.push_back(d);
+  return ret;
+}
+
+void test_log_time_histogram() {
+  // one bin per decade: [..10), [10,100), [100,1000), [1000..)
+  LogTimeHistogram h(1.0, 1.0, 4);
+  double ts[] = {0.1, 1.0, 9.9, 10.0, 99.0, 150.0, 999.0, 1000.0, 1.0e+6};
+  unsigned int bins[] = {0, 0, 0, 1, 1, 2, 2, 3, 3};
+  for (unsigned int i = 0; i < 9; i++) {
+    if (h.get_bin(ts[i]) != bins[i]) {
+      IMP_THROW("Interval " << ts[i] << " binned into " << h.get_bin(ts[i])
+                << " instead of " << bins[i], IMP::ValueException);
+    }
+    h.add(ts[i]);
+  }
+  check_counts(h, get_ints(3, 2, 2, 2), "log time");
+  if (h.get_total_count() != 9) {
+    IMP_THROW("Wrong total count " << h.get_total_count(),
+              IMP::ValueException);
+  }
+  // ten bins per decade starting at 0.01 ns
+  LogTimeHistogram h10(0.01, 10.0, 80);
+  if (h10.get_bin(0.01 * 3.0) != 4 || h10.get_bin(1.0e+10) != 79) {
+    IMP_THROW("Wrong binning with ten bins per decade", IMP::ValueException);
+  }
+  h.reset();
+  if (h.get_total_count() != 0) {
+    IMP_THROW("Histogram not reset", IMP::ValueException);
+  }
+}
+
+// the contacts present in each scripted snapshot
+IMP::ParticleIndexPairs get_contacts(bool a, bool b) {
+  IMP::ParticleIndexPairs ret;
+  if (a) {
+    ret.push_back(IMP::ParticleIndexPair(IMP::ParticleIndex(0),
+                                         IMP::ParticleIndex(1)));
+  }
+  if (b) {
+    ret.push_back(IMP::ParticleIndexPair(IMP::ParticleIndex(2),
+                                         IMP::ParticleIndex(3)));
+  }
+  return ret;
+}
+
+void test_contact_kinetics() {
+  ContactKinetics ck(1.0, 1.0, 4);
+  // A is present at 0 ns, B forms midway to 20 ns (10 ns)
+  ck.update(get_contacts(true, false), 0.0);
+  ck.update(get_contacts(true, true), 20.0);
+  if (ck.get_number_of_contacts() != 2) {
+    IMP_THROW("Expected two contacts", IMP::ValueException);
+  }
+  // A is lost at 30 ns after 30 ns, B at 50 ns after 40 ns
+  ck.update(get_contacts(false, true), 40.0);
+  ck.update(get_contacts(false, false), 60.0);
+  check_counts(ck.get_residence_times(), get_ints(0, 2, 0, 0),
+               "residence time");
+  check_counts(ck.get_rebinding_intervals(), get_ints(0, 0, 0, 0),
+               "rebinding interval");
+  // A reforms at 530 ns, 500 ns after it was lost
+  ck.update(get_contacts(true, false), 1000.0);
+  ck.update(get_contacts(true, false), 1020.0);
+  check_counts(ck.get_residence_times(), get_ints(0, 2, 0, 0),
+               "residence time");
+  check_counts(ck.get_rebinding_intervals(), get_ints(0, 0, 1, 0),
+               "rebinding interval");
+  if (ck.get_number_of_contacts() != 1) {
+    IMP_THROW("Expected one contact", IMP::ValueException);
+  }
+  // resumed tracking sees A lost at 1030 ns, after 500 ns
+  ContactKinetics resumed(1.0, 1.0, 4);
+  resumed.set_state(ck.get_state());
+  ck.reset_histograms();
+  ck.update(get_contacts(false, false), 1040.0);
+  resumed.update(get_contacts(false, false), 1040.0);
+  check_counts(ck.get_residence_times(), get_ints(0, 0, 1, 0),
+               "residence time after reset");
+  check_counts(resumed.get_residence_times(), get_ints(0, 0, 1, 0),
+               "resumed residence time");
+  // B rebinds at 1550 ns, 1500 ns after it was lost
+  ck.update(get_contacts(false, true), 2060.0);
+  check_counts(ck.get_rebinding_intervals(), get_ints(0, 0, 0, 1),
+               "rebinding interval after reset");
+  // A, lost at 1030 ns before the reset at 2060 ns, is censored by the
+  // next reset, while B, lost at 2070 ns, is still tracked
+  ck.reset_histograms();
+  ck.update(get_contacts(false, false), 2080.0);
+  ck.reset_histograms();
+  if (ck.get_rebinding_intervals().get_number_of_censored() != 1) {
+    IMP_THROW("Expected A to be censored, not "
+              << ck.get_rebinding_intervals().get_number_of_censored()
+              << " contacts", IMP::ValueException);
+  }
+  // so only B rebinding is counted
+  ck.update(get_contacts(true, true), 2100.0);
+  check_counts(ck.get_rebinding_intervals(), get_ints(0, 1, 0, 0),
+               "rebinding interval after censoring");
+  if (ck.get_state().lost_contacts.size() != 0) {
+    IMP_THROW("Lost contacts not forgotten", IMP::ValueException);
+  }
+}
+
+}  // namespace
+
+int main(int argc, char *argv[]) {
+  try {
+    IMP::setup_from_argv(argc, argv, "Test of contact kinetics");
+    test_log_time_histogram();
+    test_contact_kinetics();
+  }
+  catch (const IMP::Exception &e) {
+    std::cerr << "Test failed: " << e.what() << std::endl;
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,45 @@
+from __future__ import print_function
+import IMP
+import IMP.test
+import IMP.core
+import IMP.atom
+import IMP.algebra
+import IMP.npctransport
+import math
+from test_util import *
+
+class Tests(IMP.test.TestCase):
+    def test_pore_radius_relaxation(self):
+        """Check that a dynamic pore radius relaxes with the configured tau"""
+        m=IMP.Model()
+        p_slab=IMP.Particle(m, "slab")
+        slab=IMP.npctransport.SlabWithCylindricalPore.setup_particle \
+            (p_slab, 10.0, 100.0)
+        slab.set_pore_radius_is_optimized(True)
+        mean=50.0
+        k=1.0
+        tau_fs=1.0e+6
+        bd=IMP.npctransport.BrownianDynamicsTAMDWithSlabSupport(m)
+        bd.set_maximum_time_step(1.0e+4)
+        kt=IMP.atom.get_kt(bd.get_temperature())
+        # as in SimulationData, the pore radius diffuses by kT/k per tau
+        slab.set_pore_radius_diffusion_coefficient(kt/(tau_fs*k))
+        # a particle to simulate besides the pore radius
+        create_diffusing_rb_particle(m, 1.0)
+        r=IMP.core.SingletonRestraint \
+            (m, IMP.npctransport.PoreRadiusSingletonScore(mean, k),
+             p_slab.get_index())
+        bd.set_scoring_function([r])
+        bd.set_slab(p_slab)
+        # the mean follows exp(-t/tau) with a stationary spread of
+        # sqrt(kT/k) around it
+        sigma=math.sqrt(kt/k)
+        for i in range(3):
+            bd.optimize(100)
+            t=bd.get_current_time()
+            expected=mean + (100.0-mean)*math.exp(-t/tau_fs)
+            self.assertAlmostEqual(slab.get_pore_radius(), expected,
+                                   delta=4*sigma)
+
+if __name__ == '__main__':
+    IMP.test.main()
@@ -0,0 +1,116 @@
+from __future__ import print_function
+import IMP
+import IMP.test
+import IMP.npctransport
+import os
+import signal
+import subprocess
+import sys
+import time
+from test_util import *
+
+# a stand-in for fg_simulation, which writes an interrupted output with a
+# checkpoint and then waits to be stopped, or completes a restarted output
+fake_simulation = """
+import sys, time
+import IMP.npctransport
+args = sys.argv[1:]
+def get_flag(name):
+    if name in args:
+        return args[args.index(name) + 1]
+    return None
+output = get_flag("--output")
+restart = get_flag("--restart")
+if restart is None:
+    IMP.npctransport.assign_ranges(get_flag("--configuration"), output,
+                                   int(get_flag("--work_unit")), False, 1)
+    o = IMP.npctransport.Output()
+    with open(output, "rb") as f:
+        o.ParseFromString(f.read())
+    o.statistics.number_of_frames = 10
+    o.statistics.interrupted = 1
+    o.checkpoint.n_particles = 0
+    with open(output, "wb") as f:
+        f.write(o.SerializeToString())
+    open(output + ".started", "w").close()
+    time.sleep(120)
+    sys.exit(1)
+with open(output + ".args", "w") as f:
+    f.write(" ".join(args))
+IMP.npctransport.write_restart_output_file(restart, output, 1.0, 1)
+"""
+
+def get_executable(name):
+    for d in os.environ.get("PATH", "").split(os.pathsep):
+        fname = os.path.join(d, name)
+        if os.path.isfile(fname) and os.access(fname, os.X_OK):
+            return fname
+    return None
+
+class Tests(IMP.test.TestCase):
+
+    def _wait_for_files(self, fnames, timeout_s=60):
+        start = time.time()
+        while not all(os.path.exists(f) for f in fnames):
+            self.assertLess(time.time() - start, timeout_s,
+                            "simulations did not start")
+            time.sleep(0.1)
+
+    def test_interrupt_and_resume(self):
+        """Check that an interrupted sweep resumes from its checkpoints"""
+        test_protobuf_installed(self)
+        fg_sweep = get_executable("fg_sweep")
+        if fg_sweep is None or os.name != "posix":
+            self.skipTest("fg_sweep is not available")
+        IMP.set_log_level(IMP.SILENT)
+        config = get_basic_config()
+        IMP.npctransport.create_range(config.interaction_k, 1, 2, 2)
+        config_file = self.get_tmp_file_name("sweep_config.pb")
+        write_config_file(config_file, config)
+        simulation = self.get_tmp_file_name("fake_simulation.py")
+        with open(simulation, "w") as f:
+            f.write("#!" + sys.executable + "\n" + fake_simulation)
+        os.chmod(simulation, 0o755)
+        sweep_dir = self.get_tmp_file_name("sweep")
+        # start with a configuration relative to its directory
+        config_dir, config_name = os.path.split(config_file)
+        p = subprocess.Popen([fg_sweep, "--simulation", simulation,
+                              "--jobs", "2", sweep_dir, config_name],
+                             cwd=config_dir)
+        outputs = [os.path.join(sweep_dir, "outputs", "%d.pb" % i)
+                   for i in range(2)]
+        self._wait_for_files([o + ".started" for o in outputs])
+        p.send_signal(signal.SIGTERM)
+        self.assertEqual(p.wait(), 1)
+        queue = IMP.npctransport.SweepQueue()
+        with open(os.path.join(sweep_dir, "queue.pb"), "rb") as f:
+            queue.ParseFromString(f.read())
+        self.assertEqual(queue.configuration_file,
+                         os.path.abspath(config_file))
+        self.assertEqual([u.status for u in queue.work_units], [0, 0])
+        # resume from another working directory
+        self.assertEqual(subprocess.call([fg_sweep, "--simulation",
+                                          simulation, sweep_dir],
+                                         cwd=os.path.dirname(sweep_dir)),
+                         0)
+        with open(os.path.join(sweep_dir, "queue.pb"), "rb") as f:
+            queue.ParseFromString(f.read())
+        self.assertEqual([u.status for u in queue.work_units], [3, 3])
+        for o in outputs:
+            with open(o + ".args") as f:
+                args = f.read().split()
+            self.assertIn("--resume", args)
+            self.assertEqual(args[args.index("--restart") + 1],
+                             o + ".restart")
+        a = IMP.npctransport.Avro2PBReader(queue.archive_file)
+        work_units = set()
+        output = IMP.npctransport.Output()
+        for s in a.read_next_batch(10):
+            output.ParseFromString(s)
+            work_units.add(output.assignment.work_unit)
+            self.assertEqual(output.statistics.number_of_frames, 10)
+            self.assertFalse(output.statistics.HasField("interrupted"))
+        self.assertEqual(work_units, set([0, 1]))
+
+if __name__ == '__main__':
+    IMP.test.main()
@@ -0,0 +1,156 @@
+from __future__ import print_function
+import IMP
+import IMP.test
+import IMP.core
+import IMP.atom
+import IMP.algebra
+import IMP.npctransport
+from test_util import *
+
+radius=10
+
+class Tests(IMP.test.TestCase):
+    def test_free_diffusion_propagation(self):
+        """Check that isolated particles are propagated analytically"""
+        m=IMP.Model()
+        p0=create_diffusing_rb_particle(m,radius)
+        p1=create_diffusing_rb_particle(m,radius)
+        IMP.core.XYZ(p1).set_coordinates(IMP.algebra.Vector3D(1000,0,0))
+        bd=IMP.npctransport.BrownianDynamicsTAMDWithSlabSupport(m)
+        bd.set_maximum_time_step(100.0)
+        # bounds how fast obstacles may approach flights between checks
+        bd.set_maximum_move(1.0)
+        bd.set_scoring_function(IMP.core.RestraintsScoringFunction([]))
+        self.assertFalse(bd.get_is_free_diffusion_propagation())
+        bd.set_free_diffusion_propagation([p0.get_index()],
+                                          [p0.get_index(), p1.get_index()],
+                                          5.0, 10.0, 1.0e+6)
+        self.assertTrue(bd.get_is_free_diffusion_propagation())
+        x0=IMP.core.XYZ(p0).get_coordinates()
+        bd.optimize(20)
+        self.assertEqual(bd.get_number_of_free_diffusion_flights(), 1)
+        # only the flights of the given particles are landed
+        bd.synchronize_free_diffusion_flights([p1.get_index()])
+        self.assertEqual(bd.get_number_of_free_diffusion_flights(), 1)
+        bd.synchronize_free_diffusion_flights([p0.get_index()])
+        self.assertEqual(bd.get_number_of_free_diffusion_flights(), 0)
+        x1=IMP.core.XYZ(p0).get_coordinates()
+        self.assertGreater(IMP.algebra.get_distance(x0, x1), 0.0)
+
+    def test_free_diffusion_displacements(self):
+        """Check that free flights sample free diffusion displacements"""
+        m=IMP.Model()
+        p0=create_diffusing_rb_particle(m,radius)
+        p1=create_diffusing_rb_particle(m,radius)
+        IMP.core.XYZ(p1).set_coordinates(IMP.algebra.Vector3D(10000,0,0))
+        IMP.core.XYZ(p1).set_coordinates_are_optimized(False)
+        bd=IMP.npctransport.BrownianDynamicsTAMDWithSlabSupport(m)
+        bd.set_maximum_time_step(100.0)
+        # bounds how fast obstacles may approach flights between checks
+        bd.set_maximum_move(1.0)
+        bd.set_scoring_function(IMP.core.RestraintsScoringFunction([]))
+        bd.set_free_diffusion_propagation([p0.get_index()],
+                                          [p0.get_index(), p1.get_index()],
+                                          5.0, 10.0, 1.0e+6)
+        D=IMP.atom.Diffusion(p0).get_diffusion_coefficient()
+        n=300
+        n_flights=0
+        normalized_dx2=[0.0, 0.0, 0.0]
+        for i in range(n):
+            IMP.core.XYZ(p0).set_coordinates(IMP.algebra.get_zero_vector_3d())
+            t0=bd.get_current_time()
+            bd.optimize(50)
+            n_flights+= bd.get_number_of_free_diffusion_flights()
+            bd.synchronize_free_diffusion_flights()
+            t=bd.get_current_time()-t0
+            x=IMP.core.XYZ(p0).get_coordinates()
+            for k in range(3):
+                normalized_dx2[k]+= x[k]**2 / (2*D*t)
+        self.assertEqual(n_flights, n)
+        # each normalized squared displacement is chi-square distributed
+        # with one degree of freedom (mean 1, variance 2)
+        for k in range(3):
+            self.assertAlmostEqual(normalized_dx2[k] / n, 1.0, delta=0.3)
+
+    def test_breached_flights_are_aborted(self):
+        """Check that flights are aborted when obstacles approach"""
+        m=IMP.Model()
+        p0=create_diffusing_rb_particle(m,radius)
+        p1=create_diffusing_rb_particle(m,radius)
+        IMP.core.XYZ(p1).set_coordinates(IMP.algebra.Vector3D(1000,0,0))
+        IMP.core.XYZ(p1).set_coordinates_are_optimized(False)
+        bd=IMP.npctransport.BrownianDynamicsTAMDWithSlabSupport(m)
+        bd.set_maximum_time_step(100.0)
+        # bounds how fast obstacles may approach flights between checks
+        bd.set_maximum_move(1.0)
+        bd.set_scoring_function(IMP.core.RestraintsScoringFunction([]))
+        bd.set_free_diffusion_propagation([p0.get_index()],
+                                          [p0.get_index(), p1.get_index()],
+                                          5.0, 10.0, 1.0e+6)
+        bd.optimize(20)
+        self.assertEqual(bd.get_number_of_free_diffusion_flights(), 1)
+        x0=IMP.core.XYZ(p0).get_coordinates()
+        bd.optimize(5)
+        # coordinates are left as is while in flight
+        self.assertEqual(bd.get_number_of_free_diffusion_flights(), 1)
+        self.assertEqual(IMP.algebra.get_distance
+                         (x0, IMP.core.XYZ(p0).get_coordinates()), 0.0)
+        IMP.core.XYZ(p1).set_coordinates(x0 + IMP.algebra.Vector3D(25,0,0))
+        bd.optimize(1)
+        self.assertEqual(bd.get_number_of_free_diffusion_flights(), 0)
+        self.assertGreater(IMP.algebra.get_distance
+                           (x0, IMP.core.XYZ(p0).get_coordinates()), 0.0)
+
+    def test_no_flights_near_obstacles(self):
+        """Check that particles near obstacles are not in free flight"""
+        m=IMP.Model()
+        p0=create_diffusing_rb_particle(m,radius)
+        p1=create_diffusing_rb_particle(m,radius)
+        IMP.core.XYZ(p1).set_coordinates(IMP.algebra.Vector3D(25,0,0))
+        bd=IMP.npctransport.BrownianDynamicsTAMDWithSlabSupport(m)
+        bd.set_maximum_time_step(100.0)
+        bd.set_scoring_function(IMP.core.RestraintsScoringFunction([]))
+        bd.set_free_diffusion_propagation([p0.get_index()],
+                                          [p0.get_index(), p1.get_index()],
+                                          5.0, 100.0, 1.0e+6)
+        bd.optimize(20)
+        self.assertEqual(bd.get_number_of_free_diffusion_flights(), 0)
+
+    def test_checkpoint_with_flights(self):
+        """Check that checkpoints land free flights before saving"""
+        test_protobuf_installed(self)
+        IMP.set_log_level(IMP.SILENT)
+        config= make_simple_cfg(is_slab_on=False)
+        config.box_side.lower= 2000
+        config.free_diffusion_safety_shell.lower= 1.0
+        config_file= self.get_tmp_file_name("flights_config.pb")
+        write_config_file(config_file, config)
+        output_file= self.get_tmp_file_name("flights_output.pb")
+        IMP.npctransport.assign_ranges(config_file, output_file, 0, False, 10)
+        sd= IMP.npctransport.SimulationData(output_file, False)
+        # keep the floaters away from each other and from the FG chain
+        for p in sd.get_beads():
+            t= IMP.core.Typed(p).get_type().get_string()
+            if t == "kap0":
+                IMP.core.XYZ(p).set_coordinates(IMP.algebra.Vector3D(600,0,0))
+            elif t == "inert0":
+                IMP.core.XYZ(p).set_coordinates \
+                    (IMP.algebra.Vector3D(-600,0,0))
+        bd= sd.get_bd()
+        bd.optimize(50)
+        self.assertGreater(bd.get_number_of_free_diffusion_flights(), 0)
+        sd.get_statistics().save_rmf_conformation_to_output()
+        # nothing is left in flight, so the checkpoint holds the current
+        # coordinates of all beads
+        self.assertEqual(bd.get_number_of_free_diffusion_flights(), 0)
+        bd.synchronize_free_diffusion_flights()
+        restarted_sd= IMP.npctransport.SimulationData \
+            (output_file, False, "",
+             self.get_tmp_file_name("flights_restart_output.pb"))
+        for p, rp in zip(sd.get_beads(), restarted_sd.get_beads()):
+            self.assertLess(IMP.algebra.get_distance
+                            (IMP.core.XYZ(p).get_coordinates(),
+                             IMP.core.XYZ(rp).get_coordinates()), 1e-6)
+
+if __name__ == '__main__':
+    IMP.test.main()
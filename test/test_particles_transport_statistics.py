@@ -0,0 +1,47 @@
+from __future__ import print_function
+import IMP
+import IMP.test
+import IMP.core
+import IMP.algebra
+import IMP.npctransport
+
+class Tests(IMP.test.TestCase):
+    def test_transport_events(self):
+        """Check batched detection of transport events"""
+        m= IMP.Model()
+        ps=[]
+        for i in range(3):
+            p= IMP.Particle(m)
+            IMP.core.XYZR.setup_particle(p,
+                IMP.algebra.Sphere3D(IMP.algebra.Vector3D(0,0,0), 1))
+            ps.append(p)
+        os= IMP.npctransport.ParticlesTransportStatisticsOptimizerState(
+            ps[:2], 10, 20)
+        os.add_particle(ps[2])
+        self.assertEqual(os.get_number_of_particles(), 3)
+        # up through the channel, down through the channel, and back
+        # out of the channel top
+        trajectories= [[0, 15, 25], [30, 15, 5], [30, 15, 30]]
+        for k in range(3):
+            for p, zs in zip(ps, trajectories):
+                IMP.core.XYZ(p).set_coordinates(
+                    IMP.algebra.Vector3D(0, 0, zs[k]))
+            os.update()
+        self.assertEqual(os.get_n_transports_up(0), 1)
+        self.assertEqual(os.get_n_transports_down(0), 0)
+        self.assertEqual(os.get_n_transports_up(1), 0)
+        self.assertEqual(os.get_n_transports_down(1), 1)
+        self.assertEqual(os.get_n_transports_up(2), 0)
+        self.assertEqual(os.get_n_transports_down(2), 0)
+        self.assertEqual(os.get_total_n_transports(), 2)
+        t1= IMP.npctransport.Transporting(ps[1])
+        self.assertTrue(t1.get_is_last_entry_from_top())
+        self.assertEqual(t1.get_n_entries_top(), 1)
+        self.assertAlmostEqual(t1.get_last_tracked_z(), 5, delta=1e-6)
+        self.assertRaises(ValueError, os.add_particle, ps[0])
+        os.reset()
+        self.assertEqual(os.get_total_n_transports(), 0)
+        self.assertEqual(t1.get_n_entries_top(), 0)
+
+if __name__ == '__main__':
+    IMP.test.main()
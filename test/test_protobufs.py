@@ -68,5 +68,66 @@ class ProtobufTests(IMP.test.TestCase):
         assign= output.assignment
         self.assertAlmostEqual(assign.interaction_k.value, 20, delta=1e-5)
         self.assertEqual(assign.interactions[0].is_on.value, 1)
+
+    def test_work_units_manifest(self):
+        """Check that a manifest enumerates the work units of assign_ranges"""
+        test_protobuf_installed(self)
+        config= IMP.npctransport.Configuration()
+        IMP.npctransport.set_default_configuration(config)
+        IMP.npctransport.create_range(config.interaction_k, .2, 20, 5)
+        IMP.npctransport.create_range(config.backbone_k, .2, 20, 3)
+        IMP.npctransport.add_fg_type(config, type_name="fg0",
+                                     number_of_beads=10, number=1,
+                                     radius=10, interactions=1)
+        config_name= self.get_tmp_file_name("configuration.pb")
+        with open(config_name, "wb") as f:
+            f.write(config.SerializeToString())
+        manifest_name= self.get_tmp_file_name("manifest.pb")
+        n= IMP.npctransport.write_work_units_manifest(config_name,
+                                                       manifest_name)
+        self.assertEqual(n, 15)
+        manifest= IMP.npctransport.WorkUnitsManifest()
+        with open(manifest_name, "rb") as f:
+            manifest.ParseFromString(f.read())
+        self.assertEqual(manifest.number_of_work_units, n)
+        self.assertEqual(len(manifest.range_names), 2)
+        self.assertEqual(len(manifest.work_units), n)
+        hashes= set(wu.configuration_hash for wu in manifest.work_units)
+        self.assertEqual(len(hashes), n)
+        for wu in manifest.work_units:
+            self.assertGreater(wu.estimated_run_time_s, 0.0)
+            self.assertGreater(wu.estimated_memory_mb, 0.0)
+        output= IMP.npctransport.Output()
+        assignment_name= self.get_tmp_file_name("assignment.pb")
+        for wu in manifest.work_units:
+            IMP.npctransport.assign_ranges(config_name, assignment_name,
+                                           wu.work_unit, False, 1)
+            with open(assignment_name, "rb") as f:
+                output.ParseFromString(f.read())
+            indexes= dict(zip(manifest.range_names, wu.range_indexes))
+            self.assertEqual(indexes["interaction_k"],
+                             output.assignment.interaction_k.index)
+            self.assertEqual(indexes["backbone_k"],
+                             output.assignment.backbone_k.index)
+            self.assertEqual(wu.configuration_hash,
+                             output.assignment.configuration_hash)
+        # the archived output of the last work unit is matched by its hash,
+        # even if its assignment was changed when it was run
+        output.assignment.box_side.value*= 2.0
+        output.assignment.backbone_tau_ns.value= 1.0
+        for f in output.assignment.fgs:
+            f.interaction_k_factor.value*= 2.0
+        with open(assignment_name, "wb") as f:
+            f.write(output.SerializeToString())
+        avro_name= self.get_tmp_file_name("manifest_outputs.avro")
+        IMP.npctransport.write_outputs_to_avro_archive([assignment_name],
+                                                       avro_name, "null")
+        index= IMP.npctransport.AvroArchiveIndex()
+        with open(IMP.npctransport.get_avro_index_file_name(avro_name),
+                  "rb") as f:
+            index.ParseFromString(f.read())
+        self.assertEqual(index.entries[0].configuration_hash,
+                         manifest.work_units[-1].configuration_hash)
+
 if __name__ == '__main__':
     IMP.test.main()
@@ -0,0 +1,91 @@
+from __future__ import print_function
+import IMP
+import IMP.test
+import IMP.npctransport
+from test_util import *
+
+class Tests(IMP.test.TestCase):
+
+    def _write_prev_output(self, is_checkpoint):
+        """ an output file from a work unit, with statistics of an
+            interrupted run and possibly a checkpoint """
+        config= get_basic_config()
+        IMP.npctransport.add_float_type(config, number=2, radius=10,
+                                        interaction_k_factor=1.5,
+                                        type_name="kap20")
+        IMP.npctransport.add_float_type(config, number=2, radius=10,
+                                        interaction_k_factor=1.5,
+                                        type_name="crap0")
+        config_file= self.get_tmp_file_name("restart_config.pb")
+        write_config_file(config_file, config)
+        prev_output_file= self.get_tmp_file_name("restart_prev_output.pb")
+        IMP.npctransport.assign_ranges(config_file, prev_output_file,
+                                       0, False, 10)
+        output= IMP.npctransport.Output()
+        with open(prev_output_file, "rb") as f:
+            output.ParseFromString(f.read())
+        output.statistics.number_of_frames= 1234
+        output.statistics.bd_simulation_time_ns= 5.5
+        output.statistics.interrupted= 1
+        op= output.statistics.global_order_params.add()
+        op.time_ns= 5.5
+        op.energy= -10.0
+        output.rmf_conformation= b"\x00rmf conformation\xff"
+        if is_checkpoint:
+            output.checkpoint.n_particles= 3
+            output.checkpoint.coordinates.extend([1.0, 2.0, 3.0])
+            output.checkpoint.random_number_generator_state= b"1 2 3 4"
+        with open(prev_output_file, "wb") as f:
+            f.write(output.SerializeToString())
+        return prev_output_file, output
+
+    def _read_output(self, fname):
+        output= IMP.npctransport.Output()
+        with open(fname, "rb") as f:
+            output.ParseFromString(f.read())
+        return output
+
+    def _assert_restart_output(self, prev, new, random_seed):
+        """ assert that new is prev with adjusted kap stickiness and random
+            seed, and without the interrupted flag """
+        expected= IMP.npctransport.Output()
+        expected.CopyFrom(prev)
+        for f in expected.assignment.floaters:
+            if f.type.startswith("kap"):
+                f.interaction_k_factor.value*= 2.0
+        expected.assignment.random_seed= random_seed
+        expected.statistics.ClearField("interrupted")
+        self.assertEqual(new, expected)
+        self.assertFalse(new.statistics.HasField("interrupted"))
+        kap= [f for f in new.assignment.floaters if f.type=="kap20"][0]
+        self.assertAlmostEqual(kap.interaction_k_factor.value, 3.0,
+                               delta=1e-6)
+
+    def test_restart_output(self):
+        """Check that a restart output file keeps all previous fields"""
+        test_protobuf_installed(self)
+        IMP.set_log_level(IMP.SILENT)
+        prev_output_file, prev= self._write_prev_output(False)
+        output_file= self.get_tmp_file_name("restart_output.pb")
+        rng_state= IMP.npctransport.write_restart_output_file \
+            (prev_output_file, output_file, 2.0, 4321)
+        self.assertEqual(rng_state, "")
+        self._assert_restart_output(prev, self._read_output(output_file),
+                                    4321)
+        # the previous output file is not modified
+        self.assertEqual(self._read_output(prev_output_file), prev)
+
+    def test_restart_output_from_checkpoint(self):
+        """Check restart output of a checkpoint resumes its random seed"""
+        test_protobuf_installed(self)
+        IMP.set_log_level(IMP.SILENT)
+        prev_output_file, prev= self._write_prev_output(True)
+        # restarting in place
+        rng_state= IMP.npctransport.write_restart_output_file \
+            (prev_output_file, prev_output_file, 2.0, 4321)
+        self.assertEqual(rng_state, "1 2 3 4")
+        self._assert_restart_output(prev, self._read_output(prev_output_file),
+                                    prev.assignment.random_seed)
+
+if __name__ == '__main__':
+    IMP.test.main()
@@ -0,0 +1,65 @@
+from __future__ import print_function
+import IMP
+import IMP.test
+import IMP.algebra
+import IMP.core
+import IMP.npctransport
+import os
+import test_util
+
+
+class Tests(IMP.test.TestCase):
+
+    def _make_sd(self, name, interaction_k=10, box_side=200):
+        """ simulation data of work unit 0 of a simple configuration """
+        config = test_util.make_simple_cfg(is_slab_on=False,
+                                           is_obstacles=True)
+        config.interaction_k.lower = interaction_k
+        config.box_side.lower = box_side
+        config_file = self.get_tmp_file_name(name + "_config.pb")
+        test_util.write_config_file(config_file, config)
+        output = self.get_tmp_file_name(name + "_output.pb")
+        IMP.npctransport.assign_ranges(config_file, output, 0, False, 10)
+        return IMP.npctransport.SimulationData(output, False)
+
+    def test_snapshot(self):
+        """Check that snapshots are shared only by models of the same geometry"""
+        test_util.test_protobuf_installed(self)
+        IMP.set_log_level(IMP.SILENT)
+        sd = self._make_sd("orig")
+        bb = IMP.algebra.BoundingBox3D(IMP.algebra.Vector3D(-50, -50, -50),
+                                       IMP.algebra.Vector3D(50, 50, 50))
+        for p in sd.get_beads():
+            d = IMP.core.XYZ(p)
+            if d.get_coordinates_are_optimized():
+                d.set_coordinates(IMP.algebra.get_random_vector_in(bb))
+        snapshot_dir = os.path.dirname(self.get_tmp_file_name("snapshot"))
+        snapshot_file = IMP.npctransport.get_snapshot_file_name(snapshot_dir,
+                                                                sd)
+        IMP.npctransport.save_snapshot(sd, snapshot_file)
+        # a pool of snapshots is indexed by random seed
+        pool_file = IMP.npctransport.get_snapshot_file_name(snapshot_dir,
+                                                            sd, 1.0, 4)
+        prefix = snapshot_file[:-len(".pb")]
+        self.assertIn(pool_file, [prefix + "_%d.pb" % i for i in range(4)])
+        # different interaction parameters, same geometry
+        sd_k = self._make_sd("k", interaction_k=20)
+        self.assertEqual(IMP.npctransport.get_geometry_hash(sd),
+                         IMP.npctransport.get_geometry_hash(sd_k))
+        self.assertEqual(IMP.npctransport.get_snapshot_file_name
+                         (snapshot_dir, sd_k), snapshot_file)
+        self.assertTrue(IMP.npctransport.load_snapshot(snapshot_file, sd_k))
+        for p, pk in zip(sd.get_beads(), sd_k.get_beads()):
+            self.assertLess(IMP.algebra.get_distance
+                            (IMP.core.XYZ(p).get_coordinates(),
+                             IMP.core.XYZ(pk).get_coordinates()), 1e-4)
+        # different geometry
+        sd_box = self._make_sd("box", box_side=300)
+        self.assertNotEqual(IMP.npctransport.get_geometry_hash(sd),
+                            IMP.npctransport.get_geometry_hash(sd_box))
+        self.assertFalse(IMP.npctransport.load_snapshot(snapshot_file,
+                                                        sd_box))
+
+
+if __name__ == '__main__':
+    IMP.test.main()
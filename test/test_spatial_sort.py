@@ -0,0 +1,30 @@
+from __future__ import print_function
+import IMP
+import IMP.test
+import IMP.core
+import IMP.algebra
+import IMP.npctransport
+
+class Tests(IMP.test.TestCase):
+    def test_spatial_sort(self):
+        """Check sorting of particles along a space-filling curve"""
+        m=IMP.Model()
+        bb=IMP.algebra.BoundingBox3D(IMP.algebra.Vector3D(0,0,0),
+                                     IMP.algebra.Vector3D(100,100,100))
+        pis=[]
+        for i in range(500):
+            p=IMP.Particle(m)
+            IMP.core.XYZ.setup_particle(p,
+                IMP.algebra.get_random_vector_in(bb))
+            pis.append(p.get_index())
+        sorted_pis=IMP.npctransport.get_spatially_sorted_particle_indexes(m,
+                                                                       pis)
+        self.assertEqual(sorted(sorted_pis), sorted(pis))
+        def get_mean_step(l):
+            xyzs=[IMP.core.XYZ(m,pi).get_coordinates() for pi in l]
+            return sum(IMP.algebra.get_distance(xyzs[i], xyzs[i+1])
+                       for i in range(len(xyzs)-1)) / (len(xyzs)-1)
+        self.assertLess(get_mean_step(sorted_pis), 0.5*get_mean_step(pis))
+
+if __name__ == '__main__':
+    IMP.test.main()
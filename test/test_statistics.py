@@ -3,6 +3,9 @@ import IMP
 import IMP.test
 import IMP.npctransport
 import IMP.container
+import IMP.atom
+import IMP.core
+import IMP.algebra
 import math
 from test_util import *
 
@@ -172,5 +175,37 @@ class Tests(IMP.test.TestCase):
         for d in dfs:
             self.assertAlmostEqual(0, d, delta=.1)
 
+    def test_chain_single_update(self):
+        """Check chain Rgyr and local diffusion after a single update"""
+        m= IMP.Model()
+        ps=[]
+        for i in range(4):
+            p= IMP.Particle(m, "bead %d" % i)
+            d= IMP.core.XYZR.setup_particle(p)
+            d.set_radius(2.0 + i)
+            d.set_coordinates(IMP.algebra.Vector3D(3.0*i, i*i, 0))
+            d.set_coordinates_are_optimized(True)
+            IMP.atom.Diffusion.setup_particle(p)
+            ps.append(p)
+        bd= IMP.atom.BrownianDynamics(m)
+        bd.set_scoring_function([IMP.RestraintSet(m, "empty set")])
+        os= IMP.npctransport.ChainStatisticsOptimizerState(ps)
+        bd.add_optimizer_state(os)
+        os.update_always()
+        self.assertEqual(len(os.get_local_diffusion_coefficients()), 0)
+        # as in IMP.atom.get_radius_of_gyration(ps, False), each sphere
+        # adds 0.6*r^2 about its own center
+        xyzrs= [IMP.core.XYZR(p) for p in ps]
+        center= sum([d.get_coordinates() for d in xyzrs],
+                    IMP.algebra.Vector3D(0,0,0)) / len(ps)
+        expected= math.sqrt(sum([(d.get_coordinates()-center)
+                                 .get_squared_magnitude()
+                                 + 0.6*d.get_radius()**2
+                                 for d in xyzrs]) / len(ps))
+        self.assertAlmostEqual(os.get_mean_radius_of_gyration(),
+                               expected, delta=1e-6*expected)
+        self.assertAlmostEqual(os.get_mean_square_radius_of_gyration(),
+                               expected**2, delta=1e-6*expected**2)
+
 if __name__ == '__main__':
     IMP.test.main()
@@ -0,0 +1,139 @@
+from __future__ import print_function
+import IMP
+import IMP.test
+import IMP.algebra
+import IMP.atom
+import IMP.core
+import IMP.npctransport
+from test_util import *
+
+tamd_k=2.0
+
+class Tests(IMP.test.TestCase):
+
+    def _make_sd(self):
+        """ simulation data with two TAMD FG chains of 7 beads each """
+        config= get_basic_config()
+        config.box_side.lower=200
+        fg= IMP.npctransport.add_fg_type(config,
+                                         type_name="fg_tamd",
+                                         number_of_beads=7,
+                                         number=2,
+                                         radius=6,
+                                         interactions=1,
+                                         rest_length_factor=1.5)
+        fg.is_tamd= 1
+        fg.tamd_K.lower= tamd_k
+        config_file= self.get_tmp_file_name("tamd_config.pb")
+        write_config_file(config_file, config)
+        output= self.get_tmp_file_name("tamd_output.pb")
+        IMP.npctransport.assign_ranges(config_file, output, 0, False, 10)
+        return IMP.npctransport.SimulationData(output, False)
+
+    def _get_centroids(self, sd):
+        """ all TAMD centroids of all chains, i.e. their non-leaf nodes """
+        ret=[]
+        to_visit= sd.get_root_of_type(IMP.core.ParticleType("fg_tamd")) \
+                    .get_children()
+        while len(to_visit)>0:
+            h= to_visit.pop()
+            if h.get_number_of_children()>0:
+                ret.append(h)
+                to_visit+= h.get_children()
+        return ret
+
+    def _randomize_beads(self, sd):
+        bb= IMP.algebra.get_cube_3d(100)
+        for p in sd.get_beads():
+            IMP.core.XYZ(p).set_coordinates \
+                (IMP.algebra.get_random_vector_in(bb))
+
+    def _setup_centers_of_mass(self, m, centroids):
+        """ a CenterOfMass over the leaves of each centroid, which is
+            how centroids were maintained before TAMDForest """
+        ret=[]
+        for c in centroids:
+            p= IMP.Particle(m, "CenterOfMass of " + c.get_name())
+            leaves= [l.get_particle_index() for l in IMP.atom.get_leaves(c)]
+            ret.append(IMP.atom.CenterOfMass.setup_particle(p, leaves))
+        return ret
+
+    def test_centroids(self):
+        """Check that TAMD centroids match centers of mass of their beads"""
+        test_protobuf_installed(self)
+        IMP.set_log_level(IMP.SILENT)
+        sd= self._make_sd()
+        m= sd.get_model()
+        centroids= self._get_centroids(sd)
+        self.assertEqual(len(centroids), 2*6)
+        forest_coms= self._setup_centers_of_mass(m, centroids)
+        for i in range(3):
+            self._randomize_beads(sd)
+            m.update()
+            for c, com in zip(centroids, forest_coms):
+                self.assertLess(IMP.algebra.get_distance
+                                (IMP.core.XYZ(c).get_coordinates(),
+                                 com.get_coordinates()), 1e-6)
+                self.assertAlmostEqual(IMP.atom.Mass(c).get_mass(),
+                                       com.get_mass(), delta=1e-6)
+
+    def test_centroid_derivatives(self):
+        """Check that centroid derivatives are distributed as by CenterOfMass"""
+        test_protobuf_installed(self)
+        IMP.set_log_level(IMP.SILENT)
+        sd= self._make_sd()
+        m= sd.get_model()
+        self._randomize_beads(sd)
+        centroids= self._get_centroids(sd)
+        roots= sd.get_root_of_type(IMP.core.ParticleType("fg_tamd")) \
+                 .get_children()
+        coms= self._setup_centers_of_mass(m, roots)
+        point= IMP.algebra.Vector3D(50, 0, 0)
+        ds= IMP.core.DistanceToSingletonScore(IMP.core.Harmonic(0, 1), point)
+        beads= [l for r in roots for l in IMP.atom.get_leaves(r)]
+        derivatives=[]
+        for targets in [roots, coms]:
+            rs= [IMP.core.SingletonRestraint(m, ds, t.get_particle_index())
+                 for t in targets]
+            sf= IMP.core.RestraintsScoringFunction(rs)
+            sf.evaluate(True)
+            derivatives.append([IMP.core.XYZ(b).get_derivatives()
+                                for b in beads])
+        for d_forest, d_com in zip(derivatives[0], derivatives[1]):
+            self.assertGreater(d_com.get_magnitude(), 0.0)
+            self.assertLess((d_forest-d_com).get_magnitude(), 1e-6)
+
+    def test_image_springs(self):
+        """Check the TAMD springs restraint score and derivatives"""
+        test_protobuf_installed(self)
+        IMP.set_log_level(IMP.SILENT)
+        sd= self._make_sd()
+        m= sd.get_model()
+        self._randomize_beads(sd)
+        centroids= self._get_centroids(sd)
+        images= {}
+        for h in sd.get_root().get_children():
+            if h.get_name().startswith("Image "):
+                images[h.get_name()[len("Image "):]]= h
+        self.assertEqual(len(images), len(centroids))
+        bb= IMP.algebra.get_cube_3d(100)
+        for image in images.values():
+            IMP.core.XYZ(image).set_coordinates \
+                (IMP.algebra.get_random_vector_in(bb))
+        rs= [r for r in sd.get_scoring().get_scoring_function_restraints()
+             if r.get_name().startswith("TAMD springs of ")]
+        self.assertEqual(len(rs), 2)
+        sf= IMP.core.RestraintsScoringFunction(rs)
+        score= sf.evaluate(True)
+        expected= 0.0
+        for c in centroids:
+            image= images[c.get_name()]
+            dv= IMP.core.XYZ(image).get_coordinates() \
+                - IMP.core.XYZ(c).get_coordinates()
+            expected+= 0.5 * tamd_k * dv.get_squared_magnitude()
+            self.assertLess((IMP.core.XYZ(image).get_derivatives()
+                             - tamd_k*dv).get_magnitude(), 1e-6)
+        self.assertAlmostEqual(score, expected, delta=1e-6*expected)
+
+if __name__ == '__main__':
+    IMP.test.main()
@@ -4,34 +4,47 @@
  * Copyright 2007-2018 IMP Inventors. All rights reserved.
  */
 #include <IMP/npctransport/avro.h>
-#include <IMP/npctransport/AvroDataFileData.h>
-#include <DataFile.hh>
-#include <fstream>
-#include <iomanip>
+#include <IMP/flags.h>
+#include <algorithm>
+#include <iostream>
+#include <thread>
 
-int main(int argc, char *argv[]) {
-  if (argc < 3) {
-    std::cerr << "Usage: " << argv[0] << " protobufs... avrofile" << std::endl;
-    return 1;
-  }
-  std::string out = argv[argc - 1];
+namespace {
+
+boost::int64_t n_threads = std::thread::hardware_concurrency();
+IMP::AddIntFlag n_threads_adder("threads",
+                                "number of input files read concurrently",
+                                &n_threads);
+#ifdef IMP_NPCTRANSPORT_HAS_ZLIB
+std::string codec = "deflate";
+#else
+std::string codec = "null";
+#endif
+IMP::AddStringFlag codec_adder("codec",
+                               "compression of archive blocks,"
+                               " null or deflate",
+                               &codec);
+bool append = false;
+IMP::AddBoolFlag append_adder("append",
+                              "append to the archive if it exists,"
+                              " skipping outputs that are already in it",
+                              &append);
 
-  IMP_NPCTRANSPORT_AVRO_NAMESPACE::DataFileWriter<IMP_npctransport::wrapper> wr(
-      out.c_str(), IMP::npctransport::get_avro_data_file_schema());
+}
 
-  for (int i = 0; i < argc - 2; ++i) {
-    IMP_npctransport::wrapper data;
-    data.key = "none";
-    std::ifstream file(argv[i],
-                       std::ios::in | std::ios::binary | std::ios::ate);
-    if (!file.is_open()) {
-      throw std::runtime_error("couldn't open file");
-    }
-    data.value.resize(file.tellg());
+int main(int argc, char *argv[]) {
+  IMP::Strings files = IMP::setup_from_argv(
+      argc, argv,
+      "Concatenate output protobuf files to an avro archive, skipping "
+      "truncated outputs and repeated work unit and seed pairs",
+      "protobufs... avrofile", -2);
+  std::string out = files.back();
+  files.pop_back();
 
-    file.seekg(0, std::ios::beg);
-    if (!file.read(reinterpret_cast<char *>(&data.value[0]), data.value.size()))
-      wr.write(data);
-  }
+  unsigned int n_written =
+    IMP::npctransport::write_outputs_to_avro_archive
+    (files, out, codec, append, std::max<boost::int64_t>(n_threads, 1));
+  std::cout << "Archived " << n_written << " of " << files.size()
+            << " outputs to " << out << std::endl;
   return 0;
 }
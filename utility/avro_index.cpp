@@ -0,0 +1,22 @@
+/**
+ * \file avro_index.cpp
+ * \brief Index avro archives of output files by work unit
+ * Copyright 2007-2018 IMP Inventors. All rights reserved.
+ */
+#include <IMP/npctransport/avro.h>
+#include <iostream>
+#include <string>
+
+int main(int argc, char *argv[]) {
+  if (argc < 2) {
+    std::cerr << "Usage: " << argv[0] << " avrofiles..." << std::endl;
+    return 1;
+  }
+  for (int i = 1; i < argc; ++i) {
+    unsigned int n = IMP::npctransport::create_avro_index(argv[i]);
+    std::cout << "Indexed " << n << " entries of " << argv[i] << " in "
+              << IMP::npctransport::get_avro_index_file_name(argv[i])
+              << std::endl;
+  }
+  return 0;
+}
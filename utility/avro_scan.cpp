@@ -3,11 +3,9 @@
  * \brief Concatenate a bunch of protobufs to an avro archive
  * Copyright 2007-2018 IMP Inventors. All rights reserved.
  */
-#include <IMP/npctransport/avro.h>
-#include <IMP/npctransport/AvroDataFileData.h>
+#include <IMP/npctransport/internal/AvroBlockReader.h>
 #include <IMP/npctransport/internal/npctransport.pb.h>
 #include <IMP/check_macros.h>
-#include <DataFile.hh>
 #include <fstream>
 #include <iomanip>
 
@@ -18,18 +16,14 @@ int main(int argc, char *argv[]) {
   }
   std::string out = argv[argc - 1];
 
-  IMP_NPCTRANSPORT_AVRO_NAMESPACE::DataFileReader<IMP_npctransport::wrapper> rd(
-      out.c_str(), IMP::npctransport::get_avro_data_file_schema());
+  // reads blocks directly, so that compressed archives can be scanned
+  IMP::npctransport::internal::AvroBlockReader rd(out);
 
-  IMP_npctransport::wrapper data;
-  while (rd.read(data)) {
+  IMP::npctransport::internal::AvroBlockReader::Entry data;
+  while (rd.read_next(data)) {
     std::cout << data.key << " ";
     npctransport_proto::Output pb;
-    std::string str(data.value.begin(), data.value.end());
-    IMP_INTERNAL_CHECK(
-        str.size() == data.value.size(),
-        "Sizes don't match " << str.size() << " vs " << data.value.size());
-    pb.ParseFromString(str);
+    pb.ParseFromArray(data.value, data.value_size);
     std::cout << " work unit " << pb.assignment().work_unit() << std::endl;
   }
   return 0;
@@ -4,9 +4,8 @@
  * Copyright 2007-2018 IMP Inventors. All rights reserved.
  */
 #include <IMP/npctransport/avro.h>
-#include <IMP/npctransport/AvroDataFileData.h>
+#include <IMP/npctransport/internal/AvroBlockReader.h>
 #include <IMP/npctransport/internal/npctransport.pb.h>
-#include <DataFile.hh>
 #include <google/protobuf/text_format.h>
 #include <fstream>
 #include <iomanip>
@@ -19,15 +18,14 @@ int main(int argc, char *argv[]) {
   std::string out = argv[argc - 1];
 
   for (int i = 1; i < argc; ++i) {
-    IMP_NPCTRANSPORT_AVRO_NAMESPACE::DataFileReader<IMP_npctransport::wrapper> rd(
-        argv[i], IMP::npctransport::get_avro_data_file_schema());
-    rd.readerSchema().toJson(std::cout);
-    rd.dataSchema().toJson(std::cout);
-    IMP_npctransport::wrapper data;
-    while (rd.read(data)) {
-      std::string str(data.value.begin(), data.value.end());
+    // reads blocks directly, so that compressed archives can be shown
+    IMP::npctransport::internal::AvroBlockReader rd(argv[i]);
+    IMP::npctransport::get_avro_data_file_schema().toJson(std::cout);
+    std::cout << "codec: " << rd.get_codec() << std::endl;
+    IMP::npctransport::internal::AvroBlockReader::Entry data;
+    while (rd.read_next(data)) {
       npctransport_proto::Output output;
-      output.ParseFromString(str);
+      output.ParseFromArray(data.value, data.value_size);
       std::string output_string;
       google::protobuf::TextFormat::PrintToString(output, &output_string);
       for (int i = 0; i < output.statistics().floaters_size(); i++) {
@@ -0,0 +1,66 @@
+/**
+ * \file calibrate_cost_model.cpp
+ * \brief Measure the throughput of simulation kernels for cost estimates
+ * Copyright 2007-2018 IMP Inventors. All rights reserved.
+ */
+#include <IMP/npctransport/SimulationData.h>
+#include <IMP/npctransport/work_unit_cost.h>
+#include <IMP/npctransport/internal/OutputFileView.h>
+#include <IMP/npctransport/internal/npctransport.pb.h>
+#include <IMP/atom/BrownianDynamics.h>
+#include <IMP/flags.h>
+#include <IMP/file.h>
+#include <IMP/log.h>
+#include <chrono>
+#include <cmath>
+#include <iostream>
+
+namespace {
+boost::int64_t n_frames = 1000;
+IMP::AddIntFlag n_frames_adder("frames",
+                               "number of frames simulated per assignment",
+                               &n_frames);
+}
+
+int main(int argc, char *argv[]) {
+  IMP::Strings files = IMP::setup_from_argv(
+      argc, argv,
+      "Simulate a few frames of each assignment (e.g. written by "
+      "assign_ranges), and print the cost calibration that best matches "
+      "the measured time per frame",
+      "assignments...", -1);
+  IMP::set_log_level(IMP::SILENT);
+  IMP::npctransport::CostCalibration calibration;
+  double sum_log_ratio = 0.0;
+  for (unsigned int i = 0; i < files.size(); ++i) {
+    npctransport_proto::Assignment assignment;
+    {
+      IMP::npctransport::internal::OutputFileView view(files[i]);
+      IMP_ALWAYS_CHECK(view.get_assignment(&assignment),
+                       "No valid assignment in " << files[i],
+                       IMP::IOException);
+    }
+    // simulate in a copy, to keep the assignment file intact
+    std::string output = IMP::create_temporary_file_name("output", ".pb");
+    IMP::Pointer<IMP::npctransport::SimulationData> sd =
+      new IMP::npctransport::SimulationData(files[i], false, "", output);
+    sd->get_model()->update();
+    std::chrono::steady_clock::time_point start =
+      std::chrono::steady_clock::now();
+    sd->get_bd()->optimize(n_frames);
+    double measured_ns = std::chrono::duration<double, std::nano>
+      (std::chrono::steady_clock::now() - start).count() / n_frames;
+    double estimated_ns =
+      IMP::npctransport::get_estimated_ns_per_frame(assignment, calibration);
+    std::cout << files[i] << ": measured " << measured_ns
+              << " ns/frame, estimated " << estimated_ns << " ns/frame"
+              << std::endl;
+    sum_log_ratio += std::log(measured_ns / estimated_ns);
+  }
+  // scale uniformly by the geometric mean of measured / estimated
+  double factor = std::exp(sum_log_ratio / files.size());
+  std::cout << "Time factor " << factor << std::endl;
+  calibration.get_scaled(factor).show(std::cout);
+  std::cout << std::endl;
+  return 0;
+}
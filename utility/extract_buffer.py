@@ -1,13 +1,23 @@
 #!/usr/bin/env python
 
 import RMF
+import IMP
 import IMP.npctransport
 import sys
 
 pb = IMP.npctransport.Output()
 pb.ParseFromString(open(sys.argv[1], "rb").read())
-bch = RMF.BufferConstHandle(pb.rmf_conformation)
-RMF.write_buffer(bch, sys.argv[2])
+if pb.HasField("checkpoint") or not pb.HasField("rmf_conformation"):
+    # export the latest checkpoint to rmf by restoring it into a model
+    sd = IMP.npctransport.SimulationData(
+        sys.argv[1], False, "",
+        IMP.create_temporary_file_name("output", ".pb"))
+    sd.set_rmf_file(sys.argv[2], False)
+    sd.get_rmf_sos_writer().update_always()
+    del sd # close the rmf file
+else:
+    bch = RMF.BufferConstHandle(pb.rmf_conformation)
+    RMF.write_buffer(bch, sys.argv[2])
 
 
 # test it
@@ -1,5 +1,6 @@
 #!/usr/bin/env python
 from IMP.npctransport import *
+import IMP
 import IMP.rmf
 import RMF
 import sys
@@ -8,5 +9,12 @@ o= Output()
 #config.SetTotalBytesLimit(50000000)
 
 o.ParseFromString(f.read())
-bch= RMF.BufferConstHandle(o.rmf_conformation);
-RMF.write_buffer(bch, sys.argv[2] )
+if o.HasField("checkpoint") or not o.HasField("rmf_conformation"):
+    # export the latest checkpoint to rmf by restoring it into a model
+    sd= SimulationData(sys.argv[1], False, "",
+                       IMP.create_temporary_file_name("output", ".pb"))
+    sd.set_rmf_file(sys.argv[2], False)
+    sd.get_rmf_sos_writer().update_always()
+else:
+    bch= RMF.BufferConstHandle(o.rmf_conformation);
+    RMF.write_buffer(bch, sys.argv[2] )
@@ -0,0 +1,14 @@
+#!/usr/bin/env python
+
+import IMP.npctransport
+import optparse
+
+parser = optparse.OptionParser(
+    usage="usage: %prog configuration.pb manifest.pb\n\n"
+          "Enumerate all work units of a configuration into a manifest")
+(options, args) = parser.parse_args()
+if len(args) != 2:
+    parser.print_help()
+    exit(1)
+n = IMP.npctransport.write_work_units_manifest(args[0], args[1])
+print("Wrote", n, "work units to", args[1])